@@ -49,6 +49,12 @@ void ClassAdLibraryVersion(std::string &version_string);
 void ClassAdSetExpressionCaching(bool do_caching);
 bool ClassAdGetExpressionCaching();
 
+// How many compiled patterns the regexp() family of functions keeps for
+// reuse.  The default is 100; 0 disables the cache.
+void ClassAdSetRegexCacheSize(size_t size);
+// How often a pattern was found compiled in that cache, or not.
+void ClassAdGetRegexCacheCounts(unsigned long &hits, unsigned long &misses);
+
 // This flag is only meant for use in Condor, which is transitioning
 // from an older version of ClassAds with slightly different evaluation
 // semantics. It will be removed without warning in a future release.
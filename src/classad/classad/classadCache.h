@@ -21,24 +21,25 @@
 
 #include "classad/exprTree.h"
 #include <string>
+#include <atomic>
 
 namespace classad {
 
 class CacheEntry
 {
 public: 
-	CacheEntry() : pData(NULL) {}
-	CacheEntry(const std::string & szNameIn, const std::string & szValueIn, ExprTree * pDataIn)
-		: szName(szNameIn)
+	CacheEntry() : pName(NULL), pData(NULL) {}
+	CacheEntry(const std::string * pNameIn, const std::string & szValueIn, ExprTree * pDataIn)
+		: pName(pNameIn)
 		, szValue(szValueIn)
 		, pData(pDataIn)
 	{}
 
 	virtual ~CacheEntry();
 
-	std::string szName;    // string space the names.
-	std::string szValue;   // reference back for cleanup
-	ExprTree * pData;
+	const std::string * pName; // the cache's one copy of the name, shared by all its values
+	std::string szValue;   // the cache's only copy of the value, it indexes this entry by it
+	std::atomic<ExprTree *> pData; // parsed on first use if the entry was added lazily
 };
 
 typedef classad_weak_ptr< CacheEntry > pCacheEntry;
@@ -161,7 +161,10 @@ struct CaseIgnSizeLTStr {
 
 struct CaseIgnEqStr {
 	inline bool operator( )( const std::string &s1, const std::string &s2 ) const {
-		return( strcasecmp( s1.c_str( ), s2.c_str( ) ) == 0 );
+			// names of different lengths never match, so skip the
+			// character compare for them
+		return( s1.length( ) == s2.length( ) &&
+				strcasecmp( s1.c_str( ), s2.c_str( ) ) == 0 );
 	}
 };
 
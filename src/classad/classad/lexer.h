@@ -230,6 +230,8 @@ class Lexer
 		void 		mark(void);					// mark()s beginning of a token
 		void 		cut(void);					// delimits token
 		void		fetch();					// fetch next character if ch is empty
+		int 		windSpan(const char *accept);	// consume ch and following chars in accept
+		int 		windUntil(const char *reject);	// consume ch and following chars not in reject
 
 		// to tokenize the various tokens
 		int 		tokenizeNumber (void);		// integer or real
@@ -62,6 +62,14 @@ public:
 	// ever put back a single character. 
 	virtual void UnreadCharacter(void) = 0;
 	virtual bool AtEnd(void) const = 0;
+
+	// Sources that hold their input in memory return the characters
+	// that have not been read yet (terminated by a NUL), so that the
+	// lexer can scan a run of them at once and then skip past it with
+	// SkipCharacters(). Other sources return NULL, and are read a
+	// character at a time.
+	virtual const char *UnreadBuffer(void) const { return NULL; }
+	virtual void SkipCharacters(int /*count*/) { }
 protected:
 	int _previous_character;
 private:
@@ -103,6 +111,8 @@ public:
 	virtual int ReadCharacter(void);
 	virtual void UnreadCharacter(void);
 	virtual bool AtEnd(void) const;
+	virtual const char *UnreadBuffer(void) const;
+	virtual void SkipCharacters(int count);
 
 	virtual int GetCurrentLocation(void) const;
 private:
@@ -124,6 +134,8 @@ public:
 	virtual int ReadCharacter(void);
 	virtual void UnreadCharacter(void);
 	virtual bool AtEnd(void) const;
+	virtual const char *UnreadBuffer(void) const;
+	virtual void SkipCharacters(int count);
 
 	virtual int GetCurrentLocation(void) const;
 private:
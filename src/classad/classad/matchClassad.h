@@ -173,9 +173,12 @@ class MatchClassAd : public ClassAd
 			UnoptimizeAdForMatchmaking.
 			@param ad The ad to be optimized.
 			@param error_msg non-NULL if an error description is desired.
+			@param optimize_rank True to optimize the rank expression
+				too.  Only do this if the ad's rank is never evaluated
+				with the ad on the other side of a match.
 			@return True on success.
 		*/
-		static bool OptimizeRightAdForMatchmaking( ClassAd *ad, std::string *error_msg, const std::string &left_alias = "", const std::string &right_alias = "" );
+		static bool OptimizeRightAdForMatchmaking( ClassAd *ad, std::string *error_msg, const std::string &left_alias = "", const std::string &right_alias = "", bool optimize_rank = false );
 
 		/** Modifies the requirements expression in the given ad to
 			make matchmaking more efficient.  This will only improve
@@ -185,11 +188,15 @@ class MatchClassAd : public ClassAd
 			UnoptimizeAdForMatchmaking.
 			@param ad The ad to be optimized.
 			@param error_msg non-NULL if an error description is desired.
+			@param optimize_rank True to optimize the rank expression
+				too.  Only do this if the ad's rank is never evaluated
+				with the ad on the other side of a match.
 			@return True on success.
 		*/
-		static bool OptimizeLeftAdForMatchmaking( ClassAd *ad, std::string *error_msg, const std::string &left_alias = "", const std::string &right_alias = "" );
+		static bool OptimizeLeftAdForMatchmaking( ClassAd *ad, std::string *error_msg, const std::string &left_alias = "", const std::string &right_alias = "", bool optimize_rank = false );
 
-		/** Restores ad previously optimized with OptimizeAdForMatchmaking.
+		/** Restores ad previously optimized with OptimizeAdForMatchmaking,
+			including its rank expression if that was optimized.
 			@param ad The ad to be unoptimized.
 			@return True on success.
 		*/
@@ -218,9 +225,17 @@ class MatchClassAd : public ClassAd
 			@param ad The ad to be optimized.
 			@param is_right True if this ad will be the right ad.
 			@param error_msg non-NULL if an error description is desired.
+			@param optimize_rank True to optimize the rank expression too.
 			@return True on success.
 		*/
-		static bool OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, const std::string &left_alias, const std::string &right_alias );
+		static bool OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, const std::string &left_alias, const std::string &right_alias, bool optimize_rank );
+
+		/** Replaces the given attribute of an ad prepared by
+			OptimizeAdForMatchmaking with its flattened form, saving
+			the original under unoptimized_attr.
+			@return True on success.
+		*/
+		static bool FlattenAttrForMatchmaking( ClassAd *ad, const char *attr, const char *unoptimized_attr, std::string *error_msg );
 
 		/**
 		   @return true if the given expression evaluates to true
@@ -34,7 +34,7 @@ class ClassAdUnParser
 {
 	public:
 		/// Constructor
-		ClassAdUnParser() : oldClassAd(false), xmlUnparse(false), delimiter('\"'), oldClassAdValue(false) {}
+		ClassAdUnParser() : oldClassAd(false), xmlUnparse(false), delimiter('\"'), oldClassAdValue(false), unparseCachedText(false) {}
 
 		/// Destructor
 		virtual ~ClassAdUnParser() {}
@@ -76,6 +76,13 @@ class ClassAdUnParser
 		void SetOldClassAd( bool old_syntax, bool attr_value );
 		bool GetOldClassAd() const;
 
+			// When unparsing an attribute value in the old syntax, unparse
+			// an expression from the ClassAd cache as the text it was cached
+			// from, without unparsing its tree (or parsing it, if it was
+			// cached lazily). This is for putClassAd only: the text is not
+			// normalized and may contain comments.
+		void SetUnparseCachedText( bool cached_text );
+
 		virtual void UnparseAux( std::string &buffer,
 								 const Value&,Value::NumberFactor );
 		virtual void UnparseAux( std::string &buffer, 
@@ -100,6 +107,7 @@ class ClassAdUnParser
 		bool xmlUnparse;
 		char delimiter; // string delimiter - initialized to '\"' in the constructor
 		bool oldClassAdValue;
+		bool unparseCachedText;
 };
 
 
@@ -23,226 +23,391 @@
 #include <assert.h>
 #include <stdio.h>
 #include <list>
+#include <mutex>
 
 using namespace classad;
 using namespace std;
 
+// The values of an attribute are indexed by the string held in each
+// CacheEntry, rather than by a copy of it, so that the cache holds only
+// one copy of each value.
+struct CacheValueHash {
+	inline size_t operator()( const std::string *s ) const {
+		return std::hash<std::string>()( *s );
+	}
+};
+
+struct CacheValueEq {
+	inline bool operator()( const std::string *s1, const std::string *s2 ) const {
+		return *s1 == *s2;
+	}
+};
+
+// Counters kept by each shard of the cache, and summed for reporting.
+struct CacheCounts {
+	CacheCounts()
+	: m_HitCount(0), m_MissCount(0), m_QueryCount(0), m_HitDelete(0)
+	, m_RemovalCount(0), m_UnparseCount(0)
+	, m_Entries(0), m_UseCount(0), m_Pruned(0)
+	, m_Attribs(0), m_SingletonAttribs(0), m_AttribsWithOnlySingletonValues(0)
+	, m_SingletonValues(0), m_MaxUseCount(0)
+	{}
+
+	void add(const CacheCounts &other) {
+		m_HitCount += other.m_HitCount;
+		m_MissCount += other.m_MissCount;
+		m_QueryCount += other.m_QueryCount;
+		m_HitDelete += other.m_HitDelete;
+		m_RemovalCount += other.m_RemovalCount;
+		m_UnparseCount += other.m_UnparseCount;
+		m_Entries += other.m_Entries;
+		m_UseCount += other.m_UseCount;
+		m_Pruned += other.m_Pruned;
+		m_Attribs += other.m_Attribs;
+		m_SingletonAttribs += other.m_SingletonAttribs;
+		m_AttribsWithOnlySingletonValues += other.m_AttribsWithOnlySingletonValues;
+		m_SingletonValues += other.m_SingletonValues;
+		if (m_MaxUseCount < other.m_MaxUseCount) { m_MaxUseCount = other.m_MaxUseCount; }
+	}
+
+	unsigned long m_HitCount;	///< Hit Counter
+	unsigned long m_MissCount;	///< Miss Counter
+	unsigned long m_QueryCount;	///< Checks that don't offer an expr-tree
+	unsigned long m_HitDelete;	///< Hits that freed the incoming expr tree
+	unsigned long m_RemovalCount;	///< Useful to see churn
+	unsigned long m_UnparseCount; ///< number of times we had to unparse a tree to populate the cache.
+
+	// these are only filled in by a walk of the cache contents
+	unsigned long m_Entries;
+	unsigned long m_UseCount;
+	unsigned long m_Pruned;
+	unsigned long m_Attribs;
+	unsigned long m_SingletonAttribs;
+	unsigned long m_AttribsWithOnlySingletonValues;
+	unsigned long m_SingletonValues;
+	unsigned long m_MaxUseCount;
+};
+
 /**
- * ClassAdCache - is meant to be the storage container which is used to cache classads,
+ * ClassAdCacheShard - is meant to be the storage container which is used to cache classads,
  * I've tried some fancy tricks but they don't actually yield much better performance 
  * characteristics so I've decided to keep it simple stupid (KISS)
  * 
+ * Each shard holds the attributes whose names hash to it, under its own
+ * lock, so that threads parsing ads at the same time rarely wait for
+ * each other.  An attribute name stays in its shard for as long as any
+ * CacheEntry points at it, and is removed along with the last one.
+ *
  * @author Timothy St. Clair
  */
-class ClassAdCache
+class ClassAdCacheShard
 {
 protected:
 
-	typedef classad_unordered<std::string, pCacheEntry> AttrValues;
-	typedef classad_unordered<std::string, pCacheEntry>::iterator value_iterator;
+	typedef classad_unordered<const std::string *, pCacheEntry, CacheValueHash, CacheValueEq> AttrValues;
+	typedef AttrValues::iterator value_iterator;
 
-	typedef classad_unordered<std::string, AttrValues, ClassadAttrNameHash, CaseIgnEqStr> AttrCache;
-	typedef classad_unordered<std::string, AttrValues, ClassadAttrNameHash, CaseIgnEqStr>::iterator cache_iterator;
+	// The values of one attribute, and the number of CacheEntry objects
+	// for them, which may be more than there are values while a replaced
+	// entry is being destroyed.
+	struct AttrEntry {
+		AttrEntry() : m_EntryCount(0) {}
+		AttrValues m_Values;
+		unsigned long m_EntryCount;
+	};
 
-	AttrCache m_Cache;		///< Data Store
-	unsigned long m_HitCount;	///< Hit Counter
-	unsigned long m_MissCount;	///< Miss Counter
-	unsigned long m_QueryCount;	///< Checks that don't offer an expr-tree
-	unsigned long m_HitDelete;	///< Hits that freed the incoming expr tree
-	unsigned long m_RemovalCount;	///< Useful to see churn
-	unsigned long m_UnparseCount; ///< number of times we had to unparse a tree to populate the cache.
-	bool          m_destroyed;
+	typedef classad_unordered<std::string, AttrEntry, ClassadAttrNameHash, CaseIgnEqStr> AttrCache;
+	typedef classad_unordered<std::string, AttrEntry, ClassadAttrNameHash, CaseIgnEqStr>::iterator cache_iterator;
+
+	std::mutex    m_lock;
+	AttrCache     m_Cache;		///< Data Store
+	CacheCounts   m_Counts;
 	
 public:
-	ClassAdCache()
-	: m_HitCount(0)
-	, m_MissCount(0)
-	, m_QueryCount(0)
-	, m_HitDelete(0)
-	, m_RemovalCount(0)
-	, m_UnparseCount(0)
-	, m_destroyed(false)
-	{ 
-	};
-	
-	virtual ~ClassAdCache(){ m_destroyed = true; };
-
-#ifdef HAVE_COW_STRING
-	pCacheData cache( std::string & szName, ExprTree * pVal)
-#else
-	pCacheData cache(const std::string & szName, ExprTree * pVal)
-#endif
-	{
-		std::string szValue;
-		if (pVal) {
-			m_UnparseCount++;
-			ClassAdUnParser unparser;
-			//PRAGMA_REMIND("this should probably unparse in old classad form")
-			unparser.Unparse(szValue, pVal);
-		}
-		return cache(szName, szValue, pVal);
-	}
+	ClassAdCacheShard() {}
 
-	///< cache's a local attribute->ExpTree
+	// Adds an entry for szName = szValue, returning the entry that was
+	// already there, if any.  The caller holds m_lock.
+	pCacheData lookup_or_insert(
 #ifdef HAVE_COW_STRING
-	pCacheData cache( std::string & szName, const std::string & szValue , ExprTree * pVal)
+		std::string & szName,
 #else
-	pCacheData cache(const std::string & szName, const std::string & szValue , ExprTree * pVal)
+		const std::string & szName,
 #endif
+		const std::string & szValue, ExprTree * pVal, bool insert, bool &hit)
 	{
 		pCacheData pRet;
+		hit = false;
 
 		cache_iterator itr = m_Cache.find(szName);
-		bool bValidName=false;
 
 		if (itr != m_Cache.end()) {
-			bValidName = true;
-			value_iterator vtr = itr->second.find(szValue);
+			value_iterator vtr = itr->second.m_Values.find(&szValue);
 #ifdef HAVE_COW_STRING
 			szName = itr->first;
 #endif
 
 			// check the value cache
-			if (vtr != itr->second.end()) {
+			if (vtr != itr->second.m_Values.end()) {
 				pRet = vtr->second.lock();
-
-				m_HitCount++;
-				if (pVal) {
-					delete pVal;
-					m_HitDelete++;
-				} else {
-					m_QueryCount++;
+				if (pRet) {
+					hit = true;
+					return pRet;
 				}
-
-				// don't to any more checks just return.
-				return pRet;
+				// another thread is destroying this entry, so replace
+				// it; its flush will leave the new one alone.
+				itr->second.m_Values.erase(vtr);
 			}
 		}
 
 		// if we got here we missed 
-		if (pVal) {
-			pRet.reset( new CacheEntry(szName,szValue,pVal) );
-
-			if (bValidName) {
-				itr->second[szValue] = pRet;
-			} else {
-				(m_Cache[szName])[szValue] = pRet;
+		if (insert) {
+			if (itr == m_Cache.end()) {
+				itr = m_Cache.insert(AttrCache::value_type(szName, AttrEntry())).first;
 			}
-
-			m_MissCount++;
-		} else {
-			m_QueryCount++;
+			pRet.reset( new CacheEntry(&itr->first,szValue,pVal) );
+			itr->second.m_Values[&pRet->szValue] = pRet;
+			itr->second.m_EntryCount++;
 		}
 
 		return pRet;
 	}
 
+	///< cache's a local attribute->ExpTree
 #ifdef HAVE_COW_STRING
-	pCacheData insert_lazy( std::string & szName, const std::string & szValue)
+	pCacheData cache( std::string & szName, const std::string & szValue , ExprTree * pVal)
 #else
-	pCacheData insert_lazy(const std::string & szName, const std::string & szValue)
+	pCacheData cache(const std::string & szName, const std::string & szValue , ExprTree * pVal)
 #endif
 	{
+		bool hit = false;
 		pCacheData pRet;
-
-		cache_iterator itr = m_Cache.find(szName);
-		bool bValidName=false;
-
-		if (itr != m_Cache.end()) {
-			bValidName = true;
-			value_iterator vtr = itr->second.find(szValue);
-#ifdef HAVE_COW_STRING
-			szName = itr->first;
-#endif
-
-			// check the value cache
-			if (vtr != itr->second.end()) {
-				pRet = vtr->second.lock();
-				m_HitCount++;
-				// don't to any more checks just return.
-				return pRet;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			pRet = lookup_or_insert(szName, szValue, pVal, pVal != NULL, hit);
+			if (hit) {
+				m_Counts.m_HitCount++;
+				if (pVal) {
+					m_Counts.m_HitDelete++;
+				} else {
+					m_Counts.m_QueryCount++;
+				}
+			} else if (pVal) {
+				m_Counts.m_MissCount++;
+			} else {
+				m_Counts.m_QueryCount++;
 			}
 		}
 
-		// if we got here we missed
-		m_MissCount++;
-		pRet.reset( new CacheEntry(szName,szValue,NULL) );
+		// don't hold the lock while freeing the incoming tree
+		if (hit && pVal) {
+			delete pVal;
+		}
+		return pRet;
+	}
 
-		if (bValidName) {
-			itr->second[szValue] = pRet;
+#ifdef HAVE_COW_STRING
+	pCacheData insert_lazy( std::string & szName, const std::string & szValue)
+#else
+	pCacheData insert_lazy(const std::string & szName, const std::string & szValue)
+#endif
+	{
+		bool hit = false;
+		std::lock_guard<std::mutex> guard(m_lock);
+		pCacheData pRet = lookup_or_insert(szName, szValue, NULL, true, hit);
+		if (hit) {
+			m_Counts.m_HitCount++;
 		} else {
-			(m_Cache[szName])[szValue] = pRet;
+			m_Counts.m_MissCount++;
 		}
-
 		return pRet;
 	}
 
-	///< clears a cache key
+	///< clears a cache key, called as each CacheEntry is destroyed
 	bool flush(const std::string & szName, const std::string & szValue)
 	{
-		// this can get called after the cache has been destroyed, and that will cause an abort in MSVC11
-		// and possibly other places as well.
-		if (m_destroyed) return false;
+		bool removed = false;
+		std::lock_guard<std::mutex> guard(m_lock);
 
 		cache_iterator itr = m_Cache.find(szName);
 
 		if (itr != m_Cache.end()) {
-			if (itr->second.size() == 1) {
+			value_iterator vtr = itr->second.m_Values.find(&szValue);
+			// the entry may already have been replaced by a live one
+			// for the same value, which must stay.
+			if (vtr != itr->second.m_Values.end() && vtr->second.expired()) {
+				itr->second.m_Values.erase(vtr);
+				m_Counts.m_RemovalCount++;
+				removed = true;
+			}
+			// szName is the name in the cache, so it goes away here
+			// when this was the last entry that pointed at it.
+			if (--itr->second.m_EntryCount == 0) {
 				m_Cache.erase(itr);
-			} else {
-				value_iterator vtr = itr->second.find(szValue);
-				itr->second.erase(vtr);
 			}
-
-			m_RemovalCount++;
-			return (true);
 		}
 
-		return false;
+		return removed;
 	} 
+
+	void count_unparse()
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_Counts.m_UnparseCount++;
+	}
 	
-	///< dumps the contents of the cache to the file
-	bool dump_keys(const std::string & szFile)
+	///< dumps the contents of the shard to the file, and adds up its counts
+	void dump_keys(FILE * fp, CacheCounts & counts)
 	{
-	  FILE * fp = fopen ( szFile.c_str(), "a+" );
-	  bool bRet = false;
-
-	  if (fp)
-	  {
-	    double dHitRatio = (m_HitCount/ ((double)m_HitCount+m_MissCount))*100;
-	    double dMissRatio = (m_MissCount/ ((double)m_HitCount+m_MissCount))*100;
-	    unsigned long lTotalUseCount=0;
-	    unsigned long lTotalPruned=0;
-	    unsigned long lEntries=0;
+	    std::lock_guard<std::mutex> guard(m_lock);
+	    counts.add(m_Counts);
 
 	    cache_iterator itr = m_Cache.begin();
 
 	    while ( itr != m_Cache.end() )
 	    {
-              value_iterator vtr = itr->second.begin();
+              value_iterator vtr = itr->second.m_Values.begin();
               
-              while (vtr != itr->second.end())
+              while (vtr != itr->second.m_Values.end())
               {
                 if (vtr->second.expired())
                 {
-                    // this should never happen.
-                    fprintf( fp, "EXPIRED ** %s = %s\n", itr->first.c_str(), vtr->first.c_str() );
-                    vtr = itr->second.erase(vtr);
-                    lTotalPruned++;
+                    // only an entry that another thread is destroying
+                    // right now, whose value (the key) may already be gone.
+                    fprintf( fp, "EXPIRED ** %s\n", itr->first.c_str() );
+                    vtr = itr->second.m_Values.erase(vtr);
+                    counts.m_Pruned++;
                 }
                 else
                 {
-                    lTotalUseCount += vtr->second.use_count();
-                    lEntries++;
+                    counts.m_UseCount += vtr->second.use_count();
+                    counts.m_Entries++;
                     
                     // it's written directly to a file b/c it has the potential to be very large 
-                    fprintf( fp, "[%s = %s] - %lu\n", itr->first.c_str(), vtr->first.c_str(), vtr->second.use_count() );
+                    fprintf( fp, "[%s = %s] - %lu\n", itr->first.c_str(), vtr->first->c_str(), vtr->second.use_count() );
                     vtr++;
                 }
               }
               
               itr++;
 	    }
+	}
+
+	///< adds up the counts and use of the shard
+	void get_stats(CacheCounts & counts)
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		counts.add(m_Counts);
+
+		cache_iterator itr = m_Cache.begin();
+		while (itr != m_Cache.end())
+		{
+			value_iterator vtr = itr->second.m_Values.begin();
+
+			unsigned long cValues = 0;
+			unsigned long cMaxUse = 0;
+			while (vtr != itr->second.m_Values.end())
+			{
+				unsigned long cUseCount = vtr->second.use_count();
+				if (cUseCount == 1) { ++counts.m_SingletonValues; }
+				counts.m_UseCount += cUseCount;
+				if (cMaxUse < cUseCount) { cMaxUse = cUseCount; }
+
+				++counts.m_Entries;
+				++cValues;
+				vtr++;
+			}
+
+			if (counts.m_MaxUseCount < cMaxUse) { counts.m_MaxUseCount = cMaxUse; }
+			if (cMaxUse <= 1) { ++counts.m_AttribsWithOnlySingletonValues; }
+			if (cValues <= 1) { ++counts.m_SingletonAttribs; }
+
+			++counts.m_Attribs;
+			itr++;
+		}
+	}
+
+	void get_counts(CacheCounts & counts)
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		counts.add(m_Counts);
+	}
+};
+
+/**
+ * ClassAdCache - the cache is split into shards by attribute name, so that
+ * ads can be parsed into it by several threads at once.
+ */
+class ClassAdCache
+{
+protected:
+	enum { NUM_SHARDS = 16 };
+	ClassAdCacheShard m_Shards[NUM_SHARDS];
+
+	ClassAdCacheShard & shard(const std::string & szName) {
+		return m_Shards[ClassadAttrNameHash()(szName) % NUM_SHARDS];
+	}
+
+public:
+	ClassAdCache() {}
+	virtual ~ClassAdCache() {}
+
+#ifdef HAVE_COW_STRING
+	pCacheData cache( std::string & szName, ExprTree * pVal)
+#else
+	pCacheData cache(const std::string & szName, ExprTree * pVal)
+#endif
+	{
+		std::string szValue;
+		if (pVal) {
+			shard(szName).count_unparse();
+			ClassAdUnParser unparser;
+			//PRAGMA_REMIND("this should probably unparse in old classad form")
+			unparser.Unparse(szValue, pVal);
+		}
+		return cache(szName, szValue, pVal);
+	}
+
+	///< cache's a local attribute->ExpTree
+#ifdef HAVE_COW_STRING
+	pCacheData cache( std::string & szName, const std::string & szValue , ExprTree * pVal)
+#else
+	pCacheData cache(const std::string & szName, const std::string & szValue , ExprTree * pVal)
+#endif
+	{
+		return shard(szName).cache(szName, szValue, pVal);
+	}
+
+#ifdef HAVE_COW_STRING
+	pCacheData insert_lazy( std::string & szName, const std::string & szValue)
+#else
+	pCacheData insert_lazy(const std::string & szName, const std::string & szValue)
+#endif
+	{
+		return shard(szName).insert_lazy(szName, szValue);
+	}
+
+	///< clears a cache key
+	bool flush(const std::string & szName, const std::string & szValue)
+	{
+		return shard(szName).flush(szName, szValue);
+	}
+
+	///< dumps the contents of the cache to the file
+	bool dump_keys(const std::string & szFile)
+	{
+	  FILE * fp = fopen ( szFile.c_str(), "a+" );
+	  bool bRet = false;
+
+	  if (fp)
+	  {
+	    CacheCounts counts;
+	    for (int ii = 0; ii < NUM_SHARDS; ++ii) {
+	      m_Shards[ii].dump_keys(fp, counts);
+	    }
+
+	    double dHitRatio = (counts.m_HitCount/ ((double)counts.m_HitCount+counts.m_MissCount))*100;
+	    double dMissRatio = (counts.m_MissCount/ ((double)counts.m_HitCount+counts.m_MissCount))*100;
 
 	    // written at the end so you can tail the file.
 	    fprintf( fp, "------------------------------------------------\n");
@@ -253,9 +418,9 @@ public:
 	    getpid()
 #endif
 	    );
-	    fprintf( fp, "Hits [%lu - %f] Misses[%lu - %f] Querys[%lu]\n", m_HitCount,dHitRatio,m_MissCount,dMissRatio,m_QueryCount ); 
-	    fprintf( fp, "Entries[%lu] UseCount[%lu] FlushedCount[%lu]\n", lEntries,lTotalUseCount,m_RemovalCount );
-	    fprintf( fp, "Pruned[%lu] - SHOULD BE 0\n",lTotalPruned);
+	    fprintf( fp, "Hits [%lu - %f] Misses[%lu - %f] Querys[%lu]\n", counts.m_HitCount,dHitRatio,counts.m_MissCount,dMissRatio,counts.m_QueryCount ); 
+	    fprintf( fp, "Entries[%lu] UseCount[%lu] FlushedCount[%lu]\n", counts.m_Entries,counts.m_UseCount,counts.m_RemovalCount );
+	    fprintf( fp, "Pruned[%lu] - SHOULD BE 0\n",counts.m_Pruned);
 	    fprintf( fp, "------------------------------------------------\n");
 	    fclose(fp);
 
@@ -271,65 +436,48 @@ public:
 	{
 		double dHitRatio = 0.0;
 		double dMissRatio = 0.0;
-		unsigned long cTotalUseCount = 0;
-		unsigned long cMaxUseCount = 0;
-		unsigned long cTotalPruned = 0;
-		unsigned long cTotalValues = 0;
-		unsigned long cAttribs = 0;
-		unsigned long cSingletonValues = 0;
-		unsigned long cAttribsWithOnlySingletonValues = 0;
-		unsigned long cSingletonAttribs = 0;
-
-		if (m_HitCount+m_MissCount) {
-			double dTot = m_HitCount + m_MissCount;
-			dHitRatio = (100.0 * m_HitCount) / dTot;
-			dMissRatio = (100.0 * m_MissCount) / dTot;
-		}
-
-		cache_iterator itr = m_Cache.begin();
-		while (itr != m_Cache.end())
-		{
-			value_iterator vtr = itr->second.begin();
-
-			unsigned long cValues = 0;
-			unsigned long cMaxUse = 0;
-			while (vtr != itr->second.end())
-			{
-				unsigned long cUseCount = vtr->second.use_count();
-				if (cUseCount == 1) { ++cSingletonValues; }
-				cTotalUseCount += cUseCount;
-				if (cMaxUse < cUseCount) { cMaxUse = cUseCount; }
-
-				++cTotalValues;
-				++cValues;
-				vtr++;
-			}
 
-			if (cMaxUseCount < cMaxUse) { cMaxUseCount = cMaxUse; }
-			if (cMaxUse <= 1) { ++cAttribsWithOnlySingletonValues; }
-			if (cValues <= 1) { ++cSingletonAttribs; }
+		CacheCounts counts;
+		for (int ii = 0; ii < NUM_SHARDS; ++ii) {
+			m_Shards[ii].get_stats(counts);
+		}
 
-			++cAttribs;
-			itr++;
+		if (counts.m_HitCount+counts.m_MissCount) {
+			double dTot = counts.m_HitCount + counts.m_MissCount;
+			dHitRatio = (100.0 * counts.m_HitCount) / dTot;
+			dMissRatio = (100.0 * counts.m_MissCount) / dTot;
 		}
 
-		fprintf( fp, "Attribs: %lu SingleUseAttribs: %lu AttribsWithOnlySingletons: %lu\n",  cAttribs, cSingletonAttribs, cAttribsWithOnlySingletonValues);
-		fprintf( fp, "Values: %lu SingleUseValues: %lu UseCountTot:%lu UseCountMax: %lu\n", cTotalValues, cSingletonValues, cTotalUseCount, cMaxUseCount);
-		fprintf( fp, "Hits:%lu (%.2f%%) Misses: %lu (%.2f%%) Querys: %lu\n", m_HitCount,dHitRatio,m_MissCount,dMissRatio,m_QueryCount ); 
+		fprintf( fp, "Attribs: %lu SingleUseAttribs: %lu AttribsWithOnlySingletons: %lu\n",  counts.m_Attribs, counts.m_SingletonAttribs, counts.m_AttribsWithOnlySingletonValues);
+		fprintf( fp, "Values: %lu SingleUseValues: %lu UseCountTot:%lu UseCountMax: %lu\n", counts.m_Entries, counts.m_SingletonValues, counts.m_UseCount, counts.m_MaxUseCount);
+		fprintf( fp, "Hits:%lu (%.2f%%) Misses: %lu (%.2f%%) Querys: %lu\n", counts.m_HitCount,dHitRatio,counts.m_MissCount,dMissRatio,counts.m_QueryCount ); 
 	};
 
-	void get_counts(unsigned long &hits, unsigned long &misses, unsigned long &querys, unsigned long & hitdels, unsigned long &removals, unsigned long &unparse) const {
-		hits = m_HitCount;
-		misses = m_MissCount;
-		querys = m_QueryCount;
-		hitdels = m_HitDelete;
-		removals = m_RemovalCount;
-		unparse = m_UnparseCount;
+	void get_counts(unsigned long &hits, unsigned long &misses, unsigned long &querys, unsigned long & hitdels, unsigned long &removals, unsigned long &unparse) {
+		CacheCounts counts;
+		for (int ii = 0; ii < NUM_SHARDS; ++ii) {
+			m_Shards[ii].get_counts(counts);
+		}
+		hits = counts.m_HitCount;
+		misses = counts.m_MissCount;
+		querys = counts.m_QueryCount;
+		hitdels = counts.m_HitDelete;
+		removals = counts.m_RemovalCount;
+		unparse = counts.m_UnparseCount;
 	}
 };
 
 
-static classad_shared_ptr<ClassAdCache> _cache;
+// The cache is never deleted: ClassAds destroyed by static destructors at
+// exit, after the cache would have been, still flush their entries into it.
+static ClassAdCache * _cache = NULL;
+static std::once_flag _cache_once;
+
+static ClassAdCache * get_cache()
+{
+	std::call_once(_cache_once, []() { _cache = new ClassAdCache(); });
+	return _cache;
+}
 //////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -339,10 +487,10 @@ static classad_shared_ptr<ClassAdCache> _cache;
 
 CacheEntry::~CacheEntry()
 {
-	if (_cache && _cache.use_count()) {
-		_cache->flush(szName, szValue);
+	if (pName && _cache) {
+		_cache->flush(*pName, szValue);
 	}
-	delete pData;
+	delete pData.load();
 	pData = NULL;
 }
 
@@ -372,9 +520,8 @@ ExprTree * CachedExprEnvelope::cache (const std::string & pName, ExprTree * pTre
 		break;
 
 	default:
-		if ( ! _cache) { _cache.reset( new ClassAdCache() ); }
 		pNewEnv = new CachedExprEnvelope();
-		pNewEnv->m_pLetter = _cache->cache(pName, szValue, pTree);
+		pNewEnv->m_pLetter = get_cache()->cache(pName, szValue, pTree);
 		pRet = pNewEnv;
 		break;
 	}
@@ -388,9 +535,8 @@ ExprTree * CachedExprEnvelope::cache_lazy (std::string & pName, const std::strin
 ExprTree * CachedExprEnvelope::cache_lazy (const std::string & pName, const std::string & szValue)
 #endif
 {
-	if ( ! _cache) { _cache.reset( new ClassAdCache() ); }
 	CachedExprEnvelope *pEnv = new CachedExprEnvelope();
-	pEnv->m_pLetter = _cache->insert_lazy(pName, szValue);
+	pEnv->m_pLetter = get_cache()->insert_lazy(pName, szValue);
 	return pEnv;
 }
 
@@ -416,12 +562,7 @@ CachedExprEnvelope * CachedExprEnvelope::check_hit (string & szName, const strin
 {
    CachedExprEnvelope * pRet = 0; 
 
-   if (!_cache)
-   {
-	_cache.reset(new ClassAdCache());
-   }
-
-   pCacheData cache_check = _cache->cache( szName, szValue, 0);
+   pCacheData cache_check = get_cache()->cache( szName, szValue, 0);
 
    if (cache_check)
    {
@@ -439,12 +580,18 @@ ExprTree * CachedExprEnvelope::get() const
 	
 	if (m_pLetter) {
 		CacheEntry * ptr = m_pLetter.get();
-		expr = ptr->pData;
+		expr = ptr->pData.load(std::memory_order_acquire);
 		if ( ! expr) {
 			ClassAdParser parser;
 			parser.SetOldClassAd(true);
-			expr = parser.ParseExpression(ptr->szValue);
-			ptr->pData = expr;
+			ExprTree * parsed = parser.ParseExpression(ptr->szValue);
+			// another thread may have parsed the same entry meanwhile,
+			// in which case we use its tree and discard ours.
+			if (ptr->pData.compare_exchange_strong(expr, parsed, std::memory_order_acq_rel)) {
+				expr = parsed;
+			} else {
+				delete parsed;
+			}
 		}
 	}
 	
@@ -482,8 +629,9 @@ bool CachedExprEnvelope::SameAs(const ExprTree* tree) const
 	}
 
 	if (tree->GetKind() != EXPR_ENVELOPE) {
-		if (m_pLetter && m_pLetter->pData) {
-			return m_pLetter->pData->SameAs(tree);
+		ExprTree * expr = m_pLetter ? m_pLetter->pData.load(std::memory_order_acquire) : NULL;
+		if (expr) {
+			return expr->SameAs(tree);
 		}
 		return false;
 	}
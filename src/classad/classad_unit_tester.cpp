@@ -35,10 +35,13 @@
 #include "classad/classad_distribution.h"
 #include "classad/lexerSource.h"
 #include "classad/xmlSink.h"
+#include "classad/classadCache.h"
 #include <fstream>
 #include <iostream>
 #include <ctype.h>
 #include <assert.h>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 using namespace classad;
@@ -64,6 +67,7 @@ public:
     bool  check_operator;
     bool  check_collection;
     bool  check_utils;
+    bool  check_cache;
 	void  ParseCommandLine(int argc, char **argv);
 };
 
@@ -96,6 +100,7 @@ static void test_exprlist(const Parameters &parameters, Results &results);
 static void test_value(const Parameters &parameters, Results &results);
 static void test_collection(const Parameters &parameters, Results &results);
 static void test_utils(const Parameters &parameters, Results &results);
+static void test_cache(const Parameters &parameters, Results &results);
 static bool check_in_view(ClassAdCollection *collection, string view_name, string classad_name);
 static void print_version(void);
 
@@ -128,6 +133,7 @@ void Parameters::ParseCommandLine(
     check_operator      = false;
     check_collection    = false;
     check_utils         = false;
+    check_cache         = false;
 
 	// Then we parse to see what the user wants. 
 	for (int arg_index = 1; arg_index < argc; arg_index++) {
@@ -174,6 +180,9 @@ void Parameters::ParseCommandLine(
             selected_test       = true;
 		} else if (!strcasecmp(argv[arg_index], "-utils")){
             check_utils         = true;
+            selected_test       = true;
+		} else if (!strcasecmp(argv[arg_index], "-cache")){
+            check_cache         = true;
             selected_test       = true;
 		} else {
             cout << "Unknown argument: " << argv[arg_index] << endl;
@@ -201,6 +210,7 @@ void Parameters::ParseCommandLine(
         cout << "    -operator:   test the Operator class.\n";
         cout << "    -collection: test the Collection class.\n";
         cout << "    -utils:      test little utilities.\n";
+        cout << "    -cache:      test the expression cache from several threads.\n";
         exit(1);
     }
     if (!selected_test) {
@@ -297,6 +307,9 @@ int main(
     if (parameters.check_all || parameters.check_utils) {
         test_utils(parameters, results);
     }
+    if (parameters.check_all || parameters.check_cache) {
+        test_cache(parameters, results);
+    }
 
     /* ----- Report ----- */
     cout << endl;
@@ -543,6 +556,48 @@ static void test_classad(const Parameters &, Results &results)
     TEST("update from chain is merged",(have_attribute==true));
     TEST("update from chain has attribute c==6",(i==6));
 
+    /* ----- Test unparsing cached expressions ----- */
+    // putClassAd sends a cached expression as the text it was cached from,
+    // which must parse back to the same expression. Any other unparse must
+    // unparse the tree, since the text is not normalized.
+    const char *cached_text[] = {
+        "MY.Memory*2 >= TARGET.RequestMemory",
+        "ifThenElse(isUndefined(LastHeardFrom),CurrentTime,LastHeardFrom)  -  1 < 3600",
+        "{ \"a\", 2, 3.5, [ B = 1; C = false ] } // a list",
+        "strcat( \"x\\\"y\" , Owner )",
+    };
+    ClassAdParser old_parser;
+    old_parser.SetOldClassAd(true);
+    ClassAdUnParser unparser;
+    unparser.SetOldClassAd(true, true);
+    ClassAdUnParser put_unparser;
+    put_unparser.SetOldClassAd(true, true);
+    put_unparser.SetUnparseCachedText(true);
+    ClassAdSetExpressionCaching(true);
+    for (size_t ix = 0; ix < sizeof(cached_text) / sizeof(cached_text[0]); ix++) {
+        ClassAd cached;
+        string attr = "CachedExpr";
+        success = cached.InsertViaCache(attr, cached_text[ix], true);
+        TEST("insert lazily cached expression", (success == true));
+
+        string sent;
+        put_unparser.Unparse(sent, cached.Lookup(attr));
+        ExprTree *received = old_parser.ParseExpression(sent);
+        ExprTree *expected = old_parser.ParseExpression(cached_text[ix]);
+        TEST("cached text parses to the same expression",
+             received != NULL && expected != NULL && received->SameAs(expected));
+
+        string unparsed, expected_unparsed;
+        unparser.Unparse(unparsed, cached.Lookup(attr));
+        unparser.Unparse(expected_unparsed, expected);
+        TEST("cached expression unparses from its tree", (unparsed == expected_unparsed));
+        TEST("cached expression does not unparse as its text", (unparsed != cached_text[ix]));
+
+        delete received;
+        delete expected;
+    }
+    ClassAdSetExpressionCaching(false);
+
     return;
 }
 
@@ -1026,6 +1081,92 @@ static void test_utils(const Parameters &, Results &results)
     return;
 }
 
+/*********************************************************************
+ *
+ * Function: test_cache
+ * Purpose:  Test the expression cache from several threads at once.
+ *           They insert the same names and values, eagerly and lazily,
+ *           so they share entries, parse them lazily at the same time,
+ *           and destroy them while the others look them up.
+ *
+ *********************************************************************/
+static void get_cache_sizes(unsigned long &attribs, unsigned long &values)
+{
+    attribs = values = (unsigned long)-1;
+    FILE *fp = tmpfile();
+    if (fp) {
+        CachedExprEnvelope::_debug_print_stats(fp);
+        rewind(fp);
+        if (fscanf(fp, "Attribs: %lu%*[^\n] Values: %lu", &attribs, &values) != 2) {
+            attribs = values = (unsigned long)-1;
+        }
+        fclose(fp);
+    }
+}
+
+static void test_cache(const Parameters &, Results &results)
+{
+    const int num_threads = 8;
+    const int num_rounds = 200;
+    const int num_names = 64;
+    const int num_values = 5;
+
+    cout << "Testing the expression cache from " << num_threads << " threads...\n";
+
+    ClassAdSetExpressionCaching(true);
+
+    // make sure the cache exists, so its sizes can be compared
+    ClassAd first;
+    string first_attr = "CacheTestFirst";
+    first.InsertViaCache(first_attr, "1 + 1");
+    unsigned long attribs_before, values_before;
+    get_cache_sizes(attribs_before, values_before);
+    TEST("cache sizes can be read", (attribs_before != (unsigned long)-1));
+
+    std::atomic<int> bad_inserts(0);
+    std::atomic<int> bad_values(0);
+    std::vector<std::thread> threads;
+    for (int tid = 0; tid < num_threads; tid++) {
+        threads.push_back(std::thread([tid, &bad_inserts, &bad_values]() {
+            for (int round = 0; round < num_rounds; round++) {
+                ClassAd ad;
+                for (int ix = 0; ix < num_names; ix++) {
+                    string attr = "CacheTestAttr" + std::to_string(ix);
+                    int val = (ix + round + tid) % num_values;
+                    string rhs = std::to_string(ix) + " * 10 + " + std::to_string(val);
+                    if ( ! ad.InsertViaCache(attr, rhs, (ix + tid) % 2 == 0)) {
+                        bad_inserts++;
+                    }
+                }
+                ClassAd *copy = (ClassAd *)ad.Copy();
+                for (int ix = 0; ix < num_names; ix++) {
+                    string attr = "CacheTestAttr" + std::to_string(ix);
+                    int val = (ix + round + tid) % num_values;
+                    long long result = -1;
+                    if ( ! copy->EvaluateAttrInt(attr, result) || result != ix * 10 + val) {
+                        bad_values++;
+                    }
+                }
+                delete copy;
+            }
+        }));
+    }
+    for (size_t ix = 0; ix < threads.size(); ix++) {
+        threads[ix].join();
+    }
+    TEST("all cached expressions inserted", (bad_inserts == 0));
+    TEST("all cached expressions have their own value", (bad_values == 0));
+
+    // every name and value the threads added went away with their ads
+    unsigned long attribs_after, values_after;
+    get_cache_sizes(attribs_after, values_after);
+    TEST("cache has no names left from the threads", (attribs_after == attribs_before));
+    TEST("cache has no values left from the threads", (values_after == values_before));
+
+    ClassAdSetExpressionCaching(false);
+    return;
+}
+
 /*********************************************************************
  *
  * Function: print_version
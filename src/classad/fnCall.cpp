@@ -58,6 +58,138 @@
 
 using namespace std;
 
+#if defined USE_PCRE
+#include <list>
+#include <mutex>
+
+// Patterns given to regexp() and friends are nearly always constants in
+// a policy expression that is evaluated over and over, e.g. once per slot
+// per job by the negotiator, so the compiled patterns are kept in a small
+// LRU cache instead of being compiled on every call.  The cache may be
+// used by several matchmaking threads at once; pcre allows a compiled
+// pattern to be shared between threads, and an entry stays valid for a
+// thread using it even if it is evicted meanwhile.
+class RegexCache
+{
+public:
+	struct Entry {
+		Entry() : re(NULL), extra(NULL) {}
+		~Entry() {
+			if (extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+				pcre_free_study(extra);
+#else
+				pcre_free(extra);
+#endif
+			}
+			if (re) { pcre_free(re); }
+		}
+		pcre *re;
+		pcre_extra *extra;
+	};
+	typedef classad_shared_ptr<Entry> EntryPtr;
+
+	RegexCache() : m_maxSize(100), m_hits(0), m_misses(0) {}
+
+	// Returns the compiled pattern, or an empty pointer if the pattern
+	// does not compile.
+	EntryPtr get(const char *pattern, int options)
+	{
+		std::string key(reinterpret_cast<const char *>(&options), sizeof(options));
+		key += pattern;
+
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			Index::iterator it = m_index.find(key);
+			if (it != m_index.end()) {
+				m_lru.splice(m_lru.begin(), m_lru, it->second);
+				m_hits++;
+				return it->second->second;
+			}
+			m_misses++;
+		}
+
+		const char *error_message;
+		int error_offset;
+		EntryPtr entry(new Entry());
+		entry->re = pcre_compile(pattern, options, &error_message, &error_offset, NULL);
+		if ( ! entry->re) {
+			return EntryPtr();
+		}
+#ifdef PCRE_STUDY_JIT_COMPILE
+		entry->extra = pcre_study(entry->re, PCRE_STUDY_JIT_COMPILE, &error_message);
+#else
+		entry->extra = pcre_study(entry->re, 0, &error_message);
+#endif
+
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (m_maxSize > 0 && m_index.find(key) == m_index.end()) {
+			m_lru.push_front(std::make_pair(key, entry));
+			m_index[key] = m_lru.begin();
+			trim();
+		}
+		return entry;
+	}
+
+	void setMaxSize(size_t size)
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_maxSize = size;
+		trim();
+	}
+
+	void getCounts(unsigned long &hits, unsigned long &misses)
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		hits = m_hits;
+		misses = m_misses;
+	}
+
+private:
+	void trim()
+	{
+		while (m_lru.size() > m_maxSize) {
+			m_index.erase(m_lru.back().first);
+			m_lru.pop_back();
+		}
+	}
+
+	typedef std::list< std::pair<std::string, EntryPtr> > LruList;
+	typedef classad_unordered<std::string, LruList::iterator> Index;
+
+	std::mutex m_lock;
+	LruList m_lru;		// most recently used first
+	Index m_index;
+	size_t m_maxSize;
+	unsigned long m_hits;
+	unsigned long m_misses;
+};
+
+static RegexCache regexCache;
+#endif
+
+namespace classad {
+
+void ClassAdSetRegexCacheSize(size_t size)
+{
+#if defined USE_PCRE
+	regexCache.setMaxSize(size);
+#else
+	(void)size;
+#endif
+}
+
+void ClassAdGetRegexCacheCounts(unsigned long &hits, unsigned long &misses)
+{
+#if defined USE_PCRE
+	regexCache.getCounts(hits, misses);
+#else
+	hits = misses = 0;
+#endif
+}
+
+} // classad
+
 namespace classad {
 
 bool FunctionCall::initialized = false;
@@ -2077,7 +2209,7 @@ bool FunctionCall::hasRefs(const char*, const ArgumentList& argList, EvalState&
 
 	// for the 2 arg form, the second argument is a regex pattern to be compared against
 	// each of the unresolved references
-	pcre * re = nullptr;
+	RegexCache::EntryPtr re;
 	if (argList.size() == 2) {
 		const char* pattern = nullptr;
 		if ( !argList[1]->Evaluate(state, arg) || ! arg.IsStringValue(pattern)) {
@@ -2085,9 +2217,7 @@ bool FunctionCall::hasRefs(const char*, const ArgumentList& argList, EvalState&
 			return false;
 		}
 
-		const char  *error_message;
-		int error_offset;
-		re = pcre_compile(pattern, PCRE_CASELESS, &error_message, &error_offset, NULL);
+		re = regexCache.get(pattern, PCRE_CASELESS);
 		if ( ! re) {
 			// error in pattern
 			result.SetErrorValue();
@@ -2108,7 +2238,7 @@ bool FunctionCall::hasRefs(const char*, const ArgumentList& argList, EvalState&
 				}
 				if (re) {
 					int ovec[6];
-					if (pcre_exec(re, NULL, attr, len, 0, PCRE_NOTEMPTY, ovec, 6) > 0) {
+					if (pcre_exec(re->re, re->extra, attr, len, 0, PCRE_NOTEMPTY, ovec, 6) > 0) {
 						result.SetBooleanValue(true); // found a match
 						break;
 					}
@@ -2122,8 +2252,6 @@ bool FunctionCall::hasRefs(const char*, const ArgumentList& argList, EvalState&
 
 	if ( ! re) {
 		result.SetStringValue(val);
-	} else {
-		pcre_free(re);
 	}
 	return true;
 }
@@ -3154,9 +3282,7 @@ static bool regexp_helper(
 		return( true );
 	}
 #elif defined (USE_PCRE)
-    const char  *error_message;
-    int         error_offset;
-    pcre        *re = NULL;
+    RegexCache::EntryPtr re;
 	int group_count = 0;
 	int oveccount = 0;
 	int *ovector = NULL;
@@ -3198,15 +3324,14 @@ static bool regexp_helper(
 		}
     }
 
-    re = pcre_compile( pattern, options, &error_message,
-                      &error_offset, NULL );
-    if ( re == NULL ){
+    re = regexCache.get( pattern, options );
+    if ( ! re ){
 			// error in pattern
 		result.SetErrorValue( );
 		goto cleanup;
 	}
 
-	pcre_fullinfo(re, NULL, PCRE_INFO_CAPTURECOUNT, &group_count);
+	pcre_fullinfo(re->re, re->extra, PCRE_INFO_CAPTURECOUNT, &group_count);
 	oveccount = 3 * (group_count + 1); // +1 for the string itself
 	ovector = (int *) malloc(oveccount * sizeof(int));
 
@@ -3224,7 +3349,7 @@ static bool regexp_helper(
 			addl_opts = 0;
 		}
 
-        status = pcre_exec(re, NULL, target, target_len,
+        status = pcre_exec(re->re, re->extra, target, target_len,
                            target_idx, addl_opts, ovector, oveccount);
 
 		if (empty_match && status == PCRE_ERROR_NOMATCH) {
@@ -3289,9 +3414,6 @@ static bool regexp_helper(
 		result.SetStringValue(output);
 	}
  cleanup:
-	if ( re ) {
-		pcre_free(re);
-	}
 	free(ovector);
     return true;
 #endif
@@ -28,6 +28,12 @@ using namespace std;
 
 #define EMPTY -2
 
+// character classes for windSpan() and windUntil()
+static const char whitespace_chars[] = " \t\n\v\f\r";
+static const char digit_chars[] = "0123456789";
+static const char alpha_chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const char identifier_chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+
 namespace classad {
 
 // ctor
@@ -173,6 +179,68 @@ wind (bool fetch)
 	}
 }
 
+// WindSpan:  Like wind(), but also consumes the run of characters after the
+//        current one that are in accept.  When the source is in memory the
+//        run is scanned with strspn(), which the C library vectorizes, rather
+//        than a character at a time.  Returns the last character consumed.
+int Lexer::
+windSpan (const char *accept)
+{
+	int last = ch;
+	const char *buf = lexSource->UnreadBuffer();
+	if ( ! buf || ch <= 0) {
+		if (ch > 0) {
+			do {
+				last = ch;
+				wind();
+			} while (ch > 0 && strchr(accept, ch));
+		}
+		return last;
+	}
+
+	size_t cch = strspn(buf, accept);
+	if (accumulating) {
+		lexBuffer += ch;
+		lexBuffer.append(buf, cch);
+	}
+	if (cch) {
+		last = (unsigned char)buf[cch-1];
+		lexSource->SkipCharacters((int)cch);
+	}
+	ch = lexSource->ReadCharacter();
+	return last;
+}
+
+// WindUntil:  Like windSpan(), but consumes the characters that are not
+//        in reject.
+int Lexer::
+windUntil (const char *reject)
+{
+	int last = ch;
+	const char *buf = lexSource->UnreadBuffer();
+	if ( ! buf || ch <= 0) {
+		if (ch > 0) {
+			do {
+				last = ch;
+				wind();
+			} while (ch > 0 && ! strchr(reject, ch));
+		}
+		return last;
+	}
+
+	size_t cch = strcspn(buf, reject);
+	if (accumulating) {
+		lexBuffer += ch;
+		lexBuffer.append(buf, cch);
+	}
+	if (cch) {
+		last = (unsigned char)buf[cch-1];
+		lexSource->SkipCharacters((int)cch);
+	}
+	ch = lexSource->ReadCharacter();
+	return last;
+}
+
 			
 Lexer::TokenType Lexer::
 ConsumeToken (TokenValue *lvalp)
@@ -209,15 +277,15 @@ PeekToken (TokenValue *lvalp)
 	// consume white space
 	while( 1 ) {
 		if( isspace( ch ) ) {
-			wind( );
+			windSpan( whitespace_chars );
 			continue;
 		} else if( ch == '/' ) {
 			mark( );
 			wind( );
 			if( ch == '/' ) {
 				// a c++ style comment
-				while( ch > 0 && ch != '\n' ) {
-					wind( );
+				if( ch > 0 && ch != '\n' ) {
+					windUntil( "\n" );
 				}
 			} else if( ch == '*' ) {
 				// a c style comment
@@ -382,8 +450,8 @@ tokenizeNumber (void)
 		}
 	} else if( isdigit( och ) ) {
 		// decimal or real; get digits
-		while( isdigit( ch ) ) {
-			wind( );
+		if( isdigit( ch ) ) {
+			windSpan( digit_chars );
 		}
 		numberType = ( ch=='.' || tolower( ch )=='e' ) ? REAL : INTEGER;
 	} 
@@ -394,9 +462,7 @@ tokenizeNumber (void)
 		if( isdigit( ch ) ) {
 			// real; get digits after decimal point
 			numberType = REAL;
-			while( isdigit( ch ) ) {
-				wind( );
-			}
+			windSpan( digit_chars );
 		} else {
 			if( numberType != NONE ) {
 				// initially like a number, but no digit following the '.'
@@ -493,22 +559,15 @@ int Lexer::
 tokenizeAlphaHead (void)
 {
 	mark( );
-	while (isalpha (ch)) {
-		wind ();
-		// in Visual Studio 2017 x64 isalpha returns 258 when ch==EOF
-		// which could make this an infinite loop if we don't test for EOF explicitly here.
-		if (ch == EOF) break;
+	// in Visual Studio 2017 x64 isalpha returns 258 when ch==EOF
+	// so test for EOF explicitly here.
+	if (ch != EOF && isalpha (ch)) {
+		windSpan (alpha_chars);
 	}
 
 	if (isdigit (ch) || ch == '_') {
 		// The token is an identifier; consume the rest of the token
-		wind ();
-		while (isalnum (ch) || ch == '_') {
-			wind ();
-			// in Visual Studio 2017 x64 isalpha returns 258 when ch==EOF
-			// which could make this an infinite loop if we don't test for EOF explicitly here.
-			if (ch == EOF) break;
-		}
+		windSpan (identifier_chars);
 		cut ();
 
 		tokenType = LEX_IDENTIFIER;
@@ -561,11 +620,18 @@ tokenizeString(char delim)
 	wind ();
 	mark ();
 	
+	const char stop_chars[] = { delim, '\\', 0 };
 	while (!stringComplete) {
 		bool oddBackWhacks = false;
 		int oldCh = 0;
 		// consume the string literal; read upto " ignoring \"
 		while( ( ch > 0 ) && ( ch != delim || ( ch == delim && oldCh == '\\' && oddBackWhacks ) ) ) {
+			if( ch != delim && ch != '\\' ) {
+				// consume up to the next quote or backslash at once
+				oddBackWhacks = false;
+				oldCh = windUntil( stop_chars );
+				continue;
+			}
 			if( !oddBackWhacks && ch == '\\' ) {
 				oddBackWhacks = true;
 			}
@@ -637,12 +703,12 @@ tokenizeStringOld(char delim)
 	wind ();
 	mark ();
 
+	const char stop_chars[] = { delim, 0 };
 	while (!stringComplete) {
 		int oldCh = 0;
 		// consume the string literal; read upto " ignoring \"
-		while( ( ch > 0 ) && ( ch != delim ) ) {
-			oldCh = ch;
-			wind( );
+		if( ( ch > 0 ) && ( ch != delim ) ) {
+			oldCh = windUntil( stop_chars );
 		}
 
 		if( ch == delim ) {
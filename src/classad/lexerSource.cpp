@@ -143,6 +143,21 @@ CharLexerSource::AtEnd(void) const
 	return at_end;
 }
 
+const char *
+CharLexerSource::UnreadBuffer(void) const
+{
+	return _string + _offset;
+}
+
+void
+CharLexerSource::SkipCharacters(int count)
+{
+	if (count > 0) {
+		_offset += count;
+		_previous_character = (unsigned char)_string[_offset-1];
+	}
+}
+
 int 
 CharLexerSource::GetCurrentLocation(void) const
 {
@@ -210,6 +225,21 @@ StringLexerSource::AtEnd(void) const
 	return at_end;
 }
 
+const char *
+StringLexerSource::UnreadBuffer(void) const
+{
+	return _string->c_str() + _offset;
+}
+
+void
+StringLexerSource::SkipCharacters(int count)
+{
+	if (count > 0) {
+		_offset += count;
+		_previous_character = (unsigned char)(*_string)[_offset-1];
+	}
+}
+
 int 
 StringLexerSource::GetCurrentLocation(void) const
 {
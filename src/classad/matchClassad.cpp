@@ -25,6 +25,7 @@
 using namespace std;
 
 static char const *ATTR_UNOPTIMIZED_REQUIREMENTS = "UnoptimizedRequirements";
+static char const *ATTR_UNOPTIMIZED_RANK = "UnoptimizedRank";
 
 namespace classad {
 
@@ -309,29 +310,30 @@ SetRightAlias( const std::string &name )
 }
 
 bool MatchClassAd::
-OptimizeRightAdForMatchmaking( ClassAd *ad, std::string *error_msg, const std::string &left_alias, const std::string &right_alias )
+OptimizeRightAdForMatchmaking( ClassAd *ad, std::string *error_msg, const std::string &left_alias, const std::string &right_alias, bool optimize_rank )
 {
-	return MatchClassAd::OptimizeAdForMatchmaking( ad, true, error_msg, left_alias, right_alias );
+	return MatchClassAd::OptimizeAdForMatchmaking( ad, true, error_msg, left_alias, right_alias, optimize_rank );
 }
 
 bool MatchClassAd::
-OptimizeLeftAdForMatchmaking( ClassAd *ad, std::string *error_msg, const std::string &left_alias, const std::string &right_alias )
+OptimizeLeftAdForMatchmaking( ClassAd *ad, std::string *error_msg, const std::string &left_alias, const std::string &right_alias, bool optimize_rank )
 {
-	return MatchClassAd::OptimizeAdForMatchmaking( ad, false, error_msg, left_alias, right_alias );
+	return MatchClassAd::OptimizeAdForMatchmaking( ad, false, error_msg, left_alias, right_alias, optimize_rank );
 }
 
 bool MatchClassAd::
-OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, const std::string &left_alias, const std::string &right_alias )
+OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, const std::string &left_alias, const std::string &right_alias, bool optimize_rank )
 {
 	if( ad->Lookup("my") ||
 		ad->Lookup("target") ||
 		ad->Lookup("other") ||
 		( !left_alias.empty() && ad->Lookup(left_alias) ) ||
 		( !right_alias.empty() && ad->Lookup(right_alias) ) ||
-		ad->Lookup(ATTR_UNOPTIMIZED_REQUIREMENTS) )
+		ad->Lookup(ATTR_UNOPTIMIZED_REQUIREMENTS) ||
+		( optimize_rank && ad->Lookup(ATTR_UNOPTIMIZED_RANK) ) )
 	{
 		if( error_msg ) {
-			*error_msg = "Optimization of matchmaking requirements failed, because ad already contains one of my, target, other, or UnoptimizedRequirements.";
+			*error_msg = "Optimization of matchmaking requirements failed, because ad already contains one of my, target, other, UnoptimizedRequirements, or UnoptimizedRank.";
 		}
 		return false;
 	}
@@ -377,45 +379,18 @@ OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, co
 	}
 
 
-	ExprTree *flat_requirements = NULL;
-	Value flat_val;
+	bool result = FlattenAttrForMatchmaking( ad, ATTR_REQUIREMENTS, ATTR_UNOPTIMIZED_REQUIREMENTS, error_msg );
 
-	if( ad->FlattenAndInline(requirements,flat_val,flat_requirements) ) {
-		if( !flat_requirements ) {
-				// flattened to a value
-			flat_requirements = Literal::MakeLiteral(flat_val);
-		}
-		if( flat_requirements ) {
-				// save original requirements
-			ExprTree *orig_requirements = ad->Remove(ATTR_REQUIREMENTS);
-			if( orig_requirements ) {
-				if( !ad->Insert(ATTR_UNOPTIMIZED_REQUIREMENTS,orig_requirements) )
-				{
-						// Now we have no requirements.  Very bad!
-					if( error_msg ) {
-						*error_msg = "Failed to rename original requirements.";
-					}
-					delete orig_requirements;
-					delete flat_requirements;
-					return false;
-				}
-			}
-
-				// insert new flattened requirements
-			if( !ad->Insert(ATTR_REQUIREMENTS,flat_requirements) ) {
-				if( error_msg ) {
-					*error_msg = "Failed to insert optimized requirements.";
-				}
-				delete flat_requirements;
-				return false;
-			}
-		}
+		// The rank is evaluated against every candidate just like the
+		// requirements, so it benefits in the same way.  It is optional,
+		// so an ad without one is not an error.
+	if( result && optimize_rank && ad->Lookup(ATTR_RANK) ) {
+		result = FlattenAttrForMatchmaking( ad, ATTR_RANK, ATTR_UNOPTIMIZED_RANK, error_msg );
 	}
 
 		// After flatenning, no references should remain to MY or TARGET.
 		// Even if there are, those can be resolved by the context ads, so
 		// we don't need to leave these attributes in the ad.
-	// TODO The failure cases above should run this cleanup code
 	if ( !_useOldClassAdSemantics ) {
 		ad->Delete("my");
 	}
@@ -428,6 +403,54 @@ OptimizeAdForMatchmaking( ClassAd *ad, bool is_right, std::string *error_msg, co
 		ad->Delete( right_alias );
 	}
 
+	return result;
+}
+
+bool MatchClassAd::
+FlattenAttrForMatchmaking( ClassAd *ad, const char *attr, const char *unoptimized_attr, std::string *error_msg )
+{
+	ExprTree *expr = ad->Lookup(attr);
+	if( !expr ) {
+		if( error_msg ) {
+			*error_msg = std::string("No ") + attr + " found in ad to be optimized.";
+		}
+		return false;
+	}
+
+	ExprTree *flat_expr = NULL;
+	Value flat_val;
+
+	if( ad->FlattenAndInline(expr,flat_val,flat_expr) ) {
+		if( !flat_expr ) {
+				// flattened to a value
+			flat_expr = Literal::MakeLiteral(flat_val);
+		}
+		if( flat_expr ) {
+				// save original expression
+			ExprTree *orig_expr = ad->Remove(attr);
+			if( orig_expr ) {
+				if( !ad->Insert(unoptimized_attr,orig_expr) )
+				{
+						// Now we have no expression.  Very bad!
+					if( error_msg ) {
+						*error_msg = std::string("Failed to rename original ") + attr + ".";
+					}
+					delete orig_expr;
+					delete flat_expr;
+					return false;
+				}
+			}
+
+				// insert new flattened expression
+			if( !ad->Insert(attr,flat_expr) ) {
+				if( error_msg ) {
+					*error_msg = std::string("Failed to insert optimized ") + attr + ".";
+				}
+				delete flat_expr;
+				return false;
+			}
+		}
+	}
 	return true;
 }
 
@@ -440,6 +463,12 @@ UnoptimizeAdForMatchmaking( ClassAd *ad )
 			return false;
 		}
 	}
+	ExprTree *orig_rank = ad->Remove(ATTR_UNOPTIMIZED_RANK);
+	if( orig_rank ) {
+		if( !ad->Insert(ATTR_RANK,orig_rank) ) {
+			return false;
+		}
+	}
 	return true;
 }
 
@@ -307,13 +307,12 @@ Unparse( string &buffer, const ExprTree *tree )
 		}
 		
 		case ExprTree::EXPR_ENVELOPE: {
-#if 0
-			if (this->oldClassAd) {
+			// the cache holds the old ClassAd text that the expression was
+			// parsed from, which putClassAd sends as is, without unparsing
+			// the tree, or even parsing it if it was cached lazily.
+			if (this->unparseCachedText && this->oldClassAd && this->oldClassAdValue) {
 				buffer += ((CachedExprEnvelope*)tree)->get_unparsed_str();
 			} else {
-#else
-			{
-#endif
 				// recurse b/c we indirect for this element.
 				Unparse( buffer, ((CachedExprEnvelope*)tree)->get());
 			}
@@ -555,6 +554,12 @@ GetOldClassAd() const
 	return oldClassAd;
 }
 
+void ClassAdUnParser::
+SetUnparseCachedText( bool cached_text )
+{
+	unparseCachedText = cached_text;
+}
+
 
 // PrettyPrint object implementation
 PrettyPrint::
@@ -23,6 +23,8 @@
 
 #include "classad/classad.h"
 #include "classad/classadCache.h"
+#include "classad/sink.h"
+#include "classad_oldnew.h"
 
 using namespace std;
 using namespace classad;
@@ -150,6 +152,152 @@ bool adsource::get_line(std::string & buffer)
 	return true;
 }
 
+// Generates job ads the way a job queue log holds them, one attribute
+// per line, with the values condor_submit typically sets.  Most of them
+// are simple literals, the rest are expressions.
+class jobsource {
+public:
+	jobsource(int num_jobs) : ix(0), cluster(1000), proc(0), jobs(num_jobs) { now = time(NULL); }
+	bool eof() const { return jobs <= 0; }
+	bool get_line(std::string & buffer);
+	int urand() { int r = rand(); return r < 0 ? -r : r; }
+protected:
+	time_t now;
+	int    ix;
+	int    cluster;
+	int    proc;
+	int    jobs;
+	char kvpbuf[512];
+};
+
+bool jobsource::get_line(std::string & buffer)
+{
+	static const char * const users[] = { "alice", "bob", "james", "sally", "chen", "smyth", "avacado", "dezi", "smoller", "ladyluck", "porter" };
+	static const char * const job_attrs[] = {
+		"AutoClusterAttrs", "\"JobUniverse,LastCheckpointPlatform,NumCkpts,MachineLastMatchTime,RequestCpus,RequestDisk,RequestMemory\"",
+		"BufferBlockSize", "32768",
+		"BufferSize", "524288",
+		"CommittedSlotTime", "0",
+		"CommittedSuspensionTime", "0",
+		"CommittedTime", "0",
+		"CompletionDate", "0",
+		"CoreSize", "0",
+		"CumulativeSlotTime", "0",
+		"CumulativeSuspensionTime", "0",
+		"CurrentHosts", "0",
+		"DiskUsage", "?disk",
+		"EncryptExecuteDirectory", "false",
+		"EnteredCurrentStatus", "?now",
+		"Environment", "\"\"",
+		"Err", "?err",
+		"ExecutableSize", "?disk",
+		"ExitBySignal", "false",
+		"ExitStatus", "0",
+		"GlobalJobId", "?gjid",
+		"ImageSize", "?disk",
+		"In", "\"/dev/null\"",
+		"Iwd", "?iwd",
+		"JobLeaseDuration", "2400",
+		"JobNotification", "0",
+		"JobPrio", "0",
+		"JobStatus", "1",
+		"JobUniverse", "5",
+		"KillSig", "\"SIGTERM\"",
+		"LeaveJobInQueue", "false",
+		"MaxHosts", "1",
+		"MinHosts", "1",
+		"MyType", "\"Job\"",
+		"NiceUser", "false",
+		"NumCkpts", "0",
+		"NumJobCompletions", "0",
+		"NumJobStarts", "0",
+		"NumRestarts", "0",
+		"NumSystemHolds", "0",
+		"OnExitHold", "false",
+		"OnExitRemove", "true",
+		"Out", "?out",
+		"Owner", "?owner",
+		"PeriodicHold", "false",
+		"PeriodicRelease", "false",
+		"PeriodicRemove", "false",
+		"QDate", "?now",
+		"Rank", "0.0",
+		"ReleaseReason", "undefined",
+		"RemoteSysCpu", "0.0",
+		"RemoteUserCpu", "0.0",
+		"RemoteWallClockTime", "0.0",
+		"RequestCpus", "1",
+		"RequestDisk", "DiskUsage",
+		"RequestMemory", "ifthenelse(MemoryUsage =!= undefined,MemoryUsage,(ImageSize + 1023) / 1024)",
+		"Requirements", "(TARGET.Arch == \"X86_64\") && (TARGET.OpSys == \"LINUX\") && (TARGET.Disk >= RequestDisk) && (TARGET.Memory >= RequestMemory) && (TARGET.HasFileTransfer)",
+		"RootDir", "\"/\"",
+		"ShouldTransferFiles", "\"IF_NEEDED\"",
+		"StreamErr", "false",
+		"StreamOut", "false",
+		"TargetType", "\"Machine\"",
+		"TotalSuspensions", "0",
+		"TransferIn", "false",
+		"User", "?user",
+		"UserLog", "?log",
+		"WantCheckpoint", "false",
+		"WantRemoteIO", "true",
+		"WantRemoteSyscalls", "false",
+		"WhenToTransferOutput", "\"ON_EXIT\"",
+		"Args", "?args",
+		"Cmd", "?cmd",
+		"ClusterId", "?cluster",
+		"ProcId", "?proc",
+	};
+
+	buffer.clear();
+	if (eof()) return false;
+	if (ix >= NUMELMS(job_attrs)) {
+		// end of this job, every 100 jobs start a new cluster.
+		ix = 0;
+		--jobs;
+		if (++proc >= 100) { proc = 0; cluster += 1 + urand() % 10; }
+		return true;
+	}
+
+	buffer += job_attrs[ix++];
+	const char * p = job_attrs[ix++];
+	const char * user = users[cluster % NUMELMS(users)];
+	if (*p == '?') { // values that differ from job to job
+		if (strcmp(p, "?args") == 0) {
+			sprintf(kvpbuf, "\"-i input.%d.%d -n %d\"", cluster, proc, urand() % 1000);
+		} else if (strcmp(p, "?cluster") == 0) {
+			sprintf(kvpbuf, "%d", cluster);
+		} else if (strcmp(p, "?cmd") == 0) {
+			sprintf(kvpbuf, "\"/home/%s/bin/analyze\"", user);
+		} else if (strcmp(p, "?disk") == 0) {
+			sprintf(kvpbuf, "%d", 1 + urand() % 100000);
+		} else if (strcmp(p, "?err") == 0) {
+			sprintf(kvpbuf, "\"job.%d.%d.err\"", cluster, proc);
+		} else if (strcmp(p, "?gjid") == 0) {
+			sprintf(kvpbuf, "\"submit-1.chtc.wisc.edu#%d.%d#%lld\"", cluster, proc, (long long)now);
+		} else if (strcmp(p, "?iwd") == 0) {
+			sprintf(kvpbuf, "\"/home/%s/run%d\"", user, cluster);
+		} else if (strcmp(p, "?log") == 0) {
+			sprintf(kvpbuf, "\"/home/%s/run%d/job.log\"", user, cluster);
+		} else if (strcmp(p, "?now") == 0) {
+			sprintf(kvpbuf, "%lld", (long long)now);
+		} else if (strcmp(p, "?out") == 0) {
+			sprintf(kvpbuf, "\"job.%d.%d.out\"", cluster, proc);
+		} else if (strcmp(p, "?owner") == 0) {
+			sprintf(kvpbuf, "\"%s\"", user);
+		} else if (strcmp(p, "?proc") == 0) {
+			sprintf(kvpbuf, "%d", proc);
+		} else if (strcmp(p, "?user") == 0) {
+			sprintf(kvpbuf, "\"%s@submit.chtc.wisc.edu\"", user);
+		}
+		p = kvpbuf;
+	}
+
+	buffer += " = ";
+	buffer += p;
+	return true;
+}
+
 #ifdef WIN32
 #include <psapi.h>
 static int get_image_size()
@@ -275,20 +423,25 @@ static int get_image_size()
 #endif
 
 // --------------------------------------------------------------------
-int parse_ads(bool with_cache, bool verbose=false, bool lazy=false)
+// with num_jobs > 0, parse job ads as the schedd does when it reads its job
+// queue log, instead of machine ads as the collector does.  literals inserts
+// simple literals directly rather than through the parser or the cache.
+int parse_ads(bool with_cache, bool verbose=false, bool lazy=false, int num_jobs=0, bool literals=false)
 {
 	int barf_counter = 0;
 	int rval = 0;
 
 	int before_size = get_image_size();
 
-	const char * mode = "no-cache";
+	std::string mode = "no-cache";
 	if (with_cache) {
 		mode = lazy ? "lazy-cache" : "cache";
 		ClassAdSetExpressionCaching(true); 
 	} else {
 		ClassAdSetExpressionCaching(false); 
 	}
+	if (literals) { mode += "-literals"; }
+	if (num_jobs > 0) { mode = "jobs " + mode; }
 
 	vector< classad_shared_ptr<ClassAd> > ads;
 	vector<string> inputData;
@@ -296,14 +449,20 @@ int parse_ads(bool with_cache, bool verbose=false, bool lazy=false)
 
 	srand(42);
 	adsource infile;
+	jobsource jobs(num_jobs);
 
 	string szInput, name, szValue;
 	szInput.reserve(longest_kvp);
+	size_t cbInput = 0;
 	clock_t Start = clock();
 
-	while ( !infile.fail() && !infile.eof() )
+	while (num_jobs > 0 ? !jobs.eof() : (!infile.fail() && !infile.eof()))
 	{
-		infile.get_line(szInput);
+		if (num_jobs > 0) {
+			jobs.get_line(szInput);
+		} else {
+			infile.get_line(szInput);
+		}
 		if (verbose) { fprintf(stdout, "%s\n", szInput.c_str()); }
 
 		// This is the end of an add.
@@ -327,7 +486,11 @@ int parse_ads(bool with_cache, bool verbose=false, bool lazy=false)
 		szValue = szInput.substr(vpos);
 
 		name = szInput.substr(bpos, npos - bpos);
-		if ( ! pAd->InsertViaCache(name, szValue, lazy) )
+		cbInput += szInput.size();
+			// insert simple literals as the schedd does for the values it
+			// reads from the job queue log
+		if ( ! (literals && InsertSimpleLiteral(*pAd, name, szValue.c_str(), szValue.size() + 1)) &&
+			! pAd->InsertViaCache(name, szValue, lazy) )
 		{
 			++barf_counter;
 			fprintf(stdout, "BARFED ON: %s\n", szInput.c_str());
@@ -340,10 +503,33 @@ int parse_ads(bool with_cache, bool verbose=false, bool lazy=false)
 	}
 
 	clock_t endTime = clock();
-	fprintf (stdout, "%s Parse Time: %.6f\n", mode, (1.0*(endTime - Start))/CLOCKS_PER_SEC );
+	double parseTime = (1.0*(endTime - Start))/CLOCKS_PER_SEC;
+	fprintf (stdout, "%s Parse Time: %.6f (%lu bytes, %.1f MB/s)\n", mode.c_str(), parseTime, (unsigned long)cbInput,
+		parseTime > 0 ? cbInput / parseTime / (1024*1024) : 0.0 );
 
 	int after_size = get_image_size();
-	fprintf(stdout, "%s Parse Mem (Kb): %d (%d - %d)\n", mode, after_size - before_size, after_size, before_size);
+	fprintf(stdout, "%s Parse Mem (Kb): %d (%d - %d)\n", mode.c_str(), after_size - before_size, after_size, before_size);
+	fprintf(stdout, "%s Mem per ad (bytes): %.0f (%d ads)\n", mode.c_str(),
+		ads.empty() ? 0.0 : (after_size - before_size) * 1024.0 / ads.size(), (int)ads.size());
+
+	// unparse every attribute the way putClassAd does, to measure the cost
+	// of sending the ads as well as of receiving them.
+	classad::ClassAdUnParser unparser;
+	unparser.SetOldClassAd(true, true);
+	unparser.SetUnparseCachedText(true);
+	string szOutput;
+	size_t cbOutput = 0;
+	clock_t unparseBegin = clock();
+	for (size_t ix = 0; ix < ads.size(); ++ix) {
+		for (ClassAd::const_iterator it = ads[ix]->begin(); it != ads[ix]->end(); ++it) {
+			szOutput = it->first;
+			szOutput += " = ";
+			unparser.Unparse(szOutput, it->second);
+			cbOutput += szOutput.size();
+		}
+	}
+	clock_t unparseEnd = clock();
+	fprintf (stdout, "%s Unparse Time: %.6f (%lu bytes)\n", mode.c_str(), (1.0*(unparseEnd - unparseBegin))/CLOCKS_PER_SEC, (unsigned long)cbOutput );
 
 	// enable this to look at the cache contents and debug data
 #ifdef TJ_NEWCACHE
@@ -355,9 +541,9 @@ int parse_ads(bool with_cache, bool verbose=false, bool lazy=false)
 	ads.clear();
 	clock_t delEnd = clock();
 
-	fprintf (stdout, "%s Delete Time: %.6f\n", mode, (1.0*(delEnd - delBegin))/CLOCKS_PER_SEC );
+	fprintf (stdout, "%s Delete Time: %.6f\n", mode.c_str(), (1.0*(delEnd - delBegin))/CLOCKS_PER_SEC );
 	int final_size = get_image_size();
-	fprintf(stdout, "%s After Delete Mem (Kb): %d (%d - %d)\n", mode, final_size - before_size, after_size, before_size);
+	fprintf(stdout, "%s After Delete Mem (Kb): %d (%d - %d)\n", mode.c_str(), final_size - before_size, after_size, before_size);
 
 	return rval;
 }
@@ -367,6 +553,8 @@ int main(int argc, const char ** argv)
 	bool with_cache = false;
 	bool verbose = false;
 	bool lazy = false;
+	bool literals = false;
+	int num_jobs = 0;
 	bool generate_ads_only = false;
 	for (int ii = 0; ii < argc; ++ii) {
 		if (strcmp(argv[ii],"-cache") == 0) {
@@ -375,6 +563,11 @@ int main(int argc, const char ** argv)
 			with_cache = false;
 		} else if (strcmp(argv[ii],"-lazy") == 0) {
 			lazy = true;
+		} else if (strcmp(argv[ii],"-literals") == 0) {
+			literals = true;
+		} else if (strcmp(argv[ii],"-jobs") == 0) {
+			num_jobs = 10000;
+			if (ii+1 < argc && argv[ii+1][0] != '-') { num_jobs = atoi(argv[++ii]); }
 		} else if (strcmp(argv[ii], "-v") == 0) {
 			verbose = true;
 		} else if (strcmp(argv[ii], "-g") == 0) {
@@ -397,5 +590,5 @@ int main(int argc, const char ** argv)
 		return 0;
 	}
 
-	return parse_ads(with_cache, verbose, lazy);
+	return parse_ads(with_cache, verbose, lazy, num_jobs, literals);
 }
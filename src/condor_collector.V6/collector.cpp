@@ -112,6 +112,7 @@ int CollectorDaemon::max_query_workers = 4;
 int CollectorDaemon::reserved_for_highprio_query_workers = 1;
 int CollectorDaemon::max_pending_query_workers = 50;
 int CollectorDaemon::max_query_worktime = 0;
+bool CollectorDaemon::want_nonblocking_queries = false;
 int CollectorDaemon::active_query_workers = 0;
 int CollectorDaemon::pending_query_workers = 0;
 
@@ -608,7 +609,11 @@ int CollectorDaemon::receive_query_cedar(int command,
 		// We want to immediately handle the query inline in this process.
 		// So in this case, we simply directly invoke our worker thread function.
 		dprintf(D_FULLDEBUG,"QueryWorker: about to handle query in-process\n");
-		return_status = receive_query_cedar_worker_thread((void *)query_entry,sock);
+		if (want_nonblocking_queries) {
+			return_status = receive_query_cedar_nonblocking((void *)query_entry,sock);
+		} else {
+			return_status = receive_query_cedar_worker_thread((void *)query_entry,sock);
+		}
 	} else {
 		// Enqueue the query to ultimately run in a forked process created created with
 		// DaemonCore::Create_Thread().  
@@ -846,29 +851,13 @@ int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Str
 	double begin = condor_gettimestamp_double();
 	List<ClassAd> results;
 
-		// If our peer is at least 8.9.3 and has NEGOTIATOR authz, then we'll
-		// trust it to handle our capabilities.
-	bool filter_private_ads = true;
-	auto *verinfo = sock->get_peer_version();
-	if (verinfo && verinfo->built_since_version(8, 9, 3)) {
-		auto addr = static_cast<ReliSock*>(sock)->peer_addr();
-			// Given failure here is non-fatal, do not log at D_ALWAYS.
-		if (static_cast<Sock*>(sock)->isAuthorizationInBoundingSet("NEGOTIATOR") &&
-			(USER_AUTH_SUCCESS == daemonCore->Verify("send private ads", NEGOTIATOR, addr, static_cast<ReliSock*>(sock)->getFullyQualifiedUser(), D_SECURITY|D_FULLDEBUG))) {
-			filter_private_ads = false;
-		}
-	}
-
 	// Pull out relavent state from query_entry
 	pending_query_entry_t *query_entry = (pending_query_entry_t *) in_query_entry;
 	ClassAd *cad = query_entry->cad;
 	bool is_locate = query_entry->is_locate;
 	AdTypes whichAds = query_entry->whichAds;
 
-		// Always send private attributes in private ads.
-	if (whichAds == STARTD_PVT_AD) {
-		filter_private_ads = false;
-	}
+	bool filter_private_ads = query_filters_private_ads(sock, whichAds);
 
 	// Perform the query
 
@@ -911,17 +900,8 @@ int CollectorDaemon::receive_query_cedar_worker_thread(void *in_query_entry, Str
 		// our persistent collector ad.
 		ClassAd * stats_ad = NULL;
 		if ((whichAds == COLLECTOR_AD) && collector.isSelfAd(curr_ad)) {
-			dprintf(D_ALWAYS,"Query includes collector's self ad\n");
-			// update stats in the collector ad before we return it.
-			std::string stats_config;
-			cad->LookupString("STATISTICS_TO_PUBLISH",stats_config);
-			if (stats_config != "stored") {
-				dprintf(D_ALWAYS,"Updating collector stats using a chained ad and config=%s\n", stats_config.c_str());
-				stats_ad = new ClassAd();
-				daemonCore->dc_stats.Publish(*stats_ad, stats_config.c_str());
-				daemonCore->monitor_data.ExportData(stats_ad, true);
-				collectorStats.publishGlobal(stats_ad, stats_config.c_str());
-				stats_ad->ChainToAd(curr_ad);
+			stats_ad = make_self_stats_ad(cad, curr_ad);
+			if (stats_ad) {
 				curr_ad = stats_ad; // send the stats ad instead of the self ad.
 			}
 		}
@@ -997,6 +977,358 @@ END:
 	return return_status;
 }
 
+// If our peer is at least 8.9.3 and has NEGOTIATOR authz, then we'll
+// trust it to handle our capabilities.
+bool CollectorDaemon::query_filters_private_ads(Stream *sock, AdTypes whichAds)
+{
+		// Always send private attributes in private ads.
+	if (whichAds == STARTD_PVT_AD) {
+		return false;
+	}
+
+	auto *verinfo = sock->get_peer_version();
+	if (verinfo && verinfo->built_since_version(8, 9, 3)) {
+		auto addr = static_cast<ReliSock*>(sock)->peer_addr();
+			// Given failure here is non-fatal, do not log at D_ALWAYS.
+		if (static_cast<Sock*>(sock)->isAuthorizationInBoundingSet("NEGOTIATOR") &&
+			(USER_AUTH_SUCCESS == daemonCore->Verify("send private ads", NEGOTIATOR, addr, static_cast<ReliSock*>(sock)->getFullyQualifiedUser(), D_SECURITY|D_FULLDEBUG))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// if querying collector ads, and the collectors own ad appears in the results,
+// then we want to shove in current statistics. we do this by chaining a
+// temporary stats ad into the ad to be returned, and publishing updated
+// statistics into the stats ad.  we do this because if the verbosity level
+// is increased we do NOT want to put the high-verbosity attributes into
+// our persistent collector ad.  Returns NULL if the query wants the stored
+// statistics; otherwise the caller must Unchain() and delete the stats ad.
+ClassAd *CollectorDaemon::make_self_stats_ad(ClassAd *query, ClassAd *self_ad)
+{
+	dprintf(D_ALWAYS,"Query includes collector's self ad\n");
+	// update stats in the collector ad before we return it.
+	std::string stats_config;
+	query->LookupString("STATISTICS_TO_PUBLISH",stats_config);
+	if (stats_config == "stored") {
+		return NULL;
+	}
+	dprintf(D_ALWAYS,"Updating collector stats using a chained ad and config=%s\n", stats_config.c_str());
+	ClassAd *stats_ad = new ClassAd();
+	daemonCore->dc_stats.Publish(*stats_ad, stats_config.c_str());
+	daemonCore->monitor_data.ExportData(stats_ad, true);
+	update_udp_drop_stats();
+	collectorStats.publishGlobal(stats_ad, stats_config.c_str());
+	stats_ad->ChainToAd(self_ad);
+	return stats_ad;
+}
+
+// Make a copy of a query result holding what putClassAd() would send of it
+// with the given projection, so the copy can be sent later without one.
+static ClassAd *
+copy_query_result(const ClassAd *ad, const classad::References &proj)
+{
+	ClassAd *copy = new ClassAd();
+	if (proj.empty()) {
+		const classad::ClassAd *parent = ad->GetChainedParentAd();
+		if (parent) {
+			copy->Update(*parent);
+		}
+		copy->Update(*ad);
+		return copy;
+	}
+
+		// putClassAd() also sends the attributes the projected ones refer to
+	classad::References attrs;
+	for (classad::References::const_iterator attr = proj.begin(); attr != proj.end(); ++attr) {
+		ExprTree *tree = ad->Lookup(*attr);
+		if (tree) {
+			attrs.insert(*attr);
+			if (tree->GetKind() != ExprTree::LITERAL_NODE) {
+				ad->GetInternalReferences(tree, attrs, false);
+			}
+		}
+	}
+	for (classad::References::const_iterator attr = attrs.begin(); attr != attrs.end(); ++attr) {
+		ExprTree *tree = ad->Lookup(*attr);
+		if (tree) {
+			copy->Insert(*attr, tree->Copy());
+		}
+	}
+	return copy;
+}
+
+// Sends the results of a query handled in-process without blocking the
+// collector on a slow client, in the way the schedd answers condor_q.
+// Ads are sent straight from the collector's tables until the socket
+// would block.  The ads not yet sent are then copied, so that the client
+// still gets the ads as they were when it asked, and the copies are sent
+// as the socket drains.
+struct CollectorDaemon::QueryContinuation : public Service {
+
+	std::deque<ClassAd *> ads;	// copies of the results not yet sent
+	bool filter_private_ads;
+	bool unfinished_eom;
+
+		// for the Query info line logged when we are done
+	double begin;
+	double end_query;
+	int matched;
+	int skipped;
+	int limit;
+	bool is_locate;
+	std::string type;
+	std::string requirements;
+	std::string subsys;
+	std::string projection;
+
+	QueryContinuation() :
+		filter_private_ads(true), unfinished_eom(false),
+		begin(0.0), end_query(0.0), matched(0), skipped(0), limit(0), is_locate(false)
+	{}
+	~QueryContinuation() {
+		for (std::deque<ClassAd *>::iterator it = ads.begin(); it != ads.end(); ++it) {
+			delete *it;
+		}
+	}
+
+		// send one more ad of the response; returns 0 on failure, 2 if
+		// the socket now has a backlog, and 1 otherwise.
+	int put(ReliSock *sock, ClassAd &ad, const classad::References *proj);
+		// send the end of the response; returns as put() does.
+	int put_end(ReliSock *sock);
+	int finish(Stream *sock);
+	void log_query_info(Stream *sock) const;
+};
+
+int
+CollectorDaemon::QueryContinuation::put(ReliSock *sock, ClassAd &ad, const classad::References *proj)
+{
+	BlockingModeGuard guard(sock, true);
+	int more = 1;
+	if (!sock->code(more)) {
+		return 0;
+	}
+	int retval = putClassAd(sock, ad,
+		PUT_CLASSAD_NON_BLOCKING | (filter_private_ads ? PUT_CLASSAD_NO_PRIVATE : 0),
+		(proj && !proj->empty()) ? proj : NULL);
+	if (retval && sock->clear_backlog_flag()) {
+		retval = 2;
+	}
+	return retval;
+}
+
+int
+CollectorDaemon::QueryContinuation::put_end(ReliSock *sock)
+{
+	{
+		BlockingModeGuard guard(sock, true);
+		int more = 0;
+		if (!sock->code(more)) {
+			dprintf (D_ALWAYS, "Error sending EndOfResponse (0) to client\n");
+			return 0;
+		}
+	}
+	int retval = sock->end_of_message_nonblocking();
+	if (sock->clear_backlog_flag()) {
+		return 2;
+	}
+	if (!retval) {
+		dprintf (D_ALWAYS, "Error flushing CEDAR socket\n");
+	}
+	return retval ? 1 : 0;
+}
+
+int
+CollectorDaemon::QueryContinuation::finish(Stream *stream)
+{
+	ReliSock *sock = static_cast<ReliSock*>(stream);
+
+	if (sock->deadline_expired()) {
+		dprintf( D_ALWAYS,
+			"QueryWorker: max_worktime expired while sending query result to client -- aborting\n");
+		delete this;
+		return FALSE;
+	}
+	if (max_query_worktime <= 0) {
+			// without a limit on the whole query, give up only on a
+			// client that takes no more for QueryTimeout seconds.
+		sock->set_deadline_timeout(QueryTimeout);
+	}
+
+	if (unfinished_eom) {
+		int retval = sock->finish_end_of_message();
+		if (sock->clear_backlog_flag()) {
+			return KEEP_STREAM;
+		}
+		if (!retval) {
+			dprintf (D_ALWAYS, "Error flushing CEDAR socket\n");
+		}
+		log_query_info(sock);
+		delete this;
+		return retval ? TRUE : FALSE;
+	}
+
+	while ( ! ads.empty()) {
+		ClassAd *ad = ads.front();
+		ads.pop_front();
+		int retval = put(sock, *ad, NULL);
+		delete ad;
+		if (!retval) {
+			dprintf (D_ALWAYS, "Error sending query result to client -- aborting\n");
+			delete this;
+			return FALSE;
+		}
+		if (retval == 2) {
+			return KEEP_STREAM;
+		}
+	}
+
+	switch (put_end(sock)) {
+	case 2:
+		unfinished_eom = true;
+		return KEEP_STREAM;
+	case 1:
+		log_query_info(sock);
+		delete this;
+		return TRUE;
+	default:
+		delete this;
+		return FALSE;
+	}
+}
+
+void
+CollectorDaemon::QueryContinuation::log_query_info(Stream *sock) const
+{
+	dprintf (D_ALWAYS,
+			 "Query info: matched=%d; skipped=%d; query_time=%f; send_time=%f; type=%s; requirements={%s}; locate=%d; limit=%d; from=%s; peer=%s; projection={%s}; filter_private_ads=%d\n",
+			 matched,
+			 skipped,
+			 end_query - begin,
+			 condor_gettimestamp_double() - end_query,
+			 type.c_str(),
+			 requirements.c_str(),
+			 is_locate,
+			 limit,
+			 subsys.c_str(),
+			 sock->peer_description(),
+			 projection.c_str(),
+			 filter_private_ads);
+}
+
+// Handle a query in-process, as receive_query_cedar_worker_thread() does,
+// but return to DaemonCore whenever the client is not ready for more.
+int CollectorDaemon::receive_query_cedar_nonblocking(void *in_query_entry, Stream* sock)
+{
+	pending_query_entry_t *query_entry = (pending_query_entry_t *) in_query_entry;
+	ClassAd *cad = query_entry->cad;
+	AdTypes whichAds = query_entry->whichAds;
+	ReliSock *rsock = static_cast<ReliSock*>(sock);
+	List<ClassAd> results;
+
+	QueryContinuation *qc = new QueryContinuation();
+	qc->begin = condor_gettimestamp_double();
+	qc->filter_private_ads = query_filters_private_ads(sock, whichAds);
+
+	if (whichAds != (AdTypes) -1) {
+		process_query_public (whichAds, cad, &results);
+	}
+
+	qc->end_query = condor_gettimestamp_double();
+	qc->matched = __numAds__;
+	qc->skipped = __failed__;
+	qc->limit = (__resultLimit__ == INT_MAX) ? 0 : __resultLimit__;
+	qc->is_locate = query_entry->is_locate;
+	qc->type = AdTypeToString(whichAds);
+	qc->requirements = ExprTreeToString(__filter__);
+	qc->subsys = query_entry->subsys;
+
+	sock->timeout(QueryTimeout);
+	sock->encode();
+	if (max_query_worktime <= 0) {
+		sock->set_deadline_timeout(QueryTimeout);
+	}
+
+		// See if query ad asks for server-side projection
+	classad::References proj;
+	bool evaluate_projection = false;
+	if (cad->LookupString(ATTR_PROJECTION, qc->projection) && ! qc->projection.empty()) {
+		StringTokenIterator list(qc->projection);
+		const std::string * attr;
+		while ((attr = list.next_string())) { proj.insert(*attr); }
+	} else if (cad->Lookup(ATTR_PROJECTION)) {
+		// if projection is not a simple string, then assume that evaluating it as a string in the context of the ad will work better
+		// (the negotiator sends this sort of projection)
+		evaluate_projection = true;
+	}
+
+	bool has_backlog = false;
+	ClassAd *curr_ad = NULL;
+	results.Rewind();
+	while ( (curr_ad=results.Next()) )
+	{
+		ClassAd * stats_ad = NULL;
+		if ((whichAds == COLLECTOR_AD) && collector.isSelfAd(curr_ad)) {
+			stats_ad = make_self_stats_ad(cad, curr_ad);
+			if (stats_ad) {
+				curr_ad = stats_ad;
+			}
+		}
+
+		if (evaluate_projection) {
+			proj.clear();
+			qc->projection.clear();
+			if (EvalString(ATTR_PROJECTION, cad, curr_ad, qc->projection) && ! qc->projection.empty()) {
+				StringTokenIterator list(qc->projection);
+				const std::string * attr;
+				while ((attr = list.next_string())) { proj.insert(*attr); }
+			}
+		}
+
+		int retval = 1;
+		if (has_backlog) {
+				// the rest goes out once the client has caught up
+			qc->ads.push_back(copy_query_result(curr_ad, proj));
+		} else {
+			retval = qc->put(rsock, *curr_ad, &proj);
+			has_backlog = (retval == 2);
+		}
+
+		if (stats_ad) {
+			stats_ad->Unchain();
+			delete stats_ad;
+		}
+
+		if (!retval) {
+			dprintf (D_ALWAYS, "Error sending query result to client -- aborting\n");
+			delete qc;
+			return FALSE;
+		}
+	}
+
+	if (!has_backlog) {
+			// all of the results are on their way; finish() deletes qc
+			// unless the end of the response is still waiting on the client.
+		int retval = qc->finish(sock);
+		if (retval != KEEP_STREAM) {
+			return retval;
+		}
+	}
+
+	dprintf(D_FULLDEBUG, "QueryWorker: client is slow; %d query results left to send\n", (int)qc->ads.size());
+	int retval = daemonCore->Register_Socket(sock, "Client Response",
+		(SocketHandlercpp)&CollectorDaemon::QueryContinuation::finish,
+		"Collector Query Continuation", qc, ALLOW, HANDLE_WRITE);
+	if (retval < 0) {
+		dprintf(D_ALWAYS, "QueryWorker: failed to register socket to send query results\n");
+		delete qc;
+		return FALSE;
+	}
+	return KEEP_STREAM;
+}
+
 AdTypes
 CollectorDaemon::receive_query_public( int command )
 {
@@ -1289,6 +1621,9 @@ int CollectorDaemon::receive_update(int command, Stream* sock)
 	CollectorPluginManager::Update(command, *cad);
 #endif
 
+	/* the plug-ins may have changed indexed attributes */
+	collector.reindexAd( cad );
+
 #ifdef PROFILE_RECEIVE_UPDATE
 	CollectorEngine_ru_plugins_runtime += rt.tick(rt_last);
 #endif
@@ -1328,6 +1663,7 @@ int CollectorDaemon::receive_update_expect_ack(int command,
     ClassAd     *updateAd = new ClassAd;
     const int   timeout = 5;
     int         ok      = 1;
+	_condor_auto_accum_runtime<collector_runtime_probe> rt(CollectorEngine_receive_update_runtime);
     
     socket->decode ();
 
@@ -1336,7 +1672,10 @@ int CollectorDaemon::receive_update_expect_ack(int command,
 		// is ready to read.
 	socket->timeout(1);
 
-    if ( !getClassAd ( socket, *updateAd ) ) {
+	bool ep = CondorThreads::enable_parallel(true);
+	bool got_ad = getClassAd ( socket, *updateAd );
+	CondorThreads::enable_parallel(ep);
+    if ( !got_ad ) {
 
         dprintf ( 
             D_ALWAYS,
@@ -1429,6 +1768,11 @@ int CollectorDaemon::receive_update_expect_ack(int command,
     CollectorPluginManager::Update ( command, *cad );
 #endif
 
+	/* the plug-ins may have changed indexed attributes */
+	if(cad) {
+		collector.reindexAd( cad );
+	}
+
 	if (viewCollectorTypes || UPDATE_STARTD_AD_WITH_ACK == command) {
 		forward_classad_to_view_collector(command,
 										  ATTR_MY_TYPE,
@@ -1576,7 +1920,7 @@ void CollectorDaemon::process_query_public (AdTypes whichAds,
 		}
 	}
 
-	if (!collector.walkHashTable (whichAds, query_scanFunc))
+	if (!collector.walkHashTable (whichAds, __filter__, query_scanFunc))
 	{
 		dprintf (D_ALWAYS, "Error sending query response\n");
 	}
@@ -1617,6 +1961,7 @@ int CollectorDaemon::setAttrLastHeardFrom (ClassAd* cad, unsigned long time)
 		 result.IsBooleanValueEquiv(val) && val ) {
 
 		cad->Assign( ATTR_LAST_HEARD_FROM, time );
+		collector.reindexAd( cad );
         __numAds__++;
     }
 
@@ -1848,6 +2193,9 @@ void CollectorDaemon::Config()
 	if (opts.empty()) { opts = "none "; }
 	dprintf(D_ALWAYS, "COLLECTOR_GETAD_OPTIONS set to %s(0x%x)\n", opts.c_str(), collector.m_get_ad_options);
 
+	auto_free_ptr index_attrs(param("COLLECTOR_QUERY_INDEXES"));
+	collector.setQueryIndexes(index_attrs);
+
 	tmp = param(COLLECTOR_REQUIREMENTS);
 	std::string collector_req_err;
 	if( !collector.setCollectorRequirements( tmp, collector_req_err ) ) {
@@ -1955,6 +2303,7 @@ void CollectorDaemon::Config()
     max_query_workers = param_integer ("COLLECTOR_QUERY_WORKERS", 4, 0);
 	max_pending_query_workers = param_integer ("COLLECTOR_QUERY_WORKERS_PENDING", 50, 0);
 	max_query_worktime = param_integer("COLLECTOR_QUERY_MAX_WORKTIME",0,0);
+	want_nonblocking_queries = param_boolean("COLLECTOR_QUERY_NONBLOCKING", false);
 	reserved_for_highprio_query_workers = param_integer("COLLECTOR_QUERY_WORKERS_RESERVE_FOR_HIGH_PRIO",1,0);
 
 	// max_query_workers had better be at least one greater than reserved_for_highprio_query_workers,
@@ -2045,6 +2394,23 @@ void CollectorDaemon::Shutdown()
 	return;
 }
 
+// Count the updates that the kernel dropped because our UDP command socket
+// was full, which means they arrive faster than we handle them.  The kernel
+// counts the drops from when the socket was created.
+void CollectorDaemon::update_udp_drop_stats()
+{
+	static long long udp_drops = 0;
+	int port = daemonCore->InfoCommandPort();
+	long long drops = 0;
+	if (port <= 0 || SafeSock::recvQueueDepth(port, &drops) < 0) {
+		return;
+	}
+	if (drops > udp_drops) {
+		collectorStats.global.DroppedUdpUpdates += (long)(drops - udp_drops);
+	}
+	udp_drops = drops;
+}
+
 void CollectorDaemon::sendCollectorAd()
 {
     // compute submitted jobs information
@@ -2084,6 +2450,7 @@ void CollectorDaemon::sendCollectorAd()
 	ustatsMonthly.publish( ATTR_MAX_JOBS_RUNNING, ad );
 
 	// Collector engine stats, too
+	update_udp_drop_stats();
 	collectorStats.publishGlobal( ad, NULL );
     daemonCore->dc_stats.Publish(*ad);
     daemonCore->monitor_data.ExportData(ad);
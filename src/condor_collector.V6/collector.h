@@ -99,6 +99,7 @@ public:
 	// command handlers
 	static int receive_query_cedar(int, Stream*);
 	static int receive_query_cedar_worker_thread(void *, Stream*);
+	static int receive_query_cedar_nonblocking(void *, Stream*);
 	static AdTypes receive_query_public( int );
 	static int receive_invalidation(int, Stream*);
 	static int receive_update(int, Stream*);
@@ -148,6 +149,8 @@ public:
 	static const int HandleQueryInProcSmallTableOrQuery = 0x0004;
 	static const int HandleQueryInProcAlways = 0xFFFF;
 
+	struct QueryContinuation;
+
 	typedef struct pending_query_entry {
 		ClassAd *cad;
 		Stream *sock;
@@ -163,6 +166,7 @@ public:
 	static int max_query_workers;  // from config file
 	static int max_pending_query_workers;  // from config file
 	static int max_query_worktime;  // from config file
+	static bool want_nonblocking_queries;  // from config file
 	static int reserved_for_highprio_query_workers; // from config file
 	static int active_query_workers;
 	static int pending_query_workers;
@@ -192,6 +196,10 @@ protected:
 	static std::string __adType__;
 	static ExprTree *__filter__;
 
+	static bool query_filters_private_ads(Stream *sock, AdTypes whichAds);
+	static ClassAd *make_self_stats_ad(ClassAd *query, ClassAd *self_ad);
+	static void update_udp_drop_stats();
+
 	static TrackTotals* normalTotals;
 	static int submittorRunningJobs;
 	static int submittorIdleJobs;
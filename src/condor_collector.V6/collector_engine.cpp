@@ -30,6 +30,10 @@ extern "C" void event_mgr (void);
 #include "condor_attributes.h"
 #include "condor_daemon_core.h"
 #include "classad_merge.h"
+#include "condor_threads.h"
+#include "stl_string_utils.h"
+
+#include <cmath>
 
 //-------------------------------------------------------------
 
@@ -72,6 +76,12 @@ CollectorEngine::CollectorEngine (CollectorStats *stats ) :
 	collectorStats = stats;
 	m_collector_requirements = NULL;
 	m_get_ad_options = 0;
+
+		// Start the update sequence from the current time (scaled well
+		// beyond any sustainable update rate), so that the sequence
+		// numbers handed out after a restart are larger than any handed
+		// out by the previous instance of the collector.
+	m_updateSequence = (long long)time(NULL) * 1000000;
 }
 
 
@@ -235,6 +245,7 @@ CollectorEngine::invalidateAds(AdTypes adType, ClassAd &query)
 				dprintf(D_ALWAYS,
 						"\t\t**** Invalidating ad: \"%s\"\n",
 						hkString.c_str());
+				unindexAd(*table, ad);
 				delete ad;
 				count++;
 			}
@@ -310,6 +321,32 @@ walkHashTable (AdTypes adType, int (*scanFunction)(ClassAd *))
 	return 1;
 }
 
+int CollectorEngine::
+walkHashTable (AdTypes adType, classad::ExprTree *constraint, int (*scanFunction)(ClassAd *))
+{
+	CollectorHashTable *table;
+	CollectorEngine::HashFunc func;
+	std::vector<ClassAd*> ads;
+	if ( ! LookupByAdType(adType, table, func) || ! findIndexCandidates(*table, constraint, ads)) {
+		return walkHashTable(adType, scanFunction);
+	}
+
+	// Visit the candidates in table order, as the full walk does, so that
+	// a query that stops early (LimitResults) gets the same ads whether
+	// or not an index was used.  The index still saves evaluating the
+	// constraint against the ads that cannot match.
+	std::unordered_set<ClassAd*> candidates(ads.begin(), ads.end());
+	ClassAd *ad;
+	table->startIterations();
+	while (table->iterate(ad)) {
+		if (candidates.count(ad) && ! scanFunction(ad)) {
+			break;
+		}
+	}
+
+	return 1;
+}
+
 
 CollectorHashTable *CollectorEngine::findOrCreateTable(std::string &type)
 {
@@ -365,7 +402,12 @@ collect (int command, Sock *sock, const condor_sockaddr& from, int &insert)
 	clientAd = new ClassAd;
 	if (!clientAd) return 0;
 
-	if( !getClassAdEx(sock, *clientAd, m_get_ad_options) )
+		// Let other worker threads run while we wait on the socket,
+		// as we do when reading a query.
+	bool ep = CondorThreads::enable_parallel(true);
+	bool got_ad = getClassAdEx(sock, *clientAd, m_get_ad_options);
+	CondorThreads::enable_parallel(ep);
+	if( !got_ad )
 	{
 		dprintf (D_ALWAYS,"Command %d on Sock not followed by ClassAd (or timeout occured)\n",
 				command);
@@ -605,6 +647,10 @@ collect (int command,ClassAd *clientAd,const condor_sockaddr& from,int &insert,S
 			{
 				EXCEPT ("Memory error!");
 			}
+				// Unlike the public ad, the private ad is read without
+				// letting other threads run: retVal points into StartdAds,
+				// and another update or the housekeeper could replace or
+				// delete that ad while we wait on the socket.
 			if( !getClassAdEx(sock, *pvtAd, m_get_ad_options) )
 			{
 				dprintf(D_FULLDEBUG,"\t(Could not get startd's private ad)\n");
@@ -810,6 +856,11 @@ collect (int command,ClassAd *clientAd,const condor_sockaddr& from,int &insert,S
 			// first, purge all the existing negotiator ads, since we
 			// want to enforce that *ONLY* 1 negotiator is in the
 			// collector any given time.
+			ClassAd *negAd;
+			NegotiatorAds.startIterations();
+			while (NegotiatorAds.iterate(negAd)) {
+				unindexAd(NegotiatorAds, negAd);
+			}
 			purgeHashTable( NegotiatorAds );
 		}
 		retVal=updateClassAd (NegotiatorAds, "NegotiatorAd  ", "Negotiator",
@@ -957,6 +1008,7 @@ int CollectorEngine::remove (AdTypes t_AddType, const ClassAd & c_query, bool *q
 				hk.sprint( hkString );
 				iRet = !table->remove(hk);
 				dprintf (D_ALWAYS,"\t\t**** Removed(%d) ad(s): \"%s\"\n", iRet, hkString.c_str() );
+				unindexAd(*table, pAd);
 				delete pAd;
 			}
 		}
@@ -981,6 +1033,8 @@ int CollectorEngine::expire( AdTypes adType, const ClassAd & query, bool * query
                 cAd->Assign( ATTR_LAST_HEARD_FROM, 1 );
                 
                 if( CollectorDaemon::offline_plugin_.expire( * cAd ) == true ) {
+                    stampUpdateSequence( cAd );
+                    indexAd( * hTable, cAd );
                     return rVal;
                 }
 
@@ -995,6 +1049,7 @@ int CollectorEngine::expire( AdTypes adType, const ClassAd & query, bool * query
                 hKey.sprint( hkString );
                 dprintf( D_ALWAYS, "\t\t**** Removed(%d) stale ad(s): \"%s\"\n", rVal, hkString.c_str() );
 
+                unindexAd( * hTable, cAd );
                 delete cAd;
             }
         }
@@ -1011,6 +1066,10 @@ remove (AdTypes adType, AdNameHashKey &hk)
 	if (!LookupByAdType(adType, table, func)) {
 		return 0;
 	}
+	ClassAd *ad = NULL;
+	if (table->lookup(hk, ad) != -1) {
+		unindexAd(*table, ad);
+	}
 	return !table->remove(hk);
 }
 
@@ -1049,6 +1108,7 @@ updateClassAd (CollectorHashTable &hashTable,
 
 	// this time stamped ad is the new ad
 	new_ad = ad;
+	stampUpdateSequence(new_ad);
 	last_updateClassAd_was_insert = false;
 
 	// check if it already exists in the hash table ...
@@ -1068,6 +1128,7 @@ updateClassAd (CollectorHashTable &hashTable,
 		{
 			EXCEPT ("Error inserting ad (out of memory)");
 		}
+		indexAd(hashTable, new_ad);
 
 		insert = 1;
 
@@ -1094,6 +1155,7 @@ updateClassAd (CollectorHashTable &hashTable,
 		if (hashTable.insert(hk, new_ad) == -1) {
 			EXCEPT( "Error inserting ad" );
 		}
+		unindexAd(hashTable, old_ad);
 
 		if ( m_forwardFilteringEnabled && ( strcmp( label, "Start" ) == 0 || strcmp( label, "StartdPvt" ) == 0 || strcmp( label, "Submittor" ) == 0 ) ) {
 			bool forward = false;
@@ -1124,6 +1186,7 @@ updateClassAd (CollectorHashTable &hashTable,
 
 		if (isSelfAd(old_ad)) { __self_ad__ = new_ad; }
 
+		indexAd(hashTable, new_ad);
 		delete old_ad;
 
 		insert = 0;
@@ -1168,6 +1231,8 @@ mergeClassAd (CollectorHashTable &hashTable,
 
 		// Now, finally, merge the new ClassAd into the old one
 		MergeClassAds(old_ad,&new_ad_copy,true);
+		stampUpdateSequence(old_ad);
+		indexAd(hashTable, old_ad);
 	}
 	delete new_ad;
 	return old_ad;
@@ -1243,7 +1308,7 @@ housekeeper()
 }
 
 void CollectorEngine::
-cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey) const
+cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey)
 {
 	ClassAd         *ad;
 	int             timeStamp;
@@ -1285,6 +1350,8 @@ cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey) con
 				   so then this ad should NOT be deleted. */
 				if ( CollectorDaemon::offline_plugin_.expire( *ad ) == true ) {
 					// plugin say to not delete this ad, so continue
+					stampUpdateSequence( ad );
+					indexAd( hashTable, ad );
 					continue;
 				} else {
 					dprintf (D_ALWAYS,"\t\t**** Removing stale ad: \"%s\"\n", hkString.c_str() );
@@ -1294,12 +1361,315 @@ cleanHashTable (CollectorHashTable &hashTable, time_t now, HashFunc makeKey) con
 			{
 				dprintf (D_ALWAYS, "\t\tError while removing ad\n");
 			}
+			unindexAd (hashTable, ad);
 			delete ad;
 		}
 	}
 }
 
 
+void CollectorEngine::
+stampUpdateSequence (ClassAd *ad)
+{
+	ad->Assign(ATTR_COLLECTOR_UPDATE_SEQUENCE, ++m_updateSequence);
+}
+
+void CollectorAttrIndex::
+insert (ClassAd *ad)
+{
+	if (contains(ad)) {
+		remove(ad);
+	}
+
+	Filing &filing = m_filed[ad];
+	filing.how = FILED_NOWHERE;
+	filing.num = 0;
+
+	classad::Value value;
+	classad::ExprTree *expr = ad->LookupExpr(m_attr);
+	if ( ! expr) {
+		// comparing the attribute with a literal is undefined
+		return;
+	}
+	if ( ! ExprTreeIsLiteral(expr, value)) {
+		filing.how = FILED_EXPR;
+		m_exprs.insert(ad);
+	} else if (value.IsStringValue(filing.str)) {
+		// == on strings is not case sensitive, =?= is, so file by the
+		// lower case value and leave the case to the constraint.
+		lower_case(filing.str);
+		filing.how = FILED_STRING;
+		m_strings[filing.str].insert(ad);
+	} else if (value.IsNumber(filing.num) && ! std::isnan(filing.num)) {
+		// booleans are compared as 0 and 1, so they are filed as numbers
+		filing.how = FILED_NUMBER;
+		m_numbers[filing.num].insert(ad);
+	} else {
+		filing.how = FILED_EXPR;
+		m_exprs.insert(ad);
+	}
+}
+
+void CollectorAttrIndex::
+remove (ClassAd *ad)
+{
+	std::unordered_map<ClassAd*, Filing>::iterator it = m_filed.find(ad);
+	if (it == m_filed.end()) {
+		return;
+	}
+
+	const Filing &filing = it->second;
+	if (filing.how == FILED_STRING) {
+		std::unordered_map<std::string, AdSet>::iterator bucket = m_strings.find(filing.str);
+		if (bucket != m_strings.end()) {
+			bucket->second.erase(ad);
+			if (bucket->second.empty()) { m_strings.erase(bucket); }
+		}
+	} else if (filing.how == FILED_NUMBER) {
+		std::map<double, AdSet>::iterator bucket = m_numbers.find(filing.num);
+		if (bucket != m_numbers.end()) {
+			bucket->second.erase(ad);
+			if (bucket->second.empty()) { m_numbers.erase(bucket); }
+		}
+	} else if (filing.how == FILED_EXPR) {
+		m_exprs.erase(ad);
+	}
+	m_filed.erase(it);
+}
+
+template <typename Visit>
+bool CollectorAttrIndex::
+lookup (classad::Operation::OpKind op, const classad::Value &value, Visit visit) const
+{
+	std::string str;
+	double num;
+	if (value.IsStringValue(str)) {
+		// strings are only hashed, so only equality can be looked up
+		if (op != classad::Operation::EQUAL_OP && op != classad::Operation::META_EQUAL_OP) {
+			return false;
+		}
+		lower_case(str);
+		std::unordered_map<std::string, AdSet>::const_iterator bucket = m_strings.find(str);
+		if (bucket != m_strings.end()) {
+			visit(bucket->second);
+		}
+	} else if (value.IsNumber(num) && ! std::isnan(num)) {
+		std::map<double, AdSet>::const_iterator lo = m_numbers.begin();
+		std::map<double, AdSet>::const_iterator hi = m_numbers.end();
+		switch (op) {
+			case classad::Operation::EQUAL_OP:
+			case classad::Operation::META_EQUAL_OP:
+				lo = m_numbers.lower_bound(num);
+				hi = m_numbers.upper_bound(num);
+				break;
+			case classad::Operation::LESS_THAN_OP:
+				hi = m_numbers.lower_bound(num);
+				break;
+			case classad::Operation::LESS_OR_EQUAL_OP:
+				hi = m_numbers.upper_bound(num);
+				break;
+			case classad::Operation::GREATER_THAN_OP:
+				lo = m_numbers.upper_bound(num);
+				break;
+			case classad::Operation::GREATER_OR_EQUAL_OP:
+				lo = m_numbers.lower_bound(num);
+				break;
+			default:
+				return false;
+		}
+		for ( ; lo != hi; ++lo) {
+			visit(lo->second);
+		}
+	} else {
+		return false;
+	}
+
+	// we can't tell what an expression will evaluate to
+	visit(m_exprs);
+	return true;
+}
+
+bool CollectorAttrIndex::
+count (classad::Operation::OpKind op, const classad::Value &value, size_t &num) const
+{
+	num = 0;
+	return lookup(op, value, [&](const AdSet &ads) { num += ads.size(); });
+}
+
+bool CollectorAttrIndex::
+candidates (classad::Operation::OpKind op, const classad::Value &value, std::vector<ClassAd*> &ads) const
+{
+	return lookup(op, value, [&](const AdSet &set) { ads.insert(ads.end(), set.begin(), set.end()); });
+}
+
+void CollectorEngine::
+setQueryIndexes (const char *attrs)
+{
+	StringList attr_list(attrs);
+	std::string indexed;
+	const char *attr;
+	attr_list.rewind();
+	while ((attr = attr_list.next())) {
+		if ( ! indexed.empty()) { indexed += ","; }
+		indexed += attr;
+	}
+	if (indexed == m_indexedAttrs) {
+		return;
+	}
+	m_indexedAttrs = indexed;
+	m_indexes.clear();
+	if (attr_list.isEmpty()) {
+		return;
+	}
+
+	dprintf (D_ALWAYS, "Indexing ads on %s\n", m_indexedAttrs.c_str());
+
+	CollectorHashTable *tables[] = {
+		&StartdAds, &StartdPrivateAds, &ScheddAds, &SubmittorAds,
+		&LicenseAds, &MasterAds, &StorageAds, &AccountingAds,
+		&CkptServerAds, &CollectorAds, &NegotiatorAds, &HadAds, &GridAds
+	};
+	for (CollectorHashTable *table : tables) {
+		AttrIndexList &indexes = m_indexes[table];
+		attr_list.rewind();
+		while ((attr = attr_list.next())) {
+			indexes.push_back(CollectorAttrIndex(attr));
+		}
+
+		ClassAd *ad;
+		table->startIterations();
+		while (table->iterate(ad)) {
+			indexAd(*table, ad);
+		}
+	}
+}
+
+void CollectorEngine::
+indexAd (const CollectorHashTable &table, ClassAd *ad)
+{
+	std::map<const CollectorHashTable*, AttrIndexList>::iterator it = m_indexes.find(&table);
+	if (it == m_indexes.end()) {
+		return;
+	}
+	for (CollectorAttrIndex &index : it->second) {
+		index.insert(ad);
+	}
+}
+
+void CollectorEngine::
+unindexAd (const CollectorHashTable &table, ClassAd *ad)
+{
+	std::map<const CollectorHashTable*, AttrIndexList>::iterator it = m_indexes.find(&table);
+	if (it == m_indexes.end()) {
+		return;
+	}
+	for (CollectorAttrIndex &index : it->second) {
+		index.remove(ad);
+	}
+}
+
+void CollectorEngine::
+reindexAd (ClassAd *ad)
+{
+	for (auto &it : m_indexes) {
+		AttrIndexList &indexes = it.second;
+		if ( ! indexes.empty() && indexes.front().contains(ad)) {
+			for (CollectorAttrIndex &index : indexes) {
+				index.insert(ad);
+			}
+			return;
+		}
+	}
+}
+
+// the comparison with the operands swapped, so that 5 < Attr can be
+// looked up as Attr > 5
+static classad::Operation::OpKind
+swapComparison (classad::Operation::OpKind op)
+{
+	switch (op) {
+		case classad::Operation::LESS_THAN_OP: return classad::Operation::GREATER_THAN_OP;
+		case classad::Operation::LESS_OR_EQUAL_OP: return classad::Operation::GREATER_OR_EQUAL_OP;
+		case classad::Operation::GREATER_THAN_OP: return classad::Operation::LESS_THAN_OP;
+		case classad::Operation::GREATER_OR_EQUAL_OP: return classad::Operation::LESS_OR_EQUAL_OP;
+		default: return op;
+	}
+}
+
+bool CollectorEngine::
+findIndexCandidates (const CollectorHashTable &table, classad::ExprTree *constraint, std::vector<ClassAd*> &ads)
+{
+	std::map<const CollectorHashTable*, AttrIndexList>::iterator it = m_indexes.find(&table);
+	if (it == m_indexes.end() || ! constraint) {
+		return false;
+	}
+	const AttrIndexList &indexes = it->second;
+
+	// An ad can satisfy the constraint only if it satisfies each term
+	// of its top level && chain, so every term that compares an indexed
+	// attribute with a literal narrows down the ads that need to be
+	// looked at.  Use the term that narrows them down the most.
+	const CollectorAttrIndex *best = NULL;
+	classad::Operation::OpKind best_op = classad::Operation::__NO_OP__;
+	classad::Value best_value;
+	size_t best_num = 0;
+
+	std::vector<classad::ExprTree*> terms;
+	terms.push_back(constraint);
+	while ( ! terms.empty()) {
+		classad::ExprTree *term = SkipExprParens(terms.back());
+		terms.pop_back();
+		if ( ! term || term->GetKind() != classad::ExprTree::OP_NODE) {
+			continue;
+		}
+
+		classad::Operation::OpKind op;
+		classad::ExprTree *t1, *t2, *t3;
+		((classad::Operation*)term)->GetComponents(op, t1, t2, t3);
+		if (op == classad::Operation::LOGICAL_AND_OP) {
+			terms.push_back(t1);
+			terms.push_back(t2);
+			continue;
+		}
+		if (op < classad::Operation::__COMPARISON_START__ || op > classad::Operation::__COMPARISON_END__) {
+			continue;
+		}
+
+		std::string attr;
+		classad::Value value;
+		t1 = SkipExprParens(t1);
+		t2 = SkipExprParens(t2);
+		if (ExprTreeIsAttrRef(t1, attr) && ExprTreeIsLiteral(t2, value)) {
+			// Attr op literal
+		} else if (ExprTreeIsLiteral(t1, value) && ExprTreeIsAttrRef(t2, attr)) {
+			op = swapComparison(op);
+		} else {
+			continue;
+		}
+
+		for (const CollectorAttrIndex &index : indexes) {
+			size_t num;
+			if (strcasecmp(index.attr().c_str(), attr.c_str()) == MATCH &&
+				index.count(op, value, num) && ( ! best || num < best_num)) {
+				best = &index;
+				best_op = op;
+				best_value.CopyFrom(value);
+				best_num = num;
+			}
+		}
+	}
+
+	if ( ! best) {
+		return false;
+	}
+
+	ads.reserve(best_num);
+	best->candidates(best_op, best_value, ads);
+	dprintf (D_FULLDEBUG, "Index on %s selects %d of %d ads for the query\n",
+			 best->attr().c_str(), (int)ads.size(), table.getNumElements());
+	return true;
+}
+
 bool
 CollectorEngine::LookupByAdType(AdTypes adType,
 								CollectorHashTable *&table,
@@ -25,6 +25,58 @@
 #include "collector_stats.h"
 #include "hashkey.h"
 
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A secondary index on one attribute of the ads in a collector table, so
+// that a query whose constraint compares that attribute with a literal
+// (State == "Unclaimed", Memory >= 4096) does not have to evaluate the
+// constraint against every ad in the table.  Ads are filed by the literal
+// value of the attribute: strings by their lower case value in a hash
+// table, numbers and booleans in a sorted map so that ranges can be
+// looked up too.  Ads that define the attribute as an expression are
+// always candidates, ads that do not define it never are, since comparing
+// an undefined attribute with a literal is never true.  The candidates
+// are thus a superset of the matches, and the query constraint must still
+// be evaluated against each of them.
+class CollectorAttrIndex
+{
+  public:
+	CollectorAttrIndex(const std::string &attr) : m_attr(attr) {}
+
+	const std::string & attr() const { return m_attr; }
+
+	void insert(ClassAd *ad);
+	void remove(ClassAd *ad);
+	bool contains(ClassAd *ad) const { return m_filed.count(ad) != 0; }
+
+	// If ads satisfying (attr op value) can be looked up in the index,
+	// return true and set num to the number of candidates, or append
+	// the candidates to ads.
+	bool count(classad::Operation::OpKind op, const classad::Value &value, size_t &num) const;
+	bool candidates(classad::Operation::OpKind op, const classad::Value &value, std::vector<ClassAd*> &ads) const;
+
+  private:
+	typedef std::unordered_set<ClassAd*> AdSet;
+	enum FiledAs { FILED_NOWHERE, FILED_STRING, FILED_NUMBER, FILED_EXPR };
+	struct Filing {
+		FiledAs how;
+		std::string str;
+		double num;
+	};
+
+	template <typename Visit>
+	bool lookup(classad::Operation::OpKind op, const classad::Value &value, Visit visit) const;
+
+	std::string m_attr;
+	std::unordered_map<std::string, AdSet> m_strings;
+	std::map<double, AdSet> m_numbers;
+	AdSet m_exprs;
+	std::unordered_map<ClassAd*, Filing> m_filed;
+};
+
 class CollectorEngine : public Service
 {
   public:
@@ -70,6 +122,18 @@ class CollectorEngine : public Service
 	// walk specified hash table with the given visit procedure
 	int walkHashTable (AdTypes, int (*)(ClassAd *));
 
+	// as above, but visit only the ads that the secondary indexes say
+	// might satisfy the constraint, when the constraint allows it.
+	int walkHashTable (AdTypes, classad::ExprTree *constraint, int (*)(ClassAd *));
+
+	// set the attributes that have secondary indexes, from a list such
+	// as COLLECTOR_QUERY_INDEXES.  The indexes are rebuilt if it changed.
+	void setQueryIndexes( const char *attrs );
+
+	// refile an ad that was changed in place outside of the engine
+	// (by the offline plugin, for instance) in the secondary indexes.
+	void reindexAd( ClassAd *ad );
+
 	// Walk through a specific (non-generic, non-ANY) table using a lambda
 	template<typename T>
 	int walkConcreteTable(AdTypes adType, T scanFunction) {
@@ -154,7 +218,7 @@ class CollectorEngine : public Service
 
 	void  housekeeper ();
 	int  housekeeperTimerID;
-	void cleanHashTable (CollectorHashTable &, time_t, HashFunc) const;
+	void cleanHashTable (CollectorHashTable &, time_t, HashFunc);
 	ClassAd* updateClassAd(CollectorHashTable&,const char*, const char *,
 						   ClassAd*,AdNameHashKey&, const std::string &, int &,
 						   const condor_sockaddr& );
@@ -171,6 +235,21 @@ class CollectorEngine : public Service
 	// support for dynamically created tables
 	CollectorHashTable *findOrCreateTable(std::string &str);
 
+	// secondary indexes on the concrete tables, kept up to date as ads
+	// are stored, changed and removed.  Empty unless configured.
+	typedef std::vector<CollectorAttrIndex> AttrIndexList;
+	std::map<const CollectorHashTable*, AttrIndexList> m_indexes;
+	std::string m_indexedAttrs;
+	void indexAd(const CollectorHashTable &table, ClassAd *ad);
+	void unindexAd(const CollectorHashTable &table, ClassAd *ad);
+	bool findIndexCandidates(const CollectorHashTable &table, classad::ExprTree *constraint, std::vector<ClassAd*> &ads);
+
+	// stamp an ad we are storing (or changing in place) with the next
+	// value of m_updateSequence, so that clients such as the negotiator
+	// can tell which ads changed since their last query.
+	void stampUpdateSequence(ClassAd *ad);
+	long long m_updateSequence;
+
 	bool ValidateClassAd(int command,ClassAd *clientAd,Sock *sock);
 
 	void* __self_ad__; // contains address of last Ad for this collector added to the hashtable, do NOT free from here
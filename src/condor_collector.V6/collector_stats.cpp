@@ -376,6 +376,7 @@ void UpdatesStats::Init()
 	STATS_POOL_ADD(Pool, "", ActiveQueryWorkers, IF_BASICPUB);
 	STATS_POOL_ADD(Pool, "", PendingQueries, IF_BASICPUB);
 	STATS_POOL_ADD_VAL_PUB_RECENT(Pool, "", DroppedQueries, IF_BASICPUB);
+	STATS_POOL_ADD_VAL_PUB_RECENT(Pool, "", DroppedUdpUpdates, IF_BASICPUB);
 
 	ADD_EXTERN_RUNTIME(Pool, HandleQuery, IF_VERBOSEPUB);
 	ADD_EXTERN_RUNTIME(Pool, HandleLocate, IF_VERBOSEPUB);
@@ -173,6 +173,7 @@ struct UpdatesStats {
 	stats_entry_abs<int> ActiveQueryWorkers;
 	stats_entry_abs<int> PendingQueries;
 	stats_entry_recent<long> DroppedQueries;
+	stats_entry_recent<long> DroppedUdpUpdates; // dropped by the kernel because the UDP command socket was full
 
 #ifdef TRACK_QUERIES_BY_SUBSYS
 	stats_entry_recent<long> InProcQueriesFrom[SUBSYSTEM_ID_COUNT]; // Track subsystems < the AUTO subsys.
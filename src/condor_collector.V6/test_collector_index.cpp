@@ -0,0 +1,197 @@
+/***************************************************************
+ *
+ * Copyright (C) 2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+// Checks that a collector query answered with the help of the secondary
+// indexes (COLLECTOR_QUERY_INDEXES) returns the same ads, in the same
+// order, as the full walk of the table, with and without a limit on the
+// number of results.
+//
+//   test_collector_index [-v]
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_attributes.h"
+#include "condor_commands.h"
+#include "collector_engine.h"
+
+#include <vector>
+
+bool verbose = false;
+#define REQUIRE( condition ) \
+	if(! ( condition )) { \
+		fprintf( stderr, "Failed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+		return 1; \
+	} else if( verbose ) { \
+		fprintf( stdout, "Passed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+	}
+
+static const int NUM_SLOTS = 200;
+
+static const char * const constraints[] = {
+	"State == \"Unclaimed\"",
+	"State =?= \"Unclaimed\"",
+	"Memory >= 4096",
+	"8192 > Memory",
+	"Memory == 4096 && State == \"claimed\"",
+	"(Memory < 2048.5) && HasGpu",
+	"HasGpu == true",
+	"HasGpu =?= false",
+	"Memory > 1e10",
+	"State == 5",
+	"Memory == \"4096\"",
+		// nothing to look up, so these use the full walk
+	"Memory != 4096",
+	"Memory == 4096 || State == \"Owner\"",
+};
+
+// what the scan function looks for, and what it found
+static classad::ExprTree *scan_constraint = NULL;
+static size_t scan_limit = 0;
+static size_t scan_visited = 0;
+static std::vector<ClassAd*> scan_results;
+
+static int scan( ClassAd *ad )
+{
+	scan_visited++;
+	if ( EvalExprBool( ad, scan_constraint ) ) {
+		scan_results.push_back( ad );
+		if ( scan_limit && scan_results.size() >= scan_limit ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void query( CollectorEngine &engine, bool indexed, std::vector<ClassAd*> &results, size_t &visited )
+{
+	scan_results.clear();
+	scan_visited = 0;
+	if ( indexed ) {
+		engine.walkHashTable( STARTD_AD, scan_constraint, scan );
+	} else {
+		engine.walkHashTable( STARTD_AD, scan );
+	}
+	results = scan_results;
+	visited = scan_visited;
+}
+
+static int check_constraint( CollectorEngine &engine, const char *constraint, size_t limit, bool narrowed = false )
+{
+	REQUIRE( ParseClassAdRvalExpr( constraint, scan_constraint ) == 0 );
+	scan_limit = limit;
+
+	std::vector<ClassAd*> full, indexed;
+	size_t full_visited = 0, indexed_visited = 0;
+	query( engine, false, full, full_visited );
+	query( engine, true, indexed, indexed_visited );
+	if ( verbose ) {
+		printf( "%s (limit %d): %d ads, full walk evaluated %d, indexed walk %d\n",
+			constraint, (int)limit, (int)full.size(), (int)full_visited, (int)indexed_visited );
+	}
+	REQUIRE( indexed == full );
+	REQUIRE( indexed_visited <= full_visited );
+	REQUIRE( ! narrowed || indexed_visited < full_visited );
+
+	delete scan_constraint;
+	scan_constraint = NULL;
+	return 0;
+}
+
+int
+main( int argc, char ** argv )
+{
+	for ( int i = 1; i < argc; i++ ) {
+		if ( strcmp( argv[i], "-v" ) == 0 ) {
+			verbose = true;
+		} else {
+			fprintf( stderr, "Usage: %s [-v]\n", argv[0] );
+			return 1;
+		}
+	}
+
+	ClassAdReconfig();
+
+	CollectorStats stats( false, 0 );
+	CollectorEngine engine( &stats );
+	engine.setQueryIndexes( "State, Memory, HasGpu" );
+
+		// a mix of strings in either case, integers and reals, booleans
+		// and numbers used as booleans, expressions, and missing values
+	static const char * const states[] = { "Unclaimed", "Claimed", "unclaimed", "Owner" };
+	for ( int i = 0; i < NUM_SLOTS; i++ ) {
+		ClassAd *ad = new ClassAd;
+		SetMyTypeName( *ad, STARTD_ADTYPE );
+		ad->Assign( ATTR_NAME, std::string("slot") + std::to_string(i) + "@host" );
+		ad->Assign( ATTR_MY_ADDRESS, "<127.0.0.1:9618>" );
+		ad->Assign( ATTR_STATE, states[i % 4] );
+		if ( i % 7 == 0 ) {
+			ad->AssignExpr( ATTR_MEMORY, "Disk / 2" );
+			ad->Assign( ATTR_DISK, i * 100 );
+		} else if ( i % 11 != 0 ) {
+			if ( i % 3 ) {
+				ad->Assign( ATTR_MEMORY, (i % 5) * 2048 );
+			} else {
+				ad->Assign( ATTR_MEMORY, (i % 5) * 2048.0 );
+			}
+		}
+		if ( i % 2 ) {
+			ad->Assign( "HasGpu", true );
+		} else if ( i % 3 ) {
+			ad->Assign( "HasGpu", false );
+		} else {
+			ad->Assign( "HasGpu", 1 );
+		}
+
+		int insert = 0;
+		condor_sockaddr from;
+		REQUIRE( engine.collect( UPDATE_STARTD_AD, ad, from, insert ) != NULL );
+		REQUIRE( insert == 1 );
+	}
+
+		// replace some of them, so they are filed again
+	for ( int i = 0; i < NUM_SLOTS; i += 3 ) {
+		ClassAd *ad = new ClassAd;
+		SetMyTypeName( *ad, STARTD_ADTYPE );
+		ad->Assign( ATTR_NAME, std::string("slot") + std::to_string(i) + "@host" );
+		ad->Assign( ATTR_MY_ADDRESS, "<127.0.0.1:9618>" );
+		ad->Assign( ATTR_STATE, "Claimed" );
+		ad->Assign( ATTR_MEMORY, 4096 );
+
+		int insert = 0;
+		condor_sockaddr from;
+		REQUIRE( engine.collect( UPDATE_STARTD_AD, ad, from, insert ) != NULL );
+		REQUIRE( insert == 0 );
+	}
+
+	for ( size_t i = 0; i < sizeof(constraints) / sizeof(constraints[0]); i++ ) {
+		if ( check_constraint( engine, constraints[i], 0 ) != 0 ||
+			 check_constraint( engine, constraints[i], 5 ) != 0 ) {
+			fprintf( stderr, "Failed constraint '%s'.\n", constraints[i] );
+			return 1;
+		}
+	}
+
+		// and the index did save looking at the other ads
+	if ( check_constraint( engine, "State == \"Owner\"", 0, true ) != 0 ) {
+		return 1;
+	}
+
+	fprintf( stdout, "No failures detected.\n" );
+	return 0;
+}
@@ -76,6 +76,7 @@ class ProcFamilyInterface;
 
 template <class Key, class Value> class HashTable; // forward declaration
 class Probe;
+class Selector;
 
 #define USE_MIRON_PROBE_FOR_DC_RUNTIME_STATS
 
@@ -1749,6 +1750,7 @@ class DaemonCore : public Service
 
 		
        stats_entry_recent<Probe> PumpCycle;   // count of pump cycles plus sum of cycle time with min/max/avg/std 
+       stats_entry_recent<Probe> TimerLatency; // seconds from when timers were due until their handlers were called
        stats_entry_sum_ema_rate<int> Commands;
 
        StatisticsPool          Pool;          // pool of statistics probes and Publish attrib names
@@ -1852,6 +1854,9 @@ class DaemonCore : public Service
 	int m_iMaxReapsPerCycle; // maximum number reapers to invoke per event loop
 	int m_MaxTimeSkip;
 	int m_iMaxUdpMsgsPerCycle;	// max number of udp messages read per loop
+	Selector *m_epoll_selector;	// the Driver's selector, if it uses epoll
+	unsigned int m_nextRegistrationSerial;	// tags fds given to m_epoll_selector
+	unsigned int NextRegistrationSerial();
 
     void Inherit( void );  // called in main()
 	void InitDCCommandSocket( int command_port );  // called in main()
@@ -2020,6 +2025,7 @@ class DaemonCore : public Service
 		HandlerType		handler_type;
 		int				servicing_tid;	// tid servicing this socket
 		bool            is_command_sock;
+		unsigned int	serial;		// distinguishes reuses of the same fd
     };
     void              DumpSocketTable(int, const char* = NULL);
     int               maxSocket;  // number of socket handlers to start with
@@ -2064,6 +2070,7 @@ class DaemonCore : public Service
         bool            is_cpp;
 		bool			call_handler;
 		bool			in_handler;
+		unsigned int	serial;		// distinguishes reuses of the same fd
     };
     // void              DumpPipeTable(int, const char* = NULL);
     int               maxPipe;  // number of pipe handlers to start with
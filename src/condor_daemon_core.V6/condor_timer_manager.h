@@ -40,6 +40,9 @@
 #include <sys/time.h>
 #endif
 
+#include <vector>
+#include <unordered_map>
+
 const   int     STAR = -1;
 
 //-----------------------------------------------------------------------------
@@ -84,7 +87,8 @@ struct tagTimer {
     /** Not_Yet_Documented */ TimerHandler             handler;
     /** Not_Yet_Documented */ TimerHandlercpp          handlercpp;
     /** Not_Yet_Documented */ class Service*    service; 
-    /** Not_Yet_Documented */ struct tagTimer*  next;
+    /** Position in the timer heap, -1 if not in it */ int heap_index;
+    /** Insertion order, breaks ties between equal whens */ uint64_t insert_seq;
     /** Not_Yet_Documented */ char*             event_descrip;
     /** Not_Yet_Documented */ void*             data_ptr;
     /** Not_Yet_Documented */ Timeslice *       timeslice;
@@ -250,19 +254,28 @@ class TimerManager
                   unsigned   period          =  0,
 				  const Timeslice *timeslice = NULL);
 
-	void RemoveTimer( Timer *timer, Timer *prev );
+	void RemoveTimer( Timer *timer );
 	void InsertTimer( Timer *new_timer );
 	void DeleteTimer( Timer *timer );
 
 	/*
 	  @param id The id of the timer to find
-	  @param prev If not NULL, this will be set to previous timer in list
 	  @return pointer to timer with specified id or NULL if not found
 	 */
-	Timer *GetTimer( int id, Timer **prev );
-
-    Timer*  timer_list;
-	Timer*  list_tail;
+	Timer *GetTimer( int id );
+
+	// The timers are kept in a binary min-heap ordered on "when", with
+	// ties going to the timer inserted first, so that timers which keep
+	// resetting themselves to zero take turns.  Every timer in the heap
+	// knows its position in it, so a timer found through timer_map can
+	// be removed or moved without a search.
+	static bool TimerBefore( const Timer *a, const Timer *b );
+	void SiftUp( size_t index );
+	void SiftDown( size_t index );
+
+	std::vector<Timer*> timer_heap;
+	std::unordered_map<int, Timer*> timer_map;	// all timers, by id
+	uint64_t timer_insert_seq;
     int     timer_ids;
     Timer*  in_timeout;
     bool    did_reset;
@@ -479,6 +479,8 @@ DaemonCore::DaemonCore(int ComSize,int SigSize,
 	m_shared_port_endpoint = NULL;
 	nRegisteredSocks = 0;
 	m_iMaxUdpMsgsPerCycle = 1;
+	m_epoll_selector = NULL;
+	m_nextRegistrationSerial = 0;
 }
 
 // DaemonCore destructor. Delete the all the various handler tables, plus
@@ -1831,6 +1833,7 @@ int DaemonCore::Register_Socket(Stream *iosock, const char* iosock_descrip,
 	(*sockTable)[i].service = s;
 	(*sockTable)[i].data_ptr = NULL;
 	(*sockTable)[i].waiting_for_data = false;
+	(*sockTable)[i].serial = NextRegistrationSerial();
 	free((*sockTable)[i].iosock_descrip);
 	if ( iosock_descrip )
 		(*sockTable)[i].iosock_descrip = strdup(iosock_descrip);
@@ -1915,6 +1918,11 @@ int DaemonCore::Cancel_Socket( Stream* insock, void *prev_entry)
 		// Log a message
 		dprintf(D_DAEMONCORE,"Cancel_Socket: cancelled socket %d <%s> %p\n",
 				i,(*sockTable)[i].iosock_descrip, (*sockTable)[i].iosock );
+		// The socket is usually closed right after this, and may live
+		// on in another process, so epoll has to forget it now.
+		if ( m_epoll_selector ) {
+			m_epoll_selector->unregister_fd( (*sockTable)[i].iosock->get_file_desc() );
+		}
 		// Remove entry; mark it is available for next add via iosock=NULL
 		(*sockTable)[i].iosock = NULL;
 		free( (*sockTable)[i].iosock_descrip );
@@ -1951,6 +1959,15 @@ int DaemonCore::Cancel_Socket( Stream* insock, void *prev_entry)
 	return TRUE;
 }
 
+unsigned int DaemonCore::NextRegistrationSerial()
+{
+		// zero is left for fds that are not tagged
+	if ( ++m_nextRegistrationSerial == 0 ) {
+		++m_nextRegistrationSerial;
+	}
+	return m_nextRegistrationSerial;
+}
+
 // We no longer return "real" file descriptors from Create_Pipe. This
 // is to force people to use Read_Pipe or Write_Pipe to do I/O on a pipe,
 // which is necessary to encapsulate all the weird platform specifics
@@ -2224,6 +2241,7 @@ int DaemonCore::Register_Pipe(int pipe_end, const char* pipe_descrip,
 	(*pipeTable)[i].perm = perm;
 	(*pipeTable)[i].service = s;
 	(*pipeTable)[i].data_ptr = NULL;
+	(*pipeTable)[i].serial = NextRegistrationSerial();
 	free((*pipeTable)[i].pipe_descrip);
 	if ( pipe_descrip )
 		(*pipeTable)[i].pipe_descrip = strdup(pipe_descrip);
@@ -2312,6 +2330,12 @@ int DaemonCore::Cancel_Pipe( int pipe_end )
 			"Cancel_Pipe: cancelled pipe end %d <%s> (entry=%d)\n",
 			pipe_end,(*pipeTable)[i].pipe_descrip, i );
 
+#ifndef WIN32
+	if ( m_epoll_selector ) {
+		m_epoll_selector->unregister_fd( (*pipeHandleTable)[index] );
+	}
+#endif
+
 	// Remove entry, move the last one in the list into this spot
 	(*pipeTable)[i].index = -1;
 	free( (*pipeTable)[i].pipe_descrip );
@@ -3384,6 +3408,10 @@ DaemonCore::Async_test_Wake_up_select(
 void DaemonCore::Driver()
 {
 	Selector	selector;
+		// used for polling a single fd between handlers, so that
+		// selector keeps its registrations when it uses epoll
+	Selector	recheck_selector;
+	unsigned int async_pipe_serial = 0;
 	int			i;
 	int			tmpErrno;
 	time_t		timeout;
@@ -3405,6 +3433,12 @@ void DaemonCore::Driver()
 	char asyncpipe_buf[10];
 #endif
 
+	if ( param_boolean( "USE_EPOLL", false ) && selector.enable_epoll() ) {
+		dprintf( D_FULLDEBUG, "DaemonCore: using epoll to wait for sockets and pipes\n" );
+		m_epoll_selector = &selector;
+		async_pipe_serial = NextRegistrationSerial();
+	}
+
 	if ( param_boolean( "ENABLE_STDOUT_TESTING", false ) )
 	{
 		dprintf( D_ALWAYS, "Testing stdout & stderr\n" );
@@ -3544,7 +3578,8 @@ void DaemonCore::Driver()
 
 		// Setup what socket descriptors to select on.  We recompute this
 		// every time because 1) some timeout handler may have removed/added
-		// sockets, and 2) it ain't that expensive....
+		// sockets, and 2) it ain't that expensive....  When the selector
+		// uses epoll, only the changes since the last cycle reach the kernel.
 		selector.reset();
 		min_deadline = 0;
 		for (i = 0; i < nSock; i++) {
@@ -3571,20 +3606,25 @@ void DaemonCore::Driver()
 						// connect is ready to write.  when connect
 						// is ready, select will set the writefd set
 						// on success, or the exceptfd set on failure.
-					selector.add_fd( (*sockTable)[i].iosock->get_file_desc(), Selector::IO_WRITE );
-					selector.add_fd( (*sockTable)[i].iosock->get_file_desc(), Selector::IO_EXCEPT );
+						// A failed connect closes the fd and retries on a
+						// new one under the same registration, which most
+						// likely gets the same number, so don't tag it; an
+						// untagged fd is registered with epoll afresh each time.
+					selector.add_fd( (*sockTable)[i].iosock->get_file_desc(), Selector::IO_WRITE, 0 );
+					selector.add_fd( (*sockTable)[i].iosock->get_file_desc(), Selector::IO_EXCEPT, 0 );
 				} else {
 					int sockfd = (*sockTable)[i].iosock->get_file_desc();
+					unsigned int serial = (*sockTable)[i].serial;
 					switch( (*sockTable)[i].handler_type ) {
 					case HANDLE_READ:
-						selector.add_fd( sockfd, Selector::IO_READ );
+						selector.add_fd( sockfd, Selector::IO_READ, serial );
 						break;
 					case HANDLE_WRITE:
-						selector.add_fd( sockfd, Selector::IO_WRITE );
+						selector.add_fd( sockfd, Selector::IO_WRITE, serial );
 						break;
 					case HANDLE_READ_WRITE:
-						selector.add_fd( sockfd, Selector::IO_READ );
-						selector.add_fd( sockfd, Selector::IO_WRITE );
+						selector.add_fd( sockfd, Selector::IO_READ, serial );
+						selector.add_fd( sockfd, Selector::IO_WRITE, serial );
 						break;
 					}
 				}
@@ -3614,16 +3654,17 @@ void DaemonCore::Driver()
 		for (i = 0; i < nPipe; i++) {
 			if ( (*pipeTable)[i].index != -1 ) {	// if a valid entry....
 				int pipefd = (*pipeHandleTable)[(*pipeTable)[i].index];
+				unsigned int serial = (*pipeTable)[i].serial;
 				switch( (*pipeTable)[i].handler_type ) {
 				case HANDLE_READ:
-					selector.add_fd( pipefd, Selector::IO_READ );
+					selector.add_fd( pipefd, Selector::IO_READ, serial );
 					break;
 				case HANDLE_WRITE:
-					selector.add_fd( pipefd, Selector::IO_WRITE );
+					selector.add_fd( pipefd, Selector::IO_WRITE, serial );
 					break;
 				case HANDLE_READ_WRITE:
-					selector.add_fd( pipefd, Selector::IO_READ );
-					selector.add_fd( pipefd, Selector::IO_WRITE );
+					selector.add_fd( pipefd, Selector::IO_READ, serial );
+					selector.add_fd( pipefd, Selector::IO_WRITE, serial );
 					break;
 				}
 			}
@@ -3640,7 +3681,7 @@ void DaemonCore::Driver()
 		} 
 		selector.add_fd( async_pipe[0].get_file_desc() , Selector::IO_READ );
 #else
-		selector.add_fd( async_pipe[0], Selector::IO_READ );
+		selector.add_fd( async_pipe[0], Selector::IO_READ, async_pipe_serial );
 #endif
 
 		// Let other threads run while we are waiting on select
@@ -3917,11 +3958,11 @@ void DaemonCore::Driver()
 #else
 							// UNIX
 							int pipefd = (*pipeHandleTable)[(*pipeTable)[i].index];
-							selector.reset();
-							selector.set_timeout( 0 );
-							selector.add_fd( pipefd, Selector::IO_READ );
-							selector.execute();
-							if ( selector.timed_out() ) {
+							recheck_selector.reset();
+							recheck_selector.set_timeout( 0 );
+							recheck_selector.add_fd( pipefd, Selector::IO_READ );
+							recheck_selector.execute();
+							if ( recheck_selector.timed_out() ) {
 								// nothing available, try the next entry...
 								continue;
 							}
@@ -4012,13 +4053,13 @@ void DaemonCore::Driver()
 							// read on the pipe could block?  to prevent this, we need
 							// to check one more time to make certain the pipe is ready
 							// for reading.
-							selector.reset();
-							selector.set_timeout( 0 );// set timeout for a poll
-							selector.add_fd( (*sockTable)[i].iosock->get_file_desc(),
+							recheck_selector.reset();
+							recheck_selector.set_timeout( 0 );// set timeout for a poll
+							recheck_selector.add_fd( (*sockTable)[i].iosock->get_file_desc(),
 											 Selector::IO_READ );
 
-							selector.execute();
-							if ( selector.timed_out() ) {
+							recheck_selector.execute();
+							if ( recheck_selector.timed_out() ) {
 								// nothing available, try the next entry...
 								continue;
 							}
@@ -236,6 +236,7 @@ void DaemonCore::Stats::Init(bool enable)
    //DC_STATS_ADD_RECENT(Pool, PipeBytes,     IF_BASICPUB);
    DC_STATS_ADD_RECENT(Pool, DebugOuts,     IF_VERBOSEPUB);
    DC_STATS_ADD_RECENT(Pool, PumpCycle,     IF_VERBOSEPUB);
+   DC_STATS_ADD_RECENT(Pool, TimerLatency, IF_VERBOSEPUB);
    STATS_POOL_ADD_VAL(Pool, "DC", UdpQueueDepth,  IF_BASICPUB);
    STATS_POOL_PUB_PEAK(Pool, "DC", UdpQueueDepth,  IF_BASICPUB);
    DC_STATS_ADD_DEF(Pool, Commands, IF_BASICPUB);
@@ -289,6 +290,7 @@ void DaemonCore::Stats::Init(bool enable)
    //DC_STATS_PUB_DEBUG(Pool, PipeBytes,     IF_BASICPUB);
    DC_STATS_PUB_DEBUG(Pool, DebugOuts,     IF_VERBOSEPUB);
    DC_STATS_PUB_DEBUG(Pool, PumpCycle,     IF_VERBOSEPUB);
+   DC_STATS_PUB_DEBUG(Pool, TimerLatency, IF_VERBOSEPUB);
 
 
    // clear all counters we just added to the pool
@@ -353,6 +355,13 @@ void DaemonCore::Stats::Publish(ClassAd & ad, int flags) const
    }
    ad.Assign("RecentDaemonCoreDutyCycle", dDutyCycle);
 
+   unsigned long regex_hits = 0, regex_misses = 0;
+   classad::ClassAdGetRegexCacheCounts(regex_hits, regex_misses);
+   if (regex_hits || regex_misses) {
+      ad.Assign("DCRegexCacheHits", (long long)regex_hits);
+      ad.Assign("DCRegexCacheMisses", (long long)regex_misses);
+   }
+
    Pool.Publish(ad, flags);
 }
 
@@ -365,6 +374,8 @@ void DaemonCore::Stats::Unpublish(ClassAd & ad) const
    ad.Delete("DCRecentWindowMax");
    ad.Delete("DaemonCoreDutyCycle");
    ad.Delete("RecentDaemonCoreDutyCycle");
+   ad.Delete("DCRegexCacheHits");
+   ad.Delete("DCRegexCacheMisses");
    Pool.Unpublish(ad);
 }
 
@@ -24,7 +24,7 @@
 #include "condor_debug.h"
 #include "condor_daemon_core.h"
 #include "condor_config.h"
-#include <unordered_set>
+#include <algorithm>
 
 static const char* DEFAULT_INDENT = "DaemonCore--> ";
 
@@ -52,8 +52,7 @@ TimerManager::TimerManager()
 	{
 		EXCEPT("TimerManager object exists!");
 	}
-	timer_list = NULL;
-	list_tail = NULL;
+	timer_insert_seq = 0;
 	timer_ids = 0;
 	in_timeout = NULL;
 	_t = this; 
@@ -160,7 +159,8 @@ int TimerManager::NewTimer(Service* s, unsigned deltawhen,
 
 	new_timer->id = timer_ids++;		
 
-
+	new_timer->heap_index = -1;
+	timer_map[new_timer->id] = new_timer;
 	InsertTimer( new_timer );
 
 	DumpTimerList(D_DAEMONCORE | D_FULLDEBUG);
@@ -185,7 +185,7 @@ bool TimerManager::ResetTimerTimeslice(int id, Timeslice const &new_timeslice)
 
 bool TimerManager::GetTimerTimeslice(int id, Timeslice &timeslice)
 {
-	Timer *timer_ptr = GetTimer( id, NULL );
+	Timer *timer_ptr = GetTimer( id );
 	if( !timer_ptr || !timer_ptr->timeslice ) {
 		return false;
 	}
@@ -195,7 +195,7 @@ bool TimerManager::GetTimerTimeslice(int id, Timeslice &timeslice)
 
 time_t TimerManager::GetNextRuntime(int id)
 {
-	Timer *timer_ptr = GetTimer( id, NULL );
+	Timer *timer_ptr = GetTimer( id );
 	if (!timer_ptr) { return false; }
 
 	return timer_ptr->when;
@@ -205,22 +205,15 @@ int TimerManager::ResetTimer(int id, unsigned when, unsigned period,
 							 Timeslice const *new_timeslice)
 {
 	Timer*			timer_ptr;
-	Timer*			trail_ptr;
 
 	dprintf( D_DAEMONCORE,
 			 "In reset_timer(), id=%d, time=%d, period=%d\n",id,when,period);
-	if (timer_list == NULL) {
+	if (timer_map.empty()) {
 		dprintf( D_DAEMONCORE, "Reseting Timer from empty list!\n");
 		return -1;
 	}
 
-	timer_ptr = timer_list;
-	trail_ptr = NULL;
-	while ( timer_ptr && timer_ptr->id != id ) {
-		trail_ptr = timer_ptr;
-		timer_ptr = timer_ptr->next;
-	}
-
+	timer_ptr = GetTimer( id );
 	if ( timer_ptr == NULL ) {
 		dprintf( D_ALWAYS, "Timer %d not found\n",id );
 		return -1;
@@ -278,7 +271,7 @@ int TimerManager::ResetTimer(int id, unsigned when, unsigned period,
 	}
 	timer_ptr->period = period;
 
-	RemoveTimer( timer_ptr, trail_ptr );
+	RemoveTimer( timer_ptr );
 	InsertTimer( timer_ptr );
 
 	if ( in_timeout == timer_ptr ) {
@@ -293,27 +286,21 @@ int TimerManager::ResetTimer(int id, unsigned when, unsigned period,
 int TimerManager::CancelTimer(int id)
 {
 	Timer*		timer_ptr;
-	Timer*		trail_ptr;
 
 	dprintf( D_DAEMONCORE, "In cancel_timer(), id=%d\n",id);
-	if (timer_list == NULL) {
+	if (timer_map.empty()) {
 		dprintf( D_DAEMONCORE, "Removing Timer from empty list!\n");
 		return -1;
 	}
 
-	timer_ptr = timer_list;
-	trail_ptr = NULL;
-	while ( timer_ptr && timer_ptr->id != id ) {
-		trail_ptr = timer_ptr;
-		timer_ptr = timer_ptr->next;
-	}
-
+	timer_ptr = GetTimer( id );
 	if ( timer_ptr == NULL ) {
 		dprintf( D_ALWAYS, "Timer %d not found\n",id );
 		return -1;
 	}
 
-	RemoveTimer( timer_ptr, trail_ptr );
+	timer_map.erase( id );
+	RemoveTimer( timer_ptr );
 
 	if ( in_timeout == timer_ptr ) {
 		// We're inside the handler for this timer. Don't delete it,
@@ -329,11 +316,13 @@ int TimerManager::CancelTimer(int id)
 
 void TimerManager::CancelAllTimers()
 {
-	Timer		*timer_ptr;
+	std::vector<Timer*> timers;
+	timers.swap( timer_heap );
+	timer_map.clear();
 
-	while( timer_list != NULL ) {
-		timer_ptr = timer_list;
-		timer_list = timer_list->next;
+	for( size_t i = 0; i < timers.size(); i++ ) {
+		Timer *timer_ptr = timers[i];
+		timer_ptr->heap_index = -1;
 		if( in_timeout == timer_ptr ) {
 				// We get here if somebody calls exit from inside a timer.
 			did_cancel = true;
@@ -342,8 +331,6 @@ void TimerManager::CancelAllTimers()
 			DeleteTimer( timer_ptr );
 		}
 	}
-	timer_list = NULL;
-	list_tail = NULL;
 }
 
 // Timeout() is called when a select() time out.  Returns number of seconds
@@ -361,10 +348,10 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 
 	if ( in_timeout != NULL ) {
 		dprintf(D_DAEMONCORE,"DaemonCore Timeout() called and in_timeout is non-NULL\n");
-		if ( timer_list == NULL ) {
+		if ( timer_heap.empty() ) {
 			result = 0;
 		} else {
-			result = (timer_list->when) - time(NULL);
+			result = (timer_heap[0]->when) - time(NULL);
 		}
 		if ( result < 0 ) {
 			result = 0;
@@ -374,7 +361,7 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 		
 	dprintf( D_DAEMONCORE, "In DaemonCore Timeout()\n");
 
-	if (timer_list == NULL) {
+	if (timer_heap.empty()) {
 		dprintf( D_DAEMONCORE, "Empty timer list, nothing to do\n" );
 	}
 
@@ -383,62 +370,64 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 	DumpTimerList(D_DAEMONCORE | D_FULLDEBUG);
 
     // if we are going to not limit the number of timer handlers we invoke,
-    // make a set now of all timers that are ready to go... below we will
-    // use this set in order to NOT invoke new timers that are inserted by
-    // timer handlers themselves.
-    std::unordered_set<int> readyTimerIds;
-    if (max_timer_events_per_cycle == INT_MAX) {
-        in_timeout = timer_list;
-        while ((in_timeout != NULL) && (in_timeout->when <= now)) {
-            readyTimerIds.insert(in_timeout->id);
-            in_timeout = in_timeout->next;
+    // make a list now of all timers that are ready to go, in the order they
+    // would fire... below we will use this list in order to NOT invoke new
+    // timers that are inserted by timer handlers themselves.  The ready
+    // timers are found by walking down the heap until "when" passes now.
+    std::vector<Timer*> readyTimers;
+    if (max_timer_events_per_cycle == INT_MAX && !timer_heap.empty()) {
+        std::vector<size_t> pending(1, 0);
+        while ( ! pending.empty()) {
+            size_t index = pending.back();
+            pending.pop_back();
+            if (index >= timer_heap.size() || timer_heap[index]->when > now) {
+                continue;
+            }
+            readyTimers.push_back(timer_heap[index]);
+            pending.push_back(2*index + 1);
+            pending.push_back(2*index + 2);
         }
-        in_timeout = NULL;
+        std::sort(readyTimers.begin(), readyTimers.end(), TimerBefore);
     }
+    std::vector<int> readyTimerIds;
+    for (size_t i = 0; i < readyTimers.size(); i++) {
+        readyTimerIds.push_back(readyTimers[i]->id);
+    }
+    size_t nextReady = 0;
 
 	// loop until all handlers that should have been called by now or before
 	// are invoked and renewed if periodic.  Remember that NewTimer and CancelTimer
-	// keep the timer_list happily sorted on "when" for us.  We use "now" as a 
+	// keep the timer_heap ordered on "when" for us.  We use "now" as a 
 	// variable so that if some of these handler functions run for a long time,
 	// we do not sit in this loop forever.
 	// we make certain we do not call more than "max_fires" handlers in a 
 	// single timeout --- this ensures that timers don't starve out the rest
 	// of daemonCore if a timer handler resets itself to 0.
-	while( (timer_list != NULL) && (timer_list->when <= now ) &&
-		   (num_fires < max_timer_events_per_cycle))
+	while( num_fires < max_timer_events_per_cycle )
 	{
-        in_timeout = timer_list;
-
         // In this code block, if there is no limit on how many timer handlers we will invoke,
         // we want to skip over timers that got  added or reset by other timer handlers to make
         // certain we aren't stuck here forever. So we will only call timer handlers that
-        // were ready to fire when we first entered Timeout().
+        // were ready to fire when we first entered Timeout(), and that were not cancelled
+        // or reset into the future by the handlers called before them.
         if (max_timer_events_per_cycle == INT_MAX) {
-            std::unordered_set<int>::iterator it;
-            bool call_handler = false;
-            // Skip handlers already invoked or added
-            do {
-                it = readyTimerIds.find(in_timeout->id);
-                if (it == readyTimerIds.end()) {
-                    // this timer was not ready when we first looked, so it must have been
-                    // added or reset by another timer callback.  in this case, skip this timer
-                    // callback (we will deal with it next time through the daemoncore loop).
-                    dprintf(D_DAEMONCORE, "Timer %d not fired (SKIPPED) cause added\n", in_timeout->id);
-                    in_timeout = in_timeout->next;
-                }
-                else {
-                    // this timer was ready to fire when we first looked at the timer list, so
-                    // we are going to go ahead and call its handler.  Erase it from our readyTimerIds
-                    // list, and then break out of loop to go ahead and call the handler.
-                    call_handler = true;
-                    readyTimerIds.erase(it);
+            in_timeout = NULL;
+            while (nextReady < readyTimerIds.size()) {
+                Timer *timer_ptr = GetTimer(readyTimerIds[nextReady++]);
+                if (timer_ptr && timer_ptr->when <= now) {
+                    in_timeout = timer_ptr;
+                    break;
                 }
-            } while ((!call_handler) && (in_timeout != NULL) && (in_timeout->when <= now));
-
-            if (!call_handler) {
-                // no timers left that we want to fire at this time, break out of outer while loop
+            }
+            if ( ! in_timeout) {
+                // no timers left that we want to fire at this time
                 break;
             }
+        } else {
+            if (timer_heap.empty() || timer_heap[0]->when > now) {
+                break;
+            }
+            in_timeout = timer_heap[0];
         }  // end of block if max_timer_events_per_cycle == INT_MAX
 
         num_fires++;
@@ -461,6 +450,10 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 			in_timeout->timeslice->setStartTimeNow();
 		}
 
+		// How late is this handler being called?  The "when" of a timer only
+		// has a resolution of a second, so this is at best accurate to that.
+		daemonCore->dc_stats.TimerLatency += _condor_debug_get_time_double() - (double)in_timeout->when;
+
 		// Now we call the registered handler.  If we were told that the handler
 		// is a c++ method, we call the handler from the c++ object referenced 
 		// by service*.  If we were told the handler is a c function, we call
@@ -510,12 +503,10 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 			// If a new timer was added at a time in the past
 			// (possible when resetting a timeslice timer), then
 			// it may have landed before the timer we just processed,
-			// meaning that we cannot assume prev==NULL in the call
-			// to RemoveTimer() below.
+			// so it is not necessarily still at the top of the heap.
 
-			Timer *prev = NULL;
-			ASSERT( GetTimer(in_timeout->id,&prev) == in_timeout );
-			RemoveTimer( in_timeout, prev );
+			ASSERT( GetTimer(in_timeout->id) == in_timeout );
+			RemoveTimer( in_timeout );
 
 			if ( in_timeout->period > 0 || in_timeout->timeslice ) {
 				in_timeout->period_started = time(NULL);
@@ -533,6 +524,7 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 			} else {
 				// timer is not perodic; it is just a one-time event.  we just called
 				// the handler, so now just delete it. 
+				timer_map.erase( in_timeout->id );
 				DeleteTimer( in_timeout );
 			}
 		}
@@ -541,13 +533,13 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 
 	// set result to number of seconds until next event.  get an update on the
 	// time from time() in case the handlers we called above took significant time.
-	if ( timer_list == NULL ) {
+	if ( timer_heap.empty() ) {
 		// we set result to be -1 so that we do not busy poll.
 		// a -1 return value will tell the DaemonCore:Driver to use select with
 		// no timeout.
 		result = -1;
 	} else {
-		result = (timer_list->when) - time(NULL);
+		result = (timer_heap[0]->when) - time(NULL);
 		if (result < 0)
 			result = 0;
 	}
@@ -563,7 +555,6 @@ TimerManager::Timeout(int * pNumFired /*= NULL*/, double * pruntime /*=NULL*/)
 
 void TimerManager::DumpTimerList(int flag, const char* indent)
 {
-	Timer		*timer_ptr;
 	const char	*ptmp;
 
 	// we want to allow flag to be "D_FULLDEBUG | D_DAEMONCORE",
@@ -580,8 +571,11 @@ void TimerManager::DumpTimerList(int flag, const char* indent)
 	dprintf(flag, "\n");
 	dprintf(flag, "%sTimers\n", indent);
 	dprintf(flag, "%s~~~~~~\n", indent);
-	for(timer_ptr = timer_list; timer_ptr != NULL; timer_ptr = timer_ptr->next)
+	std::vector<Timer*> timers( timer_heap );
+	std::sort( timers.begin(), timers.end(), TimerBefore );
+	for( size_t i = 0; i < timers.size(); i++ )
 	{
+		Timer *timer_ptr = timers[i];
 		if ( timer_ptr->event_descrip )
 			ptmp = timer_ptr->event_descrip;
 		else
@@ -648,68 +642,88 @@ void TimerManager::Start()
 	}
 }
 
-void TimerManager::RemoveTimer( Timer *timer, Timer *prev )
+bool TimerManager::TimerBefore( const Timer *a, const Timer *b )
 {
-	if ( timer == NULL || ( prev && prev->next != timer ) ||
-		 ( !prev && timer != timer_list ) ) {
-		EXCEPT( "Bad call to TimerManager::RemoveTimer()!" );
+	if ( a->when != b->when ) {
+		return a->when < b->when;
+	}
+	return a->insert_seq < b->insert_seq;
+}
+
+void TimerManager::SiftUp( size_t index )
+{
+	Timer *timer = timer_heap[index];
+	while ( index > 0 ) {
+		size_t parent = (index - 1) / 2;
+		if ( ! TimerBefore( timer, timer_heap[parent] ) ) {
+			break;
+		}
+		timer_heap[index] = timer_heap[parent];
+		timer_heap[index]->heap_index = (int)index;
+		index = parent;
 	}
+	timer_heap[index] = timer;
+	timer->heap_index = (int)index;
+}
 
-	if ( timer == timer_list ) {
-		timer_list = timer_list->next;
+void TimerManager::SiftDown( size_t index )
+{
+	Timer *timer = timer_heap[index];
+	size_t size = timer_heap.size();
+	for (;;) {
+		size_t child = 2 * index + 1;
+		if ( child >= size ) {
+			break;
+		}
+		if ( child + 1 < size && TimerBefore( timer_heap[child + 1], timer_heap[child] ) ) {
+			child++;
+		}
+		if ( ! TimerBefore( timer_heap[child], timer ) ) {
+			break;
+		}
+		timer_heap[index] = timer_heap[child];
+		timer_heap[index]->heap_index = (int)index;
+		index = child;
 	}
-	if ( timer == list_tail ) {
-		list_tail = prev;
+	timer_heap[index] = timer;
+	timer->heap_index = (int)index;
+}
+
+void TimerManager::RemoveTimer( Timer *timer )
+{
+	if ( timer == NULL || timer->heap_index < 0 ||
+		 (size_t)timer->heap_index >= timer_heap.size() ||
+		 timer_heap[timer->heap_index] != timer ) {
+		EXCEPT( "Bad call to TimerManager::RemoveTimer()!" );
 	}
-	if ( prev ) {
-		prev->next = timer->next;
+
+	size_t index = timer->heap_index;
+	Timer *last = timer_heap.back();
+	timer_heap.pop_back();
+	timer->heap_index = -1;
+	if ( last != timer ) {
+		timer_heap[index] = last;
+		last->heap_index = (int)index;
+		if ( index > 0 && TimerBefore( last, timer_heap[(index - 1) / 2] ) ) {
+			SiftUp( index );
+		} else {
+			SiftDown( index );
+		}
 	}
 }
 
 void TimerManager::InsertTimer( Timer *new_timer )
 {
-	if ( timer_list == NULL ) {
-		// list is empty, place ours in front
-		timer_list = new_timer;
-		list_tail = new_timer;
-		new_timer->next = NULL;
+	// A timer inserted later goes after the timers with the same "when"
+	// -- this makes certain we "round-robin" across timers that
+	// constantly reset themselves to zero.
+	new_timer->insert_seq = timer_insert_seq++;
+	timer_heap.push_back( new_timer );
+	SiftUp( timer_heap.size() - 1 );
+
+	if ( new_timer->heap_index == 0 ) {
 			// since we have a new first timer, we must wake up select
 		daemonCore->Wake_up_select();
-	} else {
-		// list is not empty, so keep timer_list ordered from soonest to
-		// farthest (i.e. sorted on "when").
-		// Note: when doing the comparisons, we always use "<" instead
-		// of "<=" -- this makes certain we "round-robin" across 
-		// timers that constantly reset themselves to zero.
-		if ( new_timer->when < timer_list->when ) {
-			// make the this new timer first in line
-			new_timer->next = timer_list;
-			timer_list = new_timer;
-			// since we have a new first timer, we must wake up select
-			daemonCore->Wake_up_select();
-		} else if ( new_timer->when == TIME_T_NEVER ) {
-			// Our new timer goes to the very back of the list.
-			new_timer->next = NULL;
-			list_tail->next = new_timer;
-			list_tail = new_timer;
-		} else {
-			Timer* timer_ptr;
-			Timer* trail_ptr = NULL;
-			for (timer_ptr = timer_list; timer_ptr != NULL; 
-				 timer_ptr = timer_ptr->next ) 
-			{
-				if (new_timer->when < timer_ptr->when) {
-					break;
-				}
-				trail_ptr = timer_ptr;
-			}
-			ASSERT( trail_ptr );
-			new_timer->next = timer_ptr;
-			trail_ptr->next = new_timer;
-			if ( trail_ptr == list_tail ) {
-				list_tail = new_timer;
-			}
-		}
 	}
 }
 
@@ -735,18 +749,11 @@ void TimerManager::DeleteTimer( Timer *timer )
 	delete timer;
 }
 
-Timer *TimerManager::GetTimer( int id, Timer **prev )
+Timer *TimerManager::GetTimer( int id )
 {
-	Timer *timer_ptr = timer_list;
-	if( prev ) {
-		*prev = NULL;
+	std::unordered_map<int, Timer*>::iterator it = timer_map.find( id );
+	if ( it == timer_map.end() ) {
+		return NULL;
 	}
-	while ( timer_ptr && timer_ptr->id != id ) {
-		if( prev ) {
-			*prev = timer_ptr;
-		}
-		timer_ptr = timer_ptr->next;
-	}
-
-	return timer_ptr;
+	return it->second;
 }
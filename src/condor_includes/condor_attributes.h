@@ -78,6 +78,7 @@
 #define ATTR_CLAIM_STARTD  "ClaimStartd"
 #define ATTR_COD_CLAIMS  "CODClaims"
 #define ATTR_COLLECTOR_HOST  "CollectorHost"
+#define ATTR_COLLECTOR_UPDATE_SEQUENCE  "CollectorUpdateSequence"
 #define ATTR_COMMAND  "Command"
 #define ATTR_COMPRESS_FILES  "CompressFiles"
 #define ATTR_CONTAINER_SERVICE_NAMES "ContainerServiceNames"
@@ -1083,6 +1084,13 @@ extern const char ATTR_SEC_AUTHENTICATED_USER [];
 #define ATTR_LAST_NEGOTIATION_CYCLE_TOTAL_SLOTS  "LastNegotiationCycleTotalSlots"
 #define ATTR_LAST_NEGOTIATION_CYCLE_TRIMMED_SLOTS  "LastNegotiationCycleTrimmedSlots"
 #define ATTR_LAST_NEGOTIATION_CYCLE_CANDIDATE_SLOTS  "LastNegotiationCycleCandidateSlots"
+#define ATTR_LAST_NEGOTIATION_CYCLE_PREFILTERED_SLOTS  "LastNegotiationCyclePrefilteredSlots"
+#define ATTR_LAST_NEGOTIATION_CYCLE_SHARED_MATCH_LISTS  "LastNegotiationCycleSharedMatchLists"
+#define ATTR_LAST_NEGOTIATION_CYCLE_COLLECTOR_FETCH_HISTOGRAM  "LastNegotiationCycleCollectorFetchHistogram"
+#define ATTR_LAST_NEGOTIATION_CYCLE_PREFETCH_HISTOGRAM  "LastNegotiationCyclePrefetchHistogram"
+#define ATTR_LAST_NEGOTIATION_CYCLE_NEGOTIATE_HISTOGRAM  "LastNegotiationCycleNegotiateHistogram"
+#define ATTR_LAST_NEGOTIATION_CYCLE_MATCHMAKING_HISTOGRAM  "LastNegotiationCycleMatchmakingHistogram"
+#define ATTR_LAST_NEGOTIATION_CYCLE_CLAIM_HISTOGRAM  "LastNegotiationCycleClaimHistogram"
 #define ATTR_LAST_NEGOTIATION_CYCLE_SLOT_SHARE_ITER  "LastNegotiationCycleSlotShareIter"
 #define ATTR_LAST_NEGOTIATION_CYCLE_NUM_SCHEDULERS  "LastNegotiationCycleNumSchedulers"
 #define ATTR_LAST_NEGOTIATION_CYCLE_NUM_IDLE_JOBS  "LastNegotiationCycleNumIdleJobs"
@@ -26,6 +26,9 @@
 
 #include "CryptKey.h"
 
+// from <openssl/evp.h>, which most users of this header do not need
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
 struct StreamCryptoState {
     // The IV is a 16-byte random number.  The first 4 bytes are modified with
     // a message counter to ensure it is unique.
@@ -72,10 +75,15 @@ public:
     int m_method_key_data_len;
     unsigned char *m_method_key_data;
 
-// this data structure is used for AESGCM:
+// these fields are used for AESGCM:
 //
     StreamCryptoState m_stream_crypto_state;
 
+    // cipher contexts for each direction, keyed on first use so that
+    // each message only has to set a new IV.  owned by this object.
+    EVP_CIPHER_CTX *m_enc_ctx;
+    EVP_CIPHER_CTX *m_dec_ctx;
+
 private:
     Condor_Crypto_State() {ASSERT("PRIVATE CONSTRUCTOR CALLED\n");} ;
     Condor_Crypto_State(Condor_Crypto_State&) {ASSERT("PRIVATE COPY CONSTRUCTOR CALLED\n");};
@@ -316,6 +316,16 @@ protected:
 	*/
 
 	int prepare_for_nobuffering( stream_coding = stream_unknown);
+#if defined(LINUX)
+		// Used by put_file() and get_file() to move unencrypted file
+		// data between fd and the socket inside the kernel.  total is
+		// advanced by the bytes moved.  If the kernel can't do it for
+		// this fd, these return 0 early and the caller copies the rest.
+	int put_file_zero_copy( int fd, filesize_t bytes, filesize_t &total,
+							class DCTransferQueue *xfer_q );
+	int get_file_zero_copy( int &fd, filesize_t bytes, filesize_t &total,
+							int &saved_errno, class DCTransferQueue *xfer_q );
+#endif
 	int perform_authenticate( bool with_key, KeyInfo *& key, 
 							  const char* methods, CondorError* errstack,
 							  int auth_timeout, bool non_blocking, char **method_used );
@@ -115,7 +115,10 @@ public:
 	// interface no longer supported
 	int attach_to_file_desc(int);
 #endif
-	static int recvQueueDepth(int port);
+	// bytes waiting to be read on the UDP socket bound to the given port,
+	// and if drops is not NULL, the number of messages the kernel has
+	// dropped on it because its receive buffer was full.
+	static int recvQueueDepth(int port, long long *drops = NULL);
 	
 
 	//	byte operations
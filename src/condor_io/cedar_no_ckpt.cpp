@@ -47,9 +47,14 @@
 #include "dc_transfer_queue.h"
 #include "limit_directory_access.h"
 
+#include "selector.h"
+
 #ifdef WIN32
 #include <mswsock.h>	// For TransmitFile()
 #endif
+#if defined(LINUX)
+#include <sys/sendfile.h>
+#endif
 
 const unsigned int PUT_FILE_EOM_NUM = 666;
 
@@ -59,6 +64,280 @@ const int GET_FILE_NULL_FD = -10;
 
 const size_t OLD_FILE_BUF_SZ = 65536;
 const size_t AES_FILE_BUF_SZ = 262144;
+const size_t MIN_FILE_BUF_SZ = 4096;
+const size_t MAX_FILE_BUF_SZ = 1048576;
+
+// Picks the size of the buffer put_file() and get_file() copy a file
+// through.  Without AES, the buffer never goes on the wire, so it is as
+// large as the file up to MAX_FILE_BUF_SZ.  With AES, each buffer is a
+// CEDAR message whose size the sender tells the receiver, and we keep
+// to the size older versions use for large files.
+static size_t
+file_buf_size( bool buffered, filesize_t bytes )
+{
+	size_t max_sz = buffered ? AES_FILE_BUF_SZ : MAX_FILE_BUF_SZ;
+	if ( bytes < (filesize_t)MIN_FILE_BUF_SZ ) {
+		return MIN_FILE_BUF_SZ;
+	}
+	if ( bytes < (filesize_t)max_sz ) {
+		return (size_t)bytes;
+	}
+	return max_sz;
+}
+
+#if defined(LINUX)
+// The zero-copy loops run with the socket in non-blocking mode, so that
+// the socket timeout still applies.  This waits for the socket to be
+// ready again, for at most timeout seconds (forever if 0).
+static bool
+zero_copy_wait( const char *peer, int sock, Selector::IO_FUNC io, int timeout )
+{
+	Selector selector;
+	selector.add_fd( sock, io );
+	if ( timeout > 0 ) {
+		selector.set_timeout( timeout );
+	}
+	do {
+		selector.execute();
+	} while ( selector.signalled() );
+
+	if ( selector.timed_out() ) {
+		dprintf( D_ALWAYS, "ReliSock: zero-copy file transfer: timed out "
+				 "after %d seconds waiting for %s\n", timeout, peer );
+		return false;
+	}
+	if ( !selector.has_ready() ) {
+		dprintf( D_ALWAYS, "ReliSock: zero-copy file transfer: select() "
+				 "returned %d waiting for %s (errno=%d %s)\n",
+				 selector.select_retval(), peer, errno, strerror(errno) );
+		return false;
+	}
+	return true;
+}
+
+// Copies bytes out of a pipe and into fd through user space, for when
+// splice() can't write to fd.  If the write fails, the rest is read and
+// thrown away so the pipe is left empty, and false is returned with
+// errno set by the write.
+static bool
+zero_copy_drain( int pipe_fd, ssize_t bytes, int fd )
+{
+	char buf[65536];
+	bool ok = true;
+	int write_errno = 0;
+	while ( bytes > 0 ) {
+		ssize_t nr = read( pipe_fd, buf, MIN( (ssize_t)sizeof(buf), bytes ) );
+		if ( nr < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( nr <= 0 ) {
+				// can't happen: the bytes are in the pipe
+			EXCEPT( "zero_copy_drain: read from pipe returned %d (errno=%d)",
+					(int)nr, errno );
+		}
+		bytes -= nr;
+		for ( ssize_t written = 0; ok && written < nr; ) {
+			ssize_t nw = ::write( fd, buf + written, nr - written );
+			if ( nw < 0 && errno == EINTR ) {
+				continue;
+			}
+			if ( nw <= 0 ) {
+				ok = false;
+				write_errno = nw < 0 ? errno : ENOSPC;
+				break;
+			}
+			written += nw;
+		}
+	}
+	if ( !ok ) {
+		errno = write_errno;
+	}
+	return ok;
+}
+
+int
+ReliSock::put_file_zero_copy( int fd, filesize_t bytes, filesize_t &total,
+							  DCTransferQueue *xfer_q )
+{
+	if ( !prepare_for_nobuffering(stream_encode) ) {
+		dprintf( D_ALWAYS, "ReliSock: put_file: failed to drain buffers!\n" );
+		return -1;
+	}
+
+	int sock_flags = fcntl( _sock, F_GETFL );
+	if ( sock_flags < 0 || fcntl( _sock, F_SETFL, sock_flags | O_NONBLOCK ) < 0 ) {
+		return 0;
+	}
+
+	int rc = 0;
+	struct timeval t1, t2;
+	if( xfer_q ) {
+		condor_gettimestamp(t1);
+	}
+	while ( total < bytes ) {
+		size_t chunk = (size_t)MIN( (filesize_t)MAX_FILE_BUF_SZ, bytes - total );
+		ssize_t nw = sendfile( _sock, fd, NULL, chunk );
+		if ( nw < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+				if ( !zero_copy_wait( peer_description(), _sock, Selector::IO_WRITE, _timeout ) ) {
+					rc = -1;
+					break;
+				}
+				continue;
+			}
+			if ( errno == EINVAL || errno == ENOSYS ) {
+				dprintf( D_FULLDEBUG, "ReliSock: put_file: sendfile() not "
+						 "supported for this file (errno=%d %s), using read()\n",
+						 errno, strerror(errno) );
+				break;
+			}
+			dprintf( D_ALWAYS, "ReliSock: put_file: sendfile() failed after "
+					 FILESIZE_T_FORMAT " bytes: errno=%d %s\n",
+					 total, errno, strerror(errno) );
+			rc = -1;
+			break;
+		}
+		if ( nw == 0 ) {
+				// The file got shorter.  Let the caller find out.
+			break;
+		}
+
+		if( xfer_q ) {
+				// We don't know how much of the time was spent reading
+				// from disk vs. writing to the network, so we just report
+				// it all as network i/o time.
+			condor_gettimestamp(t2);
+			xfer_q->AddUsecNetWrite(timersub_usec(t2, t1));
+			xfer_q->AddBytesSent(nw);
+			xfer_q->ConsiderSendingReport(t2.tv_sec);
+			t1 = t2;
+		}
+		_bytes_sent += nw;
+		total += nw;
+	}
+
+	fcntl( _sock, F_SETFL, sock_flags );
+	return rc;
+}
+
+int
+ReliSock::get_file_zero_copy( int &fd, filesize_t bytes, filesize_t &total,
+							  int &saved_errno, DCTransferQueue *xfer_q )
+{
+	if ( !prepare_for_nobuffering(stream_decode) ) {
+		dprintf( D_ALWAYS, "get_file: prepare_for_nobuffering() failed!\n" );
+		return -1;
+	}
+
+		// splice() can only move data between a pipe and something
+		// else, so the data goes from the socket to the file through
+		// a pipe.  A bigger pipe means fewer calls; if the kernel
+		// won't make it bigger, the default works too.
+	int pipe_fds[2];
+	if ( pipe2( pipe_fds, O_CLOEXEC ) < 0 ) {
+		return 0;
+	}
+	fcntl( pipe_fds[1], F_SETPIPE_SZ, (int)MAX_FILE_BUF_SZ );
+
+	int sock_flags = fcntl( _sock, F_GETFL );
+	if ( sock_flags < 0 || fcntl( _sock, F_SETFL, sock_flags | O_NONBLOCK ) < 0 ) {
+		::close( pipe_fds[0] );
+		::close( pipe_fds[1] );
+		return 0;
+	}
+
+	int rc = 0;
+	struct timeval t1, t2;
+	if( xfer_q ) {
+		condor_gettimestamp(t1);
+	}
+	while ( total < bytes ) {
+		size_t chunk = (size_t)MIN( (filesize_t)MAX_FILE_BUF_SZ, bytes - total );
+		ssize_t nr = splice( _sock, NULL, pipe_fds[1], NULL, chunk,
+							 SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+		if ( nr < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+				if ( !zero_copy_wait( peer_description(), _sock, Selector::IO_READ, _timeout ) ) {
+					rc = -1;
+					break;
+				}
+				continue;
+			}
+			if ( errno == EINVAL || errno == ENOSYS ) {
+				dprintf( D_FULLDEBUG, "ReliSock: get_file: splice() not "
+						 "supported (errno=%d %s), using read()\n",
+						 errno, strerror(errno) );
+				break;
+			}
+			dprintf( D_ALWAYS, "ReliSock: get_file: splice() from %s failed "
+					 "after " FILESIZE_T_FORMAT " bytes: errno=%d %s\n",
+					 peer_description(), total, errno, strerror(errno) );
+			rc = -1;
+			break;
+		}
+		if ( nr == 0 ) {
+			dprintf( D_ALWAYS, "ReliSock: get_file: %s closed the connection "
+					 "after " FILESIZE_T_FORMAT " bytes\n",
+					 peer_description(), total );
+			rc = -1;
+			break;
+		}
+		if( xfer_q ) {
+			condor_gettimestamp(t2);
+			xfer_q->AddUsecNetRead(timersub_usec(t2, t1));
+		}
+		_bytes_recvd += nr;
+		total += nr;
+
+		ssize_t left = nr;
+		while ( left > 0 ) {
+			ssize_t nw = splice( pipe_fds[0], NULL, fd, NULL, left, SPLICE_F_MOVE );
+			if ( nw < 0 && errno == EINTR ) {
+				continue;
+			}
+			if ( nw <= 0 ) {
+				break;
+			}
+			left -= nw;
+		}
+		bool done = false;
+		if ( left > 0 ) {
+				// Either this fd doesn't take splice() or the write
+				// failed.  Writing the rest from user space sorts out
+				// which, and we copy through user space from here on.
+			done = true;
+			if ( !zero_copy_drain( pipe_fds[0], left, fd ) ) {
+				saved_errno = errno;
+				dprintf( D_ALWAYS, "ReliSock::get_file: write() failed: %s "
+						 "(errno=%d)\n", strerror(errno), errno );
+					// Continue reading data, but throw it all away.
+				fd = GET_FILE_NULL_FD;
+				rc = GET_FILE_WRITE_FAILED;
+			}
+		}
+		if( xfer_q ) {
+			condor_gettimestamp(t1);
+			xfer_q->AddUsecFileWrite(timersub_usec(t1, t2));
+			xfer_q->AddBytesReceived(nr);
+			xfer_q->ConsiderSendingReport(t1.tv_sec);
+		}
+		if ( done ) {
+			break;
+		}
+	}
+
+	fcntl( _sock, F_SETFL, sock_flags );
+	::close( pipe_fds[0] );
+	::close( pipe_fds[1] );
+	return rc;
+}
+#endif
 
 int
 ReliSock::get_file( filesize_t *size, const char *destination,
@@ -150,7 +429,8 @@ ReliSock::get_file( filesize_t *size, int fd,
 	int retval = 0;
 	int saved_errno = 0;
 	bool buffered = get_encryption() && get_crypto_state()->m_keyInfo.getProtocol() == CONDOR_AESGCM;
-	size_t buf_sz = OLD_FILE_BUF_SZ;
+	size_t buf_sz = 0;
+	bool failed = false;
 
 		// NOTE: the caller may pass fd=GET_FILE_NULL_FD, in which
 		// case we just read but do not write the data.
@@ -167,14 +447,38 @@ ReliSock::get_file( filesize_t *size, int fd,
 	if ( append ) {
 		lseek( fd, 0, SEEK_END );
 	}
-
-	std::unique_ptr<char[]> buf(new char[buf_sz]);
+	if ( !buffered ) {
+		buf_sz = file_buf_size( false, bytes_to_receive );
+	}
 
 	// Log what's going on
 	dprintf( D_FULLDEBUG,
 			 "get_file: Receiving " FILESIZE_T_FORMAT " bytes\n",
 			 bytes_to_receive );
 
+#if defined(LINUX)
+	// Without encryption, the file arrives as raw bytes on the socket,
+	// which the kernel can move to the file itself.  splice() won't
+	// write to a file opened for append.
+	if ( !get_encryption() && fd != GET_FILE_NULL_FD && bytes_to_receive > 0 &&
+		 (max_bytes < 0 || bytes_to_receive <= max_bytes) &&
+		 (fcntl( fd, F_GETFL ) & O_APPEND) == 0 &&
+		 param_boolean( "FILE_TRANSFER_ZERO_COPY", true ) )
+	{
+		int rc = get_file_zero_copy( fd, bytes_to_receive, total, saved_errno, xfer_q );
+		if ( rc == GET_FILE_WRITE_FAILED ) {
+			retval = rc;
+		} else if ( rc < 0 ) {
+			failed = true;
+		}
+	}
+#endif
+
+	std::unique_ptr<char[]> buf;
+	if ( !failed && total < bytes_to_receive ) {
+		buf.reset(new char[buf_sz]);
+	}
+
 		/*
 		  the code used to check for filesize == -1 here, but that's
 		  totally wrong.  we're storing the size as an unsigned int,
@@ -185,7 +489,7 @@ ReliSock::get_file( filesize_t *size, int fd,
 		*/
 
 	// Now, read it all in & save it
-	while( total < bytes_to_receive ) {
+	while( !failed && total < bytes_to_receive ) {
 		struct timeval t1,t2;
 		if( xfer_q ) {
 			condor_gettimestamp(t1);
@@ -408,7 +712,6 @@ ReliSock::put_file( filesize_t *size, int fd, filesize_t offset, filesize_t max_
 	filesize_t	filesize;
 	filesize_t	total = 0;
 	bool buffered = get_encryption() && get_crypto_state()->m_keyInfo.getProtocol() == CONDOR_AESGCM;
-	const size_t buf_sz = buffered ? AES_FILE_BUF_SZ : OLD_FILE_BUF_SZ;
 
 	StatInfo filestat( fd );
 	if ( filestat.Error() ) {
@@ -456,6 +759,7 @@ ReliSock::put_file( filesize_t *size, int fd, filesize_t offset, filesize_t max_
 		bytes_to_send = max_bytes;
 		max_bytes_exceeded = true;
 	}
+	const size_t buf_sz = file_buf_size( buffered, bytes_to_send );
 
 	// Send the file size to the receiver
 	// If we're operating in buffered mode, also send the buffer size
@@ -468,6 +772,12 @@ ReliSock::put_file( filesize_t *size, int fd, filesize_t offset, filesize_t max_
 	if ( offset ) {
 		lseek( fd, offset, SEEK_SET );
 	}
+#ifdef POSIX_FADV_SEQUENTIAL
+	if ( bytes_to_send > 0 ) {
+			// ask for more readahead, since we read the whole thing once
+		posix_fadvise( fd, offset, bytes_to_send, POSIX_FADV_SEQUENTIAL );
+	}
+#endif
 
 	// Log what's going on
 	dprintf(D_FULLDEBUG,
@@ -522,12 +832,26 @@ ReliSock::put_file( filesize_t *size, int fd, filesize_t offset, filesize_t max_
 		}
 #endif
 
-		std::unique_ptr<char[]> buf(new char[buf_sz]);
+#if defined(LINUX)
+		// Without encryption, let the kernel send the file straight
+		// from the page cache.  This is the same data on the wire as
+		// put_bytes_nobuffer() would send.
+		if ( !get_encryption() && param_boolean( "FILE_TRANSFER_ZERO_COPY", true ) ) {
+			if ( put_file_zero_copy( fd, bytes_to_send, total, xfer_q ) < 0 ) {
+				return -1;
+			}
+		}
+#endif
+
+		std::unique_ptr<char[]> buf;
+		if ( total < bytes_to_send ) {
+			buf.reset(new char[buf_sz]);
+		}
 		int nbytes, nrd;
 
-		// On Unix, always send the file using put_bytes_nobuffer().
-		// Note that on Win32, we use this method as well if encryption 
-		// is required.
+		// Otherwise, send the file using put_bytes_nobuffer(), or in
+		// CEDAR messages with AES.  Note that on Win32, we use this method
+		// as well if encryption is required.
 		while (total < bytes_to_send) {
 			struct timeval t1;
 			struct timeval t2;
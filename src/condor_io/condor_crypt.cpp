@@ -30,6 +30,7 @@
 // function in each method object.
 #include <openssl/des.h>
 #include <openssl/blowfish.h>
+#include <openssl/evp.h>
 
 #include "condor_crypt_aesgcm.h"
 
@@ -47,6 +48,8 @@ Condor_Crypto_State::Condor_Crypto_State(Protocol proto, KeyInfo &key) :
     m_ivec = NULL;
     m_method_key_data_len = 0;
     m_method_key_data = NULL;
+    m_enc_ctx = NULL;
+    m_dec_ctx = NULL;
 
     // there should probably be a static function in each crypto object to do
     // these conversions so that the state object doesn't need any specifc
@@ -100,6 +103,8 @@ Condor_Crypto_State::Condor_Crypto_State(Protocol proto, KeyInfo &key) :
 Condor_Crypto_State::~Condor_Crypto_State() {
     if(m_ivec) free(m_ivec);
     if(m_method_key_data) free(m_method_key_data);
+    if(m_enc_ctx) EVP_CIPHER_CTX_free(m_enc_ctx);
+    if(m_dec_ctx) EVP_CIPHER_CTX_free(m_dec_ctx);
 }
 
 void Condor_Crypto_State::reset() {
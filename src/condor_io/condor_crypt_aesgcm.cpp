@@ -22,7 +22,6 @@
 #include "condor_debug.h"
 #include "condor_crypt_aesgcm.h"
 
-#include <memory>
 #include <algorithm>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
@@ -32,6 +31,44 @@
 
 unsigned char g_unset_iv[IV_SIZE] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
+// Returns the cipher context for one direction of a stream, creating it
+// and setting the key the first time through.  Setting the key expands the
+// AES key schedule, so after that only the IV is set for each message.
+static EVP_CIPHER_CTX *
+keyed_context(EVP_CIPHER_CTX *&ctx, const unsigned char *key, int enc, const char *who)
+{
+    if (ctx) {
+        return ctx;
+    }
+
+    EVP_CIPHER_CTX *new_ctx = EVP_CIPHER_CTX_new();
+    if (!new_ctx) {
+        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::%s: ERROR: Failed to allocate new EVP method.\n", who);
+        return NULL;
+    }
+
+    if (1 != EVP_CipherInit_ex(new_ctx, EVP_aes_256_gcm(), NULL, NULL, NULL, enc)) {
+        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::%s: ERROR: Failed to create AES-GCM-256 mode.\n", who);
+        EVP_CIPHER_CTX_free(new_ctx);
+        return NULL;
+    }
+
+    if (1 != EVP_CIPHER_CTX_ctrl(new_ctx, EVP_CTRL_GCM_SET_IVLEN, IV_SIZE, NULL)) {
+        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::%s: ERROR: Failed to set IV length.\n", who);
+        EVP_CIPHER_CTX_free(new_ctx);
+        return NULL;
+    }
+
+    if (1 != EVP_CipherInit_ex(new_ctx, NULL, NULL, key, NULL, enc)) {
+        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::%s: ERROR: Failed to initialize key.\n", who);
+        EVP_CIPHER_CTX_free(new_ctx);
+        return NULL;
+    }
+
+    ctx = new_ctx;
+    return ctx;
+}
+
 // this function is static
 void Condor_Crypt_AESGCM::initState(StreamCryptoState* stream_state)
 {
@@ -91,22 +128,6 @@ bool Condor_Crypt_AESGCM::encrypt(Condor_Crypto_State *cs,
     // Authentication tag is an additional 16 bytes; IV is 16 bytes
     output_len += MAC_SIZE + (sending_IV ? IV_SIZE : 0);
 
-    std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
-    if (!ctx) {
-        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::encrypt: ERROR: Failed to allocate new EVP method.\n");
-        return false;
-    }
-
-    if (1 != EVP_EncryptInit_ex(ctx.get(), EVP_aes_256_gcm(), NULL, NULL, NULL)) {
-        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::encrypt: ERROR: Failed to create AES-GCM-256 mode.\n");
-        return false;
-    }
-
-    if (1 != EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, IV_SIZE, NULL)) {
-        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::encrypt: ERROR: Failed to set IV length.\n");
-        return false;
-    }
-
     // here we do the math to change the IV.  we take the lowest 4 bytes, treat
     // it as an int, add the message counter, and put it back.  this guarantees
     // the IV changes from packet to packet.  if we max out, we don't want to
@@ -151,8 +172,13 @@ bool Condor_Crypt_AESGCM::encrypt(Condor_Crypto_State *cs,
     dprintf(D_NETWORK | D_VERBOSE, "Condor_Crypt_AESGCM::encrypt DUMP : about to init key %0x %0x %0x %0x.\n",
         *(kdp), *(kdp + 15), *(kdp + 16), *(kdp + 31));
 
-    if (1 != EVP_EncryptInit_ex(ctx.get(), NULL, NULL, cs->m_keyInfo.getKeyData(), iv)) {
-        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::encrypt: ERROR: Failed to initialize key and IV.\n");
+    EVP_CIPHER_CTX *ctx = keyed_context(cs->m_enc_ctx, kdp, 1, "encrypt");
+    if (!ctx) {
+        return false;
+    }
+
+    if (1 != EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv)) {
+        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::encrypt: ERROR: Failed to initialize IV.\n");
         return false;
     }
 
@@ -160,13 +186,13 @@ bool Condor_Crypt_AESGCM::encrypt(Condor_Crypto_State *cs,
     int len;
     dprintf(D_NETWORK | D_VERBOSE, "Condor_Crypt_AESGCM::encrypt DUMP : We have %d bytes of AAD data: %s...\n",
         aad_len, debug_hex_dump(hexdbg, reinterpret_cast<const char *>(aad), std::min(16, aad_len)));
-    if (aad && (1 != EVP_EncryptUpdate(ctx.get(), NULL, &len, aad, aad_len))) {
+    if (aad && (1 != EVP_EncryptUpdate(ctx, NULL, &len, aad, aad_len))) {
         dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::encrypt: ERROR: Failed to authenticate caller input data.\n");
         return false;
     }
 
     dprintf(D_NETWORK | D_VERBOSE, "Condor_Crypt_AESGCM::encrypt DUMP : We have %d bytes of plaintext\n", input_len);
-    if (1 != EVP_EncryptUpdate(ctx.get(), output + (sending_IV ? IV_SIZE : 0),
+    if (1 != EVP_EncryptUpdate(ctx, output + (sending_IV ? IV_SIZE : 0),
         &len, input, input_len))
     {
         dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::encrypt: ERROR: Failed to encrypt plaintext buffer.\n");
@@ -175,7 +201,7 @@ bool Condor_Crypt_AESGCM::encrypt(Condor_Crypto_State *cs,
     dprintf(D_NETWORK | D_VERBOSE, "Condor_Crypt_AESGCM::encrypt DUMP : First %d bytes written to ciphertext.\n", len);
 
     int len2;
-    if (1 != EVP_EncryptFinal_ex(ctx.get(), output + (sending_IV ? IV_SIZE : 0) + len, &len2)) {
+    if (1 != EVP_EncryptFinal_ex(ctx, output + (sending_IV ? IV_SIZE : 0) + len, &len2)) {
         dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::encrypt: ERROR: Failed to finalize cipher text.\n");
         return false;
     }
@@ -210,7 +236,7 @@ bool Condor_Crypt_AESGCM::encrypt(Condor_Crypto_State *cs,
 	}
 
     // extract the tag directly into the output stream to be given to CEDAR
-    if (1 != EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, MAC_SIZE, output + output_len - MAC_SIZE)) {
+    if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, MAC_SIZE, output + output_len - MAC_SIZE)) {
         dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::encrypt: ERROR: Failed to get tag.\n");
         return false;
     }
@@ -233,8 +259,6 @@ bool Condor_Crypt_AESGCM::decrypt(Condor_Crypto_State *cs,
                                   unsigned char *        output, 
                                   int&                   output_len)
 {
-    std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
-
     dprintf(D_NETWORK | D_VERBOSE, "Condor_Crypt_AESGCM::decrypt **********************\n");
     dprintf(D_NETWORK | D_VERBOSE, "Condor_Crypt_AESGCM::decrypt with input buffer %d.\n", input_len);
     StreamCryptoState *stream_state = &(cs->m_stream_crypto_state);
@@ -248,21 +272,6 @@ bool Condor_Crypt_AESGCM::decrypt(Condor_Crypto_State *cs,
         return false;
     }
 
-    if (!ctx) {
-        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::decrypt: ERROR: Failed to initialize EVP object.\n");
-        return false;
-    }
-
-    if (!EVP_DecryptInit_ex(ctx.get(), EVP_aes_256_gcm(), NULL, NULL, NULL)) {
-        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::decrypt: ERROR: Failed to initialize AES-GCM-256 mode.\n");
-        return false;
-    }
-
-    if (!EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, IV_SIZE, NULL)) {
-        dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::decrypt: ERROR: Failed to initialize IV length to %d.\n", IV_SIZE);
-        return false;
-    }
-
     if (cs->m_keyInfo.getProtocol() != CONDOR_AESGCM) {
         dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::decrypt: ERROR: failed due to the wrong protocol.\n");
         return false;
@@ -309,7 +318,12 @@ bool Condor_Crypt_AESGCM::decrypt(Condor_Crypto_State *cs,
         debug_hex_dump(hexdbg,
         reinterpret_cast<const char *>(iv), IV_SIZE));
 
-    if (!EVP_DecryptInit_ex(ctx.get(), NULL, NULL, kdp, iv)) {
+    EVP_CIPHER_CTX *ctx = keyed_context(cs->m_dec_ctx, kdp, 0, "decrypt");
+    if (!ctx) {
+        return false;
+    }
+
+    if (!EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv)) {
         dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::decrypt: ERROR: failed due to failed init.\n");
         return false;
     }
@@ -317,7 +331,7 @@ bool Condor_Crypt_AESGCM::decrypt(Condor_Crypto_State *cs,
     int len;
     dprintf(D_NETWORK | D_VERBOSE, "Condor_Crypt_AESGCM::decrypt DUMP : We have %d bytes of AAD data: %s...\n",
         aad_len, debug_hex_dump(hexdbg, reinterpret_cast<const char *>(aad), std::min(16, aad_len)));
-    if (aad && !EVP_DecryptUpdate(ctx.get(), NULL, &len, aad, aad_len)) {
+    if (aad && !EVP_DecryptUpdate(ctx, NULL, &len, aad, aad_len)) {
         dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::decrypt: ERROR: failed when authenticating user AAD.\n");
         return false;
     }
@@ -332,7 +346,7 @@ bool Condor_Crypt_AESGCM::decrypt(Condor_Crypto_State *cs,
         return false;
     }
 
-    if (!EVP_DecryptUpdate(ctx.get(), output, &len, input + (receiving_IV ? IV_SIZE : 0), input_len - (receiving_IV ? IV_SIZE : 0) - MAC_SIZE)) {
+    if (!EVP_DecryptUpdate(ctx, output, &len, input + (receiving_IV ? IV_SIZE : 0), input_len - (receiving_IV ? IV_SIZE : 0) - MAC_SIZE)) {
         dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::decrypt: ERROR: failed due to failed cipher text update.\n");
         return false;
     }
@@ -361,7 +375,7 @@ bool Condor_Crypt_AESGCM::decrypt(Condor_Crypto_State *cs,
 				*(output + len - 1));
 	}
 
-    if (!EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, MAC_SIZE, const_cast<unsigned char *>(input + input_len - MAC_SIZE))) {
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, MAC_SIZE, const_cast<unsigned char *>(input + input_len - MAC_SIZE))) {
         dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::decrypt: ERROR: failed due to failed set of tag.\n");
         return false;
     }
@@ -371,7 +385,7 @@ bool Condor_Crypt_AESGCM::decrypt(Condor_Crypto_State *cs,
         debug_hex_dump(hex2, reinterpret_cast<const char*>(input + input_len - MAC_SIZE), MAC_SIZE));
 
     dprintf(D_NETWORK | D_VERBOSE, "Condor_Crypt_AESGCM::decrypt DUMP : about to finalize output (len is %i).\n", len);
-    if (!EVP_DecryptFinal_ex(ctx.get(), output + len, &len)) {
+    if (!EVP_DecryptFinal_ex(ctx, output + len, &len)) {
         dprintf(D_ALWAYS, "Condor_Crypt_AESGCM::decrypt: ERROR: failed due to finalize decryption and check of tag.\n");
        return false;
     }
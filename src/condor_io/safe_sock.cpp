@@ -932,8 +932,9 @@ SafeSock::msgReady() {
 }
 
 /* static */ int
-SafeSock::recvQueueDepth(int port) {
+SafeSock::recvQueueDepth(int port, long long *drops) {
 	int depth = 0;
+	if (drops) { *drops = 0; }
 #ifdef LINUX
 	FILE *f = NULL;
 
@@ -963,15 +964,24 @@ SafeSock::recvQueueDepth(int port) {
 	int queueDepth = 0;
 	while (fscanf(f, "%d: %x:%x %x:%x %x %x:%x\n", &sl, &localAddr, &localPort, &remoteAddr, &remotePort, &status, &tx_queue, &queueDepth) > 1) {
 
-		if (localPort == port) {
-			depth = queueDepth;
-		}
 		// skip to beginning of next line
 		if (fgets(skipLine, sizeof(skipLine), f) == NULL) {
 			dprintf(D_ALWAYS, "Error skipping to end of in /proc/net/udp\n");
 			fclose(f);
 			return -1;
 		}
+		if (localPort == port) {
+			depth = queueDepth;
+			if (drops) {
+				// drops is the last field of the rest of the line
+				size_t len = strlen(skipLine);
+				while (len > 0 && isspace((unsigned char)skipLine[len - 1])) {
+					skipLine[--len] = 0;
+				}
+				const char *last = strrchr(skipLine, ' ');
+				*drops = last ? atoll(last + 1) : 0;
+			}
+		}
 	}
 	fclose(f);
 #else
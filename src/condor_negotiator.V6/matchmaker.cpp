@@ -80,6 +80,11 @@ char const *RESOURCES_IN_USE_BY_USERS_GROUP_FN_NAME = "ResourcesInUseByUsersGrou
 
 GCC_DIAG_OFF(float-equal)
 
+// histogram buckets for the time taken by steps of a negotiation cycle
+static const double negotiation_step_time_levels[] = {
+	0.0001, 0.001, 0.01, 0.1, 1.0, 10.0, 100.0,
+};
+
 class NegotiationCycleStats
 {
 public:
@@ -103,9 +108,18 @@ public:
     int prefetch_duration;
     double prefetch_cpu_time;
 
+    // wall clock time of each step of the cycle, in seconds
+    stats_histogram<double> collector_fetch_times;
+    stats_histogram<double> prefetch_times;
+    stats_histogram<double> negotiate_times;     // per submitter
+    stats_histogram<double> matchmaking_times;   // per job considered
+    stats_histogram<double> claim_times;         // per match sent
+
     int total_slots;
     int trimmed_slots;
     int candidate_slots;
+    int prefiltered_slots;
+    int shared_match_lists;
 
     int slot_share_iterations;
 
@@ -148,6 +162,8 @@ NegotiationCycleStats::NegotiationCycleStats():
     total_slots(0),
     trimmed_slots(0),
     candidate_slots(0),
+    prefiltered_slots(0),
+    shared_match_lists(0),
     slot_share_iterations(0),
     num_idle_jobs(0),
     num_jobs_considered(0),
@@ -162,6 +178,11 @@ NegotiationCycleStats::NegotiationCycleStats():
     submitters_failed(),
     schedds_out_of_time()
 {
+	collector_fetch_times.set_levels(negotiation_step_time_levels, COUNTOF(negotiation_step_time_levels));
+	prefetch_times.set_levels(negotiation_step_time_levels, COUNTOF(negotiation_step_time_levels));
+	negotiate_times.set_levels(negotiation_step_time_levels, COUNTOF(negotiation_step_time_levels));
+	matchmaking_times.set_levels(negotiation_step_time_levels, COUNTOF(negotiation_step_time_levels));
+	claim_times.set_levels(negotiation_step_time_levels, COUNTOF(negotiation_step_time_levels));
 }
 
 
@@ -388,14 +409,20 @@ Matchmaker ()
 	job_attr_references = NULL;
 	
 	stashedAds = new AdHash(hashFunction);
+	m_startdAdCacheSequence = 0;
+	want_incremental_ad_fetch = false;
 
 	MatchList = NULL;
 	cachedAutoCluster = -1;
 	cachedName = NULL;
 	cachedAddr = NULL;
+	m_matchListUses = 0;
+	m_matchListCacheSize = 8;
 
 	want_globaljobprio = false;
 	want_matchlist_caching = false;
+	want_slot_prefilter = false;
+	want_optimize_job_rank = false;
 	PublishCrossSlotPrios = false;
 	ConsiderPreemption = true;
 	ConsiderEarlyPreemption = false;
@@ -458,6 +485,7 @@ Matchmaker ()
 	slotWeightStr = 0;
 	m_staticRanks = false;
 	m_dryrun = false;
+	m_replay = NULL;
 }
 
 Matchmaker::
@@ -474,9 +502,7 @@ Matchmaker::
 	delete NegotiatorPreJobRank;
 	delete NegotiatorPostJobRank;
 	delete sockCache;
-	if (MatchList) {
-		delete MatchList;
-	}
+	forgetMatchList(NULL);
 	if ( cachedName ) free(cachedName);
 	if ( cachedAddr ) free(cachedAddr);
 
@@ -485,6 +511,7 @@ Matchmaker::
     if (SlotPoolsizeConstraint) delete SlotPoolsizeConstraint;
 	if (groupQuotasHash) delete groupQuotasHash;
 	if (stashedAds) delete stashedAds;
+	clearStartdAdCache();
     if (strSlotConstraint) free(strSlotConstraint), strSlotConstraint = NULL;
 
 	int i;
@@ -768,6 +795,32 @@ reinitialize ()
 
 	want_globaljobprio = param_boolean("USE_GLOBAL_JOB_PRIOS",false);
 	want_matchlist_caching = param_boolean("NEGOTIATOR_MATCHLIST_CACHING",true);
+	m_matchListCacheSize = param_integer("NEGOTIATOR_MATCHLIST_CACHE_SIZE",8,1);
+	want_slot_prefilter = param_boolean("NEGOTIATOR_SLOT_PREFILTER",true);
+	want_optimize_job_rank = param_boolean("NEGOTIATOR_OPTIMIZE_JOB_RANK",true);
+	if ( want_optimize_job_rank ) {
+			// The optimized job Rank is only correct when the job is the
+			// left ad of the match, so leave it alone if an expression
+			// that sees the job as TARGET refers to it.
+		classad::References target_refs;
+		ExprTree *job_target_exprs[] = { PreemptionReq, PreemptionRank,
+			NegotiatorPreJobRank, NegotiatorPostJobRank };
+		for ( size_t i = 0; i < sizeof(job_target_exprs)/sizeof(job_target_exprs[0]); i++ ) {
+			if ( job_target_exprs[i] ) {
+				GetAttrRefsOfScope(job_target_exprs[i], target_refs, "target");
+				GetAttrRefsOfScope(job_target_exprs[i], target_refs, "other");
+			}
+		}
+		if ( target_refs.count(ATTR_RANK) ) {
+			dprintf(D_ALWAYS, "Not optimizing job Rank for matchmaking, because a preemption or negotiator rank expression refers to it\n");
+			want_optimize_job_rank = false;
+		}
+	}
+	want_incremental_ad_fetch = param_boolean("NEGOTIATOR_INCREMENTAL_AD_FETCH",false);
+	param(m_traceFile, "NEGOTIATOR_CYCLE_TRACE_FILE");
+		// the cached ads depend on the query (slot constraint, projection),
+		// so start over whenever the configuration may have changed.
+	clearStartdAdCache();
 	PublishCrossSlotPrios = param_boolean("NEGOTIATOR_CROSS_SLOT_PRIOS", false);
 	ConsiderPreemption = param_boolean("NEGOTIATOR_CONSIDER_PREEMPTION",true);
 	ConsiderEarlyPreemption = param_boolean("NEGOTIATOR_CONSIDER_EARLY_PREEMPTION",false);
@@ -1311,6 +1364,7 @@ compute_significant_attrs(ClassAdListDoesNotDeleteAds & startdAds)
 	// set of full reference names and then call TrimReferenceNames()
 	// on that.
 	dprintf(D_FULLDEBUG,"Entering compute_significant_attrs()\n");
+	submitter_attr_references.clear();
 	ClassAd *startd_ad = NULL;
 	ClassAd *sample_startd_ad = NULL;
 	startdAds.Open ();
@@ -1423,6 +1477,21 @@ compute_significant_attrs(ClassAdListDoesNotDeleteAds & startdAds)
 	// Simplify the attribute references
 	TrimReferenceNames( external_references, true );
 
+		// Match lists are shared between submitters, so remember which of
+		// the attributes negotiate() sets in each request for its submitter
+		// are referenced; matchListSignature() adds them to the key.
+	const char * const submitter_attrs[] = {
+		ATTR_SUBMITTOR_PRIO,
+		ATTR_SUBMITTER_USER_PRIO,
+		ATTR_SUBMITTER_USER_RESOURCES_IN_USE,
+		ATTR_SUBMITTER_GROUP_RESOURCES_IN_USE,
+	};
+	for ( size_t i = 0; i < sizeof(submitter_attrs) / sizeof(submitter_attrs[0]); i++ ) {
+		if ( external_references.count(submitter_attrs[i]) ) {
+			submitter_attr_references.insert(submitter_attrs[i]);
+		}
+	}
+
 		// Always get rid of the follow attrs:
 		//    CurrentTime - for obvious reasons
 		//    RemoteUserPrio - not needed since we negotiate per user
@@ -1521,6 +1590,7 @@ negotiationTime ()
 
 	ranksMap.clear();
 	m_slotNameToAdMap.clear();
+	m_slotPrefilter.clear();
 
 	/**
 		Check if we just finished a cycle less than NEGOTIATOR_CYCLE_DELAY
@@ -1534,7 +1604,7 @@ negotiationTime ()
 	**/
 	int elapsed = time(NULL) - completedLastCycleTime;
 	int cycle_delay = param_integer("NEGOTIATOR_CYCLE_DELAY",20,0);
-	if ( elapsed < cycle_delay ) {
+	if ( elapsed < cycle_delay && ! m_replay ) {
 		daemonCore->Reset_Timer(negotiation_timerID,
 							cycle_delay - elapsed,
 							NegotiatorInterval);
@@ -1562,22 +1632,33 @@ negotiationTime ()
 
 	// We need to nuke our MatchList from the previous negotiation cycle,
 	// since a different set of machines may now be available.
-	if (MatchList) delete MatchList;
-	MatchList = NULL;
+	forgetMatchList(NULL);
+	m_slotChanges.clear();
 
 	ScheddsTimeInCycle.clear();
 
+	if ( ! m_traceFile.empty()) {
+		m_trace.begin(m_traceFile.c_str(), start_time);
+	}
+
 	// ----- Get all required ads from the collector
     time_t start_time_phase1 = time(NULL);
 	double start_usage_phase1 = get_rusage_utime();
 	dprintf( D_ALWAYS, "Phase 1:  Obtaining ads from collector ...\n" );
+	double start_collector_fetch = _condor_debug_get_time_double();
 	if( !obtainAdsFromCollector( allAds, startdAds, submitterAds, accountingNames,
 		claimIds ) )
 	{
 		dprintf( D_ALWAYS, "Aborting negotiation cycle\n" );
+		if (m_trace.active()) {
+			ClassAd summary;
+			summary.Assign("Aborted", true);
+			m_trace.end(summary);
+		}
 		// should send email here
 		return;
 	}
+	double collector_fetch_time = _condor_debug_get_time_double() - start_collector_fetch;
 
     // From here we are committed to the main negotiator cycle, which is non
     // reentrant wrt reconfig. Set any reconfig to delay until end of this cycle
@@ -1588,6 +1669,9 @@ negotiationTime ()
 		// to abort the cycle
 	StartNewNegotiationCycleStat();
 	negotiation_cycle_stats[0]->start_time = start_time;
+	negotiation_cycle_stats[0]->collector_fetch_times += collector_fetch_time;
+
+	m_trace.recordPhase("CollectorFetch", collector_fetch_time);
 
 	// Save this for future use.
 	int cTotalSlots = startdAds.MyLength();
@@ -1730,6 +1814,9 @@ negotiationTime ()
     // ----- Done with the negotiation cycle
     dprintf( D_ALWAYS, "---------- Finished Negotiation Cycle ----------\n" );
 
+	// the prefilter refers to slot ads that are about to be deleted
+	m_slotPrefilter.clear();
+
     completedLastCycleTime = time(NULL);
 
     negotiation_cycle_stats[0]->end_time = completedLastCycleTime;
@@ -1748,6 +1835,12 @@ negotiationTime ()
 	negotiation_cycle_stats[0]->phase2_cpu_time -= negotiation_cycle_stats[0]->phase4_cpu_time;
 	negotiation_cycle_stats[0]->cpu_time = end_cycle_usage - start_usage_phase1;
 
+	if (m_trace.active()) {
+		ClassAd summary;
+		publishNegotiationCycleStats(&summary, 1);
+		m_trace.end(summary);
+	}
+
     // if we got any reconfig requests during the cycle it is safe to service them now:
     if (daemonCore->GetNeedReconfig()) {
         daemonCore->SetNeedReconfig(false);
@@ -1756,11 +1849,11 @@ negotiationTime ()
     }
     daemonCore->SetDelayReconfig(false);
 
-	if (param_boolean("NEGOTIATOR_UPDATE_AFTER_CYCLE", false)) {
+	if (param_boolean("NEGOTIATOR_UPDATE_AFTER_CYCLE", false) && ! m_replay) {
 		updateCollector();
 	}
 
-	if (param_boolean("NEGOTIATOR_ADVERTISE_ACCOUNTING", true)) {
+	if (param_boolean("NEGOTIATOR_ADVERTISE_ACCOUNTING", true) && ! m_replay) {
 		forwardAccountingData(accountingNames);
 	}
 
@@ -2147,11 +2240,15 @@ negotiateWithGroup ( int untrimmed_num_startds,
 
 		start_time_prefetch = time(NULL);
 		start_usage_prefetch = get_rusage_utime();
+		double start_prefetch = _condor_debug_get_time_double();
 
 		prefetchResourceRequestLists(submitterAds);
 
+		double prefetch_time = _condor_debug_get_time_double() - start_prefetch;
 		negotiation_cycle_stats[0]->prefetch_duration = time(NULL) - start_time_prefetch;
 		negotiation_cycle_stats[0]->prefetch_cpu_time += get_rusage_utime() - start_usage_prefetch;
+		negotiation_cycle_stats[0]->prefetch_times += prefetch_time;
+		m_trace.recordPhase("Prefetch", prefetch_time);
 
 		pieLeftOrig = pieLeft;
 		submitterAdsCountOrig = submitterAds.MyLength();
@@ -2365,12 +2462,25 @@ negotiateWithGroup ( int untrimmed_num_startds,
                 }
 				negotiation_cycle_stats[0]->active_submitters.insert(submitterName.c_str());
 				negotiation_cycle_stats[0]->active_schedds.insert(scheddAddr.c_str());
+				double start_negotiate = _condor_debug_get_time_double();
 				result=negotiate(groupName, submitterName.c_str(), submitter_ad, submitterPrio,
                               submitterLimit, submitterLimitUnclaimed, submitterCeiling,
 							  startdAds, claimIds,
 							  ignore_submitter_limit,
 							  deadline, numMatched, pieLeft);
 				updateNegCycleEndTime(startTime, submitter_ad);
+				double negotiate_time = _condor_debug_get_time_double() - start_negotiate;
+				negotiation_cycle_stats[0]->negotiate_times += negotiate_time;
+				if (m_trace.active()) {
+					ClassAd event;
+					event.Assign(ATTR_NEGOTIATION_TRACE_SUBMITTER, submitterName);
+					event.Assign("Duration", negotiate_time);
+					event.Assign("Result", (result == MM_DONE) ? "Done" : (result == MM_RESUME) ? "Resume" : "Error");
+					event.Assign("NumMatched", numMatched);
+					event.Assign("SubmitterLimit", submitterLimit);
+					event.Assign("PieSpin", spin_pie);
+					m_trace.recordEvent(NEGOTIATION_TRACE_NEGOTIATE, event);
+				}
 			}
 
 			switch (result)
@@ -2762,30 +2872,77 @@ obtainAdsFromCollector (
 	// If preemption is disabled, we only need a handful of attrs from claimed ads.
 	// Ask for that projection.
 
+	std::string projection;
 	if (!ConsiderPreemption) {
 		const char *projectionString =
 			"ifThenElse(State == \"Claimed\",\"Name MyType State Activity StartdIpAddr AccountingGroup Owner RemoteUser Requirements SlotWeight ConcurrencyLimits\",\"\") ";
-		publicQuery.setDesiredAttrsExpr(projectionString);
+		projection = projectionString;
 
 		dprintf(D_ALWAYS, "Not considering preemption, therefore constraining idle machines with %s\n", projectionString);
 	}
 
-	dprintf(D_ALWAYS,"  Getting startd private ads ...\n");
+	// For the incremental ad fetch, machine ads that the collector has
+	// not changed since our last fetch only need to be sent as a stub
+	// identifying the ad; mergeCachedStartdAds() fills in the rest from
+	// our copy.  Collectors that do not stamp ads with an update sequence
+	// number will send every ad in full.
+	long long cachedSequence = 0;
+	bool incremental_fetch = want_incremental_ad_fetch && !m_replay;
+	if (incremental_fetch && !m_startdAdCache.empty()) {
+		cachedSequence = m_startdAdCacheSequence;
+		std::string incremental;
+		formatstr(incremental,
+			"ifThenElse(MyType == \"Machine\" && %s isnt undefined && %s <= %lld,\"%s %s %s %s\",%s)",
+			ATTR_COLLECTOR_UPDATE_SEQUENCE, ATTR_COLLECTOR_UPDATE_SEQUENCE, cachedSequence,
+			ATTR_NAME, ATTR_MY_TYPE, ATTR_STARTD_IP_ADDR, ATTR_COLLECTOR_UPDATE_SEQUENCE,
+			projection.empty() ? "\"\"" : projection.c_str());
+		projection = incremental;
+	}
+	if ( ! projection.empty()) {
+		publicQuery.setDesiredAttrsExpr(projection.c_str());
+	}
+
 	ClassAdList startdPvtAdList;
-	result = collects->query (privateQuery, startdPvtAdList);
-	if( result!=Q_OK ) {
-		dprintf(D_ALWAYS, "Couldn't fetch ads: %s\n", getStrQueryResult(result));
-		return false;
+	if (m_replay) {
+		dprintf(D_ALWAYS, "  Getting Submitter and Machine ads from the replayed trace ...\n");
+		m_replay->getCollectorAds(allAds, startdPvtAdList);
+	} else {
+		dprintf(D_ALWAYS,"  Getting startd private ads ...\n");
+		result = collects->query (privateQuery, startdPvtAdList);
+		if( result!=Q_OK ) {
+			dprintf(D_ALWAYS, "Couldn't fetch ads: %s\n", getStrQueryResult(result));
+			return false;
+		}
+
+		CondorError errstack;
+		dprintf(D_ALWAYS, "  Getting Scheduler, Submitter and Machine ads ...\n");
+		result = collects->query (publicQuery, allAds, &errstack);
+		if( result!=Q_OK ) {
+			dprintf(D_ALWAYS, "Couldn't fetch ads: %s\n",
+				errstack.code() ? errstack.getFullText(false).c_str() : getStrQueryResult(result)
+				);
+			return false;
+		}
 	}
 
-    CondorError errstack;
-	dprintf(D_ALWAYS, "  Getting Scheduler, Submitter and Machine ads ...\n");
-	result = collects->query (publicQuery, allAds, &errstack);
-	if( result!=Q_OK ) {
-		dprintf(D_ALWAYS, "Couldn't fetch ads: %s\n",
-           errstack.code() ? errstack.getFullText(false).c_str() : getStrQueryResult(result)
-           );
-		return false;
+	if (incremental_fetch && !mergeCachedStartdAds(allAds, cachedSequence)) {
+			// The collector sent a stub for an ad we do not have, or for
+			// a different version of it (e.g. the collector restarted or
+			// we failed over to another one).  Start over with a full fetch.
+		dprintf(D_ALWAYS, "  Cached startd ads are out of date, fetching all ads again ...\n");
+		allAds.Clear();
+		return obtainAdsFromCollector(allAds, startdAds, submitterAds, submitterNames, claimIds);
+	}
+
+		// record the ads as the collector sent them, before we change
+		// them, so that a replay of the trace starts from the same place.
+	if (m_trace.active()) {
+		allAds.Open();
+		while( (ad=allAds.Next()) ) {
+			bool is_startd = !strcmp(GetMyTypeName(*ad),STARTD_ADTYPE);
+			m_trace.recordAd(is_startd ? NEGOTIATION_TRACE_STARTD_AD : NEGOTIATION_TRACE_SUBMITTER_AD, *ad);
+		}
+		allAds.Close();
 	}
 
 	dprintf(D_ALWAYS, "  Sorting %d ads ...\n",allAds.MyLength());
@@ -3060,6 +3217,94 @@ obtainAdsFromCollector (
 	return true;
 }
 
+// Reconcile the machine ads from an incremental fetch with the ads
+// cached from previous fetches.  Ads whose CollectorUpdateSequence is
+// newer than cachedSequence were sent in full and replace the cached
+// copy; older ones are stubs and are filled in from the cache.  Cached
+// ads the collector no longer has are dropped.  Returns false, leaving
+// the cache empty, if a stub does not match a cached ad.
+bool Matchmaker::
+mergeCachedStartdAds (ClassAdList &allAds, long long cachedSequence)
+{
+	StartdAdCache current;
+	current.reserve(m_startdAdCache.size());
+	long long maxSequence = cachedSequence;
+	int reused = 0, fetched = 0;
+	bool ok = true;
+
+	ClassAd *ad;
+	allAds.Open();
+	while( (ad=allAds.Next()) ) {
+		if (strcmp(GetMyTypeName(*ad),STARTD_ADTYPE)) {
+			continue;
+		}
+		long long sequence = 0;
+		std::string name;
+		if ( ! ad->LookupInteger(ATTR_COLLECTOR_UPDATE_SEQUENCE, sequence) ||
+			 ! ad->LookupString(ATTR_NAME, name)) {
+				// nothing to key on, so this ad is never cached
+			continue;
+		}
+		std::string adID = MachineAdID(ad);
+
+		if (sequence <= cachedSequence) {
+			StartdAdCache::iterator it = m_startdAdCache.find(adID);
+			if (it == m_startdAdCache.end() || it->second.sequence != sequence) {
+				dprintf(D_FULLDEBUG, "No cached copy of startd ad %s with sequence %lld\n",
+						adID.c_str(), sequence);
+				ok = false;
+				break;
+			}
+			ad->Update(*it->second.ad);
+			current[adID] = it->second;
+			m_startdAdCache.erase(it);
+			reused++;
+		} else {
+			StartdAdCache::iterator it = m_startdAdCache.find(adID);
+			if (it != m_startdAdCache.end()) {
+				delete it->second.ad;
+				m_startdAdCache.erase(it);
+			}
+			CachedStartdAd &entry = current[adID];
+			if (entry.ad) {
+				// duplicate ID within this fetch, keep the last one
+				delete entry.ad;
+			}
+			entry.sequence = sequence;
+			entry.ad = new ClassAd(*ad);
+			if (sequence > maxSequence) {
+				maxSequence = sequence;
+			}
+			fetched++;
+		}
+	}
+	allAds.Close();
+
+		// whatever is left in the old cache is gone from the collector
+	clearStartdAdCache();
+	m_startdAdCache.swap(current);
+	m_startdAdCacheSequence = maxSequence;
+
+	if ( ! ok) {
+		clearStartdAdCache();
+		return false;
+	}
+
+	dprintf(D_ALWAYS, "  Reused %d cached startd ads, received %d in full\n",
+			reused, fetched);
+	return true;
+}
+
+void Matchmaker::
+clearStartdAdCache ()
+{
+	for (StartdAdCache::iterator it = m_startdAdCache.begin(); it != m_startdAdCache.end(); ++it) {
+		delete it->second.ad;
+	}
+	m_startdAdCache.clear();
+	m_startdAdCacheSequence = 0;
+}
+
 void
 Matchmaker::OptimizeMachineAdForMatchmaking(ClassAd *ad)
 {
@@ -3084,7 +3329,7 @@ Matchmaker::OptimizeJobAdForMatchmaking(ClassAd *ad)
 		// matchmaking (i.e. in the call to IsAMatch()), so
 		// optimize it accordingly.
 	std::string error_msg;
-	if( !classad::MatchClassAd::OptimizeLeftAdForMatchmaking( ad, &error_msg ) ) {
+	if( !classad::MatchClassAd::OptimizeLeftAdForMatchmaking( ad, &error_msg, "", "", want_optimize_job_rank ) ) {
 		int cluster_id=-1,proc_id=-1;
 		ad->LookupInteger(ATTR_CLUSTER_ID,cluster_id);
 		ad->LookupInteger(ATTR_PROC_ID,proc_id);
@@ -3265,6 +3510,11 @@ void
 Matchmaker::prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterAds)
 {
 	if (!param_boolean("NEGOTIATOR_PREFETCH_REQUESTS", true))
+	{
+		return;
+	}
+		// a replayed schedd has nothing to prefetch; see startNegotiate()
+	if (m_replay)
 	{
 		return;
 	}
@@ -3305,6 +3555,8 @@ Matchmaker::prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterA
 	ScheddWork negotiations;
 	typedef std::map<int, std::pair<ClassAd*, RRLPtr> > FDToRRLMap;
 	FDToRRLMap fdToRRL;
+		// when we give up on the negotiation in progress with each schedd
+	std::map<std::string, double> scheddDeadlines;
 	unsigned attemptedPrefetches = 0, successfulPrefetches = 0;
 	double startTime = _condor_debug_get_time_double();
 	int prefetchTimeout = param_integer("NEGOTIATOR_PREFETCH_REQUESTS_TIMEOUT", NegotiatorTimeout);
@@ -3315,7 +3567,13 @@ Matchmaker::prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterA
 	while (assignWork(scheddWorkQueues, currentWork, negotiations) || !currentWork.empty())
 	{
 		dprintf(D_FULLDEBUG, "Starting prefetch loop.\n");
-		// Start a bunch of negotiations
+		// Start a bunch of negotiations.  Those over connections we already
+		// have go first, so that those schedds are busy building their lists
+		// while we wait to connect to the others.
+		std::stable_partition(negotiations.begin(), negotiations.end(), [&](ClassAd *ad) -> bool {
+			std::string scheddAddr; getScheddAddr(*ad, scheddAddr);
+			return sockCache->findReliSock(scheddAddr) != NULL;
+		});
 		for (ScheddWork::const_iterator it=negotiations.begin(); it!=negotiations.end(); it++)
 		{
 			std::string submitter; getSubmitter(**it, submitter);
@@ -3348,6 +3606,7 @@ Matchmaker::prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterA
 				case ResourceRequestList::RRL_CONTINUE:
 					dprintf(D_FULLDEBUG, "Prefetch negotiation would block.\n");
 					currentWork[scheddAddr] = std::make_pair(*it, rrl);
+					scheddDeadlines[scheddAddr] = _condor_debug_get_time_double() + prefetchTimeout;
 					success = true;
 					break;
 				}
@@ -3367,12 +3626,15 @@ Matchmaker::prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterA
 			break;
 		}
 
-		// Non-blocking reads of RRLs
+		// Non-blocking reads of RRLs.  Each schedd has prefetchTimeout
+		// seconds to send its list, so one slow schedd only costs us its
+		// own prefetch rather than holding up, or timing out, the others.
 		selector.reset();
-		selector.set_timeout(prefetchTimeout);
 
-			// Put together the selector.
+			// Put together the selector, and wait no longer than it takes
+			// for the first of the schedds to run out of time.
 		unsigned workCount = 0;
+		double wakeup = deadline;
 		fdToRRL.clear();
 		for (CurrentWorkMap::const_iterator it=currentWork.begin(); it!=currentWork.end(); it++)
 		{
@@ -3382,11 +3644,16 @@ Matchmaker::prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterA
 			selector.add_fd(fd, Selector::IO_READ);
 			fdToRRL[fd] = it->second;
 			workCount++;
+			double scheddDeadline = scheddDeadlines[it->first];
+			if ((wakeup < 0) || (scheddDeadline < wakeup)) {wakeup = scheddDeadline;}
 		}
 		if (!workCount) {continue;}
-		dprintf(D_FULLDEBUG, "Waiting on the results of %u negotiation sessions.\n", workCount);
+		double waitTime = wakeup - _condor_debug_get_time_double();
+		if (waitTime < 0) {waitTime = 0;}
+		selector.set_timeout((time_t)waitTime, (long)((waitTime - (time_t)waitTime) * 1000000));
+		dprintf(D_FULLDEBUG, "Waiting up to %.3f seconds on the results of %u negotiation sessions.\n", waitTime, workCount);
 		selector.execute();
-		if (selector.timed_out() || selector.failed())
+		if (selector.failed())
 		{
 			for (FDToRRLMap::const_iterator it = fdToRRL.begin(); it != fdToRRL.end(); it++)
 			{
@@ -3398,17 +3665,28 @@ Matchmaker::prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterA
 				if (iter != currentWork.end()) {currentWork.erase(iter);}
 				endNegotiate(scheddAddr);
 				sockCache->invalidateSock(scheddAddr.c_str());
-				if (selector.timed_out()) {dprintf(D_ALWAYS, "Timeout when prefetching from %s; will skip this schedd for the remainder of prefetch cycle.\n", scheddAddr.c_str());}
-				else {dprintf(D_ALWAYS, "Failure when waiting on results of negotiations sessions (%s, errno=%d).\n", strerror(selector.select_errno()), selector.select_errno());}
+				dprintf(D_ALWAYS, "Failure when waiting on results of negotiations sessions (%s, errno=%d).\n", strerror(selector.select_errno()), selector.select_errno());
 			}
 		}
 		else
-			// Try getting the RRL for all ready sockets.
+			// Try getting the RRL for all ready sockets, and give up on
+			// the schedds that are out of time.
 		for (FDToRRLMap::const_iterator it = fdToRRL.begin(); it != fdToRRL.end(); it++)
 		{
-			if (!selector.fd_ready(it->first, Selector::IO_READ)) {continue;}
-			ResourceRequestList &rrl = *(it->second.second);
 			std::string scheddAddr; getScheddAddr(*(it->second.first), scheddAddr);
+			if (!selector.fd_ready(it->first, Selector::IO_READ))
+			{
+				if (_condor_debug_get_time_double() < scheddDeadlines[scheddAddr]) {continue;}
+				scheddWorkQueues[scheddAddr]->clear();
+				CurrentWorkMap::iterator iter = currentWork.find(scheddAddr);
+				if (iter != currentWork.end()) {currentWork.erase(iter);}
+				if (!sockCache->findReliSock(scheddAddr)) {continue;}
+				endNegotiate(scheddAddr);
+				sockCache->invalidateSock(scheddAddr.c_str());
+				dprintf(D_ALWAYS, "Timeout when prefetching from %s; will skip this schedd for the remainder of prefetch cycle.\n", scheddAddr.c_str());
+				continue;
+			}
+			ResourceRequestList &rrl = *(it->second.second);
 			ReliSock *sock = sockCache->findReliSock(scheddAddr);
 			if (!sock) {continue;}
 			switch (rrl.tryRetrieve(sock)) {
@@ -3464,6 +3742,9 @@ Matchmaker::prefetchResourceRequestLists(ClassAdListDoesNotDeleteAds &submitterA
 void
 Matchmaker::endNegotiate(const std::string &scheddAddr)
 {
+	if (m_replay) {
+		return;
+	}
 	ReliSock *sock = sockCache->findReliSock(scheddAddr);
 	if (!sock)
 	{
@@ -3493,6 +3774,17 @@ Matchmaker::startNegotiate(const std::string &submitter, const ClassAd &submitte
 		m_cachedRRLs.erase(iter);
 	}
 
+	if (m_replay)
+	{
+			// the replayed schedd hands over everything it had for the
+			// submitter up front, so there is nothing to talk to.
+		std::string scheddAddr; getScheddAddr(submitterAd, scheddAddr);
+		sock = NULL;
+		request_list.reset(new ResourceRequestList(1));
+		request_list->setRequests(m_replay->getRequests(submitter, scheddAddr));
+		return request_list;
+	}
+
 	if (!startNegotiateProtocol(submitter, submitterAd, sock, request_list))
 	{
 		dprintf(D_FULLDEBUG, "Failed to start negotiation; ignoring cached request list.\n");
@@ -3800,6 +4092,7 @@ negotiate(char const* groupName, char const *submitterName, const ClassAd *submi
 			}
 		}
 		// end of asking for job information - we now have a request
+		m_trace.recordAd(NEGOTIATION_TRACE_REQUEST, request, submitterName, scheddAddr.c_str());
 	
 
         negotiation_cycle_stats[0]->num_jobs_considered += 1;
@@ -3848,12 +4141,14 @@ negotiate(char const* groupName, char const *submitterName, const ClassAd *submi
 		{
             remoteUser = "";
 			// 2e(i).  find a compatible offer
+			double start_matchmaking = _condor_debug_get_time_double();
 			offer=matchmakingAlgorithm(submitterName, scheddAddr.c_str(), request,
                                              startdAds, priority,
                                              limitUsed, limitUsedUnclaimed,
                                              submitterLimit, submitterLimitUnclaimed,
 											 pieLeft,
 											 only_consider_startd_rank);
+			negotiation_cycle_stats[0]->matchmaking_times += _condor_debug_get_time_double() - start_matchmaking;
 
 			if( !offer )
 			{
@@ -3910,19 +4205,22 @@ negotiate(char const* groupName, char const *submitterName, const ClassAd *submi
 					formatstr(diagnostic_jobinfo," |%d|%d.%d|",autocluster,cluster,proc);
 					diagnostic_message += diagnostic_jobinfo;
 				}
-				sock->encode();
-				if ((want_match_diagnostics) ?
-					(!sock->put(REJECTED_WITH_REASON) ||
-					 !sock->put(diagnostic_message) ||
-					 !sock->end_of_message()) :
-					(!sock->put(REJECTED) || !sock->end_of_message()))
-					{
-						dprintf (D_ALWAYS, "      Could not send rejection\n");
-						sock->end_of_message ();
-						sockCache->invalidateSock(scheddAddr.c_str());
-						
-						return MM_ERROR;
-					}
+				// (there is no schedd to tell when replaying a trace)
+				if (sock) {
+					sock->encode();
+					if ((want_match_diagnostics) ?
+						(!sock->put(REJECTED_WITH_REASON) ||
+						 !sock->put(diagnostic_message) ||
+						 !sock->end_of_message()) :
+						(!sock->put(REJECTED) || !sock->end_of_message()))
+						{
+							dprintf (D_ALWAYS, "      Could not send rejection\n");
+							sock->end_of_message ();
+							sockCache->invalidateSock(scheddAddr.c_str());
+							
+							return MM_ERROR;
+						}
+				}
 				result = MM_NO_MATCH;
 				continue;
 			}
@@ -3956,13 +4254,36 @@ negotiate(char const* groupName, char const *submitterName, const ClassAd *submi
 			}
 
 			// 2e(ii).  perform the matchmaking protocol
+			double start_claim = _condor_debug_get_time_double();
 			result = matchmakingProtocol (request, offer, claimIds, sock,
 					submitterName, scheddAddr.c_str());
+			double claim_time = _condor_debug_get_time_double() - start_claim;
+			negotiation_cycle_stats[0]->claim_times += claim_time;
+			if (m_trace.active()) {
+				ClassAd event;
+				std::string slot_name;
+				offer->LookupString(ATTR_NAME, slot_name);
+				event.Assign(ATTR_NEGOTIATION_TRACE_SUBMITTER, submitterName);
+				event.Assign(ATTR_NAME, slot_name);
+				event.Assign(ATTR_CLUSTER_ID, cluster);
+				event.Assign(ATTR_PROC_ID, proc);
+				event.Assign("Duration", claim_time);
+				event.Assign("Result", (result == MM_GOOD_MATCH) ? "Good" : (result == MM_BAD_MATCH) ? "Bad" : "Error");
+				m_trace.recordEvent(NEGOTIATION_TRACE_MATCH, event);
+			}
+
+				// the offer may be modified from here on (consumption
+				// policies, reevaluation), so stop prefiltering it.
+			m_slotPrefilter.invalidate(offer);
 
 			// 2e(iii). if the matchmaking protocol failed, do not consider the
 			//			startd again for this negotiation cycle.
-			if (result == MM_BAD_MATCH)
+			if (result == MM_BAD_MATCH) {
 				startdAds.Remove (offer);
+				slotChanged(offer, true);
+			} else if (result != MM_GOOD_MATCH) {
+				slotChanged(offer);
+			}
 
 			// 2e(iv).  if the matchmaking protocol failed to talk to the
 			//			schedd, invalidate the connection and return
@@ -4018,10 +4339,12 @@ negotiate(char const* groupName, char const *submitterName, const ClassAd *submi
         		// in a round-robin way
         		startdAds.Remove(offer);
         		startdAds.Insert(offer);
+        		slotChanged(offer);
     		} else  {
                 // 2g.  Delete ad from list so that it will not be considered again in
 		        // this negotiation cycle
     			startdAds.Remove(offer);
+    			slotChanged(offer, true);
     		}
             // traditional match cost is just slot weight expression
             match_cost = accountant.GetSlotWeight(offer);
@@ -4274,25 +4597,70 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 
 	request.LookupInteger(ATTR_AUTO_CLUSTER_ID, requestAutoCluster);
 
+	bool isIPv4 = false;
+	bool isIPv6 = false;
+	getSinfulStringProtocolBools( false, false, scheddAddr, isIPv4, isIPv6 );
+
 		// If this incoming job is from the same user, same schedd,
 		// and is in the same autocluster, and we have a MatchList cache,
 		// then we can just pop off
 		// the top entry in our MatchList if we have one.  The
 		// MatchList is essentially just a sorted cache of the machine
 		// ads that match jobs of this type (i.e. same autocluster).
-	if ( MatchList &&
+		// Failing that, look for a list built earlier in this pie spin
+		// for a request with the same significant attributes, either by
+		// this submitter or, if the list is sharable, by any submitter.
+	bool use_cache = MatchList &&
 		 cachedAutoCluster != -1 &&
 		 cachedAutoCluster == requestAutoCluster &&
 		 cachedPrio == preemptPrio &&
 		 cachedOnlyForStartdRank == only_for_startdrank &&
 		 strcmp(cachedName,submitterName)==0 &&
-		 strcmp(cachedAddr,scheddAddr)==0 &&
+		 strcmp(cachedAddr,scheddAddr)==0;
+	std::string matchListKey;
+	if ( !use_cache && want_matchlist_caching && requestAutoCluster != -1 ) {
+		matchListKey = matchListSignature(request, isIPv4, isIPv6);
+		MatchListCache::iterator it = m_matchListCache.find(matchListKey);
+		if ( it != m_matchListCache.end() &&
+			 it->second.onlyForStartdRank == only_for_startdrank &&
+			 ( it->second.sharable ||
+			   ( it->second.prio == preemptPrio &&
+				 it->second.submitterName == submitterName &&
+				 it->second.scheddAddr == scheddAddr ) ) )
+		{
+			MatchList = it->second.list;
+			it->second.lastUse = ++m_matchListUses;
+			cachedAutoCluster = requestAutoCluster;
+			cachedPrio = preemptPrio;
+			cachedOnlyForStartdRank = only_for_startdrank;
+			free(cachedName);
+			cachedName = strdup(submitterName);
+			free(cachedAddr);
+			cachedAddr = strdup(scheddAddr);
+			use_cache = true;
+			if ( it->second.submitterName != submitterName ) {
+				negotiation_cycle_stats[0]->shared_match_lists++;
+			}
+		}
+	}
+
+	if ( use_cache &&
 		 MatchList->cache_still_valid(request,PreemptionReq,PreemptionRank,
 					preemption_req_unstable,preemption_rank_unstable) )
 	{
 		// we can use cached information.  pop off the best
 		// candidate from our sorted list.
-		while( (cached_bestSoFar = MatchList->pop_candidate(candidateDslotClaims)) ) {
+		bool stale = false;
+		unsigned version = 0;
+		while( (cached_bestSoFar = MatchList->pop_candidate(candidateDslotClaims, version)) ) {
+			if (version != slotVersion(cached_bestSoFar)) {
+					// matched by someone else since this list was built
+				if (m_slotChanges[cached_bestSoFar].removed) {
+					continue;
+				}
+				stale = true;
+				break;
+			}
 			if (evaluate_limits_with_match) {
 				std::string limits;
 				if (EvalString(ATTR_CONCURRENCY_LIMITS, &request, cached_bestSoFar, limits)) {
@@ -4311,38 +4679,46 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 			}
 			MatchList->increment_rejForSubmitterLimit();
 		}
-		dprintf(D_FULLDEBUG,"Attempting to use cached MatchList: %s (MatchList length: %d, Autocluster: %d, Submitter Name: %s, Schedd Address: %s)\n",
-			cached_bestSoFar?"Succeeded.":"Failed",
-			MatchList->length(),
-			requestAutoCluster,
-			submitterName,
-			scheddAddr
-			);
-		if ( ! cached_bestSoFar ) {
-				// if we don't have a candidate, fill in
-				// all the rejection reason counts.
-			MatchList->get_diagnostics(
-				rejForNetwork,
-				rejForNetworkShare,
-				rejForConcurrencyLimit,
-				rejPreemptForPrio,
-				rejPreemptForPolicy,
-				rejPreemptForRank,
-				rejForSubmitterLimit,
-				rejForSubmitterCeiling);
-		}
-		if ( cached_bestSoFar && !candidateDslotClaims.empty() ) {
-			cached_bestSoFar->Assign("PreemptDslotClaims", candidateDslotClaims);
-		}
-			//  TODO  - compare results, reserve net bandwidth
-		return cached_bestSoFar;
-	}
-
-		// Delete our old MatchList, since we know that if we made it here
-		// we no longer are dealing with a job from the same autocluster.
-		// (someday we will store it in case we see another job with
-		// the same autocluster, but we aren't that smart yet...)
-	DeleteMatchList();
+		if ( !stale ) {
+			dprintf(D_FULLDEBUG,"Attempting to use cached MatchList: %s (MatchList length: %d, Autocluster: %d, Submitter Name: %s, Schedd Address: %s)\n",
+				cached_bestSoFar?"Succeeded.":"Failed",
+				MatchList->length(),
+				requestAutoCluster,
+				submitterName,
+				scheddAddr
+				);
+			if ( ! cached_bestSoFar ) {
+					// if we don't have a candidate, fill in
+					// all the rejection reason counts.
+				MatchList->get_diagnostics(
+					rejForNetwork,
+					rejForNetworkShare,
+					rejForConcurrencyLimit,
+					rejPreemptForPrio,
+					rejPreemptForPolicy,
+					rejPreemptForRank,
+					rejForSubmitterLimit,
+					rejForSubmitterCeiling);
+			}
+			if ( cached_bestSoFar && !candidateDslotClaims.empty() ) {
+				cached_bestSoFar->Assign("PreemptDslotClaims", candidateDslotClaims);
+			}
+				//  TODO  - compare results, reserve net bandwidth
+			return cached_bestSoFar;
+		}
+		dprintf(D_FULLDEBUG,"Cached MatchList is out of date, rebuilding it\n");
+	}
+
+		// If we get here, any MatchList we were looking at is of no
+		// further use.  Restoring pslot ads mutated for pslot preemption
+		// changes them under every cached list, so in that case start over.
+	if ( !unmutatedSlotAds.empty() ) {
+		DeleteMatchList();
+	} else if ( use_cache ) {
+		forgetMatchList(MatchList);
+	}
+	MatchList = NULL;
+	cachedAutoCluster = -1;
 
 		// Create a new MatchList cache if desired via config file,
 		// and the job ad contains autocluster info,
@@ -4351,13 +4727,42 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 		 requestAutoCluster != -1 &&	// job ad contains autocluster info
 		 startdAds.Length() > 0 )		// machines available
 	{
+		if ( matchListKey.empty() ) {
+			matchListKey = matchListSignature(request, isIPv4, isIPv6);
+		}
+		MatchListCache::iterator it = m_matchListCache.find(matchListKey);
+		if ( it != m_matchListCache.end() ) {
+			forgetMatchList(it->second.list);
+		}
+		while ( (int)m_matchListCache.size() >= m_matchListCacheSize ) {
+			MatchListCache::iterator lru = m_matchListCache.begin();
+			for ( it = m_matchListCache.begin(); it != m_matchListCache.end(); ++it ) {
+				if ( it->second.lastUse < lru->second.lastUse ) {
+					lru = it;
+				}
+			}
+			forgetMatchList(lru->second.list);
+		}
+
 		MatchList = new MatchListType( startdAds.Length() );
+		CachedMatchList &entry = m_matchListCache[matchListKey];
+		entry.list = MatchList;
+		entry.submitterName = submitterName;
+		entry.scheddAddr = scheddAddr;
+		entry.prio = preemptPrio;
+		entry.onlyForStartdRank = only_for_startdrank;
+		entry.sharable = false;
+		entry.lastUse = ++m_matchListUses;
 		cachedAutoCluster = requestAutoCluster;
 		cachedPrio = preemptPrio;
 		cachedOnlyForStartdRank = only_for_startdrank;
+		free(cachedName);
 		cachedName = strdup(submitterName);
+		free(cachedAddr);
 		cachedAddr = strdup(scheddAddr);
 	}
+		// cleared below if anything about the scan depends on who asked
+	bool sharable_match_list = true;
 
 
 	// initialize reasons for match failure
@@ -4370,30 +4775,45 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 
 	bool allow_pslot_preemption = param_boolean("ALLOW_PSLOT_PREEMPTION", false);
 	double allocatedWeight = 0.0;
-		// Set up for parallel matchmaking, if enabled
+		// Set up for parallel matchmaking, if enabled.
+		// The Requirements and job Rank of every candidate are evaluated
+		// up front by a pool of threads; the results are indexed by the
+		// candidate's position in startdAds, so the serial scan below
+		// sees exactly what it would have computed itself and picks the
+		// same best match and rejection counts for any number of threads.
 	std::vector<ClassAd *> par_candidates;
-	std::vector<ClassAd *> par_matches;
+	std::vector<char> par_matched;
+	std::vector<double> par_ranks;
+	size_t par_index = 0;
+
+		// Slots that certainly fail a simple clause of the job's
+		// Requirements (e.g. TARGET.Memory >= 4096) are skipped without
+		// evaluating either Requirements expression.
+	bool use_prefilter = want_slot_prefilter && m_slotPrefilter.setRequest(request) > 0;
 
 	int num_threads =  param_integer("NEGOTIATOR_NUM_THREADS", 1);
 	if (num_threads > 1) {
 		startdAds.Open();
 		par_candidates.reserve(startdAds.Length());
 		while ((candidate = startdAds.Next())) {
-			par_candidates.push_back(candidate);
+			if (use_prefilter && !cp_supports_policy(*candidate) &&
+				!m_slotPrefilter.mayMatch(candidate)) {
+				par_candidates.push_back(NULL);
+			} else {
+				par_candidates.push_back(candidate);
+			}
 		}
 		startdAds.Close();
-		ParallelIsAMatch(&request, par_candidates, par_matches, num_threads, false);
+		ParallelIsAMatch(&request, par_candidates, par_matched,
+			m_staticRanks ? NULL : &par_ranks, num_threads);
 	}
 
 	// scan the offer ads
 	startdAds.Open ();
 	std::string machineAddr;
 
-	bool isIPv4 = false;
-	bool isIPv6 = false;
-	getSinfulStringProtocolBools( false, false, scheddAddr, isIPv4, isIPv6 );
-
 	while ((candidate = startdAds.Next ())) {
+		size_t cand_index = par_index++;
 		bool v4 = false;
 		bool v6 = false;
 		candidate->LookupString( "MyAddress", machineAddr );
@@ -4435,11 +4855,15 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
         // When candidate supports a consumption policy, then resources
         // requested via consumption policy must also be available from
         // the resource
+		// The parallel pass matched against the unmodified request, so
+		// slots with a consumption policy are re-checked here.
 		bool is_a_match = false;
-		if (num_threads > 1) {
-			is_a_match = cp_sufficient &&
-				(par_matches.end() !=
-					std::find(par_matches.begin(), par_matches.end(), candidate));
+		bool par_evaluated = (num_threads > 1) && !has_cp &&
+			cand_index < par_matched.size();
+		if (use_prefilter && !has_cp && !m_slotPrefilter.mayMatch(candidate)) {
+			negotiation_cycle_stats[0]->prefiltered_slots++;
+		} else if (par_evaluated) {
+			is_a_match = cp_sufficient && par_matched[cand_index];
 		} else {
 			is_a_match = cp_sufficient && IsAMatch(&request, candidate);
 		}
@@ -4456,6 +4880,7 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 			bool jobWantsMultiMatch = false;
 			request.LookupBool(ATTR_WANT_PSLOT_PREEMPTION, jobWantsMultiMatch);
 			if (allow_pslot_preemption && jobWantsMultiMatch) {
+				sharable_match_list = false;
 				// Note: after call to pslotMultiMatch(), iff is_a_match == True,
 				// then candidatePreemptState will be updated as well as candidateDslotClaims
 				is_a_match = pslotMultiMatch(&request, candidate,submitterName,
@@ -4495,6 +4920,10 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 				}
 			}
 		}
+		if ( !remoteUser.empty() || only_for_startdrank ) {
+				// what happens next depends on the submitter
+			sharable_match_list = false;
+		}
 
 		// if only_for_startdrank flag is true, check if the offer strictly
 		// prefers this request (if we have not already done so, such as in
@@ -4606,7 +5035,11 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 			}
 		}
 
-		calculateRanks(request, candidate, candidatePreemptState, candidateRankValue, candidatePreJobRankValue, candidatePostJobRankValue, candidatePreemptRankValue);
+		const double *parJobRank = NULL;
+		if (cand_index < par_ranks.size() && par_matched[cand_index]) {
+			parJobRank = &par_ranks[cand_index];
+		}
+		calculateRanks(request, candidate, candidatePreemptState, candidateRankValue, candidatePreJobRankValue, candidatePostJobRankValue, candidatePreemptRankValue, parJobRank);
 
 		if ( MatchList ) {
 			MatchList->add_candidate(
@@ -4616,7 +5049,8 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 					candidatePostJobRankValue,
 					candidatePreemptRankValue,
 					candidatePreemptState,
-					candidateDslotClaims
+					candidateDslotClaims,
+					slotVersion(candidate)
 					);
 		}
 
@@ -4675,6 +5109,7 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 			candidate->LookupFloat(ATTR_SLOT_WEIGHT, weight);
 			allocatedWeight += weight;
 			if (allocatedWeight > submitterLimit) {
+				sharable_match_list = false;
 				break;
 			}
 		}
@@ -4691,6 +5126,9 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 		   	rejPreemptForRank,
 			rejForSubmitterLimit,
 			rejForSubmitterCeiling);
+		if ( sharable_match_list && rejForSubmitterLimit == 0 ) {
+			m_matchListCache[matchListKey].sharable = true;
+		}
 
 			// only bother sorting if there is more than one entry
 		if ( MatchList->length() > 1 ) {
@@ -4700,7 +5138,8 @@ matchmakingAlgorithm(const char *submitterName, const char *scheddAddr, ClassAd
 			dprintf(D_FULLDEBUG,"Finished sorting MatchList\n");
 		}
 		// Pop top candidate off the list to hand out as best match
-		bestSoFar = MatchList->pop_candidate(bestDslotClaims);
+		unsigned version = 0;
+		bestSoFar = MatchList->pop_candidate(bestDslotClaims, version);
 	}
 
 	if ( bestSoFar && !bestDslotClaims.empty() ) {
@@ -4828,7 +5267,8 @@ calculateRanks(ClassAd &request,
                double &candidateRankValue,
                double &candidatePreJobRankValue,
                double &candidatePostJobRankValue,
-               double &candidatePreemptRankValue
+               double &candidatePreemptRankValue,
+               const double *jobRankValue
               )
 {
 	if (m_staticRanks) {
@@ -4851,7 +5291,9 @@ calculateRanks(ClassAd &request,
 
 	// calculate the request's rank of the candidate
 	double tmp;
-	if(!EvalFloat(ATTR_RANK, &request, candidate, tmp)) {
+	if (jobRankValue) {
+		tmp = *jobRankValue;
+	} else if(!EvalFloat(ATTR_RANK, &request, candidate, tmp)) {
 		tmp = 0.0;
 	}
 	candidateRankValue = tmp;
@@ -4892,7 +5334,8 @@ returnPslotToMatchList(ClassAd &request, ClassAd *offer)
 		candidatePreJobRankValue,
 		candidatePostJobRankValue,
 		candidatePreemptRankValue,
-		NO_PREEMPTION
+		NO_PREEMPTION,
+		slotVersion(offer)
 	);
 }
 
@@ -5053,7 +5496,7 @@ matchmakingProtocol (ClassAd &request, ClassAd *offer,
 
 	// ---- real matchmaking protocol begins ----
 	// 1.  contact the startd
-	if (want_claiming && want_inform_startd) {
+	if (want_claiming && want_inform_startd && !m_replay) {
 			// The following sends a message to the startd to inform it
 			// of the match.  Although it is a UDP message, it still may
 			// block, because if there is no cached security session,
@@ -5071,17 +5514,20 @@ matchmakingProtocol (ClassAd &request, ClassAd *offer,
 	}	// end of if want_claiming
 
 	// 3.  send the match and all_claim_ids to the schedd
-	sock->encode();
+	// (there is no schedd when replaying a trace)
 	send_failed = false;	
+	if (sock) {
+		sock->encode();
 
-	dprintf(D_FULLDEBUG,
-		"      Sending PERMISSION, claim id, startdAd to schedd\n");
-	if (!sock->put(PERMISSION_AND_AD) ||
-		!sock->put_secret(all_claim_ids.c_str()) ||
-		!putClassAd(sock, *offer)	||	// send startd ad to schedd
-		!sock->end_of_message())
-	{
-			send_failed = true;
+		dprintf(D_FULLDEBUG,
+			"      Sending PERMISSION, claim id, startdAd to schedd\n");
+		if (!sock->put(PERMISSION_AND_AD) ||
+			!sock->put_secret(all_claim_ids.c_str()) ||
+			!putClassAd(sock, *offer)	||	// send startd ad to schedd
+			!sock->end_of_message())
+		{
+				send_failed = true;
+		}
 	}
 
 	if ( send_failed )
@@ -5127,6 +5573,7 @@ matchmakingProtocol (ClassAd &request, ClassAd *offer,
         // At this point the match is fully vetted so we can also deduct
         // the resource assets.
         offer->Assign(CP_MATCH_COST, cp_deduct_assets(request, *offer));
+        slotChanged(offer);
 
 		if (MatchList)
 		{
@@ -5487,7 +5934,7 @@ peek_candidate()
 #endif
 
 ClassAd* Matchmaker::MatchListType::
-pop_candidate(std::string &dslot_claims)
+pop_candidate(std::string &dslot_claims, unsigned &slot_version)
 {
 	ClassAd* candidate = NULL;
 
@@ -5495,6 +5942,9 @@ pop_candidate(std::string &dslot_claims)
 		candidate = AdListArray[adListHead].ad;
 		if ( candidate ) {
 			dslot_claims = AdListArray[adListHead].DslotClaims;
+			slot_version = AdListArray[adListHead].SlotVersion;
+				// another cached list may have ranked this slot since
+			candidate->Assign(ATTR_PREEMPT_STATE_, int(AdListArray[adListHead].PreemptStateValue));
 		}
 		adListHead++;
 	}
@@ -5512,7 +5962,8 @@ insert_candidate(ClassAd * candidate,
 	double candidatePreJobRankValue,
 	double candidatePostJobRankValue,
 	double candidatePreemptRankValue,
-	PreemptState candidatePreemptState)
+	PreemptState candidatePreemptState,
+	unsigned candidateSlotVersion)
 {
 	if (adListHead == 0) {return false;}
 	adListHead--;
@@ -5524,6 +5975,7 @@ insert_candidate(ClassAd * candidate,
 	new_entry.PreemptRankValue = candidatePreemptRankValue;
 	new_entry.PreemptStateValue = candidatePreemptState;
 	new_entry.DslotClaims.clear();
+	new_entry.SlotVersion = candidateSlotVersion;
 
 		// Hand-rolled insertion sort; as the list was previously sorted,
 		// we know this will be O(n).
@@ -5661,7 +6113,8 @@ add_candidate(ClassAd * candidate,
 					double candidatePostJobRankValue,
 					double candidatePreemptRankValue,
 					PreemptState candidatePreemptState,
-					const std::string &candidateDslotClaims)
+					const std::string &candidateDslotClaims,
+					unsigned candidateSlotVersion)
 {
 	ASSERT(AdListArray);
 	ASSERT(adListLen < adListMaxLen);  // don't write off end of array!
@@ -5673,6 +6126,7 @@ add_candidate(ClassAd * candidate,
 	AdListArray[adListLen].PreemptRankValue = candidatePreemptRankValue;
 	AdListArray[adListLen].PreemptStateValue = candidatePreemptState;
 	AdListArray[adListLen].DslotClaims = candidateDslotClaims;
+	AdListArray[adListLen].SlotVersion = candidateSlotVersion;
 
     // This hack allows me to avoid mucking with the pseudo-que-like semantics of MatchListType,
     // which ought to be replaced with something cleaner like std::deque<AdListEntry>
@@ -5686,11 +6140,9 @@ add_candidate(ClassAd * candidate,
 
 void Matchmaker::DeleteMatchList()
 {
-	// Delete our MatchList
-	if( MatchList ) {
-		delete MatchList;
-		MatchList = NULL;
-	}
+	// Delete our MatchList, and every other cached list
+	forgetMatchList(NULL);
+	m_slotChanges.clear();
 	cachedAutoCluster = -1;
 	if ( cachedName ) {
 		free(cachedName);
@@ -5711,6 +6163,98 @@ void Matchmaker::DeleteMatchList()
 	unmutatedSlotAds.clear();
 }
 
+// Delete a cached match list, or all of them if list is NULL.
+void Matchmaker::forgetMatchList(MatchListType *list)
+{
+	MatchListCache::iterator it = m_matchListCache.begin();
+	while ( it != m_matchListCache.end() ) {
+		if ( list && it->second.list != list ) {
+			++it;
+			continue;
+		}
+		delete it->second.list;
+		if ( it->second.list == MatchList ) {
+			MatchList = NULL;
+			cachedAutoCluster = -1;
+		}
+		m_matchListCache.erase(it++);
+	}
+}
+
+unsigned Matchmaker::slotVersion(const ClassAd *slot) const
+{
+	std::unordered_map<const ClassAd *, SlotChange>::const_iterator it = m_slotChanges.find(slot);
+	return it == m_slotChanges.end() ? 0 : it->second.version;
+}
+
+void Matchmaker::slotChanged(const ClassAd *slot, bool removed)
+{
+	SlotChange &change = m_slotChanges[slot];
+	change.version++;
+	change.removed = removed;
+}
+
+// Build the key under which the match list for this request is cached.
+// It holds the value of every request attribute that the outcome of
+// matchmakingAlgorithm() can depend on: the attributes the slot ads and
+// negotiator policy expressions refer to (the same set the schedds use
+// to build autoclusters, plus those of the submitter's priority and usage
+// they refer to), the request's own Requirements and Rank and whatever
+// they refer to, plus the IP protocols of the schedd.  So two
+// requests with the same key are interchangeable here, whoever sent them.
+std::string Matchmaker::
+matchListSignature(ClassAd &request, bool isIPv4, bool isIPv6) const
+{
+	classad::References attrs;
+	if ( job_attr_references ) {
+		StringList sig_attrs(job_attr_references);
+		sig_attrs.rewind();
+		const char *attr;
+		while ( (attr = sig_attrs.next()) ) {
+			attrs.insert(attr);
+		}
+	}
+	attrs.insert(ATTR_CONCURRENCY_LIMITS);
+	attrs.insert(ATTR_WANT_PSLOT_PREEMPTION);
+	attrs.insert(submitter_attr_references.begin(), submitter_attr_references.end());
+
+		// follow references from the request's own attributes
+	classad::References visited;
+	std::vector<std::string> pending(attrs.begin(), attrs.end());
+	pending.push_back(ATTR_REQUIREMENTS);
+	pending.push_back(ATTR_RANK);
+	while ( !pending.empty() ) {
+		std::string attr = pending.back();
+		pending.pop_back();
+		if ( !visited.insert(attr).second ) {
+			continue;
+		}
+		attrs.insert(attr);
+		ExprTree *expr = request.LookupExpr(attr);
+		if ( expr ) {
+			classad::References refs;
+			request.GetInternalReferences(expr, refs, false);
+			pending.insert(pending.end(), refs.begin(), refs.end());
+		}
+	}
+
+	std::string key;
+	key += isIPv4 ? '4' : '-';
+	key += isIPv6 ? '6' : '-';
+	classad::ClassAdUnParser unparser;
+	for ( classad::References::const_iterator it = attrs.begin(); it != attrs.end(); ++it ) {
+		ExprTree *expr = request.LookupExpr(*it);
+		if ( !expr ) {
+			continue;
+		}
+		key += '\n';
+		key += *it;
+		key += '=';
+		unparser.Unparse(key, expr);
+	}
+	return key;
+}
+
 bool Matchmaker::MatchListType::
 sort_compare(const AdListEntry &Elem1, const AdListEntry &Elem2)
 {
@@ -6009,9 +6553,16 @@ SetAttrN( ClassAd *ad, char const *attr, int n, std::set<std::string> &string_li
 	ad->Assign(attrn,value);
 }
 
+static void
+SetAttrN( ClassAd *ad, char const *attr, int n, const stats_histogram<double> &histogram )
+{
+	std::string attrn;
+	formatstr(attrn,"%s%d",attr,n);
+	histogram.Publish(*ad, attrn.c_str(), 0);
+}
 
 void
-Matchmaker::publishNegotiationCycleStats( ClassAd *ad )
+Matchmaker::publishNegotiationCycleStats( ClassAd *ad, int max_cycles )
 {
 	char const* attrs[] = {
         ATTR_LAST_NEGOTIATION_CYCLE_TIME,
@@ -6025,6 +6576,8 @@ Matchmaker::publishNegotiationCycleStats( ClassAd *ad )
         ATTR_LAST_NEGOTIATION_CYCLE_TOTAL_SLOTS,
         ATTR_LAST_NEGOTIATION_CYCLE_TRIMMED_SLOTS,
         ATTR_LAST_NEGOTIATION_CYCLE_CANDIDATE_SLOTS,
+        ATTR_LAST_NEGOTIATION_CYCLE_PREFILTERED_SLOTS,
+        ATTR_LAST_NEGOTIATION_CYCLE_SHARED_MATCH_LISTS,
         ATTR_LAST_NEGOTIATION_CYCLE_SLOT_SHARE_ITER,
         ATTR_LAST_NEGOTIATION_CYCLE_NUM_SCHEDULERS,
         ATTR_LAST_NEGOTIATION_CYCLE_NUM_IDLE_JOBS,
@@ -6046,7 +6599,12 @@ Matchmaker::publishNegotiationCycleStats( ClassAd *ad )
         ATTR_LAST_NEGOTIATION_CYCLE_SUBMITTERS_SHARE_LIMIT,
         ATTR_LAST_NEGOTIATION_CYCLE_ACTIVE_SUBMITTER_COUNT,
         ATTR_LAST_NEGOTIATION_CYCLE_MATCH_RATE,
-        ATTR_LAST_NEGOTIATION_CYCLE_MATCH_RATE_SUSTAINED
+        ATTR_LAST_NEGOTIATION_CYCLE_MATCH_RATE_SUSTAINED,
+        ATTR_LAST_NEGOTIATION_CYCLE_COLLECTOR_FETCH_HISTOGRAM,
+        ATTR_LAST_NEGOTIATION_CYCLE_PREFETCH_HISTOGRAM,
+        ATTR_LAST_NEGOTIATION_CYCLE_NEGOTIATE_HISTOGRAM,
+        ATTR_LAST_NEGOTIATION_CYCLE_MATCHMAKING_HISTOGRAM,
+        ATTR_LAST_NEGOTIATION_CYCLE_CLAIM_HISTOGRAM
     };
     const int nattrs = sizeof(attrs)/sizeof(*attrs);
 
@@ -6057,7 +6615,12 @@ Matchmaker::publishNegotiationCycleStats( ClassAd *ad )
 		}
 	}
 
-	for (int i=0; i<num_negotiation_cycle_stats; i++) {
+	int num_cycles = num_negotiation_cycle_stats;
+	if (max_cycles >= 0 && max_cycles < num_cycles) {
+		num_cycles = max_cycles;
+	}
+
+	for (int i=0; i<num_cycles; i++) {
 		NegotiationCycleStats* s = negotiation_cycle_stats[i];
 		if (s == NULL) continue;
 
@@ -6076,6 +6639,8 @@ Matchmaker::publishNegotiationCycleStats( ClassAd *ad )
 		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_TOTAL_SLOTS, i, (int)s->total_slots);
 		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_TRIMMED_SLOTS, i, (int)s->trimmed_slots);
         SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_CANDIDATE_SLOTS, i, (int)s->candidate_slots);
+        SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_PREFILTERED_SLOTS, i, (int)s->prefiltered_slots);
+        SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_SHARED_MATCH_LISTS, i, (int)s->shared_match_lists);
         SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_SLOT_SHARE_ITER, i, (int)s->slot_share_iterations);
 		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_NUM_SCHEDULERS, i, (int)s->active_schedds.size());
 		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_NUM_IDLE_JOBS, i, (int)s->num_idle_jobs);
@@ -6099,6 +6664,11 @@ Matchmaker::publishNegotiationCycleStats( ClassAd *ad )
 		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_SUBMITTERS_FAILED, i, s->submitters_failed);
 		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_SUBMITTERS_OUT_OF_TIME, i, s->submitters_out_of_time);
         SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_SUBMITTERS_SHARE_LIMIT, i, s->submitters_share_limit);
+		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_COLLECTOR_FETCH_HISTOGRAM, i, s->collector_fetch_times);
+		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_PREFETCH_HISTOGRAM, i, s->prefetch_times);
+		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_NEGOTIATE_HISTOGRAM, i, s->negotiate_times);
+		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_MATCHMAKING_HISTOGRAM, i, s->matchmaking_times);
+		SetAttrN( ad, ATTR_LAST_NEGOTIATION_CYCLE_CLAIM_HISTOGRAM, i, s->claim_times);
 	}
 }
 
@@ -6353,6 +6923,8 @@ Matchmaker::pslotMultiMatch(ClassAd *job, ClassAd *machine, const char *submitte
 			// Stash away all the attributes we mutated in the slot ad so we can restore it
 			// when/if we purge the match list in DeleteMatchList().
 			unmutatedSlotAds.emplace_back(machine, backupAd );
+			m_slotPrefilter.invalidate(machine);
+			slotChanged(machine);
 
 			// Note we do not want to delete backupAd when returning here, since we handed off this
 			// pointer to unmutatedSlotAds above; it will be deleted in DeleteMatchList().
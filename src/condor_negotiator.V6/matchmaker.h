@@ -28,11 +28,14 @@
 #include "dc_collector.h"
 #include "condor_ver_info.h"
 #include "matchmaker_negotiate.h"
+#include "matchmaker_prefilter.h"
+#include "matchmaker_trace.h"
 #include "GroupEntry.h"
 
 #include <vector>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 
 typedef struct MapEntry {
@@ -92,11 +95,21 @@ class Matchmaker : public Service
 		void forwardAccountingData(std::set<std::string> &names);
 		void forwardGroupAccounting(CollectorList *cl, GroupEntry *ge);
 
-		void calculateRanks(ClassAd &request, ClassAd *offer, PreemptState candidatePreemptState, double &candidateRankValue, double &candidatePreJobRankValue, double &candidatePostJobRankValue, double &candidatePreemptRankValue);
+		// If jobRankValue is not NULL, it is used as the job's Rank of the
+		// offer instead of evaluating it (e.g. when computed in parallel).
+		void calculateRanks(ClassAd &request, ClassAd *offer, PreemptState candidatePreemptState, double &candidateRankValue, double &candidatePreJobRankValue, double &candidatePostJobRankValue, double &candidatePreemptRankValue, const double *jobRankValue = NULL);
 
 		void setDryRun(bool d) {m_dryrun = d;}
 		bool getDryRun() const {return m_dryrun;}
 
+			// negotiate against a recorded cycle rather than the pool:
+			// no collector is queried, and no schedd or startd is contacted.
+		void setReplay(NegotiationReplay *replay) {m_replay = replay;}
+
+		// publish the stats of the most recent max_cycles cycles, or of
+		// all the cycles we keep if max_cycles is negative.
+		void publishNegotiationCycleStats( ClassAd *ad, int max_cycles = -1 );
+
     protected:
 		char * NegotiatorName;
 		bool NegotiatorNameInConfig;
@@ -112,6 +125,8 @@ class Matchmaker : public Service
 		
 		// auxillary functions
 		bool obtainAdsFromCollector (ClassAdList &allAds, ClassAdListDoesNotDeleteAds &startdAds, ClassAdListDoesNotDeleteAds &submitterAds, std::set<std::string> &submitterNames, ClaimIdHash &claimIds );	
+		bool mergeCachedStartdAds (ClassAdList &allAds, long long cachedSequence);
+		void clearStartdAdCache ();
 		char * compute_significant_attrs(ClassAdListDoesNotDeleteAds & startdAds);
 		bool consolidate_globaljobprio_submitter_ads(ClassAdListDoesNotDeleteAds & submitterAds) const;
 
@@ -274,6 +289,8 @@ class Matchmaker : public Service
 		void updateNegCycleEndTime(time_t startTime, ClassAd *submitter);
 		friend int comparisonFunction (ClassAd *, ClassAd *,
 										void *);
+		friend class SlotPrefilterTest;
+		friend class MatchListCacheTest;
 
 		std::vector<std::pair<ClassAd*,ClassAd*> > unmutatedSlotAds;
 		std::map<std::string, ClassAd *> m_slotNameToAdMap;
@@ -326,6 +343,12 @@ class Matchmaker : public Service
 		ExprTree *NegotiatorPostJobRank; // rank applied after job rank
 		bool want_globaljobprio;	// cached value of config knob USE_GLOBAL_JOB_PRIOS
 		bool want_matchlist_caching;	// should we cache matches per autocluster?
+		bool want_slot_prefilter;	// value of knob NEGOTIATOR_SLOT_PREFILTER
+		bool want_optimize_job_rank;	// value of knob NEGOTIATOR_OPTIMIZE_JOB_RANK
+		SlotPrefilter m_slotPrefilter;	// per-cycle index of slot attributes
+		std::string m_traceFile;	// value of knob NEGOTIATOR_CYCLE_TRACE_FILE
+		NegotiationTrace m_trace;	// flight recorder for the current cycle
+		NegotiationReplay *m_replay;	// recorded cycle to negotiate against, if any
 		bool PublishCrossSlotPrios; // value of knob NEGOTIATOR_CROSS_SLOT_PRIOS, default of false
 		bool ConsiderPreemption; // if false, negotiation is faster (default=true)
 		bool ConsiderEarlyPreemption; // if false, do not preempt slots that still have retirement time
@@ -353,6 +376,18 @@ class Matchmaker : public Service
 		typedef HashTable<std::string, MapEntry*> AdHash;
 		AdHash *stashedAds;			
 
+		// Startd ads as received from the collector, kept across cycles
+		// for the incremental ad fetch (NEGOTIATOR_INCREMENTAL_AD_FETCH).
+		// Keyed by MachineAdID(); sequence is the ad's CollectorUpdateSequence.
+		struct CachedStartdAd {
+			long long sequence;
+			ClassAd *ad;
+		};
+		typedef std::unordered_map<std::string, CachedStartdAd> StartdAdCache;
+		StartdAdCache m_startdAdCache;
+		long long m_startdAdCacheSequence;	// highest sequence in the cache
+		bool want_incremental_ad_fetch;
+
 		groupQuotasHashType *groupQuotasHash;
 
 		// rank condition on matches
@@ -372,6 +407,10 @@ class Matchmaker : public Service
 
 		// external references in startd ads ... used for autoclustering
 		char * job_attr_references;
+		// the per-submitter attributes negotiate() puts in each request
+		// that startd ads or policy expressions refer to; left out of
+		// job_attr_references, but part of every matchListSignature()
+		classad::References submitter_attr_references;
 
 		// Epoch time when we finished most rescent negotiation cycle
 		time_t completedLastCycleTime;
@@ -403,6 +442,7 @@ class Matchmaker : public Service
 				PreemptRankValue = -(FLT_MAX);
 				PreemptStateValue = (Matchmaker::PreemptState)-1;
 				ad = NULL;
+				SlotVersion = 0;
 			}			  
 			double			RankValue;
 			double			PreJobRankValue;
@@ -411,6 +451,7 @@ class Matchmaker : public Service
 			PreemptState	PreemptStateValue;
 			std::string			DslotClaims;
 			ClassAd *ad;
+			unsigned		SlotVersion;	// slotVersion(ad) when ranked
 		};
 
 		/** This class is just like ClassAdList, expept that it will
@@ -436,7 +477,8 @@ class Matchmaker : public Service
 		// List of matches.
 		// This list is essentially a list of sorted matching
 		// machine ads for a job ad of a given autocluster from
-		// a given user and schedd.
+		// a given user and schedd (or, see m_matchListCache,
+		// from any user whose job has the same significant attributes).
 		// When a job ad arrives, we store all machine ads that
 		// match into this object --- a 'match list'.   We then
 		// sort this list, and 'pop' off the top candidate.
@@ -448,7 +490,7 @@ class Matchmaker : public Service
 		{
 		public:
 
-			ClassAd* pop_candidate(std::string &dslot_claims);
+			ClassAd* pop_candidate(std::string &dslot_claims, unsigned &slot_version);
 				// Return the previously-pop'd candidate back into the list.
 				// Note that this assumes there is empty space in the front of the list
 				// Also assume list was already sorted.
@@ -458,7 +500,8 @@ class Matchmaker : public Service
 					double candidatePreJobRankValue,
 					double candidatePostJobRankValue,
 					double candidatePreemptRankValue,
-					PreemptState candidatePreemptState);
+					PreemptState candidatePreemptState,
+					unsigned candidateSlotVersion);
 			bool cache_still_valid(ClassAd &request,ExprTree *preemption_req,
 				ExprTree *preemption_rank,bool preemption_req_unstable, bool preemption_rank_unstable);
 			void get_diagnostics(int & rejForNetwork,
@@ -483,7 +526,8 @@ class Matchmaker : public Service
 					double candidatePostJobRankValue,
 					double candidatePreemptRankValue,
 					PreemptState candidatePreemptState,
-					const std::string &candidateDslotClaims);
+					const std::string &candidateDslotClaims,
+					unsigned candidateSlotVersion);
 			void sort();
 			int length() const { return adListLen - adListHead; }
 
@@ -522,6 +566,40 @@ class Matchmaker : public Service
 		double cachedPrio;
 		bool cachedOnlyForStartdRank;
 
+		// Match lists built during the current pie spin, keyed by
+		// matchListSignature() of the request.  MatchList points into
+		// this cache.  A list is sharable when nothing about how it was
+		// built depended on the submitter (no claimed slots were
+		// considered and no slots were rejected for the submitter limit),
+		// so identical requests from other submitters can pop from it.
+		struct CachedMatchList {
+			MatchListType *list;
+			std::string submitterName;
+			std::string scheddAddr;
+			double prio;
+			bool onlyForStartdRank;
+			bool sharable;
+			unsigned long lastUse;
+		};
+		typedef std::map<std::string, CachedMatchList> MatchListCache;
+		MatchListCache m_matchListCache;
+		unsigned long m_matchListUses;
+		int m_matchListCacheSize;	// value of knob NEGOTIATOR_MATCHLIST_CACHE_SIZE
+		std::string matchListSignature(ClassAd &request, bool isIPv4, bool isIPv6) const;
+		void forgetMatchList(MatchListType *list);
+
+		// Slot ads changed (claimed, split, ...) or removed from startdAds
+		// during the pie spin.  Match list entries remember the version
+		// of the slot they were ranked against; a removed slot is skipped
+		// when popped, and a changed one forces the list to be rebuilt.
+		struct SlotChange {
+			unsigned version;
+			bool removed;
+		};
+		std::unordered_map<const ClassAd *, SlotChange> m_slotChanges;
+		unsigned slotVersion(const ClassAd *slot) const;
+		void slotChanged(const ClassAd *slot, bool removed = false);
+
         // set at startup/restart/reinit
         GroupEntry* hgq_root_group;
 		std::vector<GroupEntry*> hgq_groups;
@@ -541,7 +619,6 @@ class Matchmaker : public Service
 		int num_negotiation_cycle_stats;
 
 		void StartNewNegotiationCycleStat();
-		void publishNegotiationCycleStats( ClassAd *ad );
 };
 GCC_DIAG_ON(float-equal)
 
@@ -233,6 +233,15 @@ ResourceRequestList::tryRetrieve(ReliSock *const sock)
 	return result;
 }
 
+void
+ResourceRequestList::setRequests(const std::vector<ClassAd *> &requests)
+{
+	for (size_t i = 0; i < requests.size(); i++) {
+		m_ads.push_back(new ClassAd(*requests[i]));
+	}
+	m_send_end_negotiate = true;
+}
+
 ResourceRequestList::TryStates
 ResourceRequestList::fetchRequestsFromSchedd(ReliSock* const sock, bool blocking)
 {
@@ -21,6 +21,7 @@
 #define _MATCHMAKER_NEGOTIATE_H
 
 #include <deque>
+#include <vector>
 
 class ResourceRequestList {
 
@@ -57,6 +58,11 @@ class ResourceRequestList {
 	};
 	TryStates tryRetrieve(ReliSock* const sock);
 
+		// stand in for a schedd that sends the given requests and then
+		// says it has no more.  used when replaying a negotiation trace,
+		// where there is no schedd to ask.
+	void setRequests(const std::vector<ClassAd *> &requests);
+
  private:
 
 	TryStates fetchRequestsFromSchedd(ReliSock* const sock, bool blocking);
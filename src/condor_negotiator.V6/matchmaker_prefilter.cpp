@@ -0,0 +1,414 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_attributes.h"
+#include "compat_classad_util.h"
+#include "matchmaker_prefilter.h"
+
+// Doubles represent integers exactly up to 2^53; slot values beyond
+// that are not used for pruning.
+static const double MAX_EXACT_NUMBER = 9007199254740992.0;
+
+// Unscoped references that do not resolve in the job ad are looked up
+// in the scopes the MatchClassAd puts between the job and the slot
+// before they reach the slot ad, so these names never mean a slot attribute.
+static const char * const match_scope_names[] = {
+	"my", "target", "other", "ad", "left", "right", "self", "parent",
+	"toplevel", "root", "symmetricMatch", "leftMatchesRight",
+	"rightMatchesLeft", "leftRankValue", "rightRankValue",
+};
+
+static bool
+isMatchScopeName(const std::string &attr)
+{
+	for (size_t i = 0; i < sizeof(match_scope_names)/sizeof(match_scope_names[0]); i++) {
+		if (strcasecmp(attr.c_str(), match_scope_names[i]) == MATCH) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Like ExprTreeIsLiteral(), but refuses literals with a unit suffix
+// (e.g. 4G) since the stored value is not the value they evaluate to.
+static bool
+isPlainLiteral(classad::ExprTree *tree, classad::Value &value)
+{
+	tree = SkipExprParens(tree);
+	if ( ! tree || tree->GetKind() != classad::ExprTree::LITERAL_NODE) {
+		return false;
+	}
+	classad::Value::NumberFactor factor;
+	((classad::Literal*)tree)->GetComponents(value, factor);
+	return factor == classad::Value::NO_FACTOR;
+}
+
+static classad::Operation::OpKind
+flipComparison(classad::Operation::OpKind op)
+{
+	switch (op) {
+	case classad::Operation::LESS_THAN_OP: return classad::Operation::GREATER_THAN_OP;
+	case classad::Operation::LESS_OR_EQUAL_OP: return classad::Operation::GREATER_OR_EQUAL_OP;
+	case classad::Operation::GREATER_OR_EQUAL_OP: return classad::Operation::LESS_OR_EQUAL_OP;
+	case classad::Operation::GREATER_THAN_OP: return classad::Operation::LESS_THAN_OP;
+	default: return op;
+	}
+}
+
+SlotPrefilter::SlotPrefilter()
+{
+}
+
+void
+SlotPrefilter::clear()
+{
+	m_rows.clear();
+	m_invalid.clear();
+	m_columns.clear();
+	m_column_ids.clear();
+	m_clauses.clear();
+}
+
+void
+SlotPrefilter::invalidate(const ClassAd *slot)
+{
+	auto it = m_rows.find(slot);
+	if (it != m_rows.end()) {
+		m_invalid[it->second] = true;
+	}
+}
+
+int
+SlotPrefilter::setRequest(ClassAd &request)
+{
+	m_clauses.clear();
+	classad::ExprTree *requirements = request.LookupExpr(ATTR_REQUIREMENTS);
+	if (requirements) {
+		addConjuncts(request, requirements);
+	}
+	return (int)m_clauses.size();
+}
+
+void
+SlotPrefilter::addConjuncts(ClassAd &request, classad::ExprTree *tree)
+{
+	tree = SkipExprParens(tree);
+	if ( ! tree) {
+		return;
+	}
+	if (tree->GetKind() == classad::ExprTree::OP_NODE) {
+		classad::Operation::OpKind op;
+		classad::ExprTree *t1, *t2, *t3;
+		((classad::Operation*)tree)->GetComponents(op, t1, t2, t3);
+		if (op == classad::Operation::LOGICAL_AND_OP) {
+			addConjuncts(request, t1);
+			addConjuncts(request, t2);
+			return;
+		}
+	}
+	addClause(request, tree);
+}
+
+	// Is this a reference to an attribute of the slot ad?
+bool
+SlotPrefilter::isSlotAttrRef(ClassAd &request, classad::ExprTree *tree, std::string &attr) const
+{
+	tree = SkipExprParens(tree);
+	if ( ! tree || tree->GetKind() != classad::ExprTree::ATTRREF_NODE) {
+		return false;
+	}
+
+	classad::ExprTree *scope = NULL;
+	bool absolute = false;
+	((classad::AttributeReference*)tree)->GetComponents(scope, attr, absolute);
+	if (absolute) {
+		return false;
+	}
+
+	if ( ! scope) {
+			// unscoped, so it means the slot attribute only if it
+			// is not found in the job or the match scopes first.
+		return ! request.Lookup(attr) && ! isMatchScopeName(attr);
+	}
+
+		// TARGET.Attr, or RIGHT.Attr once the job ad has been optimized
+	std::string scope_name;
+	classad::ExprTree *scope_scope = NULL;
+	if (scope->GetKind() != classad::ExprTree::ATTRREF_NODE) {
+		return false;
+	}
+	((classad::AttributeReference*)scope)->GetComponents(scope_scope, scope_name, absolute);
+	if (scope_scope) {
+		return false;
+	}
+	if (absolute) {
+		return strcasecmp(scope_name.c_str(), "RIGHT") == MATCH;
+	}
+	return strcasecmp(scope_name.c_str(), "TARGET") == MATCH && ! request.Lookup("TARGET");
+}
+
+	// Is this a literal, or a job attribute whose value is a literal?
+bool
+SlotPrefilter::isJobLiteral(ClassAd &request, classad::ExprTree *tree, classad::Value &value) const
+{
+	if (isPlainLiteral(tree, value)) {
+		return true;
+	}
+
+	std::string attr;
+	bool absolute = false;
+	tree = SkipExprParens(tree);
+	if ( ! tree || tree->GetKind() != classad::ExprTree::ATTRREF_NODE) {
+		return false;
+	}
+	classad::ExprTree *scope = NULL;
+	((classad::AttributeReference*)tree)->GetComponents(scope, attr, absolute);
+	if (absolute) {
+		return false;
+	}
+	if (scope) {
+		std::string scope_name;
+		classad::ExprTree *scope_scope = NULL;
+		if (scope->GetKind() != classad::ExprTree::ATTRREF_NODE) {
+			return false;
+		}
+		((classad::AttributeReference*)scope)->GetComponents(scope_scope, scope_name, absolute);
+		if (scope_scope || absolute || strcasecmp(scope_name.c_str(), "MY") != MATCH) {
+			return false;
+		}
+	}
+	return isPlainLiteral(request.Lookup(attr), value);
+}
+
+bool
+SlotPrefilter::addClause(ClassAd &request, classad::ExprTree *tree)
+{
+	Clause clause;
+	std::string attr;
+	classad::Value value;
+
+	clause.bare = false;
+	clause.op = classad::Operation::__NO_OP__;
+	clause.num = 0.0;
+	clause.b = false;
+
+	if (isSlotAttrRef(request, tree, attr)) {
+		clause.bare = true;
+		clause.type = classad::Value::BOOLEAN_VALUE;
+		clause.b = true;
+	} else {
+		if (tree->GetKind() != classad::ExprTree::OP_NODE) {
+			return false;
+		}
+		classad::Operation::OpKind op;
+		classad::ExprTree *t1, *t2, *t3;
+		((classad::Operation*)tree)->GetComponents(op, t1, t2, t3);
+		if (op < classad::Operation::__COMPARISON_START__ || op > classad::Operation::__COMPARISON_END__) {
+			return false;
+		}
+		if (isSlotAttrRef(request, t1, attr) && isJobLiteral(request, t2, value)) {
+			clause.op = op;
+		} else if (isSlotAttrRef(request, t2, attr) && isJobLiteral(request, t1, value)) {
+			clause.op = flipComparison(op);
+		} else {
+			return false;
+		}
+
+		bool is_meta = (clause.op == classad::Operation::META_EQUAL_OP ||
+		                clause.op == classad::Operation::META_NOT_EQUAL_OP);
+		bool is_equality = is_meta ||
+		                   clause.op == classad::Operation::EQUAL_OP ||
+		                   clause.op == classad::Operation::NOT_EQUAL_OP;
+		long long ival;
+		if (value.IsBooleanValue(clause.b)) {
+			if ( ! is_equality) return false;
+		} else if (value.IsIntegerValue(ival)) {
+				// =?= distinguishes 1 from 1.0, which we do not track
+			if (is_meta) return false;
+			clause.num = (double)ival;
+			if (clause.num > MAX_EXACT_NUMBER || clause.num < -MAX_EXACT_NUMBER) return false;
+		} else if (value.IsRealValue(clause.num)) {
+			if (is_meta) return false;
+			if (clause.num != clause.num) return false; // NaN
+		} else if (value.IsStringValue(clause.str)) {
+			if ( ! is_equality) return false;
+		} else {
+			return false;
+		}
+		clause.type = value.GetType();
+		if (clause.type == classad::Value::INTEGER_VALUE) {
+			clause.type = classad::Value::REAL_VALUE;
+		}
+	}
+
+	clause.col = columnFor(attr);
+	m_clauses.push_back(clause);
+	return true;
+}
+
+size_t
+SlotPrefilter::columnFor(const std::string &attr)
+{
+	auto it = m_column_ids.find(attr);
+	if (it != m_column_ids.end()) {
+		return it->second;
+	}
+	size_t col = m_columns.size();
+	m_columns.emplace_back();
+	m_columns.back().attr = attr;
+	m_column_ids[attr] = col;
+	return col;
+}
+
+const SlotPrefilter::Cell &
+SlotPrefilter::cellFor(Column &column, size_t row, const ClassAd *slot)
+{
+	if (column.cells.size() <= row) {
+		column.cells.resize(m_rows.size());
+	}
+	Cell &cell = column.cells[row];
+	if (cell.kind != Cell::UNLOADED) {
+		return cell;
+	}
+
+	classad::Value value;
+	classad::ExprTree *tree = slot->Lookup(column.attr);
+	std::string str;
+	long long ival;
+	cell.kind = Cell::OTHER;
+	if ( ! tree) {
+		cell.kind = Cell::MISSING;
+	} else if ( ! isPlainLiteral(tree, value)) {
+		cell.kind = Cell::OTHER;
+	} else if (value.IsUndefinedValue()) {
+		cell.kind = Cell::MISSING;
+	} else if (value.IsBooleanValue(cell.b)) {
+		cell.kind = Cell::BOOLEAN;
+	} else if (value.IsIntegerValue(ival)) {
+		cell.num = (double)ival;
+		if (cell.num <= MAX_EXACT_NUMBER && cell.num >= -MAX_EXACT_NUMBER) {
+			cell.kind = Cell::NUMBER;
+		}
+	} else if (value.IsRealValue(cell.num)) {
+		if (cell.num == cell.num) {
+			cell.kind = Cell::NUMBER;
+		}
+	} else if (value.IsStringValue(str)) {
+		auto it = column.string_ids.find(str);
+		if (it == column.string_ids.end()) {
+			it = column.string_ids.insert(std::make_pair(str, (unsigned int)column.strings.size())).first;
+			column.strings.push_back(str);
+		}
+		cell.str = it->second;
+		cell.kind = Cell::STRING;
+	}
+	return cell;
+}
+
+	// Returns true if the clause is certainly not true for this cell,
+	// in which case neither is the job Requirements.
+bool
+SlotPrefilter::clauseFails(const Clause &clause, const Column &column, const Cell &cell) const
+{
+	switch (cell.kind) {
+	case Cell::MISSING:
+			// an undefined operand makes every comparison undefined,
+			// except for the meta operators
+		if (clause.op == classad::Operation::META_NOT_EQUAL_OP) {
+			return false;
+		}
+		return true;
+
+	case Cell::BOOLEAN:
+		if (clause.type != classad::Value::BOOLEAN_VALUE) {
+			return false;
+		}
+		if (clause.bare) {
+			return ! cell.b;
+		}
+		if (clause.op == classad::Operation::EQUAL_OP || clause.op == classad::Operation::META_EQUAL_OP) {
+			return cell.b != clause.b;
+		}
+		return cell.b == clause.b;
+
+	case Cell::NUMBER:
+		if (clause.type != classad::Value::REAL_VALUE) {
+			return false;
+		}
+		switch (clause.op) {
+		case classad::Operation::LESS_THAN_OP: return !(cell.num < clause.num);
+		case classad::Operation::LESS_OR_EQUAL_OP: return !(cell.num <= clause.num);
+		case classad::Operation::EQUAL_OP: return !(cell.num == clause.num);
+		case classad::Operation::NOT_EQUAL_OP: return !(cell.num != clause.num);
+		case classad::Operation::GREATER_OR_EQUAL_OP: return !(cell.num >= clause.num);
+		case classad::Operation::GREATER_THAN_OP: return !(cell.num > clause.num);
+		default: return false;
+		}
+
+	case Cell::STRING: {
+		if (clause.type != classad::Value::STRING_VALUE) {
+			return false;
+		}
+		const std::string &str = column.strings[cell.str];
+		switch (clause.op) {
+			// == is case-insensitive for strings, =?= is not
+		case classad::Operation::EQUAL_OP: return strcasecmp(str.c_str(), clause.str.c_str()) != MATCH;
+		case classad::Operation::NOT_EQUAL_OP: return strcasecmp(str.c_str(), clause.str.c_str()) == MATCH;
+		case classad::Operation::META_EQUAL_OP: return str != clause.str;
+		case classad::Operation::META_NOT_EQUAL_OP: return str == clause.str;
+		default: return false;
+		}
+	}
+
+	default:
+		return false;
+	}
+}
+
+bool
+SlotPrefilter::mayMatch(const ClassAd *slot)
+{
+	if (m_clauses.empty()) {
+		return true;
+	}
+
+	size_t row;
+	auto it = m_rows.find(slot);
+	if (it == m_rows.end()) {
+		row = m_rows.size();
+		m_rows[slot] = row;
+		m_invalid.push_back(false);
+	} else {
+		row = it->second;
+	}
+	if (m_invalid[row]) {
+		return true;
+	}
+
+	for (auto clause = m_clauses.begin(); clause != m_clauses.end(); ++clause) {
+		Column &column = m_columns[clause->col];
+		const Cell &cell = cellFor(column, row, slot);
+		if (clauseFails(*clause, column, cell)) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,114 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef _MATCHMAKER_PREFILTER_H
+#define _MATCHMAKER_PREFILTER_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <unordered_map>
+
+#include "condor_classad.h"
+
+// A per-cycle cache of slot attribute values, stored by column, used
+// to throw out slots that cannot possibly satisfy a job's Requirements
+// before doing a full ClassAd match.
+//
+// Only top-level conjuncts of the job Requirements of the form
+//     TARGET.Attr <op> <literal>     (or <literal> <op> TARGET.Attr)
+//     TARGET.Attr                     (a boolean attribute)
+// are considered, and only when the slot attribute is itself a literal.
+// Since every conjunct of an && chain must be true for the chain to be
+// true, a slot that fails (or is undefined for) one of these conjuncts
+// cannot match, whatever the rest of either Requirements says.
+// Anything this class cannot reason about is never pruned.
+//
+// Slot values are loaded lazily, once per slot and attribute per cycle,
+// so the cost of a lookup is paid once rather than once per job.
+// Callers must invalidate() a slot ad whenever they modify it.
+class SlotPrefilter {
+
+ public:
+	SlotPrefilter();
+
+		// forget all slots; call at the start and end of every cycle,
+		// since the index holds pointers to the cycle's slot ads.
+	void clear();
+
+		// the slot ad was modified, never prune it again this cycle.
+	void invalidate(const ClassAd *slot);
+
+		// find the prunable clauses in the job's Requirements;
+		// returns the number of clauses found.
+	int setRequest(ClassAd &request);
+
+		// returns false only if the slot certainly does not match the
+		// request passed to the last call of setRequest().
+	bool mayMatch(const ClassAd *slot);
+
+	int numSlots() const { return (int)m_rows.size(); }
+	int numColumns() const { return (int)m_columns.size(); }
+
+ private:
+
+	struct Cell {
+		enum Kind { UNLOADED = 0, MISSING, NUMBER, STRING, BOOLEAN, OTHER };
+		unsigned char kind;
+		union {
+			double num;
+			unsigned int str;
+			bool b;
+		};
+		Cell() : kind(UNLOADED), num(0.0) {}
+	};
+
+	struct Column {
+		std::string attr;
+		std::vector<Cell> cells;
+		std::vector<std::string> strings;          // distinct string values
+		std::map<std::string, unsigned int> string_ids;
+	};
+
+	struct Clause {
+		size_t col;
+		bool bare;                          // just TARGET.Attr
+		classad::Operation::OpKind op;      // slot value <op> literal
+		classad::Value::ValueType type;     // type of the literal
+		double num;
+		bool b;
+		std::string str;
+	};
+
+	void addConjuncts(ClassAd &request, classad::ExprTree *tree);
+	bool addClause(ClassAd &request, classad::ExprTree *tree);
+	bool isSlotAttrRef(ClassAd &request, classad::ExprTree *tree, std::string &attr) const;
+	bool isJobLiteral(ClassAd &request, classad::ExprTree *tree, classad::Value &value) const;
+	size_t columnFor(const std::string &attr);
+	const Cell & cellFor(Column &column, size_t row, const ClassAd *slot);
+	bool clauseFails(const Clause &clause, const Column &column, const Cell &cell) const;
+
+	std::unordered_map<const ClassAd *, size_t> m_rows;
+	std::vector<char> m_invalid;
+	std::vector<Column> m_columns;
+	std::map<std::string, size_t, classad::CaseIgnLTStr> m_column_ids;
+	std::vector<Clause> m_clauses;
+};
+
+#endif
@@ -0,0 +1,270 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#include "condor_common.h"
+#include <set>
+
+#include "condor_debug.h"
+#include "condor_attributes.h"
+#include "util_lib_proto.h"
+#include "matchmaker_trace.h"
+
+NegotiationTrace::NegotiationTrace() :
+	m_fp(NULL),
+	m_start(0.0),
+	m_records(0)
+{
+}
+
+NegotiationTrace::~NegotiationTrace()
+{
+	close();
+}
+
+void
+NegotiationTrace::close()
+{
+	if (m_fp) {
+		fclose(m_fp);
+		m_fp = NULL;
+	}
+}
+
+bool
+NegotiationTrace::begin(const char *filename, time_t cycle_start)
+{
+	close();
+	m_filename = filename;
+	m_records = 0;
+	m_start = _condor_debug_get_time_double();
+
+	std::string old_filename = m_filename + ".old";
+	if (access(m_filename.c_str(), F_OK) == 0 &&
+		rotate_file(m_filename.c_str(), old_filename.c_str()) != 0)
+	{
+		dprintf(D_ALWAYS, "Failed to rotate negotiation trace %s to %s\n",
+				m_filename.c_str(), old_filename.c_str());
+	}
+
+		// the trace holds whole job and slot ads, so only we may read it
+	int fd = safe_open_wrapper_follow(m_filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	if (fd >= 0) {
+		m_fp = fdopen(fd, "w");
+		if ( ! m_fp) {
+			::close(fd);
+		}
+	}
+	if ( ! m_fp) {
+		dprintf(D_ALWAYS, "Failed to open negotiation trace %s: %s (errno=%d)\n",
+				m_filename.c_str(), strerror(errno), errno);
+		return false;
+	}
+
+	ClassAd cycle;
+	cycle.Assign(ATTR_LAST_NEGOTIATION_CYCLE_TIME, cycle_start);
+	recordEvent(NEGOTIATION_TRACE_CYCLE, cycle);
+	return true;
+}
+
+void
+NegotiationTrace::end(ClassAd &summary)
+{
+	if ( ! m_fp) {
+		return;
+	}
+	recordEvent(NEGOTIATION_TRACE_CYCLE_END, summary);
+	dprintf(D_FULLDEBUG, "Wrote %d records to negotiation trace %s\n",
+			m_records, m_filename.c_str());
+	close();
+}
+
+void
+NegotiationTrace::recordAd(const char *record, const ClassAd &ad, const char *submitter,
+	const char *schedd)
+{
+	if ( ! m_fp) {
+		return;
+	}
+
+		// the ad belongs to the cycle, so rather than copy it to add the
+		// record type, write the extra attributes in front of it.
+	std::string buf;
+	fprintf(m_fp, "%s = %s\n", ATTR_NEGOTIATION_TRACE_RECORD, QuoteAdStringValue(record, buf));
+	if (submitter) {
+		fprintf(m_fp, "%s = %s\n", ATTR_NEGOTIATION_TRACE_SUBMITTER, QuoteAdStringValue(submitter, buf));
+	}
+	if (schedd) {
+		fprintf(m_fp, "%s = %s\n", ATTR_NEGOTIATION_TRACE_SCHEDD, QuoteAdStringValue(schedd, buf));
+	}
+	fPrintAd(m_fp, ad);
+	fprintf(m_fp, "\n");
+	m_records++;
+}
+
+void
+NegotiationTrace::recordEvent(const char *record, ClassAd &event)
+{
+	if ( ! m_fp) {
+		return;
+	}
+	event.Assign(ATTR_NEGOTIATION_TRACE_RECORD, record);
+	event.Assign("Offset", _condor_debug_get_time_double() - m_start);
+	fPrintAd(m_fp, event);
+	fprintf(m_fp, "\n");
+	m_records++;
+}
+
+void
+NegotiationTrace::recordPhase(const char *phase, double duration, const char *submitter)
+{
+	if ( ! m_fp) {
+		return;
+	}
+	ClassAd event;
+	event.Assign("Phase", phase);
+	event.Assign("Duration", duration);
+	if (submitter) {
+		event.Assign(ATTR_NEGOTIATION_TRACE_SUBMITTER, submitter);
+	}
+	recordEvent(NEGOTIATION_TRACE_PHASE, event);
+}
+
+NegotiationReplay::NegotiationReplay() :
+	m_numRequests(0)
+{
+}
+
+NegotiationReplay::~NegotiationReplay()
+{
+	clear();
+}
+
+void
+NegotiationReplay::clear()
+{
+	for (size_t i = 0; i < m_startdAds.size(); i++) {
+		delete m_startdAds[i];
+	}
+	m_startdAds.clear();
+	for (size_t i = 0; i < m_submitterAds.size(); i++) {
+		delete m_submitterAds[i];
+	}
+	m_submitterAds.clear();
+	for (RequestMap::iterator it = m_requests.begin(); it != m_requests.end(); ++it) {
+		for (size_t i = 0; i < it->second.size(); i++) {
+			delete it->second[i];
+		}
+	}
+	m_requests.clear();
+	m_numRequests = 0;
+}
+
+bool
+NegotiationReplay::load(const char *filename, std::string &errmsg)
+{
+	clear();
+
+	FILE *fp = safe_fopen_wrapper_follow(filename, "r");
+	if ( ! fp) {
+		formatstr(errmsg, "cannot open %s: %s (errno=%d)", filename, strerror(errno), errno);
+		return false;
+	}
+
+		// the trace records a request each time the negotiator looks at
+		// it, so a request the schedd sent more than once (because it was
+		// not matched in an earlier spin of the pie, or because its
+		// ResourceRequestCount was more than one) is only kept once.
+	std::map<std::pair<std::string, std::string>, std::set<std::pair<int, int> > > seen;
+
+	CondorClassAdFileIterator iter;
+	iter.begin(fp, true, CondorClassAdFileParseHelper::Parse_long);
+	ClassAd *ad;
+	while ((ad = iter.next(NULL))) {
+		std::string record;
+		ad->LookupString(ATTR_NEGOTIATION_TRACE_RECORD, record);
+		if (record == NEGOTIATION_TRACE_STARTD_AD) {
+			ad->Delete(ATTR_NEGOTIATION_TRACE_RECORD);
+			m_startdAds.push_back(ad);
+		} else if (record == NEGOTIATION_TRACE_SUBMITTER_AD) {
+			ad->Delete(ATTR_NEGOTIATION_TRACE_RECORD);
+			m_submitterAds.push_back(ad);
+		} else if (record == NEGOTIATION_TRACE_REQUEST) {
+			std::pair<std::string, std::string> key;
+			int cluster = -1, proc = -1;
+			if ( ! ad->LookupString(ATTR_NEGOTIATION_TRACE_SUBMITTER, key.first) ||
+				 ! ad->LookupString(ATTR_NEGOTIATION_TRACE_SCHEDD, key.second) ||
+				 ! ad->LookupInteger(ATTR_CLUSTER_ID, cluster) ||
+				 ! ad->LookupInteger(ATTR_PROC_ID, proc) ||
+				 ! seen[key].insert(std::make_pair(cluster, proc)).second)
+			{
+				delete ad;
+				continue;
+			}
+			ad->Delete(ATTR_NEGOTIATION_TRACE_RECORD);
+			ad->Delete(ATTR_NEGOTIATION_TRACE_SUBMITTER);
+			ad->Delete(ATTR_NEGOTIATION_TRACE_SCHEDD);
+			m_requests[key].push_back(ad);
+			m_numRequests++;
+		} else {
+			delete ad;
+		}
+	}
+
+	if (m_startdAds.empty() && m_submitterAds.empty()) {
+		formatstr(errmsg, "%s has no slot or submitter ads", filename);
+		return false;
+	}
+	return true;
+}
+
+void
+NegotiationReplay::getCollectorAds(ClassAdList &publicAds, ClassAdList &privateAds) const
+{
+	for (size_t i = 0; i < m_startdAds.size(); i++) {
+		const ClassAd *ad = m_startdAds[i];
+		publicAds.Insert(new ClassAd(*ad));
+
+		std::string name, addr, claim_id;
+		if ( ! ad->LookupString(ATTR_NAME, name) ||
+			 ! ad->LookupString(ATTR_STARTD_IP_ADDR, addr)) {
+			continue;
+		}
+			// the claim id is never sent anywhere, it only has to be
+			// unique and look like the real thing.
+		formatstr(claim_id, "%s#%d#%d#...", addr.c_str(), 0, (int)i + 1);
+		ClassAd *pvt = new ClassAd();
+		pvt->Assign(ATTR_NAME, name);
+		pvt->Assign(ATTR_MY_ADDRESS, addr);
+		pvt->Assign(ATTR_CLAIM_ID, claim_id);
+		privateAds.Insert(pvt);
+	}
+	for (size_t i = 0; i < m_submitterAds.size(); i++) {
+		publicAds.Insert(new ClassAd(*m_submitterAds[i]));
+	}
+}
+
+const std::vector<ClassAd *> &
+NegotiationReplay::getRequests(const std::string &submitter, const std::string &schedd) const
+{
+	RequestMap::const_iterator it = m_requests.find(std::make_pair(submitter, schedd));
+	if (it == m_requests.end()) {
+		return m_noRequests;
+	}
+	return it->second;
+}
@@ -0,0 +1,137 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+#ifndef _MATCHMAKER_TRACE_H
+#define _MATCHMAKER_TRACE_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "condor_classad.h"
+
+// Record types written to a negotiation cycle trace file
+#define NEGOTIATION_TRACE_CYCLE       "Cycle"
+#define NEGOTIATION_TRACE_STARTD_AD   "StartdAd"
+#define NEGOTIATION_TRACE_SUBMITTER_AD "SubmitterAd"
+#define NEGOTIATION_TRACE_REQUEST     "ResourceRequest"
+#define NEGOTIATION_TRACE_PHASE       "Phase"
+#define NEGOTIATION_TRACE_NEGOTIATE   "Negotiate"
+#define NEGOTIATION_TRACE_MATCH       "Match"
+#define NEGOTIATION_TRACE_CYCLE_END   "CycleEnd"
+
+// The attribute naming the type of each record in a trace file
+#define ATTR_NEGOTIATION_TRACE_RECORD "NegotiationTraceRecord"
+// The submitter a record applies to, if any
+#define ATTR_NEGOTIATION_TRACE_SUBMITTER "NegotiationTraceSubmitter"
+// The schedd a resource request came from
+#define ATTR_NEGOTIATION_TRACE_SCHEDD "NegotiationTraceSchedd"
+
+// A flight recorder for the negotiator: writes what happened during
+// one negotiation cycle to a file, so that a slow or surprising cycle
+// can be looked at (or replayed) after the fact.
+//
+// The file is a sequence of ClassAds in the long form, separated by
+// blank lines, which can be read back with condor_status -ads or a
+// CondorClassAdFileIterator.  Every ad has a NegotiationTraceRecord
+// attribute saying what it is: the slot and submitter ads as fetched
+// from the collector and the resource request ads as sent by the
+// schedds, followed by timing records for the phases
+// of the cycle and the outcome of each negotiation.  Records are
+// written as they happen, so the trace of a cycle that never finished
+// is still useful.  The trace of the previous cycle is kept in
+// <file>.old
+class NegotiationTrace {
+
+ public:
+	NegotiationTrace();
+	~NegotiationTrace();
+
+		// start tracing a new cycle into the given file; returns false
+		// (and does not trace) if the file cannot be opened.
+	bool begin(const char *filename, time_t cycle_start);
+
+		// finish the trace of the current cycle and close the file.
+	void end(ClassAd &summary);
+
+	bool active() const { return m_fp != NULL; }
+
+		// write an ad the cycle worked from.  the submitter and schedd,
+		// if given, are recorded alongside the ad.
+	void recordAd(const char *record, const ClassAd &ad, const char *submitter = NULL,
+		const char *schedd = NULL);
+
+		// write a record of something that happened during the cycle;
+		// the record type and time are added to the ad.
+	void recordEvent(const char *record, ClassAd &event);
+
+		// shorthand for a Phase record
+	void recordPhase(const char *phase, double duration, const char *submitter = NULL);
+
+	int numRecords() const { return m_records; }
+
+ private:
+	void close();
+
+	FILE *m_fp;
+	std::string m_filename;
+	double m_start;
+	int m_records;
+};
+
+// The input of a negotiation cycle, read back from a trace file written
+// by NegotiationTrace, so that the cycle can be run again without a
+// collector or any schedds.  See negotiator_replay.cpp.
+class NegotiationReplay {
+
+ public:
+	NegotiationReplay();
+	~NegotiationReplay();
+
+		// read the slot, submitter and request ads from a trace file;
+		// returns false and sets errmsg if the file cannot be read.
+	bool load(const char *filename, std::string &errmsg);
+
+		// fill in fresh copies of the slot and submitter ads, as a
+		// collector query would, along with a startd private ad holding
+		// a made-up claim id for each slot.
+	void getCollectorAds(ClassAdList &publicAds, ClassAdList &privateAds) const;
+
+		// the requests the schedd sent for the submitter, in the order
+		// it sent them.
+	const std::vector<ClassAd *> &getRequests(const std::string &submitter,
+		const std::string &schedd) const;
+
+	int numStartdAds() const { return (int)m_startdAds.size(); }
+	int numSubmitterAds() const { return (int)m_submitterAds.size(); }
+	int numRequests() const { return m_numRequests; }
+
+ private:
+	void clear();
+
+	typedef std::map<std::pair<std::string, std::string>, std::vector<ClassAd *> > RequestMap;
+
+	std::vector<ClassAd *> m_startdAds;
+	std::vector<ClassAd *> m_submitterAds;
+	RequestMap m_requests;
+	std::vector<ClassAd *> m_noRequests;
+	int m_numRequests;
+};
+
+#endif
@@ -0,0 +1,145 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+// Runs negotiation cycles against a trace written by the negotiator
+// (see NEGOTIATOR_CYCLE_TRACE_FILE) instead of a live pool, and reports
+// how long they took.  The slot and submitter ads come from the trace
+// rather than the collector, the resource requests come from the trace
+// rather than the schedds, and no match is sent anywhere, so only the
+// work the negotiator does itself is measured.  The negotiator's
+// configuration is used as is, so the effect of a knob or of a new
+// version on a pool can be measured by replaying the same trace.
+//
+// Matches are recorded by the accountant as in a real cycle, so SPOOL
+// should point at a scratch directory.  The options are named so that
+// DaemonCore, which looks only at the first letter, leaves them alone.
+
+#include "condor_common.h"
+#include "subsystem_info.h"
+#include "condor_attributes.h"
+#include "matchmaker.h"
+
+#include <vector>
+#include <algorithm>
+
+Matchmaker matchMaker;
+NegotiationReplay replay;
+
+void usage(char* name)
+{
+	fprintf(stderr, "Usage: %s -input <trace file> [-iterations <n>] [-n negotiator_name]\n", name);
+	exit( 1 );
+}
+
+void main_init (int argc, char *argv[])
+{
+	const char *neg_name = NULL;
+	const char *trace_file = NULL;
+	int cycles = 1;
+
+	for ( int i = 1; i < argc; i++ ) {
+		if ( argv[i][0] == '-' && argv[i][1] == 'n' && (i + 1) < argc ) {
+			neg_name = argv[i + 1];
+			i++;
+		} else if (strcmp(argv[i], "-input") == 0 && (i + 1) < argc) {
+			trace_file = argv[i + 1];
+			i++;
+		} else if (strcmp(argv[i], "-iterations") == 0 && (i + 1) < argc) {
+			cycles = atoi(argv[i + 1]);
+			i++;
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if ( ! trace_file || cycles < 1) {
+		usage(argv[0]);
+	}
+
+	std::string errmsg;
+	if ( ! replay.load(trace_file, errmsg)) {
+		fprintf(stderr, "Error: %s\n", errmsg.c_str());
+		DC_Exit(1);
+	}
+	printf("Replaying %s: %d slots, %d submitters, %d requests\n", trace_file,
+		replay.numStartdAds(), replay.numSubmitterAds(), replay.numRequests());
+
+	matchMaker.setReplay(&replay);
+	matchMaker.initialize(neg_name);
+
+	std::vector<double> durations;
+	long long total_matches = 0;
+	for (int cycle = 0; cycle < cycles; cycle++) {
+		double start = _condor_debug_get_time_double();
+		matchMaker.negotiationTime();
+		double duration = _condor_debug_get_time_double() - start;
+
+		ClassAd stats;
+		matchMaker.publishNegotiationCycleStats(&stats, 1);
+		int matches = 0, considered = 0, rejections = 0;
+		stats.LookupInteger(ATTR_LAST_NEGOTIATION_CYCLE_MATCHES "0", matches);
+		stats.LookupInteger(ATTR_LAST_NEGOTIATION_CYCLE_NUM_JOBS_CONSIDERED "0", considered);
+		stats.LookupInteger(ATTR_LAST_NEGOTIATION_CYCLE_REJECTIONS "0", rejections);
+
+		printf("Cycle %d: %.3f seconds, %d requests considered, %d matches, %d rejections, %.1f matches/sec\n",
+			cycle + 1, duration, considered, matches, rejections,
+			duration > 0 ? matches / duration : 0.0);
+		durations.push_back(duration);
+		total_matches += matches;
+	}
+
+	std::sort(durations.begin(), durations.end());
+	double total = 0.0;
+	for (size_t i = 0; i < durations.size(); i++) {
+		total += durations[i];
+	}
+	printf("Cycle latency: min %.3f, median %.3f, max %.3f, mean %.3f seconds\n",
+		durations.front(), durations[durations.size() / 2], durations.back(),
+		total / durations.size());
+	printf("Matches/sec: %.1f\n", total > 0 ? total_matches / total : 0.0);
+
+	DC_Exit(0);
+}
+
+void main_shutdown_graceful()
+{
+	DC_Exit(0);
+}
+
+void main_shutdown_fast()
+{
+	DC_Exit(0);
+}
+
+void
+main_config()
+{
+	matchMaker.reinitialize ();
+}
+
+int
+main( int argc, char **argv )
+{
+	set_mySubSystem( "NEGOTIATOR", SUBSYSTEM_TYPE_NEGOTIATOR );
+
+	dc_main_init = main_init;
+	dc_main_config = main_config;
+	dc_main_shutdown_fast = main_shutdown_fast;
+	dc_main_shutdown_graceful = main_shutdown_graceful;
+	return dc_main( argc, argv );
+}
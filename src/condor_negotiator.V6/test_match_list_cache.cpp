@@ -0,0 +1,184 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+// Checks that a match list built for one submitter is only shared with
+// another when the slots would match both the same way.  The slots START
+// only for submitters with a good priority, which negotiate() puts into
+// each request; a submitter with a poor priority must not be handed a
+// slot from the list built for one with a good priority, while another
+// with the same priority may share it.
+//
+//   test_match_list_cache [-v]
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_attributes.h"
+#include "stl_string_utils.h"
+#include "matchmaker.h"
+
+bool verbose = false;
+#define REQUIRE( condition ) \
+	if(! ( condition )) { \
+		fprintf( stderr, "Failed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+		return 1; \
+	} else if( verbose ) { \
+		fprintf( stdout, "Passed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+	}
+
+static const int NUM_SLOTS = 4;
+
+static ClassAd *makeAd( const char *attrs )
+{
+	classad::ClassAdParser parser;
+	return parser.ParseClassAd( std::string("[ ") + attrs + " ]", true );
+}
+
+class MatchListCacheTest {
+ public:
+	MatchListCacheTest()
+	{
+		mm.ConsiderPreemption = false;
+		mm.want_matchlist_caching = true;
+		mm.num_negotiation_cycle_stats = 1;
+		mm.StartNewNegotiationCycleStat();
+	}
+
+	~MatchListCacheTest()
+	{
+		for ( size_t i = 0; i < slots.size(); i++ ) {
+			delete slots[i];
+		}
+	}
+
+		// Slots that START only for submitters with a user priority
+		// below 10, as the pool admin might configure them.
+	int makeSlots()
+	{
+		for ( int i = 0; i < NUM_SLOTS; i++ ) {
+			std::string attrs;
+			formatstr( attrs, "Name = \"slot%d@host\"; MyAddress = \"<127.0.0.1:9618>\"; "
+				"Cpus = 1; Memory = 1024; Rank = 0; "
+				"Start = TARGET.SubmitterUserPrio < 10; Requirements = START", i + 1 );
+			ClassAd *slot = makeAd( attrs.c_str() );
+			REQUIRE( slot );
+			slots.push_back( slot );
+			slotList.Insert( slot );
+		}
+
+		if ( mm.job_attr_references ) {
+			free( mm.job_attr_references );
+		}
+		mm.job_attr_references = mm.compute_significant_attrs( slotList );
+		return 0;
+	}
+
+		// A request in the same autocluster from each submitter, carrying
+		// the submitter's priority the way negotiate() adds it.
+	ClassAd *match( const char *submitter, double prio )
+	{
+		std::string attrs;
+		formatstr( attrs, "ClusterId = 1; ProcId = 0; AutoClusterId = 1; Owner = \"%s\"; "
+			"RequestCpus = 1; RequestMemory = 1024; Rank = 0; "
+			"Requirements = TARGET.Cpus >= RequestCpus && TARGET.Memory >= RequestMemory",
+			submitter );
+		ClassAd *request = makeAd( attrs.c_str() );
+		if ( ! request ) {
+			return NULL;
+		}
+		request->Assign( ATTR_SUBMITTOR_PRIO, (float)prio );
+		request->Assign( ATTR_SUBMITTER_USER_PRIO, (float)prio );
+
+		std::string name;
+		formatstr( name, "%s@example.com", submitter );
+		ClassAd *best = mm.matchmakingAlgorithm( name.c_str(), "<127.0.0.1:9618>",
+			*request, slotList, prio, 0.0, 0.0, 1e9, 1e9, 1e9, false );
+		if ( verbose ) {
+			std::string slot_name;
+			if ( best ) {
+				best->LookupString( ATTR_NAME, slot_name );
+			}
+			printf( "%s (prio %g): %s\n", submitter, prio, best ? slot_name.c_str() : "no match" );
+		}
+		delete request;
+		return best;
+	}
+
+	int sharedMatchLists()
+	{
+		ClassAd stats;
+		int shared = 0;
+		mm.publishNegotiationCycleStats( &stats, 1 );
+		stats.LookupInteger( ATTR_LAST_NEGOTIATION_CYCLE_SHARED_MATCH_LISTS "0", shared );
+		return shared;
+	}
+
+	int checkPrioStart()
+	{
+		REQUIRE( makeSlots() == 0 );
+
+			// the priority has to be part of the match list key
+		REQUIRE( mm.submitter_attr_references.count( ATTR_SUBMITTER_USER_PRIO ) == 1 );
+
+		REQUIRE( match( "alice", 1.0 ) != NULL );
+		REQUIRE( match( "bob", 100.0 ) == NULL );
+		REQUIRE( match( "alice", 1.0 ) != NULL );
+
+			// the same priority may share the list built for alice
+		int shared = sharedMatchLists();
+		REQUIRE( match( "carol", 1.0 ) != NULL );
+		REQUIRE( sharedMatchLists() == shared + 1 );
+
+			// and a poor priority still matches nothing, whichever
+			// list was built last
+		REQUIRE( match( "bob", 100.0 ) == NULL );
+		REQUIRE( match( "dave", 100.0 ) == NULL );
+		REQUIRE( match( "alice", 1.0 ) != NULL );
+
+		mm.DeleteMatchList();
+		return 0;
+	}
+
+ private:
+	Matchmaker mm;
+	std::vector<ClassAd*> slots;
+	ClassAdListDoesNotDeleteAds slotList;
+};
+
+int
+main( int argc, char ** argv )
+{
+	for ( int i = 1; i < argc; i++ ) {
+		if ( strcmp( argv[i], "-v" ) == 0 ) {
+			verbose = true;
+		} else {
+			fprintf( stderr, "Usage: %s [-v]\n", argv[0] );
+			return 1;
+		}
+	}
+
+	ClassAdReconfig();
+
+	MatchListCacheTest test;
+	if ( test.checkPrioStart() != 0 ) {
+		return 1;
+	}
+
+	fprintf( stdout, "No failures detected.\n" );
+	return 0;
+}
@@ -0,0 +1,271 @@
+/***************************************************************
+ *
+ * Copyright (C) 1990-2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+// Checks that the slot prefilter (NEGOTIATOR_SLOT_PREFILTER) never throws
+// out a slot that the full match would accept.  Every job is matched by
+// Matchmaker::matchmakingAlgorithm() against every slot on its own, once
+// with the prefilter off and once with it on, both as submitted and as
+// optimized for matchmaking; the two must agree with each other and with
+// the expected result.  Where the case says so, the prefilter must also
+// have thrown the slot out, so that the test fails if it stops working.
+//
+//   test_slot_prefilter [-v]
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_attributes.h"
+#include "stl_string_utils.h"
+#include "matchmaker.h"
+
+bool verbose = false;
+#define REQUIRE( condition ) \
+	if(! ( condition )) { \
+		fprintf( stderr, "Failed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+		return 1; \
+	} else if( verbose ) { \
+		fprintf( stdout, "Passed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+	}
+
+enum Prefiltered { KEPT, PRUNED, EITHER };
+
+struct PrefilterCase {
+	const char *name;
+	const char *job;		// attributes added to every job ad
+	const char *slot;		// attributes added to every slot ad
+	bool matches;			// the full match accepts the slot
+	Prefiltered prefiltered;
+};
+
+static const PrefilterCase cases[] = {
+		// numbers
+	{ "enough memory", "Requirements = TARGET.Memory >= 4096", "Memory = 8192", true, KEPT },
+	{ "too little memory", "Requirements = TARGET.Memory >= 4096", "Memory = 2048", false, PRUNED },
+	{ "literal on the left", "Requirements = 4096 <= TARGET.Memory", "Memory = 2048", false, PRUNED },
+	{ "not equal", "Requirements = TARGET.Cpus != 4", "Cpus = 4", false, PRUNED },
+	{ "integer equals real", "Requirements = TARGET.Cpus == 2.0", "Cpus = 2", true, KEPT },
+	{ "=?= integer against real", "Requirements = TARGET.Cpus =?= 2", "Cpus = 2.0", false, KEPT },
+	{ "beyond exact doubles", "Requirements = TARGET.Memory == 9007199254740992", "Memory = 9007199254740993", false, KEPT },
+	{ "slot value is an expression", "Requirements = TARGET.Memory >= 4096", "Memory = TotalMemory / 2; TotalMemory = 4096", false, KEPT },
+
+		// scoping of the references in the job Requirements
+	{ "MY literal", "Requirements = TARGET.Memory >= MY.RequestMemory; RequestMemory = 4096", "Memory = 2048", false, PRUNED },
+		// only a literal once optimization has flattened it
+	{ "MY expression", "Requirements = TARGET.Memory >= MY.RequestMemory; RequestMemory = ImageSize / 1024; ImageSize = 4194304", "Memory = 2048", false, EITHER },
+	{ "MY undefined", "Requirements = TARGET.Memory >= MY.RequestMemory", "Memory = 8192", false, KEPT },
+	{ "unscoped slot attribute", "Requirements = Memory >= 4096", "Memory = 2048", false, PRUNED },
+	{ "unscoped job attribute", "Requirements = Memory >= 4096; Memory = 8192", "Memory = 2048", true, KEPT },
+	{ "unscoped match scope name", "Requirements = TARGET.Cpus > 0 && rightRankValue >= 0", "Cpus = 1; Rank = 5; rightRankValue = -1", true, KEPT },
+	{ "job defines TARGET", "Requirements = TARGET.Memory >= 4096; TARGET = [ Memory = 8192 ]", "Memory = 2048", true, KEPT },
+	{ "RIGHT too little", "Requirements = RIGHT.Memory >= 4096", "Memory = 2048", false, EITHER },
+	{ "RIGHT enough", "Requirements = RIGHT.Memory >= 4096", "Memory = 8192", true, KEPT },
+
+		// undefined slot attributes
+	{ "missing number", "Requirements = TARGET.Gpus >= 1", "Cpus = 1", false, PRUNED },
+	{ "undefined number", "Requirements = TARGET.Gpus >= 1", "Gpus = undefined", false, PRUNED },
+	{ "missing boolean", "Requirements = TARGET.HasDocker", "Cpus = 1", false, PRUNED },
+	{ "missing =?=", "Requirements = TARGET.OpSys =?= \"LINUX\"", "Cpus = 1", false, PRUNED },
+	{ "missing =!=", "Requirements = TARGET.OpSys =!= \"WINDOWS\"", "Cpus = 1", true, KEPT },
+
+		// strings
+	{ "string against number", "Requirements = TARGET.Memory == \"4096\"", "Memory = 4096", false, KEPT },
+	{ "number against string", "Requirements = TARGET.OpSys == 5", "OpSys = \"LINUX\"", false, KEPT },
+	{ "== ignores case", "Requirements = TARGET.OpSys == \"linux\"", "OpSys = \"LINUX\"", true, KEPT },
+	{ "== different", "Requirements = TARGET.OpSys == \"WINDOWS\"", "OpSys = \"LINUX\"", false, PRUNED },
+	{ "!= ignores case", "Requirements = TARGET.OpSys != \"LINUX\"", "OpSys = \"linux\"", false, PRUNED },
+	{ "=?= minds case", "Requirements = TARGET.OpSys =?= \"linux\"", "OpSys = \"LINUX\"", false, PRUNED },
+	{ "=!= minds case", "Requirements = TARGET.OpSys =!= \"linux\"", "OpSys = \"LINUX\"", true, KEPT },
+	{ "string ordering", "Requirements = TARGET.OpSys < \"A\"", "OpSys = \"LINUX\"", false, KEPT },
+
+		// booleans
+	{ "true boolean", "Requirements = TARGET.HasDocker", "HasDocker = true", true, KEPT },
+	{ "false boolean", "Requirements = TARGET.HasDocker", "HasDocker = false", false, PRUNED },
+	{ "boolean against string", "Requirements = TARGET.HasDocker == true", "HasDocker = \"yes\"", false, KEPT },
+	{ "boolean equals false", "Requirements = TARGET.HasDocker == false", "HasDocker = true", false, PRUNED },
+
+		// literals with a unit suffix; optimization turns 4K into 4096.0
+	{ "job suffix too little", "Requirements = TARGET.Disk >= 4K", "Disk = 2048", false, EITHER },
+	{ "job suffix enough", "Requirements = TARGET.Disk >= 4K", "Disk = 8192", true, KEPT },
+	{ "slot suffix", "Requirements = TARGET.Disk >= 4096", "Disk = 4K", true, KEPT },
+
+		// the shape of the Requirements
+	{ "disjunction", "Requirements = TARGET.Memory >= 4096 || TARGET.Disk >= 1", "Memory = 2048; Disk = 10", true, KEPT },
+	{ "nested conjunction", "Requirements = (TARGET.Memory >= 1 && TARGET.Cpus >= 4) && TARGET.Disk > 0", "Memory = 2048; Cpus = 2; Disk = 10", false, PRUNED },
+	{ "slot requirements", "Requirements = TARGET.Memory >= 1024", "Memory = 2048; Requirements = false", false, KEPT },
+};
+
+static ClassAd *makeAd( const char *base, const char *attrs )
+{
+	std::string str;
+	formatstr( str, "[ %s; %s ]", base, attrs );
+	classad::ClassAdParser parser;
+	return parser.ParseClassAd( str, true );
+}
+
+static ClassAd *makeJob( const char *attrs )
+{
+	return makeAd( "ClusterId = 1; ProcId = 0; Owner = \"alice\"; Rank = 0", attrs );
+}
+
+static ClassAd *makeSlot( const char *attrs )
+{
+	return makeAd( "Name = \"slot1@host\"; MyAddress = \"<127.0.0.1:9618>\"; Requirements = true; Rank = 0", attrs );
+}
+
+class SlotPrefilterTest {
+ public:
+	SlotPrefilterTest()
+	{
+		mm.ConsiderPreemption = false;
+		mm.num_negotiation_cycle_stats = 1;
+		mm.StartNewNegotiationCycleStat();
+	}
+
+		// Returns true if matchmakingAlgorithm() picks the slot for the
+		// job; pruned is set to 1 if the prefilter threw the slot out.
+	bool match( ClassAd &job, ClassAd *slot, bool prefilter, int &pruned )
+	{
+		ClassAdListDoesNotDeleteAds slots;
+		slots.Insert( slot );
+		mm.want_slot_prefilter = prefilter;
+		ClassAd *best = mm.matchmakingAlgorithm( "alice@example.com", "<127.0.0.1:9618>",
+			job, slots, 0.0, 0.0, 0.0, 1e9, 1e9, 1e9, false );
+
+		ClassAd stats;
+		int prefiltered = 0;
+		mm.publishNegotiationCycleStats( &stats, 1 );
+		stats.LookupInteger( ATTR_LAST_NEGOTIATION_CYCLE_PREFILTERED_SLOTS "0", prefiltered );
+		pruned = prefiltered - m_prefiltered;
+		m_prefiltered = prefiltered;
+		return best == slot;
+	}
+
+	int checkCase( const PrefilterCase &c, bool optimize )
+	{
+		ClassAd *job = makeJob( c.job );
+		ClassAd *slot = makeSlot( c.slot );
+		REQUIRE( job && slot );
+		if ( optimize ) {
+			mm.OptimizeJobAdForMatchmaking( job );
+		}
+
+			// a new negotiation cycle, as far as the prefilter knows
+		mm.m_slotPrefilter.clear();
+
+		int pruned = 0;
+		bool full = match( *job, slot, false, pruned );
+		REQUIRE( pruned == 0 );
+		bool filtered = match( *job, slot, true, pruned );
+		if ( verbose ) {
+			printf( "%s%s: full %d, prefiltered %d, pruned %d\n", c.name,
+				optimize ? " (optimized)" : "", full, filtered, pruned );
+		}
+		REQUIRE( full == c.matches );
+		REQUIRE( filtered == full );
+		REQUIRE( c.prefiltered != PRUNED || pruned == 1 );
+		REQUIRE( c.prefiltered != KEPT || pruned == 0 );
+
+		delete job;
+		delete slot;
+		return 0;
+	}
+
+		// A slot ad modified during the cycle, e.g. by a claim, a split
+		// or a pslot growing, must be matched as it is now, and not as
+		// the prefilter saw it earlier in the cycle.
+	int checkInvalidate()
+	{
+		mm.m_slotPrefilter.clear();
+		int pruned = 0;
+
+			// a pslot that grows
+		ClassAd *job = makeJob( "Requirements = TARGET.Memory >= 4096" );
+		ClassAd *slot = makeSlot( "Memory = 2048; PartitionableSlot = true" );
+		REQUIRE( job && slot );
+		REQUIRE( ! match( *job, slot, true, pruned ) );
+		REQUIRE( pruned == 1 );
+		slot->Assign( ATTR_MEMORY, 8192 );
+		mm.m_slotPrefilter.invalidate( slot );
+		REQUIRE( match( *job, slot, true, pruned ) );
+		REQUIRE( match( *job, slot, false, pruned ) );
+
+			// a pslot that is split
+		ClassAd *job2 = makeJob( "Requirements = TARGET.Cpus >= 4" );
+		ClassAd *pslot = makeSlot( "Cpus = 8; PartitionableSlot = true" );
+		REQUIRE( job2 && pslot );
+		REQUIRE( match( *job2, pslot, true, pruned ) );
+		pslot->Assign( ATTR_CPUS, 2 );
+		mm.m_slotPrefilter.invalidate( pslot );
+		REQUIRE( ! match( *job2, pslot, true, pruned ) );
+		REQUIRE( ! match( *job2, pslot, false, pruned ) );
+
+			// a slot that is claimed
+		ClassAd *job3 = makeJob( "Requirements = TARGET.State == \"Claimed\"" );
+		ClassAd *claimed = makeSlot( "State = \"Unclaimed\"" );
+		REQUIRE( job3 && claimed );
+		REQUIRE( ! match( *job3, claimed, true, pruned ) );
+		REQUIRE( pruned == 1 );
+		claimed->Assign( ATTR_STATE, "Claimed" );
+		mm.m_slotPrefilter.invalidate( claimed );
+		REQUIRE( match( *job3, claimed, true, pruned ) );
+		REQUIRE( pruned == 0 );
+		REQUIRE( match( *job3, claimed, false, pruned ) );
+
+		mm.m_slotPrefilter.clear();
+		delete job;
+		delete slot;
+		delete job2;
+		delete pslot;
+		delete job3;
+		delete claimed;
+		return 0;
+	}
+
+ private:
+	Matchmaker mm;
+	int m_prefiltered = 0;
+};
+
+int
+main( int argc, char ** argv )
+{
+	for ( int i = 1; i < argc; i++ ) {
+		if ( strcmp( argv[i], "-v" ) == 0 ) {
+			verbose = true;
+		} else {
+			fprintf( stderr, "Usage: %s [-v]\n", argv[0] );
+			return 1;
+		}
+	}
+
+	ClassAdReconfig();
+
+	SlotPrefilterTest test;
+	for ( size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++ ) {
+		if ( test.checkCase( cases[i], false ) != 0 || test.checkCase( cases[i], true ) != 0 ) {
+			fprintf( stderr, "Failed case '%s'.\n", cases[i].name );
+			return 1;
+		}
+	}
+	if ( test.checkInvalidate() != 0 ) {
+		return 1;
+	}
+
+	fprintf( stdout, "No failures detected.\n" );
+	return 0;
+}
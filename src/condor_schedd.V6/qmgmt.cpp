@@ -56,6 +56,7 @@
 #include "iso_dates.h"
 #include "jobsets.h"
 #include <param_info.h>
+#include <algorithm>
 
 #if defined(HAVE_DLOPEN) || defined(WIN32)
 #include "ScheddPlugin.h"
@@ -200,6 +201,12 @@ schedd_runtime_probe WalkJobQ_get_job_prio_runtime;
 class Service;
 
 bool        PrioRecArrayIsDirty = true;
+// When only some jobs have changed since the PrioRecArray was built, these
+// are the jobs, and the array is updated by replacing just their entries.
+static bool PrioRecArrayNeedsFullRebuild = true;
+static std::set<JOB_ID_KEY> PrioRecDirtyJobs;
+// past this many changed jobs, walking the whole job queue is cheaper
+const size_t PrioRecMaxDirtyJobs = 50000;
 // spend at most this fraction of the time rebuilding the PrioRecArray
 const double PrioRecRebuildMaxTimeSlice = 0.05;
 const double PrioRecRebuildMaxTimeSliceWhenNoMatchFound = 0.1;
@@ -239,6 +246,10 @@ static void HandleFlushJobQueueLogTimer();
 static int dirty_notice_interval = 0;
 static void PeriodicDirtyAttributeNotification();
 static void ScheduleJobQueueLogFlush();
+static bool job_queue_log_group_commit = false;
+static int job_queue_log_unsynced_commits = 0;
+static int sync_job_queue_log_timer_id = -1;
+static void HandleSyncJobQueueLogTimer();
 
 bool qmgmt_all_users_trusted = false;
 static std::vector<std::string> super_users;
@@ -1272,6 +1283,7 @@ InitQmgmt()
     cluster_maximum_val = param_integer("SCHEDD_CLUSTER_MAXIMUM_VALUE",0,0);
 
 	flush_job_queue_log_delay = param_integer("SCHEDD_JOB_QUEUE_LOG_FLUSH_DELAY",5,0);
+	job_queue_log_group_commit = param_boolean("SCHEDD_JOB_QUEUE_LOG_GROUP_COMMIT", false);
 	dirty_notice_interval = param_integer("SCHEDD_JOB_QUEUE_NOTIFY_UPDATES",30,0);
 }
 
@@ -2070,6 +2082,8 @@ DestroyJobQueue( void )
 	// object deleted by the time the child cleanup is attempted.
 	schedd_forker.DeleteAll( );
 
+	SyncJobQueueLog();
+
 	if (JobQueueDirty) {
 			// We can't destroy it until it's clean.
 		CleanJobQueue();
@@ -4575,7 +4589,7 @@ SetAttribute(int cluster_id, int proc_id, const char *attr_name,
 		// give the autocluster code a chance to invalidate (or rebuild)
 		// based on the changed attribute.
 		if (scheduler.autocluster.preSetAttribute(*job, attr_name, attr_value, flags)) {
-			DirtyPrioRecArray();
+			DirtyPrioRecJob(key, true);
 			dprintf(D_FULLDEBUG,
 					"Prioritized runnable job list will be rebuilt, because "
 					"ClassAd attribute %s=%s changed\n",
@@ -4692,15 +4706,16 @@ SetAttribute(int cluster_id, int proc_id, const char *attr_name,
 	}
 	free( round_param );
 
-	if( !PrioRecArrayIsDirty ) {
+	if ((attr_category & catDirtyPrioRec) || attr_id == idATTR_JOB_STATUS) {
+		bool was_dirty = PrioRecArrayIsDirty;
 		if (attr_category & catDirtyPrioRec) {
-			DirtyPrioRecArray();
-		} else if(attr_id == idATTR_JOB_STATUS) {
-			if( atoi(attr_value) == IDLE ) {
-				DirtyPrioRecArray();
-			}
+			DirtyPrioRecJob(key, true);
+		} else {
+			// a job that becomes idle must be added to the list right away,
+			// a job that stops being idle is dropped the next time it is updated.
+			DirtyPrioRecJob(key, atoi(attr_value) == IDLE);
 		}
-		if(PrioRecArrayIsDirty) {
+		if( ! was_dirty && PrioRecArrayIsDirty) {
 			dprintf(D_FULLDEBUG,
 					"Prioritized runnable job list will be rebuilt, because "
 					"ClassAd attribute %s=%s changed\n",
@@ -5005,6 +5020,54 @@ HandleFlushJobQueueLogTimer()
 	JobQueue->FlushLog();
 }
 
+schedd_runtime_probe JobQueueLogSync_runtime;
+
+// fsync the transactions committed in group commit mode since the last sync.
+void
+SyncJobQueueLog()
+{
+	if (job_queue_log_unsynced_commits <= 0 || ! JobQueue) {
+		return;
+	}
+	{
+		condor_auto_runtime rt(JobQueueLogSync_runtime);
+		JobQueue->ForceLog();
+	}
+	scheduler.stats.JobQueueLogSyncs += 1;
+	scheduler.stats.JobQueueLogSyncedTransactions += job_queue_log_unsynced_commits;
+	job_queue_log_unsynced_commits = 0;
+}
+
+void
+HandleSyncJobQueueLogTimer()
+{
+	sync_job_queue_log_timer_id = -1;
+	SyncJobQueueLog();
+}
+
+// Commit a transaction that must be durable without waiting for the disk.
+// Only the transactions the schedd commits on its own are grouped; their
+// fsync is done as soon as it gets back to its event loop.  A commit for a
+// qmgmt client is forced right away, before the client is answered, and
+// that fsync covers any grouped transactions still waiting for one.  Code
+// that acts outside the schedd on a commit (replying to a command,
+// starting a job) must call SyncJobQueueLog() first.
+static void
+GroupCommitTransaction(const char * commit_comment)
+{
+	JobQueue->CommitNondurableTransaction(commit_comment);
+	job_queue_log_unsynced_commits++;
+
+	if (Q_SOCK) {
+		SyncJobQueueLog();
+	} else if (sync_job_queue_log_timer_id == -1) {
+		sync_job_queue_log_timer_id = daemonCore->Register_Timer(
+			0,
+			HandleSyncJobQueueLogTimer,
+			"HandleSyncJobQueueLogTimer");
+	}
+}
+
 int
 SetTimerAttribute( int cluster, int proc, const char *attr_name, int dur )
 {
@@ -5757,6 +5820,9 @@ int CommitTransactionInternal( bool durable, CondorError * errorStack ) {
 		JobQueue->CommitNondurableTransaction(commit_comment);
 		ScheduleJobQueueLogFlush();
 	}
+	else if (job_queue_log_group_commit) {
+		GroupCommitTransaction(commit_comment);
+	}
 	else {
 		JobQueue->CommitTransaction(commit_comment);
 	}
@@ -8065,6 +8131,28 @@ void DirtyPrioRecArray() {
 		// Mark the PrioRecArray as stale. This will trigger a rebuild,
 		// though possibly not immediately.
 	PrioRecArrayIsDirty = true;
+	PrioRecArrayNeedsFullRebuild = true;
+	PrioRecDirtyJobs.clear();
+}
+
+void DirtyPrioRecJob(const JOB_ID_KEY & jid, bool now) {
+		// Mark the PrioRecArray entry of a single job as stale. When
+		// now is false, the entry is updated the next time the array is,
+		// but that does not by itself trigger an update.
+	if (jid.proc < 0) {
+			// a change to a cluster ad can affect all of its jobs.
+		DirtyPrioRecArray();
+		return;
+	}
+	if (now) {
+		PrioRecArrayIsDirty = true;
+	}
+	if ( ! PrioRecArrayNeedsFullRebuild) {
+		PrioRecDirtyJobs.insert(jid);
+		if (PrioRecDirtyJobs.size() > PrioRecMaxDirtyJobs) {
+			DirtyPrioRecArray();
+		}
+	}
 }
 
 // runtime stats for count & time spent building the priorec array
@@ -8074,10 +8162,55 @@ schedd_runtime_probe BuildPrioRec_mark_runtime;
 schedd_runtime_probe BuildPrioRec_walk_runtime;
 schedd_runtime_probe BuildPrioRec_sort_runtime;
 schedd_runtime_probe BuildPrioRec_sweep_runtime;
+schedd_runtime_probe BuildPrioRec_update_runtime;
+
+static bool prio_rec_less(const prio_rec & a, const prio_rec & b) {
+	return prio_compar(const_cast<prio_rec*>(&a), const_cast<prio_rec*>(&b)) < 0;
+}
+
+// Update the PrioRec array for the jobs that changed since it was last
+// built, without walking the job queue.  Entries of the other jobs are kept
+// as they are, in order, so the entries of the changed jobs that are still
+// runnable are sorted among themselves and then merged in.
+static void DoUpdatePrioRecArray() {
+	condor_auto_runtime rt(BuildPrioRec_update_runtime);
+
+	int num_kept = 0;
+	for (int ii = 0; ii < N_PrioRecs; ++ii) {
+		if (PrioRecDirtyJobs.count(JOB_ID_KEY(PrioRec[ii].id))) {
+			continue;
+		}
+		if (num_kept != ii) {
+			PrioRec[num_kept] = PrioRec[ii];
+		}
+		++num_kept;
+	}
+	N_PrioRecs = num_kept;
+
+	for (std::set<JOB_ID_KEY>::const_iterator it = PrioRecDirtyJobs.begin(); it != PrioRecDirtyJobs.end(); ++it) {
+		JobQueueJob * job = GetJobAd(*it);
+		if (job && job->IsJob()) {
+			get_job_prio(job, *it, NULL);
+		}
+	}
+
+	if (N_PrioRecs > num_kept) {
+		std::sort(PrioRec + num_kept, PrioRec + N_PrioRecs, prio_rec_less);
+		std::inplace_merge(PrioRec, PrioRec + num_kept, PrioRec + N_PrioRecs, prio_rec_less);
+	}
+
+	dprintf(D_FULLDEBUG, "Updated %d changed jobs in prioritized runnable job list of %d jobs\n",
+			(int)PrioRecDirtyJobs.size(), N_PrioRecs);
+	PrioRecDirtyJobs.clear();
+}
 
 static void DoBuildPrioRecArray() {
 	condor_auto_runtime rt(BuildPrioRec_runtime);
 	double now = rt.begin;
+
+	PrioRecArrayNeedsFullRebuild = false;
+	PrioRecDirtyJobs.clear();
+
 	scheduler.autocluster.mark();
 	BuildPrioRec_mark_runtime += rt.tick(now);
 
@@ -8113,7 +8246,7 @@ static void DoBuildPrioRecArray() {
 void BuildPrioRecArrayPeriodic()
 {
 	if ( time(NULL) >= PrioRecArrayTimeslice.getStartTime().tv_sec + PrioRecRebuildMaxInterval ) {
-		PrioRecArrayIsDirty = true;
+		DirtyPrioRecArray();
 		BuildPrioRecArray(false);
 	}
 }
@@ -8154,6 +8287,15 @@ bool BuildPrioRecArray(bool no_match_found /*default false*/) {
 				&BuildPrioRecArrayPeriodic, "BuildPrioRecArrayPeriodic");
 	}
 
+		// if only some jobs have changed, updating their entries is cheap
+		// enough to do every time, so there is no need to wait for the
+		// timeslice.
+	if ( ! PrioRecArrayNeedsFullRebuild) {
+		PrioRecArrayIsDirty = false;
+		DoUpdatePrioRecArray();
+		return true;
+	}
+
 		// run without any delay the first time
 	PrioRecArrayTimeslice.setInitialInterval( 0 );
 
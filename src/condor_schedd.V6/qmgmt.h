@@ -333,6 +333,9 @@ int QmgmtHandleSendMaterializeData(int cluster_id, ReliSock * sock, std::string
 void SetMaxHistoricalLogs(int max_historical_logs);
 time_t GetOriginalJobQueueBirthdate();
 void DestroyJobQueue( void );
+// With SCHEDD_JOB_QUEUE_LOG_GROUP_COMMIT, fsync the job queue log now.
+// Call before telling a client outside of qmgmt that a commit succeeded.
+void SyncJobQueueLog();
 int handle_q(int, Stream *sock);
 void dirtyJobQueue( void );
 bool SendDirtyJobAdNotification(const PROC_ID& job_id);
@@ -352,6 +355,8 @@ bool UserCheck2( ClassAd *ad, const char *test_owner, char const *job_owner=NULL
 
 bool BuildPrioRecArray(bool no_match_found=false);
 void DirtyPrioRecArray();
+// mark the entry of one job as stale, now=false defers the update until the array is next updated
+void DirtyPrioRecJob(const JOB_ID_KEY & jid, bool now);
 extern ClassAd *dollarDollarExpand(int cid, int pid, ClassAd *job, ClassAd *res, bool persist_expansions);
 bool rewriteSpooledJobAd(ClassAd *job_ad, int cluster, int proc, bool modify_ad);
 
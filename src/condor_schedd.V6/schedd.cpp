@@ -6391,6 +6391,9 @@ Scheduler::actOnJobs(int, Stream* s)
 	time_t before = time(NULL);
 	if( needs_transaction ) {
 		CommitTransactionOrDieTrying();
+			// with group commit, the tool is not waiting on a qmgmt
+			// connection, so make sure it's on disk before we say so
+		SyncJobQueueLog();
 	}
 	time_t after = time(NULL);
 	if ( (after - before) > 5 ) {
@@ -11028,6 +11031,9 @@ Scheduler::add_shadow_rec( shadow_rec* new_rec )
 	GetAttributeInt( cluster, proc, ATTR_JOB_UNIVERSE, &new_rec->universe );
 	add_shadow_birthdate( cluster, proc, new_rec->is_reconnect );
 	CommitTransactionOrDieTrying();
+		// with group commit, the job is about to be started or
+		// reconnected, so don't let it run ahead of the log on disk
+	SyncJobQueueLog();
 	if( new_rec->pid ) {
 		dprintf( D_FULLDEBUG, "Added shadow record for PID %d, job (%d.%d)\n",
 				 new_rec->pid, cluster, proc );
@@ -14518,6 +14524,10 @@ Scheduler::unlinkMrec(match_rec* match)
 	jobId.cluster = match->cluster;
 	jobId.proc = match->proc;
 	matchesByJobID->remove(jobId);
+	if (jobId.proc >= 0) {
+			// the job may be runnable again
+		DirtyPrioRecJob(jobId, true);
+	}
 
 		// fill any authorization hole we made for this match
 	if (match->auth_hole_id != NULL) {
@@ -14584,6 +14594,10 @@ Scheduler::SetMrecJobID(match_rec *match, PROC_ID job_id) {
 	}
 
 	matchesByJobID->remove(old_job_id);
+	if (old_job_id.proc >= 0) {
+			// the job may be runnable again
+		DirtyPrioRecJob(old_job_id, true);
+	}
 
 	match->cluster = job_id.cluster;
 	match->proc = job_id.proc;
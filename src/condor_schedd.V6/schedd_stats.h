@@ -106,6 +106,10 @@ typedef struct ScheddStatistics : public ScheddJobCounters {
    stats_entry_recent<int> Autoclusters;   // number of active autoclusters
    stats_entry_recent<int> ResourceRequestsSent;   // number of resource requests
 
+   // job queue log group commit (SCHEDD_JOB_QUEUE_LOG_GROUP_COMMIT)
+   stats_entry_recent<int> JobQueueLogSyncs;               // number of fsyncs of the job queue log
+   stats_entry_recent<int> JobQueueLogSyncedTransactions;  // number of transactions made durable by those fsyncs
+
    // These track how successful the schedd was at reconnecting to
    // running jobs after the last restart.
    // How many reconnect attempts failed.
@@ -1048,6 +1048,30 @@ int PrettyPrinter::ppSetNegotiatorNormalCols (int)
 	return 12;
 }
 
+// The histograms count the calls to matchmakingAlgorithm and the claims sent
+// that took less than .1ms, 1ms, 10ms, .1s, 1s, 10s, 100s and longer.
+const char * const negotiatorTiming_PrintFormat = "SELECT\n"
+	"Name           AS Name         WIDTH AUTO\n"
+	"LastNegotiationCycleEnd0  AS LastCycleEnd WIDTH 12 PRINTAS DATE\n"
+	"LastNegotiationCycleDuration0 AS (Sec) PRINTF %5d\n"
+	"LastNegotiationCyclePhase1Duration0 AS Fetch PRINTF %5d\n"
+	"LastNegotiationCyclePrefetchDuration0 AS Prefetch PRINTF %8d\n"
+	"LastNegotiationCyclePhase4Duration0 AS Negotiate PRINTF %9d\n"
+	"LastNegotiationCycleMatchmakingHistogram0 AS 'Matchmaking Times' PRINTF %s OR -\n"
+	"LastNegotiationCycleClaimHistogram0 AS 'Claim Times' PRINTF %s OR -\n"
+"SUMMARY NONE\n";
+
+int PrettyPrinter::ppSetNegotiatorTimingCols (int)
+{
+	const char * tag = "NegotiatorTiming";
+	const char * fmt = negotiatorTiming_PrintFormat;
+	const char * constr = NULL;
+	if (set_status_print_mask_from_stream(fmt, false, &constr) < 0) {
+		fprintf(stderr, "Internal error: default %s print-format is invalid !\n", tag);
+	}
+	return 12;
+}
+
 // Annex names are limited to 27 characters by the width of the client token
 // that we embed them in.  With the new tag-on-creation, this may no longer
 // be necessary, but it's convenient.
@@ -1326,6 +1350,12 @@ void PrettyPrinter::ppInitPrintMask(ppOption pps, classad::References & proj, co
 		width_of_fixed_cols = 12+4+8+7+8+7;
 		break;
 
+		case PP_NEGOTIATOR_TIMING:
+		name_width = ppSetNegotiatorTimingCols(display_width);
+		name_flags = FormatOptionAutoWidth;
+		width_of_fixed_cols = 12+5+5+8+9;
+		break;
+
 		case PP_SUBMITTER_NORMAL:
 		name_width = ppSetSubmitterNormalCols(display_width, machine_width);
 		machine_flags = name_flags = FormatOptionAutoWidth;
@@ -111,6 +111,7 @@ class PrettyPrinter {
 		int     ppSetDefragNormalCols( int width );
 		int ppSetAccountingNormalCols( int width );
 		int ppSetNegotiatorNormalCols( int width );
+		int ppSetNegotiatorTimingCols( int width );
 		int     ppSetScheddNormalCols( int width, int & mach_width );
 		int  ppSetSubmitterNormalCols( int width, int & mach_width );
 		void          ppSetServerCols( int width, const char * & constr );
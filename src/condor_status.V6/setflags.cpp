@@ -54,6 +54,7 @@ getPPStyleStr (ppOption pps)
 		case PP_CKPT_SRVR_NORMAL:return"Normal (CkptSrvr)";
 		case PP_COLLECTOR_NORMAL:return"Normal (Collector)";
 		case PP_NEGOTIATOR_NORMAL: return "Normal (Negotiator)";
+		case PP_NEGOTIATOR_TIMING: return "Timing (Negotiator)";
 		case PP_DEFRAG_NORMAL:  return "Normal (Defrag)";
 		case PP_ACCOUNTING_NORMAL:  return "Normal (Accounting)";
 		case PP_GRID_NORMAL:    return "Grid";
@@ -138,6 +139,7 @@ const char * getOldModeStr(int sdo_mode)
 		case SDO_CkptSvr:	return "Normal (CkptSrvr)";
 		case SDO_Collector:	return "Normal (Collector)";
 		case SDO_Negotiator:	return "Normal (Negotiator)";
+		case SDO_Negotiator_Timing:	return "Timing (Negotiator)";
 		case SDO_Grid:          return "Normal (Grid)";
 		case SDO_Storage:	return "Normal (Storage)";
 		case SDO_Generic:	return "Normal (Generic)";
@@ -202,6 +204,7 @@ static const struct _sdo_mode_info {
 	SDO(SDO_License,      LICENSE_AD, PP_LONG),				//  MODE_LICENSE_NORMAL,
 	SDO(SDO_Storage,      STORAGE_AD, PP_STORAGE_NORMAL),	//  MODE_STORAGE_NORMAL,
 	SDO(SDO_Negotiator,NEGOTIATOR_AD, PP_NEGOTIATOR_NORMAL),//  MODE_NEGOTIATOR_NORMAL,
+	SDO(SDO_Negotiator_Timing,NEGOTIATOR_AD, PP_NEGOTIATOR_TIMING),
 	SDO(SDO_Defrag,        DEFRAG_AD, PP_DEFRAG_NORMAL),	//  MODE_DEFRAG_NORMAL,
 	SDO(SDO_Accounting,ACCOUNTING_AD, PP_ACCOUNTING_NORMAL),
 	SDO(SDO_Generic,      GENERIC_AD, PP_GENERIC_NORMAL),	//  MODE_GENERIC_NORMAL,
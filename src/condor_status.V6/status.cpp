@@ -1604,6 +1604,7 @@ usage ()
 		"\t-generic\t\tDisplay attributes of 'generic' ads\n"
 		"\t-subsystem <type>\tDisplay classads of the given type\n"
 		"\t-negotiator\t\tDisplay negotiator attributes\n"
+		"\t-negotiator -timing\tDisplay negotiation cycle timing\n"
 		"\t-storage\t\tDisplay network storage resources\n"
 		"\t-any\t\t\tDisplay any resources\n"
 		"\t-state\t\t\tDisplay state of resources\n"
@@ -2051,7 +2052,16 @@ firstPass (int argc, char *argv[])
 			mainPP.setMode (SDO_Storage, i, argv[i]);
 		} else
 		if (is_dash_arg_prefix (argv[i], "negotiator", 1)) {
-			mainPP.setMode (SDO_Negotiator, i, argv[i]);
+			if (sdo_mode != SDO_Negotiator_Timing) {
+				mainPP.setMode (SDO_Negotiator, i, argv[i]);
+			}
+		} else
+		if (is_dash_arg_prefix (argv[i], "timing", 3)) {
+			if (sdo_mode == SDO_Negotiator) {
+				mainPP.resetMode (SDO_Negotiator_Timing, i, argv[i]);
+			} else {
+				mainPP.setMode (SDO_Negotiator_Timing, i, argv[i]);
+			}
 		} else
 		if (is_dash_arg_prefix (argv[i], "generic", 2)) {
 			mainPP.setMode (SDO_Generic, i, argv[i]);
@@ -397,6 +397,7 @@ check_spool_dir()
 		"spool_version",
 		"Accountant.log",
 		"Accountantnew.log",
+		"Accountantnew.log.snapshot",
 		"local_univ_execute",
 		"EventdShutdownRate.log",
 		"OfflineLog",
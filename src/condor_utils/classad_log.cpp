@@ -30,6 +30,7 @@
 #include "classad_merge.h"
 #include "condor_fsync.h"
 #include "condor_attributes.h"
+#include <vector>
 
 #if defined(HAVE_DLOPEN)
 #include "ClassAdLogPlugin.h"
@@ -64,6 +65,395 @@ const ConstructClassAdLogTableEntry<ClassAd*> DefaultMakeClassAdLogTableEntry;
 #endif
 
 
+// A binary snapshot of the state at the head of a log can be kept next to
+// the log in <log>.snapshot, so that at startup the state is loaded without
+// parsing it back from text.  The snapshot is written when the log is
+// truncated, from the same records that are written to the log, and holds
+// the length and checksum of the text it matches.  It is used only while
+// the log still begins with exactly that text; the records after it are
+// read from the log as usual, and the log alone is always a complete copy
+// of the state, for the readers of the log that know nothing of snapshots.
+//
+// The snapshot is a header followed by chunks of whole ads, each chunk
+// prefixed by its length, its number of ads and a checksum, so a chunk can
+// be verified and decoded without looking at any other chunk.  A chunk
+// holding no ads ends the snapshot, its payload is the total number of ads.
+// Strings are stored as a length followed by the characters and a null.
+// Numbers are stored in the byte order of the machine that wrote them.
+
+#define CLASSAD_LOG_SNAPSHOT_MAGIC "CALSNAP1"
+static const uint32_t CLASSAD_LOG_SNAPSHOT_VERSION = 1;
+static const uint32_t CLASSAD_LOG_SNAPSHOT_BYTE_ORDER = 0x01020304;
+static const size_t CLASSAD_LOG_SNAPSHOT_HEADER_SIZE = 8 + 4 + 4 + 8*6;
+static const size_t CLASSAD_LOG_SNAPSHOT_CHUNK_SIZE = 1024*1024;
+static const uint64_t CLASSAD_LOG_CHECKSUM_SEED = 0xcbf29ce484222325ULL;
+
+// A fast checksum for detecting a damaged or mismatched snapshot.
+// It consumes 8 bytes at a time, so data that is checksummed in pieces
+// must be split at multiples of 8 bytes to get the same result.
+static uint64_t ClassAdLogChecksum(uint64_t sum, const char * data, size_t len)
+{
+	const uint64_t mult = 0x9e3779b97f4a7c15ULL;
+	while (len >= 8) {
+		uint64_t word;
+		memcpy(&word, data, sizeof(word));
+		sum = (sum ^ word) * mult;
+		sum ^= sum >> 29;
+		data += 8; len -= 8;
+	}
+	while (len > 0) {
+		sum = (sum ^ (unsigned char)*data) * mult;
+		sum ^= sum >> 29;
+		++data; --len;
+	}
+	return sum;
+}
+
+// checksum the first len bytes of the file, leaving the file positioned after them.
+static bool ChecksumClassAdLogPrefix(FILE * fp, long long len, uint64_t & sum)
+{
+	sum = CLASSAD_LOG_CHECKSUM_SEED;
+	if (fseek(fp, 0, SEEK_SET) != 0) {
+		return false;
+	}
+	std::vector<char> buf(CLASSAD_LOG_SNAPSHOT_CHUNK_SIZE);
+	while (len > 0) {
+		size_t cb = (len < (long long)buf.size()) ? (size_t)len : buf.size();
+		if (fread(&buf[0], 1, cb, fp) != cb) {
+			return false;
+		}
+		sum = ClassAdLogChecksum(sum, &buf[0], cb);
+		len -= cb;
+	}
+	return true;
+}
+
+static void snapshot_put32(std::string & buf, uint32_t val) { buf.append((const char *)&val, sizeof(val)); }
+static void snapshot_put64(std::string & buf, uint64_t val) { buf.append((const char *)&val, sizeof(val)); }
+static void snapshot_put_str(std::string & buf, const char * str)
+{
+	size_t len = strlen(str);
+	snapshot_put32(buf, (uint32_t)len);
+	buf.append(str, len + 1);
+}
+
+// Reads the fields of a snapshot from a buffer, failing rather than reading past the end of it.
+class ClassAdLogSnapshotReader {
+public:
+	ClassAdLogSnapshotReader(const char * data, size_t len) : ptr(data), end(data + len) {}
+	bool get32(uint32_t & val) { return get(&val, sizeof(val)); }
+	bool get64(uint64_t & val) { return get(&val, sizeof(val)); }
+	bool get_str(const char *& str) {
+		uint32_t len;
+		if ( ! get32(len) || (size_t)(end - ptr) <= len || ptr[len] != 0) return false;
+		str = ptr;
+		ptr += len + 1;
+		return true;
+	}
+	bool at_end() const { return ptr == end; }
+private:
+	bool get(void * val, size_t cb) {
+		if ((size_t)(end - ptr) < cb) return false;
+		memcpy(val, ptr, cb);
+		ptr += cb;
+		return true;
+	}
+	const char * ptr;
+	const char * end;
+};
+
+class ClassAdLogSnapshotWriter {
+public:
+	ClassAdLogSnapshotWriter(FILE * _fp) : fp(_fp), num_ads(0), num_records(0), chunk_ads(0), attr_count_pos(0), attr_count(0), failed(false) {}
+
+	// called by WriteClassAdLogState for each record it writes
+	void AddSequenceNumber() { ++num_records; }
+	void AddClassAd(const char * key, const char * mytype, const char * targettype) {
+		snapshot_put_str(chunk, key);
+		snapshot_put_str(chunk, mytype ? mytype : "");
+		snapshot_put_str(chunk, targettype ? targettype : "");
+		attr_count_pos = chunk.size();
+		attr_count = 0;
+		snapshot_put32(chunk, 0);
+		++num_records;
+	}
+	void AddAttribute(const char * name, const char * value) {
+		snapshot_put_str(chunk, name);
+		snapshot_put_str(chunk, value);
+		++attr_count;
+		++num_records;
+	}
+	void EndClassAd() {
+		memcpy(&chunk[attr_count_pos], &attr_count, sizeof(attr_count));
+		++chunk_ads;
+		++num_ads;
+		if (chunk.size() >= CLASSAD_LOG_SNAPSHOT_CHUNK_SIZE) {
+			WriteChunk();
+		}
+	}
+
+	// reserve room for the header, which is written last.
+	bool Begin() {
+		std::string header(CLASSAD_LOG_SNAPSHOT_HEADER_SIZE, '\0');
+		return fwrite(header.data(), 1, header.size(), fp) == header.size();
+	}
+
+	// write the last chunk, the end of the snapshot and the header, and force it all to disk.
+	// state_end and state_sum are the length and checksum of the state as written to the log.
+	bool Finish(unsigned long sequence_number, time_t birthdate, long long state_end, uint64_t state_sum) {
+		if (chunk_ads) { WriteChunk(); }
+		snapshot_put64(chunk, num_ads);
+		WriteChunk();
+
+		std::string header(CLASSAD_LOG_SNAPSHOT_MAGIC);
+		snapshot_put32(header, CLASSAD_LOG_SNAPSHOT_VERSION);
+		snapshot_put32(header, CLASSAD_LOG_SNAPSHOT_BYTE_ORDER);
+		snapshot_put64(header, sequence_number);
+		snapshot_put64(header, (uint64_t)birthdate);
+		snapshot_put64(header, (uint64_t)state_end);
+		snapshot_put64(header, state_sum);
+		snapshot_put64(header, num_records);
+		snapshot_put64(header, ClassAdLogChecksum(CLASSAD_LOG_CHECKSUM_SEED, header.data(), header.size()));
+		ASSERT(header.size() == CLASSAD_LOG_SNAPSHOT_HEADER_SIZE);
+
+		if (failed || fseek(fp, 0, SEEK_SET) != 0 ||
+			fwrite(header.data(), 1, header.size(), fp) != header.size()) {
+			return false;
+		}
+		return FlushClassAdLog(fp, true) == 0;
+	}
+
+private:
+	void WriteChunk() {
+		std::string prefix;
+		snapshot_put32(prefix, (uint32_t)chunk.size());
+		snapshot_put32(prefix, chunk_ads);
+		snapshot_put64(prefix, ClassAdLogChecksum(CLASSAD_LOG_CHECKSUM_SEED, chunk.data(), chunk.size()));
+		if (fwrite(prefix.data(), 1, prefix.size(), fp) != prefix.size() ||
+			fwrite(chunk.data(), 1, chunk.size(), fp) != chunk.size()) {
+			failed = true;
+		}
+		chunk.clear();
+		chunk_ads = 0;
+	}
+
+	FILE * fp;
+	std::string chunk;
+	uint64_t num_ads;
+	uint64_t num_records;
+	uint32_t chunk_ads;
+	size_t attr_count_pos;
+	uint32_t attr_count;
+	bool failed;
+};
+
+static bool UseClassAdLogSnapshot()
+{
+	return param_boolean("CLASSAD_LOG_BINARY_SNAPSHOT", false);
+}
+
+// What LoadClassAdLogSnapshotChunk does with the ads in a chunk.
+enum ClassAdLogSnapshotPass {
+	SNAPSHOT_CHECK,   // only check that the chunk decodes
+	SNAPSHOT_INSERT,  // put the ads into the table
+	SNAPSHOT_NOTIFY,  // tell the ClassAdLog plugins about the ads in the table
+};
+
+// Go through the ads in one chunk of a snapshot, returns false if the chunk
+// is malformed or an ad cannot be inserted.  Inserting does not tell the
+// plugins, so that a snapshot that fails part way through can be backed out
+// without them ever seeing its ads.
+static bool LoadClassAdLogSnapshotChunk(
+	const char * data,
+	size_t len,
+	uint32_t num_ads,
+	ClassAdLogSnapshotPass pass,
+	LoggableClassAdTable & la,
+	const ConstructLogEntry& maker)
+{
+	ClassAdLogSnapshotReader rd(data, len);
+	for (uint32_t ix = 0; ix < num_ads; ++ix) {
+		const char *key, *mytype, *targettype;
+		uint32_t num_attrs;
+		if ( ! rd.get_str(key) || ! rd.get_str(mytype) || ! rd.get_str(targettype) || ! rd.get32(num_attrs)) {
+			return false;
+		}
+		ClassAd * ad = NULL;
+		if (pass == SNAPSHOT_INSERT) {
+				// as LogNewClassAd::Play does
+			ad = maker.New(key, mytype);
+			SetMyTypeName(*ad, mytype);
+			SetTargetTypeName(*ad, targettype);
+			ad->EnableDirtyTracking();
+			if ( ! la.insert(key, ad)) {
+				maker.Delete(ad);
+				return false;
+			}
+		}
+#if defined(HAVE_DLOPEN)
+		if (pass == SNAPSHOT_NOTIFY) {
+			ClassAdLogPluginManager::NewClassAd(key);
+		}
+#endif
+		for (uint32_t jx = 0; jx < num_attrs; ++jx) {
+			const char *name, *value;
+			if ( ! rd.get_str(name) || ! rd.get_str(value)) {
+				return false;
+			}
+			if (pass == SNAPSHOT_INSERT) {
+					// These values passed the parser when the snapshot was written,
+					// so they are inserted the same way LogSetAttribute::Play does.
+				std::string attr(name);
+				if ( ! InsertSimpleLiteral(*ad, attr, value, strlen(value) + 1)) {
+					ad->InsertViaCache(attr, value, true);
+				}
+				ad->MarkAttributeClean(name);
+			}
+#if defined(HAVE_DLOPEN)
+			if (pass == SNAPSHOT_NOTIFY) {
+				ClassAdLogPluginManager::SetAttribute(key, name, value);
+			}
+#endif
+		}
+	}
+	return rd.at_end();
+}
+
+// Remove every ad from the table, used to back out a snapshot that could not
+// be inserted in full.  The plugins were not told about the ads, so they are
+// not told about removing them either.
+static void ClearClassAdLogTable(LoggableClassAdTable & la, const ConstructLogEntry& maker)
+{
+	std::vector<std::string> keys;
+	const char * key;
+	ClassAd * ad;
+	la.startIterations();
+	while (la.nextIteration(key, ad)) {
+		keys.push_back(key);
+	}
+	for (size_t ix = 0; ix < keys.size(); ++ix) {
+		if (la.lookup(keys[ix].c_str(), ad)) {
+			maker.Delete(ad);
+			la.remove(keys[ix].c_str());
+		}
+	}
+}
+
+// Load the state from the snapshot of the given log if there is one that
+// matches the head of the log.  Returns the offset in the log of the first
+// record that is not in the snapshot, or 0 if the snapshot was not used,
+// in which case the table is left empty.
+static long long LoadClassAdLogSnapshot(
+	const char * filename,
+	FILE * log_fp,
+	LoggableClassAdTable & la,
+	const ConstructLogEntry& maker,
+	unsigned long & historical_sequence_number,
+	time_t & m_original_log_birthdate,
+	unsigned long & num_records,
+	MyString & errmsg)
+{
+	MyString snapshot_filename;
+	snapshot_filename.formatstr("%s.snapshot", filename);
+	int snap_fd = safe_open_wrapper_follow(snapshot_filename.c_str(), O_RDONLY | O_LARGEFILE | _O_NOINHERIT, 0600);
+	if (snap_fd < 0) {
+		return 0;
+	}
+	FILE * snap_fp = fdopen(snap_fd, "r");
+	if ( ! snap_fp) {
+		close(snap_fd);
+		return 0;
+	}
+
+	char header[CLASSAD_LOG_SNAPSHOT_HEADER_SIZE];
+	uint32_t version = 0, byte_order = 0;
+	uint64_t sequence_number = 0, birthdate = 0, state_end = 0, state_sum = 0, records = 0, header_sum = 0;
+	ClassAdLogSnapshotReader hdr(header + 8, sizeof(header) - 8);
+	if (fread(header, 1, sizeof(header), snap_fp) != sizeof(header) ||
+		memcmp(header, CLASSAD_LOG_SNAPSHOT_MAGIC, 8) != 0 ||
+		! hdr.get32(version) || ! hdr.get32(byte_order) ||
+		version != CLASSAD_LOG_SNAPSHOT_VERSION || byte_order != CLASSAD_LOG_SNAPSHOT_BYTE_ORDER ||
+		! hdr.get64(sequence_number) || ! hdr.get64(birthdate) || ! hdr.get64(state_end) ||
+		! hdr.get64(state_sum) || ! hdr.get64(records) || ! hdr.get64(header_sum) ||
+		header_sum != ClassAdLogChecksum(CLASSAD_LOG_CHECKSUM_SEED, header, sizeof(header) - 8)) {
+		errmsg.formatstr_cat("Ignoring snapshot %s, it is not a valid snapshot\n", snapshot_filename.c_str());
+		fclose(snap_fp);
+		return 0;
+	}
+
+		// the snapshot is only good for the log it was written with, check that
+		// the log still begins with the state that was written with it.
+	uint64_t log_sum = 0;
+	if ( ! ChecksumClassAdLogPrefix(log_fp, (long long)state_end, log_sum) || log_sum != state_sum) {
+		dprintf(D_FULLDEBUG, "Snapshot %s does not match %s, reading the log instead\n", snapshot_filename.c_str(), filename);
+		fclose(snap_fp);
+		fseek(log_fp, 0, SEEK_SET);
+		return 0;
+	}
+
+		// Read and check every chunk before anything goes into the table, so
+		// that a damaged snapshot leaves no trace.  This holds the whole
+		// snapshot in memory while it loads.
+	bool ok = false;
+	uint64_t num_ads = 0;
+	std::vector< std::vector<char> > chunks;
+	std::vector<uint32_t> chunk_counts;
+	for (;;) {
+		char prefix[16];
+		uint32_t chunk_len = 0, chunk_ads = 0;
+		uint64_t chunk_sum = 0;
+		ClassAdLogSnapshotReader pre(prefix, sizeof(prefix));
+		if (fread(prefix, 1, sizeof(prefix), snap_fp) != sizeof(prefix) ||
+			! pre.get32(chunk_len) || ! pre.get32(chunk_ads) || ! pre.get64(chunk_sum)) {
+			break;
+		}
+		std::vector<char> chunk(chunk_len + 1);
+		if (fread(&chunk[0], 1, chunk_len, snap_fp) != chunk_len ||
+			chunk_sum != ClassAdLogChecksum(CLASSAD_LOG_CHECKSUM_SEED, &chunk[0], chunk_len)) {
+			break;
+		}
+		if ( ! chunk_ads) {
+			uint64_t total_ads = 0;
+			ClassAdLogSnapshotReader rd(&chunk[0], chunk_len);
+			ok = rd.get64(total_ads) && rd.at_end() && total_ads == num_ads;
+			break;
+		}
+		if ( ! LoadClassAdLogSnapshotChunk(&chunk[0], chunk_len, chunk_ads, SNAPSHOT_CHECK, la, maker)) {
+			break;
+		}
+		chunks.push_back(std::vector<char>());
+		chunks.back().swap(chunk);
+		chunk_counts.push_back(chunk_ads);
+		num_ads += chunk_ads;
+	}
+	fclose(snap_fp);
+
+	if (ok && fseek(log_fp, (long)state_end, SEEK_SET) != 0) {
+		ok = false;
+	}
+	for (size_t ix = 0; ok && ix < chunks.size(); ++ix) {
+		ok = LoadClassAdLogSnapshotChunk(&chunks[ix][0], chunks[ix].size() - 1, chunk_counts[ix], SNAPSHOT_INSERT, la, maker);
+	}
+	if ( ! ok) {
+		errmsg.formatstr_cat("Snapshot %s is damaged, reading the log instead\n", snapshot_filename.c_str());
+		ClearClassAdLogTable(la, maker);
+		fseek(log_fp, 0, SEEK_SET);
+		return 0;
+	}
+#if defined(HAVE_DLOPEN)
+	for (size_t ix = 0; ix < chunks.size(); ++ix) {
+		LoadClassAdLogSnapshotChunk(&chunks[ix][0], chunks[ix].size() - 1, chunk_counts[ix], SNAPSHOT_NOTIFY, la, maker);
+	}
+#endif
+
+	historical_sequence_number = (unsigned long)sequence_number;
+	m_original_log_birthdate = (time_t)birthdate;
+	num_records = (unsigned long)records;
+	dprintf(D_ALWAYS, "Loaded %llu ads from snapshot %s\n", (unsigned long long)num_ads, snapshot_filename.c_str());
+	return (long long)state_end;
+}
+
+
 // non-templatized worker function that implements the log loading functionality of ClassAdLog
 //
 FILE* LoadClassAdLog(
@@ -103,6 +493,13 @@ FILE* LoadClassAdLog(
 	unsigned long count = 0;
 	long long next_log_entry_pos = 0;
     long long curr_log_entry_pos = 0;
+
+	// if there is a snapshot of the state at the head of the log, load that
+	// and read only the records that follow it.
+	if (UseClassAdLogSnapshot()) {
+		next_log_entry_pos = LoadClassAdLogSnapshot(filename, log_fp, la, maker,
+			historical_sequence_number, m_original_log_birthdate, count, errmsg);
+	}
 	while ((log_rec = ReadLogEntry(log_fp, 1+count, InstantiateLogEntry, maker)) != 0) {
         curr_log_entry_pos = next_log_entry_pos;
 		next_log_entry_pos = ftell(log_fp);
@@ -287,11 +684,55 @@ bool TruncateClassAdLog(
 	// Now it is time to move courageously into the future.
 	unsigned long future_sequence_number = historical_sequence_number + 1;
 
+	// when enabled, write a binary snapshot of the state along with the new log
+	MyString snapshot_filename, tmp_snapshot_filename;
+	snapshot_filename.formatstr("%s.snapshot", filename);
+	FILE *snapshot_fp = NULL;
+	ClassAdLogSnapshotWriter *snapshot = NULL;
+	if (UseClassAdLogSnapshot()) {
+		tmp_snapshot_filename.formatstr("%s.snapshot.tmp", filename);
+		int snapshot_fd = safe_create_replace_if_exists(tmp_snapshot_filename.c_str(), O_WRONLY | O_CREAT | O_LARGEFILE | _O_NOINHERIT, 0600);
+		if (snapshot_fd >= 0) {
+			snapshot_fp = fdopen(snapshot_fd, "w");
+			if ( ! snapshot_fp) { close(snapshot_fd); }
+		}
+		if (snapshot_fp) {
+			snapshot = new ClassAdLogSnapshotWriter(snapshot_fp);
+			if ( ! snapshot->Begin()) {
+				delete snapshot;
+				snapshot = NULL;
+			}
+		}
+		if ( ! snapshot) {
+			dprintf(D_ALWAYS, "Failed to create snapshot %s, errno = %d, the log will be rotated without it\n",
+				tmp_snapshot_filename.c_str(), errno);
+		}
+	}
+
 	// flush our current state into the temp file,
 	// with a future value for sequence number
 	bool success = WriteClassAdLogState(new_log_fp, tmp_log_filename.c_str(),
 		future_sequence_number, m_original_log_birthdate,
-		la, maker, errmsg);
+		la, maker, errmsg, snapshot);
+
+	// finish the snapshot with the length and checksum of the state it goes with
+	bool snapshot_ok = false;
+	if (snapshot && success) {
+		long long state_end = ftell(new_log_fp);
+		uint64_t state_sum = 0;
+		snapshot_ok = state_end > 0 &&
+			ChecksumClassAdLogPrefix(new_log_fp, state_end, state_sum) &&
+			snapshot->Finish(future_sequence_number, m_original_log_birthdate, state_end, state_sum);
+		if ( ! snapshot_ok) {
+			dprintf(D_ALWAYS, "Failed to write snapshot %s, errno = %d, the log will be rotated without it\n",
+				tmp_snapshot_filename.c_str(), errno);
+		}
+	}
+	delete snapshot;
+	if (snapshot_fp) {
+		fclose(snapshot_fp);
+		if ( ! snapshot_ok) { unlink(tmp_snapshot_filename.c_str()); }
+	}
 
 	fclose(log_fp);
 	log_fp = NULL;
@@ -311,6 +752,7 @@ bool TruncateClassAdLog(
 		errmsg.formatstr("failed to rotate job queue log!\n");
 
 		unlink(tmp_log_filename.c_str());
+		if (snapshot_ok) { unlink(tmp_snapshot_filename.c_str()); }
 
 		int log_fd = safe_open_wrapper_follow(filename, O_RDWR | O_APPEND | O_LARGEFILE | _O_NOINHERIT, 0600);
 		if (log_fd < 0) {
@@ -329,6 +771,18 @@ bool TruncateClassAdLog(
 	// we successfully wrote and rotated, so we can update our sequence number
 	historical_sequence_number = future_sequence_number;
 
+	// The snapshot goes in after the log, so a crash in between leaves the old
+	// snapshot, which will not match the new log.  An old snapshot is removed
+	// when there is no new one, so it does not linger in the spool.
+	if (snapshot_ok) {
+		if (rotate_file(tmp_snapshot_filename.c_str(), snapshot_filename.c_str()) < 0) {
+			dprintf(D_ALWAYS, "Failed to rename snapshot %s to %s\n", tmp_snapshot_filename.c_str(), snapshot_filename.c_str());
+			unlink(tmp_snapshot_filename.c_str());
+		}
+	} else if (unlink(snapshot_filename.c_str()) < 0 && errno != ENOENT) {
+		dprintf(D_ALWAYS, "Failed to remove stale snapshot %s, errno = %d\n", snapshot_filename.c_str(), errno);
+	}
+
 #ifndef WIN32
 	// POSIX does not provide any durability guarantees for rename().  Instead, we must
 	// open the parent directory and invoke fsync there.
@@ -543,7 +997,8 @@ bool WriteClassAdLogState(
 	time_t m_original_log_birthdate, // in
 	LoggableClassAdTable & la,
 	const ConstructLogEntry& maker,
-	MyString & errmsg)
+	MyString & errmsg,
+	ClassAdLogSnapshotWriter * snapshot)
 {
 	LogRecord	*log=NULL;
 	ExprTree	*expr=NULL;
@@ -556,6 +1011,7 @@ bool WriteClassAdLogState(
 		return false;
 	}
 	delete log;
+	if (snapshot) { snapshot->AddSequenceNumber(); }
 
 	const char * key;
 	ClassAd * ad;
@@ -568,6 +1024,10 @@ bool WriteClassAdLogState(
 			delete log;
 			return false;
 		}
+		if (snapshot) {
+			LogNewClassAd * new_ad = (LogNewClassAd *)log;
+			snapshot->AddClassAd(key, new_ad->get_mytype(), new_ad->get_targettype());
+		}
 		delete log;
 
 			// Unchain the ad -- we just want to write out this ads exprs,
@@ -587,9 +1047,14 @@ bool WriteClassAdLogState(
 					delete log;
 					return false;
 				}
+				if (snapshot) {
+					LogSetAttribute * set_attr = (LogSetAttribute *)log;
+					snapshot->AddAttribute(set_attr->get_name(), set_attr->get_value());
+				}
 				delete log;
 			}
 		}
+		if (snapshot) { snapshot->EndClassAd(); }
 			// ok, now that we're done writing out this ad, restore the chain
 		ad->ChainToAd(chain);
 	}
@@ -825,8 +1290,13 @@ LogSetAttribute::Play(void *data_structure)
 	if ( ! table->lookup(key, ad))
 		return -1;
 
+		// Most job attributes are simple literals, which are stored
+		// as they are.  Other values passed the parser when this record
+		// was read, so they can be parsed lazily, when first used, as
+		// the collector does for the ads it receives.
 	std::string attr(name);
-	if (ad->InsertViaCache(attr, value)) {
+	if (InsertSimpleLiteral(*ad, attr, value, strlen(value) + 1) ||
+		ad->InsertViaCache(attr, value, value_expr != NULL)) {
 		rval = TRUE;
 	} else {
 		rval = FALSE;
@@ -442,6 +442,9 @@ bool TruncateClassAdLog(
 	time_t & m_original_log_birthdate, // in,out
 	MyString & errmsg);             // out
 
+// writes the binary snapshot of the log state (see classad_log.cpp)
+class ClassAdLogSnapshotWriter;
+
 bool WriteClassAdLogState(
 	FILE *fp,                       // in
 	const char * filename,          // in: used for error messages
@@ -449,7 +452,8 @@ bool WriteClassAdLogState(
 	time_t original_log_birthdate,  // in
 	LoggableClassAdTable & la,      // in
 	const ConstructLogEntry& maker, // in
-	MyString & errmsg);             // out
+	MyString & errmsg,              // out
+	ClassAdLogSnapshotWriter * snapshot = NULL); // in: if not NULL, the state is also written here
 
 FILE* LoadClassAdLog(
 	const char *filename,           // in
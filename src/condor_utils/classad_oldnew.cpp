@@ -222,6 +222,38 @@ static long long myatoll(const char *s, const char* &end) {
 }
 
 
+int InsertSimpleLiteral(classad::ClassAd &ad, const std::string &attr, const char *rhs, size_t cbrhs)
+{
+	const size_t always_cache_string_size = 128; // no fast parse for strings > this size.
+
+	char ch = rhs[0];
+	if (cbrhs == 5 && (ch&~0x20) == 'T' && (rhs[1]&~0x20) == 'R' && (rhs[2]&~0x20) == 'U' && (rhs[3]&~0x20) == 'E') {
+		return ad.InsertLiteral(attr, classad::Literal::MakeBool(true)) ? 1 : 0;
+	} else if (cbrhs == 6 && (ch&~0x20) == 'F' && (rhs[1]&~0x20) == 'A' && (rhs[2]&~0x20) == 'L' && (rhs[3]&~0x20) == 'S' && (rhs[4]&~0x20) == 'E') {
+		return ad.InsertLiteral(attr, classad::Literal::MakeBool(false)) ? 1 : 0;
+	} else if (cbrhs < 30 && (ch == '-' || (ch >= '0' && ch <= '9'))) {
+		if (strchr(rhs, '.')) {
+			char *pe = NULL;
+			double d = strtod(rhs, &pe);
+			if (*pe == 0 || *pe == '\r' || *pe == '\n') {
+				return ad.InsertLiteral(attr, classad::Literal::MakeReal(d)) ? 2 : 0;
+			}
+		} else {
+			const char * pe = NULL;
+			long long ll = myatoll(rhs, pe);
+			if (*pe == 0 || *pe == '\r' || *pe == '\n') {
+				return ad.InsertLiteral(attr, classad::Literal::MakeLong(ll)) ? 2 : 0;
+			}
+		}
+	} else if (cbrhs < always_cache_string_size && ch == '"') { // 128 because we want long strings in the cache.
+		size_t cch = IsSimpleString(rhs);
+		if (cch) {
+			return ad.InsertLiteral(attr, classad::Literal::MakeString(rhs+1, cch-2)) ? 3 : 0;
+		}
+	}
+	return 0;
+}
+
 bool getClassAdEx( Stream *sock, classad::ClassAd& ad, int options)
 {
 	int cb;
@@ -230,7 +262,6 @@ bool getClassAdEx( Stream *sock, classad::ClassAd& ad, int options)
 	bool use_cache = (options & GET_CLASSAD_NO_CACHE) == 0;
 	bool cache_lazy = (options & GET_CLASSAD_LAZY_PARSE) != 0;
 	bool fast_tricks = (options & GET_CLASSAD_FAST) != 0;
-	const size_t always_cache_string_size = 128; // no fast parse for strings > this size.
 
 #ifdef PROFILE_GETCLASSAD
 	_condor_auto_accum_runtime< stats_entry_probe<double> > rt(getClassAdEx_runtime);
@@ -300,36 +331,9 @@ bool getClassAdEx( Stream *sock, classad::ClassAd& ad, int options)
 		IF_PROFILE_GETCLASSAD(int subtype = 0);
 		size_t cbrhs = cb - (rhs - strptr);
 		if (fast_tricks) {
-			char ch = rhs[0];
-			if (cbrhs == 5 && (ch&~0x20) == 'T' && (rhs[1]&~0x20) == 'R' && (rhs[2]&~0x20) == 'U' && (rhs[3]&~0x20) == 'E') {
-				inserted = ad.InsertLiteral(attr, classad::Literal::MakeBool(true));
-				IF_PROFILE_GETCLASSAD(subtype = 1);
-			} else if (cbrhs == 6 && (ch&~0x20) == 'F' && (rhs[1]&~0x20) == 'A' && (rhs[2]&~0x20) == 'L' && (rhs[3]&~0x20) == 'S' && (rhs[4]&~0x20) == 'E') {
-				inserted = ad.InsertLiteral(attr, classad::Literal::MakeBool(false));
-				IF_PROFILE_GETCLASSAD(subtype = 1);
-			} else if (cbrhs < 30 && (ch == '-' || (ch >= '0' && ch <= '9'))) {
-				if (strchr(rhs, '.')) {
-					char *pe = NULL;
-					double d = strtod(rhs, &pe);
-					if (*pe == 0 || *pe == '\r' || *pe == '\n') {
-						inserted = ad.InsertLiteral(attr, classad::Literal::MakeReal(d));
-						IF_PROFILE_GETCLASSAD(subtype = 2);
-					}
-				} else {
-					const char * pe = NULL;
-					long long ll = myatoll(rhs, pe);
-					if (*pe == 0 || *pe == '\r' || *pe == '\n') {
-						inserted = ad.InsertLiteral(attr, classad::Literal::MakeLong(ll));
-						IF_PROFILE_GETCLASSAD(subtype = 2);
-					}
-				}
-			} else if (cbrhs < always_cache_string_size && ch == '"') { // 128 because we want long strings in the cache.
-				size_t cch = IsSimpleString(rhs);
-				if (cch) {
-					inserted = ad.InsertLiteral(attr, classad::Literal::MakeString(rhs+1, cch-2));
-					IF_PROFILE_GETCLASSAD(subtype = 3);
-				}
-			}
+			int literal_type = InsertSimpleLiteral(ad, attr, rhs, cbrhs);
+			inserted = literal_type != 0;
+			IF_PROFILE_GETCLASSAD(subtype = literal_type);
 		}
 
 		if (inserted) {
@@ -637,6 +641,7 @@ int _putClassAd( Stream *sock, const classad::ClassAd& ad, int options,
 	bool send_server_time = false;
 
 	unp.SetOldClassAd( true, true );
+	unp.SetUnparseCachedText( true );
 
 	int numExprs=0;
 
@@ -755,6 +760,7 @@ int _putClassAd( Stream *sock, const classad::ClassAd& ad, int options, const cl
 
 	classad::ClassAdUnParser unp;
 	unp.SetOldClassAd( true, true );
+	unp.SetUnparseCachedText( true );
 
 	classad::References blacklist;
 	for (classad::References::const_iterator attr = whitelist.begin(); attr != whitelist.end(); ++attr) {
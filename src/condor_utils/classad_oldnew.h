@@ -43,6 +43,13 @@ bool getClassAdEx( Stream *sock, classad::ClassAd& ad, int options);
 #define GET_CLASSAD_FAST                0x10 // use tricks to quickly parse the ad.
 #define GET_CLASSAD_LAZY_PARSE          0x20 // parse only when evaluating the first time. (ignored if GET_CLASSAD_NO_CACHE is set)
 
+// If rhs is a simple literal (a boolean, a number, or a short string with
+// no escapes), insert it into the ad as a literal node, which is faster than
+// parsing it and uses less memory than the classad cache. cbrhs is the size
+// of rhs including the terminating null.  Returns 0 if nothing was inserted,
+// otherwise 1 for a boolean, 2 for a number and 3 for a string.
+int InsertSimpleLiteral(classad::ClassAd &ad, const std::string &attr, const char *rhs, size_t cbrhs);
+
 class StatisticsPool;
 void getClassAdEx_addProfileStatsToPool(StatisticsPool * pool, int publevel);
 void getClassAdEx_clearProfileStats();
@@ -75,6 +75,7 @@ void ClassAdReconfig()
 	classad::SetOldClassAdSemantics( !ClassAd_strictEvaluation );
 
 	classad::ClassAdSetExpressionCaching( param_boolean( "ENABLE_CLASSAD_CACHING", false ) );
+	classad::ClassAdSetRegexCacheSize( param_integer( "CLASSAD_REGEX_CACHE_SIZE", 100, 0 ) );
 
 	char *new_libs = param( "CLASSAD_USER_LIBS" );
 	if ( new_libs ) {
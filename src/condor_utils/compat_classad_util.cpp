@@ -22,6 +22,7 @@
 #include "classad_oldnew.h"
 #include "string_list.h"
 #include "condor_adtypes.h"
+#include "condor_attributes.h"
 #include "classad/classadCache.h" // for CachedExprEnvelope
 
 #include "compat_classad_list.h"
@@ -808,14 +809,11 @@ bool IsAMatch( ClassAd *ad1, ClassAd *ad2 )
 static classad::MatchClassAd *match_pool = NULL;
 static ClassAd *target_pool = NULL;
 static std::vector<ClassAd*> *matched_ads = NULL;
+static int cpu_count = 0;
 
-bool ParallelIsAMatch(ClassAd *ad1, std::vector<ClassAd*> &candidates, std::vector<ClassAd*> &matches, int threads, bool halfMatch)
+static void setup_match_pools(int threads)
 {
-	int adCount = candidates.size();
-	static int cpu_count = 0;
 	int current_cpu_count = threads;
-	int iterations = 0;
-	size_t matched = 0;
 
 	if(cpu_count != current_cpu_count)
 	{
@@ -843,6 +841,15 @@ bool ParallelIsAMatch(ClassAd *ad1, std::vector<ClassAd*> &candidates, std::vect
 		target_pool = new ClassAd[cpu_count];
 	if(!matched_ads)
 		matched_ads = new std::vector<ClassAd*>[cpu_count];
+}
+
+bool ParallelIsAMatch(ClassAd *ad1, std::vector<ClassAd*> &candidates, std::vector<ClassAd*> &matches, int threads, bool halfMatch)
+{
+	int adCount = candidates.size();
+	int iterations = 0;
+	size_t matched = 0;
+
+	setup_match_pools(threads);
 
 	if(!candidates.size())
 		return false;
@@ -931,6 +938,90 @@ bool ParallelIsAMatch(ClassAd *ad1, std::vector<ClassAd*> &candidates, std::vect
 	return matches.size() > 0;
 }
 
+bool ParallelIsAMatch(ClassAd *ad1, std::vector<ClassAd*> &candidates, std::vector<char> &is_match, std::vector<double> *ranks, int threads)
+{
+	int adCount = candidates.size();
+	bool any_match = false;
+
+	is_match.assign(adCount, 0);
+	if(ranks)
+		ranks->assign(adCount, 0.0);
+
+	setup_match_pools(threads);
+
+	if(!adCount)
+		return false;
+
+	for(int index = 0; index < cpu_count; index++)
+	{
+		target_pool[index].CopyFrom(*ad1);
+		match_pool[index].ReplaceLeftAd(&(target_pool[index]));
+	}
+
+	// Each candidate is evaluated by exactly one thread and its result is
+	// stored at the candidate's own index, so the outcome does not depend
+	// on how the candidates were divided among the threads.
+#ifdef _OPENMP
+	omp_set_num_threads(cpu_count);
+#endif
+
+#pragma omp parallel for schedule(dynamic, 64)
+	for(int offset = 0; offset < adCount; offset++)
+	{
+#ifdef _OPENMP
+		int omp_id = omp_get_thread_num();
+#else
+		int omp_id = 0;
+#endif
+		ClassAd *ad2 = candidates[offset];
+		if ( ! ad2)
+			continue;
+		classad::MatchClassAd &mad = match_pool[omp_id];
+
+		mad.ReplaceRightAd(ad2);
+
+		if(mad.symmetricMatch())
+		{
+			is_match[offset] = 1;
+
+			// Same semantics as EvalFloat(ATTR_RANK, ad1, ad2, rank),
+			// but using this thread's private copy of ad1.
+			if(ranks)
+			{
+				double rank = 0.0;
+				ClassAd *left = &(target_pool[omp_id]);
+				if(left->Lookup(ATTR_RANK)) {
+					if(!left->EvaluateAttrNumber(ATTR_RANK, rank)) {
+						rank = 0.0;
+					}
+				} else if(ad2->Lookup(ATTR_RANK)) {
+					if(!ad2->EvaluateAttrNumber(ATTR_RANK, rank)) {
+						rank = 0.0;
+					}
+				}
+				(*ranks)[offset] = rank;
+			}
+		}
+
+		mad.RemoveRightAd();
+	}
+
+	for(int index = 0; index < cpu_count; index++)
+	{
+		match_pool[index].RemoveLeftAd();
+	}
+
+	for(int offset = 0; offset < adCount; offset++)
+	{
+		if(is_match[offset]) {
+			any_match = true;
+			break;
+		}
+	}
+
+	return any_match;
+}
+
 bool IsAHalfMatch( ClassAd *my, ClassAd *target )
 {
 		// The collector relies on this function to check the target type.
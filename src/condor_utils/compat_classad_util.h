@@ -103,6 +103,14 @@ bool IsAHalfMatch( ClassAd *my, ClassAd *target );
 
 bool ParallelIsAMatch(ClassAd *ad1, std::vector<ClassAd*> &candidates, std::vector<ClassAd*> &matches, int threads, bool halfMatch = false);
 
+// Symmetric match of ad1 against every candidate using up to the given
+// number of threads.  On return, is_match[i] is non-zero iff candidates[i]
+// matches.  If ranks is not NULL, (*ranks)[i] is set to the Rank of ad1
+// evaluated against each matching candidate (0.0 when it does not evaluate
+// to a number).  Results are in candidate order regardless of thread count.
+// NULL candidates are skipped and reported as not matching.
+bool ParallelIsAMatch(ClassAd *ad1, std::vector<ClassAd*> &candidates, std::vector<char> &is_match, std::vector<double> *ranks, int threads);
+
 void AddClassAdXMLFileHeader(std::string &buffer);
 void AddClassAdXMLFileFooter(std::string &buffer);
 
@@ -2403,7 +2403,8 @@ FileTransfer::DoDownload( filesize_t *total_bytes, ReliSock *s)
 		thisFileStats.TransferFileBytes = 0;
 		thisFileStats.TransferFileName = filename.c_str();
 		thisFileStats.TransferProtocol = "cedar";
-		thisFileStats.TransferStartTime = condor_gettimestamp_double();
+		double thisFileStartTime = condor_gettimestamp_double();
+		thisFileStats.TransferStartTime = thisFileStartTime;
 		thisFileStats.TransferType = "download";
 
 		// Create a ClassAd we'll use to store stats from a file transfer
@@ -2874,8 +2875,11 @@ FileTransfer::DoDownload( filesize_t *total_bytes, ReliSock *s)
 		}
 
 		elapsed = time(NULL)-start;
-		thisFileStats.TransferEndTime = condor_gettimestamp_double();
-		thisFileStats.ConnectionTimeSeconds = thisFileStats.TransferEndTime - thisFileStats.TransferStartTime;
+		double thisFileEndTime = condor_gettimestamp_double();
+		thisFileStats.TransferEndTime = thisFileEndTime;
+		// TransferStartTime and TransferEndTime are whole seconds, which
+		// is too coarse to tell the throughput of most files
+		thisFileStats.ConnectionTimeSeconds = thisFileEndTime - thisFileStartTime;
 
 		if( rc < 0 ) {
 			int the_error = errno;
@@ -3132,6 +3136,24 @@ FileTransfer::DoDownload( filesize_t *total_bytes, ReliSock *s)
 		dprintf(D_STATS, "%s", full_stats.c_str());
 	}
 
+		// Also record the sandbox as a whole; when it is many small
+		// files, the throughput of each one says little about the transfer.
+	if (numFiles > 1) {
+		FileTransferStats sandboxStats;
+		sandboxStats.TransferProtocol = "cedar";
+		sandboxStats.TransferType = "download";
+		sandboxStats.TransferStartTime = downloadStartTime;
+		sandboxStats.TransferEndTime = downloadEndTime;
+		sandboxStats.ConnectionTimeSeconds = downloadEndTime - downloadStartTime;
+		sandboxStats.TransferFileBytes = *total_bytes;
+		sandboxStats.TransferTotalBytes = *total_bytes;
+		sandboxStats.TransferFileCount = numFiles;
+		sandboxStats.TransferSuccess = true;
+
+		ClassAd sandboxStatsAd;
+		sandboxStats.Publish(sandboxStatsAd);
+		OutputFileTransferStats(sandboxStatsAd);
+	}
 
 	return_and_resetpriv( 0 );
 }
@@ -3727,6 +3749,7 @@ FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 	MyString error_desc;
 	bool I_go_ahead_always = false;
 	bool peer_goes_ahead_always = false;
+	bool coalescing_writes = false;
 	DCTransferQueue xfer_queue(m_xfer_queue_contact_info);
 
 		// Declaration to make the return_and_reset_priv macro happy.
@@ -4389,6 +4412,15 @@ FileTransfer::DoUpload(filesize_t *total_bytes, ReliSock *s)
 		// then this would provide a natural synchronization point.
 		bool can_defer_uploads = !PeerDoesGoAhead || (peer_goes_ahead_always && I_go_ahead_always);
 
+		// From here on, nothing is read from the peer until every file has
+		// been sent, so the rest of the sandbox can be streamed as one.
+		if( can_defer_uploads && !coalescing_writes &&
+			param_boolean("FILE_TRANSFER_COALESCE_WRITES", true) )
+		{
+			CoalesceUploadWrites(s, true);
+			coalescing_writes = true;
+		}
+
 		UpdateXferStatus(XFER_STATUS_ACTIVE);
 
 		filesize_t this_file_max_bytes = -1;
@@ -4747,6 +4779,29 @@ FileTransfer::setTransferQueueContactInfo(char const *contact) {
 	m_xfer_queue_contact_info = TransferQueueContactInfo(contact);
 }
 
+void
+FileTransfer::CoalesceUploadWrites(ReliSock *s, bool coalesce)
+{
+	// ReliSock turns off Nagle's algorithm, so every CEDAR message goes out
+	// in its own segment as soon as it is complete.  That is what we want
+	// for request/reply traffic, but once the peer has given its go-ahead
+	// for all files, each file is sent as several tiny messages (command,
+	// name, size, data, end of message) with no reply in between; for a
+	// sandbox of many small files this is most of the packets on the wire.
+	// Corking the socket lets the kernel send only full segments until we
+	// uncork it, which also flushes what remains.
+#if defined(TCP_CORK)
+	int val = coalesce ? 1 : 0;
+	if( !s->setsockopt(IPPROTO_TCP, TCP_CORK, &val, sizeof(val)) ) {
+		dprintf(D_FULLDEBUG, "DoUpload: failed to %s writes to %s\n",
+				coalesce ? "coalesce" : "flush", s->peer_description());
+	}
+#else
+	(void)s;
+	(void)coalesce;
+#endif
+}
+
 bool
 FileTransfer::ObtainAndSendTransferGoAhead(DCTransferQueue &xfer_queue,bool downloading,Stream *s,filesize_t sandbox_size,char const *full_fname,bool &go_ahead_always)
 {
@@ -5108,6 +5163,9 @@ FileTransfer::ExitDoUpload(const filesize_t *total_bytes, int numFiles, ReliSock
 		s->set_crypto_mode(socket_default_crypto);
 	}
 
+	// push out whatever is still held back before waiting on the peer
+	CoalesceUploadWrites(s, false);
+
 	// Now find out whether there was an error on the receiver's
 	// (i.e. downloader's) end, such as failure to write data to disk.
 	// If we have already failed to communicate with the receiver
@@ -5838,16 +5896,16 @@ FileTransfer::InvokeMultipleFileTransferPlugin( CondorError &e,
 
 int FileTransfer::OutputFileTransferStats( ClassAd &stats ) {
 
-	// this log is meant to be kept in the condor LOG directory, so switch to
-	// the correct priv state to manipulate files in that dir.
-	priv_state saved_priv = set_condor_priv();
-
 	// Read name of statistics file from params
 	std::string stats_file_path;
 	if (!param( stats_file_path, "FILE_TRANSFER_STATS_LOG" )) {
 		return 1;
 	}
 
+	// this log is meant to be kept in the condor LOG directory, so switch to
+	// the correct priv state to manipulate files in that dir.
+	priv_state saved_priv = set_condor_priv();
+
 	// First, check for an existing statistics file.
 	struct stat stats_file_buf;
 	int rc = stat( stats_file_path.c_str(), &stats_file_buf );
@@ -497,6 +497,10 @@ class FileTransfer final: public Service {
 	// Called internally by DoUpload() in order to handle common wrapup tasks.
 	int ExitDoUpload(const filesize_t *total_bytes, int numFiles, ReliSock *s, priv_state saved_priv, bool socket_default_crypto, bool upload_success, bool do_upload_ack, bool do_download_ack, bool try_again, int hold_code, int hold_subcode, char const *upload_error_desc,int DoUpload_exit_line);
 
+	// Called internally by DoUpload() to let the small messages sent for
+	// each file share TCP segments while nothing is expected back.
+	void CoalesceUploadWrites(ReliSock *s, bool coalesce);
+
 	// Send acknowledgment of success/failure after downloading files.
 	void SendTransferAck(Stream *s,bool success,bool try_again,int hold_code,int hold_subcode,char const *hold_reason);
 
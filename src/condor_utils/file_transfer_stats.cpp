@@ -35,6 +35,7 @@ void FileTransferStats::Init() {
 	TransferEndTime = 0;
 	TransferStartTime = 0;
 	TransferFileBytes = 0;
+	TransferFileCount = 0;
     LibcurlReturnCode = -1;
 }
 
@@ -76,6 +77,10 @@ void FileTransferStats::Publish(classad::ClassAd &ad) const {
         ad.InsertAttr("LibcurlReturnCode", LibcurlReturnCode);
     if (TransferTries > 0) 
         ad.InsertAttr("TransferTries", TransferTries);
+    if (TransferFileCount > 0)
+        ad.InsertAttr("TransferFileCount", TransferFileCount);
+    if (ConnectionTimeSeconds > 0 && TransferFileBytes > 0)
+        ad.InsertAttr("TransferBytesPerSecond", TransferFileBytes / ConnectionTimeSeconds);
     if (!TransferType.empty())
         ad.InsertAttr("TransferType", TransferType);
     if (!TransferUrl.empty())
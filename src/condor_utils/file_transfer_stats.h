@@ -39,6 +39,7 @@
 		time_t TransferStartTime;
 		
 		long TransferFileBytes;
+		long TransferFileCount;
 		long TransferHTTPStatusCode;
 		long TransferTotalBytes;
 		long TransferTries;
@@ -76,12 +76,40 @@ Selector::Selector()
 	save_write_fds = NULL;
 	save_except_fds = NULL;
 
+#ifdef SELECTOR_USE_EPOLL
+	m_epfd = -1;
+#endif
+
 	reset();
 }
 
 Selector::~Selector()
 {
 	free( read_fds );
+#ifdef SELECTOR_USE_EPOLL
+	if ( m_epfd >= 0 ) {
+		close( m_epfd );
+	}
+#endif
+}
+
+bool
+Selector::enable_epoll()
+{
+#ifdef SELECTOR_USE_EPOLL
+	if ( m_epfd < 0 ) {
+		m_epfd = epoll_create1( EPOLL_CLOEXEC );
+		if ( m_epfd < 0 ) {
+			dprintf( D_ALWAYS, "Selector: epoll_create1() failed, using select() instead: %s\n",
+					 strerror(errno) );
+			return false;
+		}
+		reset();
+	}
+	return true;
+#else
+	return false;
+#endif
 }
 
 void
@@ -146,6 +174,22 @@ Selector::reset()
 #endif
 	memset(&m_poll, '\0', sizeof(m_poll));
 
+#ifdef SELECTOR_USE_EPOLL
+		// Only the fds touched by the last cycle need to be cleared.
+		// Their kernel registrations are kept until execute() finds
+		// out which fds were not added again.
+	for ( size_t i = 0; i < m_epoll_ready.size(); i++ ) {
+		m_epoll_fds[m_epoll_ready[i]].ready = 0;
+	}
+	m_epoll_ready.clear();
+	for ( size_t i = 0; i < m_epoll_added.size(); i++ ) {
+		EpollFd &entry = m_epoll_fds[m_epoll_added[i]];
+		entry.added = false;
+		entry.wanted = 0;
+	}
+	m_epoll_added.clear();
+#endif
+
 	if (IsDebugLevel(D_DAEMONCORE)) {
 		dprintf(D_DAEMONCORE | D_VERBOSE, "selector %p resetting\n", this);
 	}
@@ -201,7 +245,7 @@ describe_fd(int fd) {
 }
 
 void
-Selector::add_fd( int fd, IO_FUNC interest )
+Selector::add_fd( int fd, IO_FUNC interest, unsigned int tag )
 {
 	// update max_fd (the highest valid index in fd_set's array) and also
         
@@ -228,6 +272,34 @@ Selector::add_fd( int fd, IO_FUNC interest )
 		free(fd_description);
 	}
 
+#ifdef SELECTOR_USE_EPOLL
+	if ( m_epfd >= 0 ) {
+		if ( (size_t)fd >= m_epoll_fds.size() ) {
+			m_epoll_fds.resize( fd + 1, EpollFd() );
+		}
+		EpollFd &entry = m_epoll_fds[fd];
+		if ( ! entry.added ) {
+			entry.added = true;
+			entry.tag = tag;
+			m_epoll_added.push_back( fd );
+		}
+		switch( interest ) {
+		case IO_READ:
+			entry.wanted |= EPOLLIN;
+			break;
+		case IO_WRITE:
+			entry.wanted |= EPOLLOUT;
+			break;
+		case IO_EXCEPT:
+			entry.wanted |= EPOLLPRI;
+			break;
+		}
+		return;
+	}
+#else
+	if (tag) {}
+#endif
+
 	if ((m_single_shot == SINGLE_SHOT_OK) && (m_poll.fd != fd)) {
 		init_fd_sets();
 		m_single_shot = SINGLE_SHOT_SKIP;
@@ -292,13 +364,33 @@ Selector::delete_fd( int fd, IO_FUNC interest )
 	}
 #endif
 
-	init_fd_sets();
-	m_single_shot = SINGLE_SHOT_SKIP;
-
 	if (IsDebugLevel(D_DAEMONCORE)) {
 		dprintf(D_DAEMONCORE | D_VERBOSE, "selector %p deleting fd %d\n", this, fd);
 	}
 
+#ifdef SELECTOR_USE_EPOLL
+	if ( m_epfd >= 0 ) {
+		if ( (size_t)fd < m_epoll_fds.size() ) {
+			EpollFd &entry = m_epoll_fds[fd];
+			switch( interest ) {
+			case IO_READ:
+				entry.wanted &= ~EPOLLIN;
+				break;
+			case IO_WRITE:
+				entry.wanted &= ~EPOLLOUT;
+				break;
+			case IO_EXCEPT:
+				entry.wanted &= ~EPOLLPRI;
+				break;
+			}
+		}
+		return;
+	}
+#endif
+
+	init_fd_sets();
+	m_single_shot = SINGLE_SHOT_SKIP;
+
 	switch( interest ) {
 
 	  case IO_READ:
@@ -316,6 +408,24 @@ Selector::delete_fd( int fd, IO_FUNC interest )
 	}
 }
 
+void
+Selector::unregister_fd( int fd )
+{
+#ifdef SELECTOR_USE_EPOLL
+	if ( m_epfd < 0 || fd < 0 || (size_t)fd >= m_epoll_fds.size() ) {
+		return;
+	}
+	EpollFd &entry = m_epoll_fds[fd];
+	if ( entry.in_kernel ) {
+		epoll_update( EPOLL_CTL_DEL, fd, 0 );
+		entry.in_kernel = false;
+		entry.registered = 0;
+	}
+#else
+	if (fd) {}
+#endif
+}
+
 void
 Selector::set_timeout( time_t sec, long usec )
 {
@@ -362,6 +472,19 @@ Selector::execute()
 		// select() ignores its first argument on Windows. We still track
 		// max_fd for the display() functions.
 	start_thread_safe("select");
+#ifdef SELECTOR_USE_EPOLL
+	if ( m_epfd >= 0 ) {
+		int timeout_ms = -1;
+		if ( tp ) {
+			if ( tp->tv_sec >= INT_MAX / 1000 ) {
+				timeout_ms = INT_MAX;
+			} else {
+				timeout_ms = 1000*tp->tv_sec + (tp->tv_usec + 999)/1000;
+			}
+		}
+		nfds = execute_epoll( timeout_ms );
+	} else
+#endif
 	if (m_single_shot == SINGLE_SHOT_VIRGIN) {
 		nfds = select( 0, NULL, NULL, NULL, tp );
 	}
@@ -397,6 +520,141 @@ Selector::execute()
 	return;
 }
 
+#ifdef SELECTOR_USE_EPOLL
+bool
+Selector::epoll_update( int op, int fd, unsigned int events )
+{
+	struct epoll_event ev;
+	memset( &ev, 0, sizeof(ev) );
+	ev.events = events;
+		// The tag goes along with the fd, so that an event from a
+		// registration that outlived its fd can be told apart.
+	ev.data.u64 = ((uint64_t)m_epoll_fds[fd].tag << 32) | (uint32_t)fd;
+
+	int rc = epoll_ctl( m_epfd, op, fd, &ev );
+	if ( rc < 0 ) {
+		if ( op == EPOLL_CTL_ADD && errno == EEXIST ) {
+			rc = epoll_ctl( m_epfd, EPOLL_CTL_MOD, fd, &ev );
+		} else if ( op == EPOLL_CTL_MOD && errno == ENOENT ) {
+			rc = epoll_ctl( m_epfd, EPOLL_CTL_ADD, fd, &ev );
+		} else if ( op == EPOLL_CTL_DEL && (errno == ENOENT || errno == EBADF) ) {
+				// Already gone from the set, most likely because
+				// the fd was closed.
+			rc = 0;
+		}
+	}
+	if ( rc < 0 ) {
+		int the_errno = errno;
+		dprintf( D_ALWAYS, "Selector: epoll_ctl(%d) on fd %d failed: %s\n",
+				 op, fd, strerror(the_errno) );
+		errno = the_errno;
+		return false;
+	}
+	return true;
+}
+
+int
+Selector::execute_epoll( int timeout_ms )
+{
+		// Drop the registrations of fds that were not added this cycle.
+	size_t kept = 0;
+	for ( size_t i = 0; i < m_epoll_registered.size(); i++ ) {
+		int fd = m_epoll_registered[i];
+		EpollFd &entry = m_epoll_fds[fd];
+		if ( entry.added && entry.wanted ) {
+			m_epoll_registered[kept++] = fd;
+			continue;
+		}
+		if ( entry.in_kernel ) {
+			if ( ! epoll_update( EPOLL_CTL_DEL, fd, 0 ) ) {
+				return -1;
+			}
+			entry.in_kernel = false;
+			entry.registered = 0;
+		}
+		entry.listed = false;
+	}
+	m_epoll_registered.resize( kept );
+
+		// Register new fds, and fds whose interest or owner changed.
+	for ( size_t i = 0; i < m_epoll_added.size(); i++ ) {
+		int fd = m_epoll_added[i];
+		EpollFd &entry = m_epoll_fds[fd];
+		if ( ! entry.wanted ) {
+			continue;
+		}
+		if ( entry.in_kernel && (entry.tag == 0 || entry.tag != entry.reg_tag) ) {
+			if ( ! epoll_update( EPOLL_CTL_DEL, fd, 0 ) ) {
+				return -1;
+			}
+			entry.in_kernel = false;
+		}
+		if ( ! entry.in_kernel ) {
+			if ( ! epoll_update( EPOLL_CTL_ADD, fd, entry.wanted ) ) {
+				return -1;
+			}
+			entry.in_kernel = true;
+			entry.reg_tag = entry.tag;
+			entry.registered = entry.wanted;
+		} else if ( entry.registered != entry.wanted ) {
+			if ( ! epoll_update( EPOLL_CTL_MOD, fd, entry.wanted ) ) {
+				return -1;
+			}
+			entry.registered = entry.wanted;
+		}
+		if ( ! entry.listed ) {
+			entry.listed = true;
+			m_epoll_registered.push_back( fd );
+		}
+	}
+
+	size_t max_events = m_epoll_registered.size() ? m_epoll_registered.size() : 1;
+	if ( m_epoll_events.size() < max_events ) {
+		m_epoll_events.resize( max_events );
+	}
+
+	int n = epoll_wait( m_epfd, &m_epoll_events[0], (int)max_events, timeout_ms );
+	if ( n <= 0 ) {
+		return n;
+	}
+
+		// Level-triggered, so anything not handled this cycle is
+		// reported again by the next epoll_wait().  The mapping of
+		// events onto read/write/except matches what select() does.
+	int nready = 0;
+	for ( int i = 0; i < n; i++ ) {
+		int fd = (int)(uint32_t)m_epoll_events[i].data.u64;
+		unsigned int tag = (unsigned int)(m_epoll_events[i].data.u64 >> 32);
+		unsigned int events = m_epoll_events[i].events;
+		if ( (size_t)fd >= m_epoll_fds.size() ) {
+			continue;
+		}
+		EpollFd &entry = m_epoll_fds[fd];
+		if ( ! entry.added || tag != entry.reg_tag ) {
+			continue;
+		}
+		unsigned int ready = 0;
+		if ( (entry.wanted & EPOLLIN) && (events & (EPOLLIN|EPOLLHUP|EPOLLERR)) ) {
+			ready |= EPOLLIN;
+		}
+		if ( (entry.wanted & EPOLLOUT) && (events & (EPOLLOUT|EPOLLERR)) ) {
+			ready |= EPOLLOUT;
+		}
+		if ( (entry.wanted & EPOLLPRI) && (events & EPOLLPRI) ) {
+			ready |= EPOLLPRI;
+		}
+		if ( ready ) {
+			if ( ! entry.ready ) {
+				m_epoll_ready.push_back( fd );
+			}
+			entry.ready |= ready;
+			nready++;
+		}
+	}
+	return nready;
+}
+#endif
+
 int
 Selector::select_retval() const
 {
@@ -426,6 +684,23 @@ Selector::fd_ready( int fd, IO_FUNC interest )
 	}
 #endif
 
+#ifdef SELECTOR_USE_EPOLL
+	if ( m_epfd >= 0 ) {
+		if ( (size_t)fd >= m_epoll_fds.size() ) {
+			return false;
+		}
+		switch( interest ) {
+		case IO_READ:
+			return m_epoll_fds[fd].ready & EPOLLIN;
+		case IO_WRITE:
+			return m_epoll_fds[fd].ready & EPOLLOUT;
+		case IO_EXCEPT:
+			return m_epoll_fds[fd].ready & EPOLLPRI;
+		}
+		return false;
+	}
+#endif
+
 	switch( interest ) {
 
 	  case IO_READ:
@@ -477,8 +752,6 @@ Selector::display()
 	//   poll() is used to query a single fd. Currently, it's only
 	//   called in DaemonCore::Driver(), where we should always be
 	//   in select() mode.
-	init_fd_sets();
-
 	switch( state ) {
 
 	  case VIRGIN:
@@ -502,19 +775,51 @@ Selector::display()
 		break;
 	}
 
-	dprintf( D_ALWAYS, "max_fd = %d\n", max_fd );
+#ifdef SELECTOR_USE_EPOLL
+	if ( m_epfd >= 0 ) {
+		dprintf( D_ALWAYS, "Using epoll, %d fds registered\n",
+				 (int)m_epoll_registered.size() );
+		dprintf( D_ALWAYS, "Selection FD's {" );
+		for ( size_t i = 0; i < m_epoll_added.size(); i++ ) {
+			int fd = m_epoll_added[i];
+			unsigned int wanted = m_epoll_fds[fd].wanted;
+			dprintf( D_ALWAYS | D_NOHEADER, "%d%s%s%s ", fd,
+					 (wanted & EPOLLIN) ? "r" : "",
+					 (wanted & EPOLLOUT) ? "w" : "",
+					 (wanted & EPOLLPRI) ? "e" : "" );
+		}
+		dprintf( D_ALWAYS | D_NOHEADER, "} = %d\n", (int)m_epoll_added.size() );
+		if( state == FDS_READY ) {
+			dprintf( D_ALWAYS, "Ready FD's {" );
+			for ( size_t i = 0; i < m_epoll_ready.size(); i++ ) {
+				int fd = m_epoll_ready[i];
+				unsigned int ready = m_epoll_fds[fd].ready;
+				dprintf( D_ALWAYS | D_NOHEADER, "%d%s%s%s ", fd,
+						 (ready & EPOLLIN) ? "r" : "",
+						 (ready & EPOLLOUT) ? "w" : "",
+						 (ready & EPOLLPRI) ? "e" : "" );
+			}
+			dprintf( D_ALWAYS | D_NOHEADER, "} = %d\n", (int)m_epoll_ready.size() );
+		}
+	} else
+#endif
+	{
+		init_fd_sets();
+
+		dprintf( D_ALWAYS, "max_fd = %d\n", max_fd );
 
-	dprintf( D_ALWAYS, "Selection FD's\n" );
-	bool try_dup = ( (FAILED == state) &&  (EBADF == _select_errno) );
-	display_fd_set( "\tRead", save_read_fds, max_fd, try_dup );
-	display_fd_set( "\tWrite", save_write_fds, max_fd, try_dup );
-	display_fd_set( "\tExcept", save_except_fds, max_fd, try_dup );
+		dprintf( D_ALWAYS, "Selection FD's\n" );
+		bool try_dup = ( (FAILED == state) &&  (EBADF == _select_errno) );
+		display_fd_set( "\tRead", save_read_fds, max_fd, try_dup );
+		display_fd_set( "\tWrite", save_write_fds, max_fd, try_dup );
+		display_fd_set( "\tExcept", save_except_fds, max_fd, try_dup );
 
-	if( state == FDS_READY ) {
-		dprintf( D_ALWAYS, "Ready FD's\n" );
-		display_fd_set( "\tRead", read_fds, max_fd );
-		display_fd_set( "\tWrite", write_fds, max_fd );
-		display_fd_set( "\tExcept", except_fds, max_fd );
+		if( state == FDS_READY ) {
+			dprintf( D_ALWAYS, "Ready FD's\n" );
+			display_fd_set( "\tRead", read_fds, max_fd );
+			display_fd_set( "\tWrite", write_fds, max_fd );
+			display_fd_set( "\tExcept", except_fds, max_fd );
+		}
 	}
 	if( timeout_wanted ) {
 		dprintf( D_ALWAYS,
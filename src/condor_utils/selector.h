@@ -27,6 +27,10 @@
 #define SELECTOR_USE_POLL 1
 #endif
 
+#ifdef LINUX
+#define SELECTOR_USE_EPOLL 1
+#endif
+
 #ifdef SELECTOR_USE_POLL
 #include <poll.h>
 #else
@@ -39,6 +43,11 @@ struct fake_pollfd {
 };
 #endif
 
+#ifdef SELECTOR_USE_EPOLL
+#include <sys/epoll.h>
+#include <vector>
+#endif
+
 class Selector {
 public:
 	Selector();
@@ -53,9 +62,19 @@ public:
 		VIRGIN, FDS_READY, TIMED_OUT, SIGNALLED, FAILED
 	};
 
+	// Use epoll() instead of select(), if available.  Fds stay registered
+	// with the kernel across calls to execute(); only the fds that were
+	// added, dropped or changed since the last call cost a system call.
+	bool enable_epoll();
+
 	void reset();
-	void add_fd( int fd, IO_FUNC interest );
+	// With epoll(), the tag tells a new fd from an old one that had the
+	// same number.  Tag 0 means re-register the fd on every execute().
+	void add_fd( int fd, IO_FUNC interest, unsigned int tag = 0 );
 	void delete_fd( int fd, IO_FUNC interest );
+	// Call before closing a registered fd that may have been duplicated;
+	// epoll() only forgets it when the last copy is closed.
+	void unregister_fd( int fd );
 	void set_timeout( time_t sec, long usec = 0 );
 	void set_timeout( timeval tv );
 	void unset_timeout();
@@ -72,6 +91,10 @@ public:
 private:
 
 	void init_fd_sets();
+#ifdef SELECTOR_USE_EPOLL
+	int execute_epoll( int timeout_ms );
+	bool epoll_update( int op, int fd, unsigned int events );
+#endif
 
 	enum SINGLE_SHOT {
 		SINGLE_SHOT_VIRGIN, SINGLE_SHOT_OK, SINGLE_SHOT_SKIP
@@ -95,6 +118,25 @@ private:
 #else
 	struct fake_pollfd m_poll;
 #endif
+
+#ifdef SELECTOR_USE_EPOLL
+	struct EpollFd {
+		unsigned int	tag;		// tag passed to add_fd() this cycle
+		unsigned int	reg_tag;	// tag the kernel registration was made for
+		unsigned int	wanted;		// EPOLL* bits added this cycle
+		unsigned int	registered;	// EPOLL* bits registered with the kernel
+		unsigned int	ready;		// EPOLL* bits found by the last execute()
+		bool			added;		// add_fd() was called this cycle
+		bool			in_kernel;	// fd is in the epoll set
+		bool			listed;		// fd is in m_epoll_registered
+	};
+	int		m_epfd;
+	std::vector<EpollFd>	m_epoll_fds;		// indexed by fd
+	std::vector<int>		m_epoll_added;		// fds added this cycle
+	std::vector<int>		m_epoll_registered;	// fds registered on the last execute()
+	std::vector<int>		m_epoll_ready;		// fds with ready bits set
+	std::vector<struct epoll_event>	m_epoll_events;
+#endif
 };
 
 void display_fd_set( const char *msg, fd_set *set, int max,
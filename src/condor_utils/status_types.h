@@ -41,6 +41,7 @@ enum ppOption {
     PP_GRID_NORMAL,
     PP_STORAGE_NORMAL,
     PP_NEGOTIATOR_NORMAL,
+    PP_NEGOTIATOR_TIMING,
     PP_DEFRAG_NORMAL,
     PP_ACCOUNTING_NORMAL,
 
@@ -75,6 +76,7 @@ enum {
 	SDO_License,		//  MODE_LICENSE_NORMAL,
 	SDO_Storage,		//  MODE_STORAGE_NORMAL,
 	SDO_Negotiator,		//  MODE_NEGOTIATOR_NORMAL,
+	SDO_Negotiator_Timing,	//  MODE_NEGOTIATOR_TIMING,
 	SDO_Defrag,			//  MODE_DEFRAG_NORMAL,
 	SDO_Accounting,		//  
 	SDO_Generic,		//  MODE_GENERIC_NORMAL,
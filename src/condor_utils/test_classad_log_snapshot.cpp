@@ -0,0 +1,373 @@
+/***************************************************************
+ *
+ * Copyright (C) 2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+// Checks the binary snapshot of a ClassAd log (CLASSAD_LOG_BINARY_SNAPSHOT).
+// A log with records appended after its snapshot must load to the same ads
+// with the snapshot as without it.  A damaged snapshot, or one written for
+// an earlier version of the log, must be ignored without putting any of its
+// ads into the table.
+//
+//   test_classad_log_snapshot [-v]
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "condor_config.h"
+#include "condor_attributes.h"
+#include "condor_adtypes.h"
+#include "subsystem_info.h"
+#include "stl_string_utils.h"
+#include "compat_classad_util.h"
+#include "classad_log.h"
+
+#include <map>
+#include <string>
+
+bool verbose = false;
+#define REQUIRE( condition ) \
+	if(! ( condition )) { \
+		fprintf( stderr, "Failed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+		return 1; \
+	} else if( verbose ) { \
+		fprintf( stdout, "Passed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+	}
+
+// enough ads of this size for the snapshot to need more than one chunk
+static const int NUM_ADS = 1500;
+static const size_t DESCRIPTION_SIZE = 1000;
+
+// layout of the snapshot file, see classad_log.cpp
+static const size_t SNAPSHOT_HEADER_SIZE = 64;
+static const size_t SNAPSHOT_CHUNK_PREFIX_SIZE = 16;
+
+// A table that counts what the log loader does to it.
+class TestTable : public LoggableClassAdTable {
+public:
+	TestTable() : lookups(0), inserts(0), removes(0) {}
+	virtual ~TestTable() { clear(); }
+
+	virtual bool lookup( const char * key, ClassAd *& ad ) {
+		++lookups;
+		std::map<std::string, ClassAd*>::iterator it = ads.find( key );
+		if ( it == ads.end() ) { return false; }
+		ad = it->second;
+		return true;
+	}
+	virtual bool remove( const char * key ) {
+		++removes;
+		return ads.erase( key ) > 0;
+	}
+	virtual bool insert( const char * key, ClassAd * ad ) {
+		++inserts;
+		return ads.insert( std::make_pair( std::string(key), ad ) ).second;
+	}
+	virtual void startIterations() { it = ads.begin(); }
+	virtual bool nextIteration( const char *& key, ClassAd *& ad ) {
+		if ( it == ads.end() ) { return false; }
+		key = it->first.c_str();
+		ad = it->second;
+		++it;
+		return true;
+	}
+
+	void clear() {
+		for ( it = ads.begin(); it != ads.end(); ++it ) {
+			delete it->second;
+		}
+		ads.clear();
+		lookups = inserts = removes = 0;
+	}
+
+	std::map<std::string, ClassAd*> ads;
+	int lookups;
+	int inserts;
+	int removes;
+
+private:
+	std::map<std::string, ClassAd*>::iterator it;
+};
+
+static bool readFile( const std::string & filename, std::string & data )
+{
+	data.clear();
+	FILE * fp = safe_fopen_wrapper_follow( filename.c_str(), "rb" );
+	if ( ! fp ) { return false; }
+	char buf[4096];
+	size_t cb;
+	while ( (cb = fread( buf, 1, sizeof(buf), fp )) > 0 ) {
+		data.append( buf, cb );
+	}
+	fclose( fp );
+	return true;
+}
+
+static bool writeFile( const std::string & filename, const std::string & data )
+{
+	FILE * fp = safe_fopen_wrapper_follow( filename.c_str(), "wb" );
+	if ( ! fp ) { return false; }
+	bool ok = fwrite( data.data(), 1, data.size(), fp ) == data.size();
+	return (fclose( fp ) == 0) && ok;
+}
+
+static uint32_t get32( const std::string & data, size_t offset )
+{
+	uint32_t val = 0;
+	memcpy( &val, data.data() + offset, sizeof(val) );
+	return val;
+}
+
+// Load the log into the table the way ClassAdLog does at startup.
+static bool load( const std::string & filename, bool use_snapshot, TestTable & table,
+	std::string & errors, unsigned long & sequence_number )
+{
+	config_insert( "CLASSAD_LOG_BINARY_SNAPSHOT", use_snapshot ? "true" : "false" );
+
+	table.clear();
+	time_t birthdate = 0;
+	bool is_clean = true;
+	bool requires_cleaning = false;
+	MyString errmsg;
+	FILE * fp = LoadClassAdLog( filename.c_str(), table, DefaultMakeClassAdLogTableEntry,
+		sequence_number, birthdate, is_clean, requires_cleaning, errmsg );
+	errors = errmsg.c_str();
+	if ( verbose && ! errors.empty() ) {
+		printf( "%s", errors.c_str() );
+	}
+	if ( ! fp ) {
+		return false;
+	}
+	fclose( fp );
+	return is_clean && ! requires_cleaning;
+}
+
+static bool sameAds( TestTable & a, TestTable & b )
+{
+	if ( a.ads.size() != b.ads.size() ) {
+		return false;
+	}
+	std::map<std::string, ClassAd*>::iterator it;
+	for ( it = a.ads.begin(); it != a.ads.end(); ++it ) {
+		std::map<std::string, ClassAd*>::iterator jt = b.ads.find( it->first );
+		if ( jt == b.ads.end() || it->second->size() != jt->second->size() ) {
+			if ( verbose ) { printf( "ad %s differs\n", it->first.c_str() ); }
+			return false;
+		}
+		for ( ClassAd::iterator attr = it->second->begin(); attr != it->second->end(); ++attr ) {
+			ExprTree * other = jt->second->Lookup( attr->first );
+			std::string lhs, rhs;
+			if ( other ) {
+				ExprTreeToString( attr->second, lhs );
+				ExprTreeToString( other, rhs );
+			}
+			if ( ! other || lhs != rhs ) {
+				if ( verbose ) { printf( "ad %s differs in %s\n", it->first.c_str(), attr->first.c_str() ); }
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+class SnapshotTest {
+public:
+	SnapshotTest( const std::string & dir )
+		: log_filename( dir + "/test_classad_log_snapshot.log" )
+		, snapshot_filename( log_filename + ".snapshot" )
+		, text_sequence_number( 0 )
+	{
+		unlink( log_filename.c_str() );
+		unlink( snapshot_filename.c_str() );
+	}
+
+	~SnapshotTest()
+	{
+		unlink( log_filename.c_str() );
+		unlink( snapshot_filename.c_str() );
+	}
+
+		// Write a log with a snapshot, then records after the snapshot
+		// that add, change, delete and destroy.
+	int writeLog()
+	{
+		config_insert( "CLASSAD_LOG_BINARY_SNAPSHOT", "true" );
+
+		ClassAdLog<std::string, ClassAd*> log( log_filename.c_str() );
+		std::string description( DESCRIPTION_SIZE, 'x' );
+		log.BeginTransaction();
+		for ( int i = 0; i < NUM_ADS; i++ ) {
+			std::string key, value;
+			formatstr( key, "1.%d", i );
+			log.AppendLog( new LogNewClassAd( key.c_str(), JOB_ADTYPE, "Machine" ) );
+			formatstr( value, "%d", i );
+			log.AppendLog( new LogSetAttribute( key.c_str(), ATTR_PROC_ID, value.c_str() ) );
+			log.AppendLog( new LogSetAttribute( key.c_str(), ATTR_OWNER, "\"alice\"" ) );
+			log.AppendLog( new LogSetAttribute( key.c_str(), ATTR_REQUIREMENTS, "TARGET.Memory >= RequestMemory && TARGET.Arch == \"X86_64\"" ) );
+			log.AppendLog( new LogSetAttribute( key.c_str(), "Environment", "{ \"A=1\", \"B=2\" }" ) );
+			formatstr( value, "\"%s %d\"", description.c_str(), i );
+			log.AppendLog( new LogSetAttribute( key.c_str(), "Description", value.c_str() ) );
+		}
+		log.CommitTransaction();
+		REQUIRE( log.TruncLog() );
+		REQUIRE( readFile( snapshot_filename, snapshot ) );
+
+		log.BeginTransaction();
+		log.AppendLog( new LogNewClassAd( "2.0", JOB_ADTYPE, "Machine" ) );
+		log.AppendLog( new LogSetAttribute( "2.0", ATTR_OWNER, "\"bob\"" ) );
+		log.AppendLog( new LogSetAttribute( "1.1", ATTR_OWNER, "\"carol\"" ) );
+		log.AppendLog( new LogDeleteAttribute( "1.2", "Environment" ) );
+		log.AppendLog( new LogDestroyClassAd( "1.3" ) );
+		log.CommitTransaction();
+		return 0;
+	}
+
+	int checkRoundTrip()
+	{
+		REQUIRE( load( log_filename, false, text, errors, text_sequence_number ) );
+		REQUIRE( errors.empty() );
+		REQUIRE( text.ads.size() == (size_t)NUM_ADS );
+		REQUIRE( text.ads.count( "2.0" ) == 1 );
+		REQUIRE( text.ads.count( "1.3" ) == 0 );
+
+		TestTable snap;
+		unsigned long sequence_number = 0;
+		REQUIRE( load( log_filename, true, snap, errors, sequence_number ) );
+		REQUIRE( errors.empty() );
+		REQUIRE( sequence_number == text_sequence_number );
+		REQUIRE( sameAds( text, snap ) );
+
+			// the ads came from the snapshot, not one record at a time
+		REQUIRE( snap.lookups < text.lookups );
+
+		std::string owner;
+		REQUIRE( snap.ads["1.1"]->LookupString( ATTR_OWNER, owner ) && owner == "carol" );
+		REQUIRE( snap.ads["1.2"]->Lookup( "Environment" ) == NULL );
+		return 0;
+	}
+
+		// Load with the snapshot replaced by the given data, which it must ignore.
+	int checkIgnored( const std::string & data, bool reported )
+	{
+		REQUIRE( writeFile( snapshot_filename, data ) );
+
+		TestTable snap;
+		unsigned long sequence_number = 0;
+		REQUIRE( load( log_filename, true, snap, errors, sequence_number ) );
+		REQUIRE( errors.empty() != reported );
+		REQUIRE( sequence_number == text_sequence_number );
+		REQUIRE( sameAds( text, snap ) );
+
+			// nothing from the snapshot went into the table and came out again
+		REQUIRE( snap.removes == text.removes );
+		REQUIRE( snap.inserts == text.inserts );
+		return 0;
+	}
+
+	int checkDamaged()
+	{
+			// find the second chunk, the first must be good
+		REQUIRE( snapshot.size() > SNAPSHOT_HEADER_SIZE + SNAPSHOT_CHUNK_PREFIX_SIZE );
+		size_t second = SNAPSHOT_HEADER_SIZE + SNAPSHOT_CHUNK_PREFIX_SIZE + get32( snapshot, SNAPSHOT_HEADER_SIZE );
+		REQUIRE( snapshot.size() > second + SNAPSHOT_CHUNK_PREFIX_SIZE );
+		uint32_t second_len = get32( snapshot, second );
+		REQUIRE( get32( snapshot, second + 4 ) > 0 );
+		REQUIRE( snapshot.size() >= second + SNAPSHOT_CHUNK_PREFIX_SIZE + second_len );
+
+		std::string corrupt( snapshot );
+		corrupt[second + SNAPSHOT_CHUNK_PREFIX_SIZE + second_len / 2] ^= 0x20;
+		REQUIRE( checkIgnored( corrupt, true ) == 0 );
+
+		std::string truncated( snapshot, 0, second + SNAPSHOT_CHUNK_PREFIX_SIZE + second_len / 2 );
+		REQUIRE( checkIgnored( truncated, true ) == 0 );
+
+		REQUIRE( checkIgnored( std::string( snapshot, 0, SNAPSHOT_HEADER_SIZE / 2 ), true ) == 0 );
+
+		REQUIRE( writeFile( snapshot_filename, snapshot ) );
+		return 0;
+	}
+
+		// A snapshot that was good, left behind by a later rotation of the log.
+	int checkMismatched()
+	{
+		config_insert( "CLASSAD_LOG_BINARY_SNAPSHOT", "true" );
+		{
+			ClassAdLog<std::string, ClassAd*> log( log_filename.c_str() );
+			log.BeginTransaction();
+			log.AppendLog( new LogSetAttribute( "1.4", ATTR_OWNER, "\"dave\"" ) );
+			log.CommitTransaction();
+			REQUIRE( log.TruncLog() );
+		}
+		std::string newer;
+		REQUIRE( readFile( snapshot_filename, newer ) );
+		REQUIRE( newer != snapshot );
+
+		REQUIRE( load( log_filename, false, text, errors, text_sequence_number ) );
+		REQUIRE( checkIgnored( snapshot, false ) == 0 );
+
+		std::string owner;
+		REQUIRE( text.ads["1.4"]->LookupString( ATTR_OWNER, owner ) && owner == "dave" );
+		return 0;
+	}
+
+private:
+	std::string log_filename;
+	std::string snapshot_filename;
+	std::string snapshot;		// as written by the first rotation
+	std::string errors;
+	TestTable text;				// the log loaded without its snapshot
+	unsigned long text_sequence_number;
+};
+
+int
+main( int argc, char ** argv )
+{
+	for ( int i = 1; i < argc; i++ ) {
+		if ( strcmp( argv[i], "-v" ) == 0 ) {
+			verbose = true;
+		} else {
+			fprintf( stderr, "Usage: %s [-v]\n", argv[0] );
+			return 1;
+		}
+	}
+
+	set_mySubSystem( "TEST_CLASSAD_LOG_SNAPSHOT", SUBSYSTEM_TYPE_TOOL );
+	config();
+	dprintf_set_tool_debug( "TEST_CLASSAD_LOG_SNAPSHOT", 0 );
+
+	char dir[] = "/tmp/test_classad_log_snapshot.XXXXXX";
+	if ( ! mkdtemp( dir ) ) {
+		fprintf( stderr, "Failed to create a directory: %s\n", strerror(errno) );
+		return 1;
+	}
+
+	int rval = 0;
+	{
+		SnapshotTest test( dir );
+		if ( test.writeLog() != 0 ||
+			 test.checkRoundTrip() != 0 ||
+			 test.checkDamaged() != 0 ||
+			 test.checkMismatched() != 0 ) {
+			rval = 1;
+		}
+	}
+	rmdir( dir );
+
+	if ( rval == 0 ) {
+		fprintf( stdout, "No failures detected.\n" );
+	}
+	return rval;
+}
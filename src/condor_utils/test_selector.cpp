@@ -0,0 +1,260 @@
+/***************************************************************
+ *
+ * Copyright (C) 2021, Condor Team, Computer Sciences Department,
+ * University of Wisconsin-Madison, WI.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You may
+ * obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ***************************************************************/
+
+// Checks that the select() and epoll() modes of the Selector agree, then
+// measures the cost of one DaemonCore-style loop over many idle sockets:
+// reset, add every fd, wait, and look up every fd, with one socket ready.
+//
+//   test_selector [-fds <n>] [-loops <n>] [-v]
+
+#include "condor_common.h"
+#include "condor_debug.h"
+#include "selector.h"
+
+#include <stdio.h>
+#include <vector>
+#include <sys/resource.h>
+
+bool verbose = false;
+#define REQUIRE( condition ) \
+	if(! ( condition )) { \
+		fprintf( stderr, "Failed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+		return 1; \
+	} else if( verbose ) { \
+		fprintf( stdout, "Passed requirement '%s' on line %d.\n", #condition, __LINE__ ); \
+	}
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Reads back the byte written to make a socket ready.
+static void drain( int fd )
+{
+	char c;
+	while ( read( fd, &c, 1 ) == 1 ) {}
+}
+
+static int check_mode( bool use_epoll )
+{
+	int sv[2], sv2[2];
+	REQUIRE( socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) == 0 );
+	REQUIRE( socketpair( AF_UNIX, SOCK_STREAM, 0, sv2 ) == 0 );
+	fcntl( sv[0], F_SETFL, O_NONBLOCK );
+
+	Selector selector;
+	if ( use_epoll ) {
+		REQUIRE( selector.enable_epoll() );
+	}
+
+		// nothing to read
+	selector.add_fd( sv[0], Selector::IO_READ, 1 );
+	selector.add_fd( sv2[0], Selector::IO_READ, 2 );
+	selector.set_timeout( 0 );
+	selector.execute();
+	REQUIRE( selector.timed_out() );
+	REQUIRE( ! selector.fd_ready( sv[0], Selector::IO_READ ) );
+
+		// something to read on one of them
+	REQUIRE( write( sv[1], "x", 1 ) == 1 );
+	selector.reset();
+	selector.add_fd( sv[0], Selector::IO_READ, 1 );
+	selector.add_fd( sv2[0], Selector::IO_READ, 2 );
+	selector.set_timeout( 0 );
+	selector.execute();
+	REQUIRE( selector.has_ready() );
+	REQUIRE( selector.fd_ready( sv[0], Selector::IO_READ ) );
+	REQUIRE( ! selector.fd_ready( sv2[0], Selector::IO_READ ) );
+
+		// still ready if not drained, but not when it is not asked for
+	selector.reset();
+	selector.add_fd( sv[0], Selector::IO_WRITE, 1 );
+	selector.add_fd( sv2[0], Selector::IO_READ, 2 );
+	selector.set_timeout( 0 );
+	selector.execute();
+	REQUIRE( ! selector.fd_ready( sv[0], Selector::IO_READ ) );
+	REQUIRE( selector.fd_ready( sv[0], Selector::IO_WRITE ) );
+	drain( sv[0] );
+
+		// fd closed and its number reused for another socket
+	int old_fd = sv2[0];
+	selector.unregister_fd( sv2[0] );
+	close( sv2[0] );
+	close( sv2[1] );
+	REQUIRE( socketpair( AF_UNIX, SOCK_STREAM, 0, sv2 ) == 0 );
+	REQUIRE( sv2[0] == old_fd || sv2[1] == old_fd );
+	int reused = old_fd;
+	int other = ( sv2[0] == old_fd ) ? sv2[1] : sv2[0];
+	REQUIRE( write( other, "y", 1 ) == 1 );
+	selector.reset();
+	selector.add_fd( sv[0], Selector::IO_READ, 1 );
+	selector.add_fd( reused, Selector::IO_READ, 3 );
+	selector.set_timeout( 0 );
+	selector.execute();
+	REQUIRE( selector.fd_ready( reused, Selector::IO_READ ) );
+	REQUIRE( ! selector.fd_ready( sv[0], Selector::IO_READ ) );
+
+		// fd replaced under an untagged registration without being
+		// unregistered, as a failed non-blocking connect does
+	fcntl( reused, F_SETFL, O_NONBLOCK );
+	drain( reused );
+	selector.reset();
+	selector.add_fd( reused, Selector::IO_READ, 0 );
+	selector.set_timeout( 0 );
+	selector.execute();
+	REQUIRE( ! selector.fd_ready( reused, Selector::IO_READ ) );
+	close( sv2[0] );
+	close( sv2[1] );
+	REQUIRE( socketpair( AF_UNIX, SOCK_STREAM, 0, sv2 ) == 0 );
+	REQUIRE( sv2[0] == reused || sv2[1] == reused );
+	other = ( sv2[0] == reused ) ? sv2[1] : sv2[0];
+	REQUIRE( write( other, "z", 1 ) == 1 );
+	selector.reset();
+	selector.add_fd( reused, Selector::IO_READ, 0 );
+	selector.set_timeout( 0 );
+	selector.execute();
+	REQUIRE( selector.fd_ready( reused, Selector::IO_READ ) );
+
+		// peer went away
+	close( sv[1] );
+	selector.reset();
+	selector.add_fd( sv[0], Selector::IO_READ, 1 );
+	selector.set_timeout( 0 );
+	selector.execute();
+	REQUIRE( selector.fd_ready( sv[0], Selector::IO_READ ) );
+
+	close( sv[0] );
+	close( sv2[0] );
+	close( sv2[1] );
+	return 0;
+}
+
+static int bench_mode( bool use_epoll, const std::vector<int> & fds, int loops )
+{
+	Selector selector;
+	if ( use_epoll && ! selector.enable_epoll() ) {
+		printf( "epoll is not available\n" );
+		return 0;
+	}
+
+	int nfds = (int)fds.size() / 2;
+	int found = 0;
+	double start = 0.0;
+	for ( int loop = -1; loop < loops; loop++ ) {
+		if ( loop == 0 ) {
+				// the first pass registers everything
+			start = now();
+		}
+		int active = fds[2 * ((loop + 1) % nfds) + 1];
+		if ( write( active, "x", 1 ) != 1 ) {
+			fprintf( stderr, "write failed: %s\n", strerror(errno) );
+			return 1;
+		}
+
+		selector.reset();
+		for ( int i = 0; i < nfds; i++ ) {
+			selector.add_fd( fds[2 * i], Selector::IO_READ, i + 1 );
+		}
+		selector.set_timeout( 0 );
+		selector.execute();
+		REQUIRE( selector.has_ready() );
+		for ( int i = 0; i < nfds; i++ ) {
+			if ( selector.fd_ready( fds[2 * i], Selector::IO_READ ) ) {
+				drain( fds[2 * i] );
+				found++;
+			}
+		}
+	}
+	double elapsed = now() - start;
+	REQUIRE( found == loops + 1 );
+
+	printf( "%-6s %d fds: %.1f usec per loop\n", use_epoll ? "epoll" : "select",
+			nfds, elapsed * 1000000.0 / loops );
+	return 0;
+}
+
+int main( int argc, char ** argv ) {
+	int nfds = 10000;
+	int loops = 1000;
+	for ( int i = 1; i < argc; i++ ) {
+		if ( strcmp( argv[i], "-fds" ) == 0 && i + 1 < argc ) {
+			nfds = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "-loops" ) == 0 && i + 1 < argc ) {
+			loops = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "-v" ) == 0 ) {
+			verbose = true;
+		} else {
+			fprintf( stderr, "Usage: %s [-fds <n>] [-loops <n>] [-v]\n", argv[0] );
+			return 1;
+		}
+	}
+	if ( nfds < 1 || loops < 1 ) {
+		fprintf( stderr, "-fds and -loops must be positive\n" );
+		return 1;
+	}
+
+		// This must happen before the first Selector is made, as it
+		// sizes its fd_sets from the limit.
+	struct rlimit rl;
+	getrlimit( RLIMIT_NOFILE, &rl );
+	rlim_t wanted = 2 * nfds + 64;
+	if ( rl.rlim_cur < wanted ) {
+		rl.rlim_cur = ( rl.rlim_max == RLIM_INFINITY || rl.rlim_max > wanted ) ? wanted : rl.rlim_max;
+		setrlimit( RLIMIT_NOFILE, &rl );
+	}
+
+	if ( check_mode( false ) != 0 ) {
+		return 1;
+	}
+#ifdef SELECTOR_USE_EPOLL
+	if ( check_mode( true ) != 0 ) {
+		return 1;
+	}
+#endif
+
+	std::vector<int> fds;
+	for ( int i = 0; i < nfds; i++ ) {
+		int sv[2];
+		if ( socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) != 0 ) {
+			fprintf( stderr, "Only made %d socket pairs: %s\n", i, strerror(errno) );
+			break;
+		}
+		fcntl( sv[0], F_SETFL, O_NONBLOCK );
+		fds.push_back( sv[0] );
+		fds.push_back( sv[1] );
+	}
+	REQUIRE( ! fds.empty() );
+
+	if ( bench_mode( false, fds, loops ) != 0 ) {
+		return 1;
+	}
+#ifdef SELECTOR_USE_EPOLL
+	if ( bench_mode( true, fds, loops ) != 0 ) {
+		return 1;
+	}
+#endif
+
+	for ( size_t i = 0; i < fds.size(); i++ ) {
+		close( fds[i] );
+	}
+	return 0;
+}